@@ -85,8 +85,10 @@ bool CK4_IsPresent()
 	if (!FS_IsOmniFilePresent("AUDINFOE.CK4"))
 		return false;
 
+#ifndef CK_VARS_LINKED
 	if (!FS_IsOmniFilePresent("ACTION.CK4"))
 		return false;
+#endif
 
 	// We clearly have all of the required files.
 	return true;
@@ -72,8 +72,10 @@ bool CK5_IsPresent()
 	if (!FS_IsOmniFilePresent("AUDINFOE.CK5"))
 		return false;
 
+#ifndef CK_VARS_LINKED
 	if (!FS_IsOmniFilePresent("ACTION.CK5"))
 		return false;
+#endif
 
 	// We clearly have all of the required files.
 	return true;
@@ -78,8 +78,10 @@ bool CK6_IsPresent()
 	if (!FS_IsOmniFilePresent("AUDINFOE.CK6"))
 		return false;
 
+#ifndef CK_VARS_LINKED
 	if (!FS_IsOmniFilePresent("ACTION.CK6"))
 		return false;
+#endif
 
 	// We clearly have all of the required files.
 	return true;
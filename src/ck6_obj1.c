@@ -612,7 +612,6 @@ void CK6_BloogCol(CK_object *a, CK_object *b)
 	}
 }
 
-int ck6_smashScreenDistance;
 int16_t ck6_smashScreenOfs[] =
 	{
 		0, -64, -64, -64, 64, 64, 64, -200, -200, -200, 200, 200, 200,
@@ -746,13 +745,6 @@ void CK6_SpawnBlooglet(int tileX, int tileY, int type)
 	}
 }
 
-static const char *stunnedBloogletActions[] = {
-	"CK6_ACT_BloogletRStunned0",
-	"CK6_ACT_BloogletYStunned0",
-	"CK6_ACT_BloogletBStunned0",
-	"CK6_ACT_BloogletGStunned0",
-};
-
 extern chunk_id_t CK_ItemSpriteChunks[];
 void CK6_BloogletCol(CK_object *a, CK_object *b)
 {
@@ -782,7 +774,13 @@ void CK6_BloogletCol(CK_object *a, CK_object *b)
 			SD_PlaySound(CK_SOUNDNUM(SOUND_BLOOGLETGEM));
 		}
 
-		CK_StunCreature(a, b, CK_GetActionByName(stunnedBloogletActions[color]));
+		CK_action *stunnedBloogletActions[] = {
+			CK_ACTION(CK6_ACT_BloogletRStunned0),
+			CK_ACTION(CK6_ACT_BloogletYStunned0),
+			CK_ACTION(CK6_ACT_BloogletBStunned0),
+			CK_ACTION(CK6_ACT_BloogletGStunned0),
+		};
+		CK_StunCreature(a, b, stunnedBloogletActions[color]);
 	}
 }
 
@@ -17,6 +17,8 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
+#include "id_ca.h"
+#include "id_fs.h"
 #include "id_str.h"
 #include "id_us.h"
 
@@ -90,12 +92,24 @@ CK_ACT_ColFunction CK_ACT_GetColFunction(const char *fnName)
 #define CK_VAR_MAXVARS 2048
 #define CK_VAR_MAXACTIONS 512
 #define CK_VAR_MAX_ARRAY_LEN 96
+// Tools like varparser keep the names of functions as well.
+#ifdef CK_VAR_FUNCTIONS_AS_STRINGS
+#define CK_VAR_ARENA_SIZE 262144
+#else
+#define CK_VAR_ARENA_SIZE 65536
+#endif
 
 STR_Table *ck_varTable;
 ID_MM_Arena *ck_varArena;
 CK_action *ck_actionData;
 int ck_actionsUsed;
 
+// Bumped whenever a variable is set, so that every CK_VAR_Handle is looked
+// up again. Handles start out at generation 0, so this never is.
+uint32_t ck_varGeneration = 1;
+static unsigned long ck_varLookups;
+static FILE *ck_varTraceFile;
+
 typedef enum CK_VAR_VarType
 {
 	VAR_Invalid,
@@ -118,24 +132,80 @@ typedef struct CK_VAR_Variable
 } CK_VAR_Variable;
 #endif
 
+// Every variable set, in order, so that they can be written to the cache.
+typedef struct CK_VAR_Record
+{
+	const char *name;
+	CK_VAR_VarType type;
+	void *value;
+	size_t length;
+} CK_VAR_Record;
+
+static CK_VAR_Record *ck_varRecords;
+static int ck_varRecordsUsed;
+static int ck_varRecordsSize;
+
 void CK_VAR_Startup()
 {
 	STR_AllocTable(&ck_varTable, CK_VAR_MAXVARS);
-	ck_varArena = MM_ArenaCreate(65536);
+	ck_varArena = MM_ArenaCreate(CK_VAR_ARENA_SIZE);
 	MM_GetPtr((mm_ptr_t *)&ck_actionData, sizeof(CK_action) * CK_VAR_MAXACTIONS);
 	ck_actionsUsed = 0;
+	ck_varRecordsUsed = 0;
 }
 
 void CK_VAR_SetEntry(const char *name, void *val)
 {
 	STR_AddEntry(ck_varTable, name, val);
+	if (++ck_varGeneration == 0)
+		ck_varGeneration = 1;
+}
+
+// Adds a variable (with the name already in the arena).
+static void CK_VAR_AddVar(const char *name, CK_VAR_VarType type, void *value, size_t length)
+{
+#ifdef CK_VAR_TYPECHECK
+	CK_VAR_Variable *var = (CK_VAR_Variable *)MM_ArenaAlloc(ck_varArena, sizeof(*var));
+	var->type = type;
+	var->value = value;
+	var->length = length;
+	CK_VAR_SetEntry(name, (void *)var);
+#else
+	CK_VAR_SetEntry(name, value);
+#endif
+	if (ck_varRecordsUsed == ck_varRecordsSize)
+	{
+		ck_varRecordsSize = ck_varRecordsSize ? ck_varRecordsSize * 2 : CK_VAR_MAXVARS;
+		ck_varRecords = (CK_VAR_Record *)realloc(ck_varRecords, sizeof(CK_VAR_Record) * ck_varRecordsSize);
+		if (!ck_varRecords)
+			Quit("CK_VAR_AddVar: Out of memory!");
+	}
+	CK_VAR_Record *record = &ck_varRecords[ck_varRecordsUsed++];
+	record->name = name;
+	record->type = type;
+	record->value = value;
+	record->length = length;
 }
 
 void *CK_VAR_GetByName(const char *name, void *def)
 {
+	ck_varLookups++;
+	if (ck_varTraceFile)
+		fprintf(ck_varTraceFile, "%s\n", name);
 	return STR_LookupEntryWithDefault(ck_varTable, name, def);
 }
 
+unsigned long CK_VAR_GetLookupCount(void)
+{
+	return ck_varLookups;
+}
+
+bool CK_VAR_TraceLookups(const char *filename)
+{
+	ck_varTraceFile = fopen(filename, "w");
+	return ck_varTraceFile != NULL;
+}
+
 const char *CK_VAR_GetString(const char *name, const char *def)
 {
 #ifdef CK_VAR_TYPECHECK
@@ -275,6 +345,91 @@ CK_action *CK_GetActionByName(const char *name)
 #endif
 }
 
+void CK_VAR_ResolveInt(CK_VAR_Handle *handle, const char *name, intptr_t def)
+{
+	handle->value = (void *)CK_VAR_GetInt(name, def);
+	handle->generation = ck_varGeneration;
+}
+
+void CK_VAR_ResolveIntArray(CK_VAR_Handle *handle, const char *name, intptr_t def)
+{
+	(void)def;
+#ifdef CK_VAR_TYPECHECK
+	CK_VAR_Variable *var = (CK_VAR_Variable *)CK_VAR_GetByName(name, NULL);
+	if (!var)
+	{
+#ifdef CK_VAR_WARNONNOTSET
+		CK_Cross_LogMessage(CK_LOG_MSG_WARNING, "Integer array variable \"%s\" not set, returning NULL\n", name);
+#endif
+		handle->value = NULL;
+		handle->length = 0;
+	}
+	else
+	{
+		if (var->type != VAR_IntArray)
+			Quit("CK_VAR_ResolveIntArray: Tried to access a non-integer array variable!");
+		handle->value = var->value;
+		handle->length = var->length;
+	}
+#else
+	handle->value = (void *)CK_VAR_GetIntArray(name);
+#endif
+	handle->generation = ck_varGeneration;
+}
+
+void CK_VAR_ResolveAction(CK_VAR_Handle *handle, const char *name, intptr_t def)
+{
+	(void)def;
+	handle->value = (void *)CK_GetActionByName(name);
+	handle->generation = ck_varGeneration;
+}
+
+void CK_VAR_CheckIntArrayIndex(CK_VAR_Handle *handle, int index)
+{
+#ifdef CK_VAR_TYPECHECK
+	if (handle->value && (index < 0 || (size_t)index >= handle->length))
+		Quit("CK_VAR_CheckIntArrayIndex: Index out of range!");
+#else
+	(void)handle;
+	(void)index;
+#endif
+}
+
+// Chunk IDs are looked up through a table of handles keyed by the ID's
+// address, rather than by name. The IDs are all CK_CHUNKID string literals,
+// so each has an address of its own for as long as the program runs.
+#define CK_VAR_CHUNKCACHESIZE 256
+
+typedef struct CK_VAR_ChunkCacheEntry
+{
+	const char *id;
+	CK_VAR_Handle handle;
+} CK_VAR_ChunkCacheEntry;
+
+static CK_VAR_ChunkCacheEntry ck_varChunkCache[CK_VAR_CHUNKCACHESIZE];
+static int ck_varChunkCacheUsed;
+
+intptr_t CK_VAR_LookupChunk(const char *id)
+{
+	int i = (int)(((uintptr_t)id >> 2) % CK_VAR_CHUNKCACHESIZE);
+	while (ck_varChunkCache[i].id && ck_varChunkCache[i].id != id)
+		i = (i + 1) % CK_VAR_CHUNKCACHESIZE;
+
+	if (!ck_varChunkCache[i].id)
+	{
+		// Keep a free entry, so that the search above always ends.
+		if (ck_varChunkCacheUsed == CK_VAR_CHUNKCACHESIZE - 1)
+			return CK_VAR_GetInt(id, 0);
+		ck_varChunkCache[i].id = id;
+		ck_varChunkCacheUsed++;
+	}
+
+	CK_VAR_Handle *handle = &ck_varChunkCache[i].handle;
+	if (handle->generation != ck_varGeneration)
+		CK_VAR_ResolveInt(handle, id, 0);
+	return (intptr_t)handle->value;
+}
+
 CK_action *CK_GetOrCreateActionByName(const char *name)
 {
 	CK_action *ptr = NULL;
@@ -294,15 +449,9 @@ CK_action *CK_GetOrCreateActionByName(const char *name)
 		if (ck_actionsUsed >= CK_VAR_MAXACTIONS)
 			Quit("Too many actions!");
 		ptr = &(ck_actionData[ck_actionsUsed++]);
+		memset(ptr, 0, sizeof(*ptr));
 		char *dupName = MM_ArenaStrDup(ck_varArena, name);
-#ifdef CK_VAR_TYPECHECK
-		CK_VAR_Variable *var = (CK_VAR_Variable *)MM_ArenaAlloc(ck_varArena, sizeof(*var));
-		var->type = VAR_Action;
-		var->value = (void *)ptr;
-		CK_VAR_SetEntry(dupName, (void *)var);
-#else
-		CK_VAR_SetEntry(dupName, (void *)ptr);
-#endif
+		CK_VAR_AddVar(dupName, VAR_Action, (void *)ptr, 0);
 	}
 	return ptr;
 }
@@ -310,9 +459,15 @@ CK_action *CK_GetOrCreateActionByName(const char *name)
 // POTENTIALLY SLOW function - Use in game loading only!
 CK_action *CK_LookupActionFrom16BitOffset(uint16_t offset)
 {
+#ifdef CK_VARS_LINKED
+	for (int i = 0; ck_linkedActions[i]; ++i)
+		if (ck_linkedActions[i]->compatDosPointer == offset)
+			return ck_linkedActions[i];
+#else
 	for (int i = 0; i < ck_actionsUsed; ++i)
 		if (ck_actionData[i].compatDosPointer == offset)
 			return &ck_actionData[i];
+#endif
 
 	return NULL;
 }
@@ -320,14 +475,7 @@ CK_action *CK_LookupActionFrom16BitOffset(uint16_t offset)
 void CK_VAR_SetInt(const char *name, intptr_t val)
 {
 	const char *realName = MM_ArenaStrDup(ck_varArena, name);
-#ifdef CK_VAR_TYPECHECK
-	CK_VAR_Variable *var = (CK_VAR_Variable *)MM_ArenaAlloc(ck_varArena, sizeof(*var));
-	var->type = VAR_Int;
-	var->value = (void *)val;
-	CK_VAR_SetEntry(realName, (void *)var);
-#else
-	CK_VAR_SetEntry(realName, (void *)val);
-#endif
+	CK_VAR_AddVar(realName, VAR_Int, (void *)val, 0);
 }
 
 void CK_VAR_SetIntArray(const char *name, intptr_t *array, size_t arrayLen)
@@ -335,29 +483,14 @@ void CK_VAR_SetIntArray(const char *name, intptr_t *array, size_t arrayLen)
 	const char *realName = MM_ArenaStrDup(ck_varArena, name);
 	intptr_t *realArray = (intptr_t *)MM_ArenaAllocAligned(ck_varArena, arrayLen * sizeof(intptr_t), sizeof(intptr_t));
 	memcpy(realArray, array, arrayLen * sizeof(intptr_t));
-#ifdef CK_VAR_TYPECHECK
-	CK_VAR_Variable *var = (CK_VAR_Variable *)MM_ArenaAlloc(ck_varArena, sizeof(*var));
-	var->type = VAR_IntArray;
-	var->value = (void *)realArray;
-	var->length = arrayLen;
-	CK_VAR_SetEntry(realName, (void *)var);
-#else
-	CK_VAR_SetEntry(realName, (void *)realArray);
-#endif
+	CK_VAR_AddVar(realName, VAR_IntArray, (void *)realArray, arrayLen);
 }
 
 void CK_VAR_SetString(const char *name, const char *val)
 {
 	const char *realName = MM_ArenaStrDup(ck_varArena, name);
 	const char *realVal = MM_ArenaStrDup(ck_varArena, val);
-#ifdef CK_VAR_TYPECHECK
-	CK_VAR_Variable *var = (CK_VAR_Variable *)MM_ArenaAlloc(ck_varArena, sizeof(*var));
-	var->type = VAR_String;
-	var->value = (void *)realVal;
-	CK_VAR_SetEntry(realName, (void *)var);
-#else
-	CK_VAR_SetEntry(realName, (void *)realVal);
-#endif
+	CK_VAR_AddVar(realName, VAR_String, (void *)realVal, 0);
 }
 
 void CK_VAR_SetStringArray(const char *name, const char **array, size_t arrayLen)
@@ -365,15 +498,7 @@ void CK_VAR_SetStringArray(const char *name, const char **array, size_t arrayLen
 	const char *realName = MM_ArenaStrDup(ck_varArena, name);
 	intptr_t *realArray = (intptr_t *)MM_ArenaAllocAligned(ck_varArena, arrayLen * sizeof(const char *), sizeof(const char *));
 	memcpy(realArray, array, arrayLen * sizeof(const char *));
-#ifdef CK_VAR_TYPECHECK
-	CK_VAR_Variable *var = (CK_VAR_Variable *)MM_ArenaAlloc(ck_varArena, sizeof(*var));
-	var->type = VAR_StringArray;
-	var->value = (void *)realArray;
-	var->length = arrayLen;
-	CK_VAR_SetEntry(realName, (void *)var);
-#else
-	CK_VAR_SetEntry(realName, (void *)realArray);
-#endif
+	CK_VAR_AddVar(realName, VAR_StringArray, (void *)realArray, arrayLen);
 }
 
 // == Parser ===
@@ -647,12 +772,48 @@ bool CK_VAR_ParseVar(STR_ParserState *ps)
 	return true;
 }
 
+// The files which the variables were loaded from, so that the cache can tell
+// if they've changed.
+#define CK_VAR_MAX_SOURCES 16
+
+typedef struct CK_VAR_Source
+{
+	const char *name;
+	uint32_t length;
+	uint64_t hash;
+} CK_VAR_Source;
+
+static CK_VAR_Source ck_varSources[CK_VAR_MAX_SOURCES];
+static int ck_varSourcesUsed;
+
+// FNV-1a
+static uint64_t CK_VAR_HashData(const void *data, size_t length)
+{
+	const uint8_t *bytes = (const uint8_t *)data;
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (size_t i = 0; i < length; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
 void CK_VAR_LoadVars(const char *filename)
 {
 	int numVarsParsed = 0;
 	STR_ParserState parserstate;
 
 	CA_LoadFile(filename, (mm_ptr_t *)(&parserstate.data), &(parserstate.datasize));
+	if (ck_varSourcesUsed < CK_VAR_MAX_SOURCES)
+	{
+		CK_VAR_Source *source = &ck_varSources[ck_varSourcesUsed];
+		source->name = MM_ArenaStrDup(ck_varArena, filename);
+		source->length = parserstate.datasize;
+		source->hash = CK_VAR_HashData(parserstate.data, parserstate.datasize);
+	}
+	// Counted even when full, so that the cache isn't written.
+	ck_varSourcesUsed++;
 	parserstate.dataindex = 0;
 	parserstate.linecount = 0;
 	parserstate.haveBufferedToken = false;
@@ -662,3 +823,440 @@ void CK_VAR_LoadVars(const char *filename)
 
 	CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "Parsed %d vars from \"%s\" over %d lines (%d actions created).\n", numVarsParsed, filename, parserstate.linecount, ck_actionsUsed);
 }
+
+// == Cache ===
+
+/*
+ * Parsing the variables takes a while, so the result is cached in the user
+ * path, as a flat image of the hash table, the strings and arrays, and the
+ * actions. Pointers are stored as offsets into the image (or indices), and
+ * fixed up when it is loaded, with a single read. The cache is only used if
+ * every file the variables came from is unchanged, and only by the same kind
+ * of build which wrote it (the function table indices must match, too).
+ *
+ * Tools like varparser don't have the function table, so don't use it.
+ */
+#ifndef CK_VAR_FUNCTIONS_AS_STRINGS
+
+#define CK_VAR_CACHE_VERSION 2
+#define CK_VAR_CACHE_MAX_TABLE 0x100000
+#define CK_VAR_CACHE_BYTEORDER 0x01020304
+static const char ck_varCacheMagic[8] = {'C', 'K', 'V', 'A', 'R', 'S', '\x1A', '\0'};
+
+typedef struct CK_VAR_CacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t pointerSize;
+	uint32_t tableSize;
+	uint32_t numSources;
+	uint32_t numEntries;
+	uint32_t numFunctions;
+	uint32_t numActions;
+	uint32_t dataSize;
+	uint32_t reserved;
+} CK_VAR_CacheHeader;
+
+// Names, strings and arrays are offsets into the data at the end.
+typedef struct CK_VAR_CacheSource
+{
+	uint32_t name;
+	uint32_t length;
+	uint64_t hash;
+} CK_VAR_CacheSource;
+
+typedef struct CK_VAR_CacheEntry
+{
+	uint32_t slot; // In ck_varTable
+	uint32_t name;
+	uint32_t type;
+	uint32_t length;
+	int64_t value; // Integer, data offset, or action index
+} CK_VAR_CacheEntry;
+
+typedef struct CK_VAR_CacheFunction
+{
+	uint32_t slot; // In ck_functionTable
+	uint32_t name;
+} CK_VAR_CacheFunction;
+
+typedef struct CK_VAR_CacheAction
+{
+	int16_t chunkLeft, chunkRight;
+	int16_t type;
+	int16_t protectAnimation, stickToGround;
+	int16_t timer;
+	int16_t velX, velY;
+	uint16_t compatDosPointer;
+	int16_t padding;
+	// Indices of functions and actions, or -1 for NULL.
+	int32_t think, collide, draw;
+	int32_t next;
+} CK_VAR_CacheAction;
+
+typedef struct CK_VAR_CacheData
+{
+	uint8_t *data;
+	size_t size, capacity;
+} CK_VAR_CacheData;
+
+static uint32_t CK_VAR_CacheAddData(CK_VAR_CacheData *cd, const void *ptr, size_t length, size_t alignment)
+{
+	size_t offset = (cd->size + alignment - 1) & ~(alignment - 1);
+	if (offset + length > cd->capacity)
+	{
+		cd->capacity = (offset + length) * 2;
+		cd->data = (uint8_t *)realloc(cd->data, cd->capacity);
+	}
+	memset(cd->data + cd->size, 0, offset - cd->size);
+	memcpy(cd->data + offset, ptr, length);
+	cd->size = offset + length;
+	return (uint32_t)offset;
+}
+
+static uint32_t CK_VAR_CacheAddString(CK_VAR_CacheData *cd, const char *str)
+{
+	return CK_VAR_CacheAddData(cd, str, strlen(str) + 1, 1);
+}
+
+static int CK_VAR_CacheFindFunction(CK_VAR_CacheFunction *functions, void **functionPtrs, uint32_t *numFunctions, CK_VAR_CacheData *cd, void *fn)
+{
+	if (!fn)
+		return -1;
+	for (uint32_t i = 0; i < *numFunctions; ++i)
+		if (functionPtrs[i] == fn)
+			return i;
+	if (*numFunctions == CK_FUNCTABL_SIZE)
+		return -2;
+	for (size_t slot = 0; slot < ck_functionTable->size; ++slot)
+	{
+		if (ck_functionTable->arr[slot].str && ck_functionTable->arr[slot].ptr == fn)
+		{
+			functions[*numFunctions].slot = slot;
+			functions[*numFunctions].name = CK_VAR_CacheAddString(cd, ck_functionTable->arr[slot].str);
+			functionPtrs[*numFunctions] = fn;
+			return (*numFunctions)++;
+		}
+	}
+	return -2;
+}
+
+static void CK_VAR_WriteCache(const char *cacheFilename)
+{
+	if (ck_varSourcesUsed > CK_VAR_MAX_SOURCES || ck_varTable->size > CK_VAR_CACHE_MAX_TABLE)
+	{
+		CK_Cross_LogMessage(CK_LOG_MSG_WARNING, "Too many variables or files to cache.\n");
+		return;
+	}
+
+	CK_VAR_CacheHeader header;
+	CK_VAR_CacheSource sources[CK_VAR_MAX_SOURCES];
+	CK_VAR_CacheEntry *entries = (CK_VAR_CacheEntry *)calloc(ck_varRecordsUsed, sizeof(CK_VAR_CacheEntry));
+	CK_VAR_CacheFunction functions[CK_FUNCTABL_SIZE];
+	void *functionPtrs[CK_FUNCTABL_SIZE];
+	CK_VAR_CacheAction *actions = (CK_VAR_CacheAction *)calloc(ck_actionsUsed, sizeof(CK_VAR_CacheAction));
+	CK_VAR_CacheData cd = {NULL, 0, 0};
+	bool ok = true;
+
+	memcpy(header.magic, ck_varCacheMagic, sizeof(header.magic));
+	header.version = CK_VAR_CACHE_VERSION;
+	header.byteOrder = CK_VAR_CACHE_BYTEORDER;
+	header.pointerSize = sizeof(intptr_t);
+	header.tableSize = ck_varTable->size;
+	header.numSources = ck_varSourcesUsed;
+	header.numEntries = ck_varRecordsUsed;
+	header.numFunctions = 0;
+	header.numActions = ck_actionsUsed;
+	header.reserved = 0;
+
+	for (int i = 0; i < ck_varSourcesUsed; ++i)
+	{
+		sources[i].name = CK_VAR_CacheAddString(&cd, ck_varSources[i].name);
+		sources[i].length = ck_varSources[i].length;
+		sources[i].hash = ck_varSources[i].hash;
+	}
+
+	for (int i = 0; i < ck_varRecordsUsed && ok; ++i)
+	{
+		CK_VAR_Record *record = &ck_varRecords[i];
+		CK_VAR_CacheEntry *entry = &entries[i];
+
+		// Every name was copied into the arena, so the pointer finds its slot.
+		entry->slot = UINT32_MAX;
+		for (size_t slot = 0; slot < ck_varTable->size; ++slot)
+			if (ck_varTable->arr[slot].str == record->name)
+				entry->slot = slot;
+		ok = entry->slot != UINT32_MAX;
+
+		entry->name = CK_VAR_CacheAddString(&cd, record->name);
+		entry->type = record->type;
+		entry->length = record->length;
+		switch (record->type)
+		{
+		case VAR_Int:
+			entry->value = (intptr_t)record->value;
+			break;
+		case VAR_String:
+			entry->value = CK_VAR_CacheAddString(&cd, (const char *)record->value);
+			break;
+		case VAR_IntArray:
+			entry->value = CK_VAR_CacheAddData(&cd, record->value, record->length * sizeof(intptr_t), sizeof(intptr_t));
+			break;
+		case VAR_StringArray:
+		{
+			intptr_t offsets[CK_VAR_MAX_ARRAY_LEN];
+			for (size_t j = 0; j < record->length; ++j)
+				offsets[j] = CK_VAR_CacheAddString(&cd, ((const char **)record->value)[j]);
+			entry->value = CK_VAR_CacheAddData(&cd, offsets, record->length * sizeof(intptr_t), sizeof(intptr_t));
+			break;
+		}
+		case VAR_Action:
+			entry->value = (CK_action *)record->value - ck_actionData;
+			break;
+		default:
+			ok = false;
+		}
+	}
+
+	for (int i = 0; i < ck_actionsUsed && ok; ++i)
+	{
+		CK_action *act = &ck_actionData[i];
+		CK_VAR_CacheAction *cached = &actions[i];
+		cached->chunkLeft = act->chunkLeft;
+		cached->chunkRight = act->chunkRight;
+		cached->type = act->type;
+		cached->protectAnimation = act->protectAnimation;
+		cached->stickToGround = act->stickToGround;
+		cached->timer = act->timer;
+		cached->velX = act->velX;
+		cached->velY = act->velY;
+		cached->compatDosPointer = act->compatDosPointer;
+		cached->padding = 0;
+		cached->think = CK_VAR_CacheFindFunction(functions, functionPtrs, &header.numFunctions, &cd, (void *)act->think);
+		cached->collide = CK_VAR_CacheFindFunction(functions, functionPtrs, &header.numFunctions, &cd, (void *)act->collide);
+		cached->draw = CK_VAR_CacheFindFunction(functions, functionPtrs, &header.numFunctions, &cd, (void *)act->draw);
+		cached->next = act->next ? act->next - ck_actionData : -1;
+		ok = cached->think != -2 && cached->collide != -2 && cached->draw != -2;
+	}
+	header.dataSize = cd.size;
+
+	FS_File f = ok ? FS_CreateUserFile(cacheFilename) : NULL;
+	if (FS_IsFileValid(f))
+	{
+		static const uint8_t zeroes[8] = {0};
+		size_t offset = sizeof(header) + header.numSources * sizeof(CK_VAR_CacheSource) +
+			header.numEntries * sizeof(CK_VAR_CacheEntry) + header.numFunctions * sizeof(CK_VAR_CacheFunction) +
+			header.numActions * sizeof(CK_VAR_CacheAction);
+		FS_Write(&header, sizeof(header), 1, f);
+		FS_Write(sources, sizeof(CK_VAR_CacheSource), header.numSources, f);
+		FS_Write(entries, sizeof(CK_VAR_CacheEntry), header.numEntries, f);
+		FS_Write(functions, sizeof(CK_VAR_CacheFunction), header.numFunctions, f);
+		FS_Write(actions, sizeof(CK_VAR_CacheAction), header.numActions, f);
+		// The data is aligned, so the arrays can be used in place.
+		FS_Write(zeroes, 1, (8 - offset % 8) % 8, f);
+		FS_Write(cd.data, 1, cd.size, f);
+		FS_CloseFile(f);
+	}
+	else
+		CK_Cross_LogMessage(CK_LOG_MSG_WARNING, "Couldn't write the variable cache \"%s\".\n", cacheFilename);
+
+	free(cd.data);
+	free(actions);
+	free(entries);
+}
+
+// Returns false, leaving the variables untouched, if the cache is missing,
+// stale or doesn't match this build.
+static bool CK_VAR_LoadCache(const char *cacheFilename)
+{
+	uint8_t *image = NULL;
+	int imageSize;
+	if (!FS_LoadUserFile(cacheFilename, (mm_ptr_t *)&image, &imageSize))
+	{
+		if (image)
+			MM_FreePtr((mm_ptr_t *)&image);
+		return false;
+	}
+
+	CK_VAR_CacheHeader *header = (CK_VAR_CacheHeader *)image;
+	if ((size_t)imageSize < sizeof(*header) ||
+		memcmp(header->magic, ck_varCacheMagic, sizeof(header->magic)) ||
+		header->version != CK_VAR_CACHE_VERSION ||
+		header->byteOrder != CK_VAR_CACHE_BYTEORDER ||
+		header->pointerSize != sizeof(intptr_t) ||
+		!header->tableSize || header->tableSize > CK_VAR_CACHE_MAX_TABLE ||
+		header->tableSize & (header->tableSize - 1) ||
+		header->numEntries * 4 > header->tableSize * 3 ||
+		ck_varTable->numElements ||
+		header->numSources > CK_VAR_MAX_SOURCES ||
+		header->numFunctions > CK_FUNCTABL_SIZE ||
+		header->numActions > CK_VAR_MAXACTIONS)
+	{
+		MM_FreePtr((mm_ptr_t *)&image);
+		return false;
+	}
+
+	// The slots are only valid in a table of the same size.
+	if (ck_varTable->size != header->tableSize)
+		STR_ResizeTable(ck_varTable, header->tableSize);
+
+	size_t offset = sizeof(*header);
+	CK_VAR_CacheSource *sources = (CK_VAR_CacheSource *)(image + offset);
+	offset += header->numSources * sizeof(CK_VAR_CacheSource);
+	CK_VAR_CacheEntry *entries = (CK_VAR_CacheEntry *)(image + offset);
+	offset += header->numEntries * sizeof(CK_VAR_CacheEntry);
+	CK_VAR_CacheFunction *functions = (CK_VAR_CacheFunction *)(image + offset);
+	offset += header->numFunctions * sizeof(CK_VAR_CacheFunction);
+	CK_VAR_CacheAction *actions = (CK_VAR_CacheAction *)(image + offset);
+	offset += header->numActions * sizeof(CK_VAR_CacheAction);
+	offset = (offset + 7) & ~(size_t)7;
+	char *data = (char *)image + offset;
+	bool ok = offset + header->dataSize == (size_t)imageSize;
+
+// Is there a whole string at this offset into the data?
+#define CK_VAR_CACHE_STRING_OK(ofs) ((ofs) < header->dataSize && memchr(data + (ofs), '\0', header->dataSize - (ofs)))
+
+	// Check that the files haven't changed.
+	for (uint32_t i = 0; i < header->numSources && ok; ++i)
+	{
+		char *source;
+		int sourceSize;
+		ok = CK_VAR_CACHE_STRING_OK(sources[i].name) &&
+			CA_LoadFile(data + sources[i].name, (mm_ptr_t *)&source, &sourceSize);
+		if (ok)
+		{
+			ok = (uint32_t)sourceSize == sources[i].length && CK_VAR_HashData(source, sourceSize) == sources[i].hash;
+			MM_FreePtr((mm_ptr_t *)&source);
+		}
+	}
+
+	// Check that the functions are where they were.
+	void *functionPtrs[CK_FUNCTABL_SIZE];
+	for (uint32_t i = 0; i < header->numFunctions && ok; ++i)
+	{
+		STR_Entry *fn = &ck_functionTable->arr[functions[i].slot % ck_functionTable->size];
+		ok = functions[i].slot < ck_functionTable->size && CK_VAR_CACHE_STRING_OK(functions[i].name) &&
+			fn->str && !strcmp(fn->str, data + functions[i].name);
+		functionPtrs[i] = ok ? fn->ptr : NULL;
+	}
+	for (uint32_t i = 0; i < header->numActions && ok; ++i)
+	{
+		CK_VAR_CacheAction *cached = &actions[i];
+		ok = cached->think >= -1 && cached->think < (int32_t)header->numFunctions &&
+			cached->collide >= -1 && cached->collide < (int32_t)header->numFunctions &&
+			cached->draw >= -1 && cached->draw < (int32_t)header->numFunctions &&
+			cached->next >= -1 && cached->next < (int32_t)header->numActions;
+	}
+	for (uint32_t i = 0; i < header->numEntries && ok; ++i)
+	{
+		CK_VAR_CacheEntry *entry = &entries[i];
+		ok = entry->slot < ck_varTable->size && !ck_varTable->arr[entry->slot].str && CK_VAR_CACHE_STRING_OK(entry->name);
+		if (entry->type == VAR_String)
+			ok = ok && CK_VAR_CACHE_STRING_OK((uint64_t)entry->value);
+		else if (entry->type == VAR_IntArray || entry->type == VAR_StringArray)
+			ok = ok && !(entry->value % sizeof(intptr_t)) && entry->length <= CK_VAR_MAX_ARRAY_LEN &&
+				(uint64_t)entry->value + entry->length * sizeof(intptr_t) <= header->dataSize;
+		else if (entry->type == VAR_Action)
+			ok = ok && entry->value >= 0 && entry->value < header->numActions;
+		else
+			ok = ok && entry->type == VAR_Int;
+
+		if (ok && entry->type == VAR_StringArray)
+		{
+			intptr_t *offsets = (intptr_t *)(data + entry->value);
+			for (uint32_t j = 0; j < entry->length && ok; ++j)
+				ok = offsets[j] >= 0 && CK_VAR_CACHE_STRING_OK((uint64_t)offsets[j]);
+		}
+	}
+#undef CK_VAR_CACHE_STRING_OK
+
+	if (!ok)
+	{
+		MM_FreePtr((mm_ptr_t *)&image);
+		return false;
+	}
+
+	// Everything checks out: fix it all up.
+	for (uint32_t i = 0; i < header->numActions; ++i)
+	{
+		CK_VAR_CacheAction *cached = &actions[i];
+		CK_action *act = &ck_actionData[i];
+		act->chunkLeft = cached->chunkLeft;
+		act->chunkRight = cached->chunkRight;
+		act->type = (CK_ActionType)cached->type;
+		act->protectAnimation = cached->protectAnimation;
+		act->stickToGround = cached->stickToGround;
+		act->timer = cached->timer;
+		act->velX = cached->velX;
+		act->velY = cached->velY;
+		act->think = cached->think < 0 ? NULL : (CK_ACT_Function)functionPtrs[cached->think];
+		act->collide = cached->collide < 0 ? NULL : (CK_ACT_ColFunction)functionPtrs[cached->collide];
+		act->draw = cached->draw < 0 ? NULL : (CK_ACT_Function)functionPtrs[cached->draw];
+		act->next = cached->next < 0 ? NULL : &ck_actionData[cached->next];
+		act->compatDosPointer = cached->compatDosPointer;
+	}
+	ck_actionsUsed = header->numActions;
+
+#ifdef CK_VAR_TYPECHECK
+	CK_VAR_Variable *vars;
+	MM_GetPtr((mm_ptr_t *)&vars, header->numEntries * sizeof(CK_VAR_Variable));
+#endif
+	for (uint32_t i = 0; i < header->numEntries; ++i)
+	{
+		CK_VAR_CacheEntry *entry = &entries[i];
+		void *value;
+		if (entry->type == VAR_Int)
+			value = (void *)(intptr_t)entry->value;
+		else if (entry->type == VAR_Action)
+			value = (void *)&ck_actionData[entry->value];
+		else
+			value = (void *)(data + entry->value);
+
+		if (entry->type == VAR_StringArray)
+		{
+			// The offsets become pointers in place.
+			intptr_t *elements = (intptr_t *)value;
+			for (uint32_t j = 0; j < entry->length; ++j)
+				elements[j] = (intptr_t)(data + elements[j]);
+		}
+
+#ifdef CK_VAR_TYPECHECK
+		vars[i].type = (CK_VAR_VarType)entry->type;
+		vars[i].value = value;
+		vars[i].length = entry->length;
+		STR_PlaceEntry(ck_varTable, entry->slot, data + entry->name, (void *)&vars[i]);
+#else
+		STR_PlaceEntry(ck_varTable, entry->slot, data + entry->name, value);
+#endif
+	}
+	if (++ck_varGeneration == 0)
+		ck_varGeneration = 1;
+
+	// The image stays in memory for as long as the variables do.
+	return true;
+}
+
+void CK_VAR_LoadVarsWithCache(const char *filename, const char *cacheFilename)
+{
+	uint64_t startTime = CK_Cross_GetMicroseconds();
+	char realCacheFilename[16];
+
+	if (cacheFilename)
+	{
+		strcpy(realCacheFilename, FS_AdjustExtension(cacheFilename));
+		if (CK_VAR_LoadCache(realCacheFilename))
+		{
+			CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "Loaded vars from \"%s\" in %.2f ms (%d actions).\n", realCacheFilename, (CK_Cross_GetMicroseconds() - startTime) / 1000.0, ck_actionsUsed);
+			return;
+		}
+	}
+
+	CK_VAR_LoadVars(filename);
+	CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "Parsed vars in %.2f ms.\n", (CK_Cross_GetMicroseconds() - startTime) / 1000.0);
+
+	if (cacheFilename)
+		CK_VAR_WriteCache(realCacheFilename);
+}
+
+#endif
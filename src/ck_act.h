@@ -20,6 +20,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #ifndef CK_ACT_H
 #define CK_ACT_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct CK_object CK_object;
@@ -46,11 +48,44 @@ CK_action *CK_LookupActionFrom16BitOffset(uint16_t offset); // POTENTIALLY SLOW
 void CK_VAR_SetInt(const char *name, intptr_t val);
 void CK_VAR_SetString(const char *name, const char *val);
 void CK_VAR_LoadVars(const char *filename);
+// Loads the variables from cacheFilename (in the user path; the extension is
+// replaced with the episode's) instead, if it's up to date, or else loads them
+// from filename and writes the cache. A NULL cacheFilename disables it.
+void CK_VAR_LoadVarsWithCache(const char *filename, const char *cacheFilename);
+// The number of times a variable has been looked up by name.
+unsigned long CK_VAR_GetLookupCount(void);
+// Writes the name of every variable looked up to filename, one per line, for
+// tools/strbench to replay.
+bool CK_VAR_TraceLookups(const char *filename);
+
+// Each use of CK_INT, CK_ACTION, etc. keeps what it looked up in a handle of
+// its own, and only looks it up again once a variable has been (re)set, which
+// bumps ck_varGeneration.
+typedef struct CK_VAR_Handle
+{
+	uint32_t generation;
+	void *value;
+	size_t length;
+} CK_VAR_Handle;
+
+extern uint32_t ck_varGeneration;
+
+void CK_VAR_ResolveInt(CK_VAR_Handle *handle, const char *name, intptr_t def);
+void CK_VAR_ResolveIntArray(CK_VAR_Handle *handle, const char *name, intptr_t def);
+void CK_VAR_ResolveAction(CK_VAR_Handle *handle, const char *name, intptr_t def);
+void CK_VAR_CheckIntArrayIndex(CK_VAR_Handle *handle, int index);
+// Looks up a CK_CHUNKID, through a handle kept for that ID.
+intptr_t CK_VAR_LookupChunk(const char *id);
+
+// With CK_VARS_LINKED and CK_STRINGS_LINKED, the variables of one episode are
+// built into the executable, from the ck_vars.h and ck_vars.c files which
+// tools/varparser generates (see the LINK_VARS CMake option), instead of
+// being loaded from EPISODE.CKx and looked up by name.
+#if defined(CK_VARS_LINKED) || defined(CK_STRINGS_LINKED)
+#include "ck_vars.h"
+#endif
 
 #ifdef CK_STRINGS_LINKED
-// TODO: This is here in case we want to support building string values directly
-// into the executable again. (I have an in-progress tool to do this, though
-// it lacks support for a few things, so it's not workable at present.)
 #define CK_STRING(s) STRING_ ## s
 #else
 #define CK_STRING(s) CK_VAR_GetString(#s, #s)
@@ -68,6 +103,32 @@ typedef int16_t chunk_id_t;
 #define CK_INTELEMENT(name, i) (CK_INTARRAY(name)[i])
 #define CK_STRINGARRAY(name) STRARRAY_ ## name
 #define CK_STRINGELEMENT(name, i) (CK_STRINGARRAY(name)[i])
+#elif defined(__GNUC__)
+// The handles are static variables in GNU statement expressions.
+#define CK_VAR_CACHED(type, name, resolve, def) __extension__({ \
+	static CK_VAR_Handle ck_varHandle; \
+	if (ck_varHandle.generation != ck_varGeneration) \
+		resolve(&ck_varHandle, #name, (def)); \
+	(type)ck_varHandle.value; \
+})
+#define CK_INT(name, default) CK_VAR_CACHED(intptr_t, name, CK_VAR_ResolveInt, default)
+#define CK_CHUNKNUM(name) CK_VAR_CACHED(intptr_t, name, CK_VAR_ResolveInt, 0)
+#define CK_SOUNDNUM(name) CK_VAR_CACHED(intptr_t, name, CK_VAR_ResolveInt, 0)
+#define CK_ACTION(name) CK_VAR_CACHED(CK_action *, name, CK_VAR_ResolveAction, 0)
+typedef const char *chunk_id_t;
+#define CK_CHUNKID(name) #name
+#define CK_LookupChunk(id) CK_VAR_LookupChunk(id)
+#define CK_INTARRAY(name) CK_VAR_CACHED(intptr_t *, name, CK_VAR_ResolveIntArray, 0)
+#define CK_INTELEMENT(name, i) __extension__({ \
+	static CK_VAR_Handle ck_varHandle; \
+	int ck_varIndex = (i); \
+	if (ck_varHandle.generation != ck_varGeneration) \
+		CK_VAR_ResolveIntArray(&ck_varHandle, #name, 0); \
+	CK_VAR_CheckIntArrayIndex(&ck_varHandle, ck_varIndex); \
+	ck_varHandle.value ? ((intptr_t *)ck_varHandle.value)[ck_varIndex] : 0; \
+})
+#define CK_STRINGARRAY(name) CK_VAR_GetStringArray(#name)
+#define CK_STRINGELEMENT(name, i) CK_VAR_GetStringArrayElement(#name, i)
 #else
 #define CK_INT(name, default) CK_VAR_GetInt(#name, default)
 #define CK_CHUNKNUM(name) CK_VAR_GetInt(#name, 0)
@@ -75,7 +136,7 @@ typedef int16_t chunk_id_t;
 #define CK_ACTION(name) CK_GetActionByName(#name)
 typedef const char *chunk_id_t;
 #define CK_CHUNKID(name) #name
-#define CK_LookupChunk(id) CK_VAR_GetInt(id, 0)
+#define CK_LookupChunk(id) CK_VAR_LookupChunk(id)
 #define CK_INTARRAY(name) CK_VAR_GetIntArray(#name)
 #define CK_INTELEMENT(name, i) CK_VAR_GetIntArrayElement(#name, i)
 #define CK_STRINGARRAY(name) CK_VAR_GetStringArray(#name)
@@ -0,0 +1,339 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "id_us.h"
+#include "ck_act.h"
+#include "ck_collide.h"
+#include "ck_def.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+CK_CollideMode ck_collideMode = CK_COLLIDE_AUTO;
+
+// Below this many objects, testing every pair is cheap enough.
+#define CK_COLLIDE_BROADPHASE_MIN_OBJECTS 128
+
+static FILE *ck_collideLogFile;
+static long ck_collideLogFrame;
+static bool ck_collideLogging; // This frame
+
+// An active object in the broadphase, with a copy of its clipping box.
+typedef struct CK_CollideEntry
+{
+	uint16_t unitX1, unitY1, unitX2, unitY2;
+	int pos; // In the object list
+	CK_object *obj;
+} CK_CollideEntry;
+
+// The broadphase is built at the start of the pass. It's only valid until a
+// collide function is called, after which it's marked as stale, and updated
+// (or, if objects were added, removed, activated or deactivated, rebuilt) the
+// next time it's needed.
+static bool ck_collideBuilt;
+static bool ck_collideStale;
+// Whether the whole object list is in the broadphase.
+static bool ck_collideComplete;
+static CK_CollideEntry *ck_collideEntries; // Sorted by unitX1, then pos
+static int ck_collideNumEntries;
+static int ck_collideEntriesSize;
+static int ck_collideMaxWidth;
+static int ck_collideListLength;
+
+// The list position and entry (-1 if inactive) of every object in the list,
+// valid if its stamp is the current epoch.
+static unsigned int ck_collideEpoch;
+static unsigned int *ck_collideStamps;
+static int *ck_collidePositions;
+static int *ck_collideEntryIndices;
+static int ck_collideIndicesSize;
+
+static int CK_CollideObjIndex(CK_object *obj)
+{
+	if (obj >= ck_objArray && obj < ck_objArray + ck_objArraySize)
+		return obj - ck_objArray;
+	return -1;
+}
+
+static int CK_CollideCompareEntries(const void *a, const void *b)
+{
+	const CK_CollideEntry *entryA = (const CK_CollideEntry *)a;
+	const CK_CollideEntry *entryB = (const CK_CollideEntry *)b;
+	if (entryA->unitX1 != entryB->unitX1)
+		return entryA->unitX1 < entryB->unitX1 ? -1 : 1;
+	return entryA->pos - entryB->pos;
+}
+
+static void CK_CollideRebuild(void)
+{
+	// The object array is bigger on some maps.
+	if (ck_objArraySize > ck_collideIndicesSize)
+	{
+		ck_collideIndicesSize = ck_objArraySize;
+		ck_collideStamps = (unsigned int *)realloc(ck_collideStamps, ck_collideIndicesSize * sizeof(unsigned int));
+		ck_collidePositions = (int *)realloc(ck_collidePositions, ck_collideIndicesSize * sizeof(int));
+		ck_collideEntryIndices = (int *)realloc(ck_collideEntryIndices, ck_collideIndicesSize * sizeof(int));
+		if (!ck_collideStamps || !ck_collidePositions || !ck_collideEntryIndices)
+			Quit("CK_CollideRebuild: Out of memory!");
+		memset(ck_collideStamps, 0, ck_collideIndicesSize * sizeof(unsigned int));
+	}
+
+	if (++ck_collideEpoch == 0)
+	{
+		memset(ck_collideStamps, 0, ck_collideIndicesSize * sizeof(unsigned int));
+		ck_collideEpoch = 1;
+	}
+
+	ck_collideNumEntries = 0;
+	ck_collideMaxWidth = 0;
+	ck_collideComplete = true;
+	int pos = 0;
+	for (CK_object *obj = ck_keenObj; obj; obj = obj->next, ++pos)
+	{
+		// Anything outside of the object array (or a loop) can't be
+		// indexed, so the links have to be followed instead.
+		int index = CK_CollideObjIndex(obj);
+		if (index < 0 || ck_collideStamps[index] == ck_collideEpoch)
+		{
+			ck_collideComplete = false;
+			break;
+		}
+		ck_collideStamps[index] = ck_collideEpoch;
+		ck_collidePositions[index] = pos;
+		ck_collideEntryIndices[index] = -1;
+
+		if (!obj->active)
+			continue;
+
+		if (ck_collideNumEntries == ck_collideEntriesSize)
+		{
+			ck_collideEntriesSize = ck_collideEntriesSize ? ck_collideEntriesSize * 2 : 64;
+			ck_collideEntries = (CK_CollideEntry *)realloc(ck_collideEntries, ck_collideEntriesSize * sizeof(CK_CollideEntry));
+			if (!ck_collideEntries)
+				Quit("CK_CollideRebuild: Out of memory!");
+		}
+		CK_CollideEntry *entry = &ck_collideEntries[ck_collideNumEntries++];
+		entry->unitX1 = obj->clipRects.unitX1;
+		entry->unitY1 = obj->clipRects.unitY1;
+		entry->unitX2 = obj->clipRects.unitX2;
+		entry->unitY2 = obj->clipRects.unitY2;
+		entry->pos = pos;
+		entry->obj = obj;
+
+		int width = (int)entry->unitX2 - (int)entry->unitX1;
+		if (width > ck_collideMaxWidth)
+			ck_collideMaxWidth = width;
+	}
+
+	ck_collideListLength = pos;
+
+	qsort(ck_collideEntries, ck_collideNumEntries, sizeof(CK_CollideEntry), CK_CollideCompareEntries);
+	for (int i = 0; i < ck_collideNumEntries; ++i)
+		ck_collideEntryIndices[CK_CollideObjIndex(ck_collideEntries[i].obj)] = i;
+	ck_collideBuilt = true;
+	ck_collideStale = false;
+}
+
+// Updates the clipping boxes of the objects which moved, and re-sorts them.
+// Returns false if the list itself changed, and it needs rebuilding.
+static bool CK_CollideUpdate(void)
+{
+	bool moved = false;
+	int pos = 0;
+	for (CK_object *obj = ck_keenObj; obj; obj = obj->next, ++pos)
+	{
+		int index = CK_CollideObjIndex(obj);
+		if (index < 0 || ck_collideStamps[index] != ck_collideEpoch || ck_collidePositions[index] != pos)
+			return false;
+		int entryIndex = ck_collideEntryIndices[index];
+		if (!obj->active != (entryIndex < 0))
+			return false;
+		if (entryIndex < 0)
+			continue;
+
+		CK_CollideEntry *entry = &ck_collideEntries[entryIndex];
+		if (entry->unitX1 != obj->clipRects.unitX1 || entry->unitY1 != obj->clipRects.unitY1 ||
+			entry->unitX2 != obj->clipRects.unitX2 || entry->unitY2 != obj->clipRects.unitY2)
+		{
+			entry->unitX1 = obj->clipRects.unitX1;
+			entry->unitY1 = obj->clipRects.unitY1;
+			entry->unitX2 = obj->clipRects.unitX2;
+			entry->unitY2 = obj->clipRects.unitY2;
+			int width = (int)entry->unitX2 - (int)entry->unitX1;
+			if (width > ck_collideMaxWidth)
+				ck_collideMaxWidth = width;
+			moved = true;
+		}
+	}
+	if (pos != ck_collideListLength)
+		return false;
+
+	if (moved)
+	{
+		// Only a few objects will have moved, so an insertion sort is
+		// quickest.
+		for (int i = 1; i < ck_collideNumEntries; ++i)
+		{
+			CK_CollideEntry entry = ck_collideEntries[i];
+			int j = i;
+			for (; j > 0 && CK_CollideCompareEntries(&ck_collideEntries[j - 1], &entry) > 0; --j)
+				ck_collideEntries[j] = ck_collideEntries[j - 1];
+			ck_collideEntries[j] = entry;
+		}
+		for (int i = 0; i < ck_collideNumEntries; ++i)
+			ck_collideEntryIndices[CK_CollideObjIndex(ck_collideEntries[i].obj)] = i;
+	}
+	ck_collideStale = false;
+	return true;
+}
+
+// Finds the first object at or after list position 'startPos' which overlaps
+// 'currentObj'.
+static CK_object *CK_CollideFindFirst(CK_object *currentObj, int startPos)
+{
+	CK_objPhysData *rect = &currentObj->clipRects;
+
+	// Anything overlapping starts after rect->unitX1 - ck_collideMaxWidth.
+	int minX1 = (int)rect->unitX1 - ck_collideMaxWidth;
+	int lo = 0, hi = ck_collideNumEntries;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if ((int)ck_collideEntries[mid].unitX1 > minX1)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	CK_object *first = NULL;
+	int firstPos = INT_MAX;
+	for (int i = lo; i < ck_collideNumEntries && ck_collideEntries[i].unitX1 < rect->unitX2; ++i)
+	{
+		CK_CollideEntry *entry = &ck_collideEntries[i];
+		if (entry->pos >= startPos && entry->pos < firstPos &&
+			(rect->unitX1 < entry->unitX2) &&
+			(rect->unitY1 < entry->unitY2) &&
+			(rect->unitY2 > entry->unitY1))
+		{
+			first = entry->obj;
+			firstPos = entry->pos;
+		}
+	}
+	return first;
+}
+
+static void CK_CollidePair(CK_object *currentObj, CK_object *collideObj)
+{
+	if (ck_collideLogging)
+		fprintf(ck_collideLogFile, " %d-%d", (int)(currentObj - ck_objArray), (int)(collideObj - ck_objArray));
+
+	if (currentObj->currentAction->collide)
+	{
+		currentObj->currentAction->collide(currentObj, collideObj);
+		ck_collideStale = true;
+	}
+	if (collideObj->currentAction->collide)
+	{
+		collideObj->currentAction->collide(collideObj, currentObj);
+		ck_collideStale = true;
+	}
+}
+
+// The original loop: test currentObj with every object from 'start' on.
+static void CK_CollideBruteForce(CK_object *currentObj, CK_object *start)
+{
+	for (CK_object *collideObj = start; collideObj; collideObj = collideObj->next)
+	{
+		if (!collideObj->active)
+			continue;
+
+		if ((currentObj->clipRects.unitX2 > collideObj->clipRects.unitX1) &&
+			(currentObj->clipRects.unitX1 < collideObj->clipRects.unitX2) &&
+			(currentObj->clipRects.unitY1 < collideObj->clipRects.unitY2) &&
+			(currentObj->clipRects.unitY2 > collideObj->clipRects.unitY1))
+		{
+			CK_CollidePair(currentObj, collideObj);
+		}
+	}
+}
+
+static void CK_CollideBroadphase(CK_object *currentObj, CK_object *start)
+{
+	while (start)
+	{
+		if (!ck_collideBuilt || (ck_collideStale && !(ck_collideComplete && CK_CollideUpdate())))
+			CK_CollideRebuild();
+
+		// If currentObj was removed, its next object might not be in
+		// the list any more.
+		int index = CK_CollideObjIndex(start);
+		if (!ck_collideComplete || index < 0 || ck_collideStamps[index] != ck_collideEpoch)
+		{
+			CK_CollideBruteForce(currentObj, start);
+			return;
+		}
+
+		CK_object *collideObj = CK_CollideFindFirst(currentObj, ck_collidePositions[index]);
+		if (!collideObj)
+			return;
+		CK_CollidePair(currentObj, collideObj);
+		start = collideObj->next;
+	}
+}
+
+void CK_CollideObjects(bool log)
+{
+	bool broadphase = ck_collideMode == CK_COLLIDE_BROADPHASE ||
+		(ck_collideMode == CK_COLLIDE_AUTO && ck_numObjects >= CK_COLLIDE_BROADPHASE_MIN_OBJECTS);
+	ck_collideLogging = log && ck_collideLogFile;
+	if (ck_collideLogging)
+		fprintf(ck_collideLogFile, "%ld:", ck_collideLogFrame++);
+
+	ck_collideBuilt = false;
+	for (CK_object *currentObj = ck_keenObj; currentObj; currentObj = currentObj->next)
+	{
+		// Some strange Keen4 stuff here. Ignoring for now.
+
+		if (!currentObj->active)
+			continue;
+		if (broadphase)
+			CK_CollideBroadphase(currentObj, currentObj->next);
+		else
+			CK_CollideBruteForce(currentObj, currentObj->next);
+	}
+
+	if (ck_collideLogging)
+		fprintf(ck_collideLogFile, "\n");
+}
+
+bool CK_CollideLogOpen(const char *fileName)
+{
+	ck_collideLogFile = fopen(fileName, "w");
+	ck_collideLogFrame = 0;
+	return ck_collideLogFile != NULL;
+}
+
+void CK_CollideLogClose(void)
+{
+	if (ck_collideLogFile)
+		fclose(ck_collideLogFile);
+	ck_collideLogFile = NULL;
+}
@@ -0,0 +1,55 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CK_COLLIDE_H
+#define CK_COLLIDE_H
+
+#include <stdbool.h>
+
+/*
+ * The object collision pass.
+ *
+ * Every pair of active, overlapping objects has its collide functions called,
+ * in list order: for each object, with each object after it. With lots of
+ * objects, a sweep over the objects sorted by their left edge (a broadphase)
+ * finds the overlapping pairs instead of testing all of them. It finds exactly
+ * the same pairs in exactly the same order, so demos stay in sync: after any
+ * collide function runs, everything could have moved, so the broadphase is
+ * rebuilt before it's used again.
+ */
+
+typedef enum CK_CollideMode
+{
+	CK_COLLIDE_AUTO,       // The broadphase once there are enough objects.
+	CK_COLLIDE_BRUTEFORCE, // Always test every pair (/NOBROADPHASE).
+	CK_COLLIDE_BROADPHASE  // Always use the broadphase (/BROADPHASE).
+} CK_CollideMode;
+
+extern CK_CollideMode ck_collideMode;
+
+// Runs the collision pass. Pairs are only logged if 'log' is set (they aren't
+// for run-ahead frames).
+void CK_CollideObjects(bool log);
+
+// Writes each frame's pairs to a text file (/COLLIDELOG), one line per frame,
+// so that the two modes can be compared.
+bool CK_CollideLogOpen(const char *fileName);
+void CK_CollideLogClose(void);
+
+#endif
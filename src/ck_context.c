@@ -0,0 +1,94 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+ * CK_CONTEXT: Holds the simulation state of each running game.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "id_ca.h"
+#include "id_in.h"
+#include "id_mm.h"
+#include "id_rf.h"
+#include "id_sd.h"
+#include "id_us.h"
+#include "ck_def.h"
+
+// The context the game itself runs in.
+static CK_Context ck_mainContext;
+
+// How many contexts CK_CreateContext has made that are still around.
+static int ck_numExtraContexts;
+
+CK_Context *ck_context = &ck_mainContext;
+RF_State *rf_state = &ck_mainContext.rf;
+CA_MapState *ca_mapState = &ck_mainContext.map;
+IN_Demo *in_demo = &ck_mainContext.demo;
+US_RndState *us_rndState = &ck_mainContext.rnd;
+SD_TimeState *volatile sd_timeState = &ck_mainContext.time;
+
+CK_Context *CK_CreateContext(void)
+{
+	CK_Context *ctx = (CK_Context *)calloc(1, sizeof(CK_Context));
+	if (!ctx)
+		Quit("CK_CreateContext: Out of memory!");
+	ctx->map.mapOn = -1;
+	if (!ck_numExtraContexts++)
+		CA_SetMapSharing(true);
+	return ctx;
+}
+
+// Frees a context, its copy of the map and its object and sprite pools. A
+// demo buffer it was playing back belongs to the caller, and is not freed.
+void CK_DestroyContext(CK_Context *ctx)
+{
+	if (!ctx || ctx == &ck_mainContext)
+		return;
+	if (ctx == ck_context)
+		CK_SetContext(NULL);
+	for (int plane = 0; plane < CA_NUMMAPPLANES; ++plane)
+	{
+		if (ctx->map.planes[plane])
+			MM_FreePtr((mm_ptr_t *)&ctx->map.planes[plane]);
+	}
+	free(ctx->objArray);
+	RF_FreeState(&ctx->rf);
+	free(ctx);
+	if (!--ck_numExtraContexts)
+		CA_SetMapSharing(false);
+}
+
+// Makes ctx the context the game code works on, or the main context if
+// ctx is NULL.
+void CK_SetContext(CK_Context *ctx)
+{
+	if (!ctx)
+		ctx = &ck_mainContext;
+	if (ctx == ck_context)
+		return;
+	ck_context = ctx;
+	rf_state = &ctx->rf;
+	ca_mapState = &ctx->map;
+	in_demo = &ctx->demo;
+	us_rndState = &ctx->rnd;
+	sd_timeState = &ctx->time;
+	RF_ScheduleRedraw();
+}
@@ -9,6 +9,12 @@
 #include <execinfo.h>
 #endif
 
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 void CK_PRINTF_FORMAT(2, 3) CK_Cross_LogMessage(CK_Log_Message_Class_T msgClass, const char *format, ...)
 {
 	// TODO: For now we simply do this.
@@ -47,6 +53,22 @@ void CK_Cross_StackTrace()
 
 #endif
 
+uint64_t CK_Cross_GetMicroseconds(void)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (uint64_t)count.QuadPart * 1000000 / (uint64_t)freq.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	return (uint64_t)clock() * 1000000 / CLOCKS_PER_SEC;
+#endif
+}
+
 void CK_Cross_puts(const char *str)
 {
 	// Reason for this wrapper: Maybe a different
@@ -74,6 +74,9 @@ typedef enum CK_Log_Message_Class_T
 // Used for debugging
 void CK_PRINTF_FORMAT(2, 3) CK_Cross_LogMessage(CK_Log_Message_Class_T msgClass, const char *format, ...);
 
+// A monotonic timestamp in microseconds, used for profiling and benchmarks
+uint64_t CK_Cross_GetMicroseconds(void);
+
 // Emulates the functionality of the "puts" function in text mode
 void CK_Cross_puts(const char *str);
 
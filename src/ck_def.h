@@ -23,6 +23,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <stdbool.h>
 
 #include "id_heads.h"
+#include "id_rf.h"
 #include "ck_ep.h"
 #include "ck_act.h"
 #include "ck_phys.h"
@@ -47,6 +48,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define MISCFLAG_LEFTELEVATOR 33
 #define MISCFLAG_RIGHTELEVATOR 34
 
+// The size of the original games' object array. Levels with more spawn
+// points than this get a bigger one (see CK_SizeObjArray), but the first
+// CK_MAX_OBJECTS objects are handed out as in the original.
 #define CK_MAX_OBJECTS 100
 
 // The "default" limit (beyond the edge of the screen) sprites remain active.
@@ -290,8 +294,6 @@ typedef struct CK_GameState
 	bool jumpCheat; // Is the jump cheat enabled? (Not in Keen5 gamestate struct)
 } CK_GameState;
 
-extern CK_GameState ck_gameState;
-
 typedef enum CK_ActionType
 {
 	AT_UnscaledOnce,  // Unscaled Motion, Thinks once.
@@ -392,11 +394,6 @@ typedef struct CK_object
 	struct CK_object *prev;
 } CK_object;
 
-extern CK_objPhysData ck_oldrects;
-extern CK_objPhysDataDelta ck_deltarects;
-extern int16_t ck_nextX;
-extern int16_t ck_nextY;
-
 typedef struct CK_keenState
 {
 	int jumpTimer;
@@ -412,8 +409,111 @@ typedef struct CK_keenState
 	CK_object *platform;
 } CK_keenState;
 
-extern CK_keenState ck_keenState;
-extern IN_ControlFrame ck_inputFrame;
+typedef struct CK_FlagPoint
+{
+	uint16_t x, y;
+} CK_FlagPoint;
+
+// Everything the simulation of a game depends on. The game itself runs in
+// the main context, but CK_CreateContext can make more, each of which can
+// be stepped independently in the same process once made current with
+// CK_SetContext. The library (ck_lib.c) makes one per environment, and
+// /CHECKCONTEXTS plays a demo in two at once to check that they match. The
+// assets (graphics, tile info, actions, map headers) are shared between all
+// of them.
+//
+// The screen, and the refresh manager's tile buffer and sprite erasers, are
+// shared too. Switching contexts makes the next refresh redraw all of them
+// (see RF_ScheduleRedraw), so the screen shows the context refreshed last.
+// The live input devices and sound are process-wide, so a context which is
+// playing back a demo doesn't depend on them. Contexts have to be stepped
+// one at a time, from one thread: the memory manager and the graphics cache
+// aren't thread-safe.
+//
+// The old global names (ck_gameState, rf_scrollXUnit, ca_mapOn, ...) are
+// now macros for the current context's members.
+typedef struct CK_Context
+{
+	CK_GameState gameState;
+	CK_keenState keenState;
+	IN_ControlFrame inputFrame;
+
+	// Allocated by CK_SizeObjArray, and only ever grown, so that pointers
+	// into it stay valid for as long as the size doesn't change.
+	CK_object *objArray;
+	int objArraySize;
+	int objArrayAllocated;
+	CK_object *freeObject;
+	CK_object *lastObject;
+	int numObjects;
+	CK_object *keenObj;
+	CK_object *scoreBoxObj;
+	CK_object tempObj; // Handed out when objArray is full
+
+	// The rectangle within which objects are active.
+	int activeX0Tile, activeY0Tile, activeX1Tile, activeY1Tile;
+	bool scrollDisabled;
+	int16_t invincibilityTimer;
+	int pogoTimer;
+	int16_t keenMoon;
+	int smashScreenDistance; // Keen 6 only
+
+	// Set up by CK_PhysUpdateNormalObj and friends
+	int16_t nextX, nextY;
+	bool keenIgnoreVertClip;
+	CK_objPhysData oldRects;
+	CK_objPhysDataDelta deltaRects;
+
+	// Set from when a game is loaded until play resumes in it
+	int startingSavedGame;
+	int lastLevelFinished;
+
+	// The path of a flag thrown onto the world map (Keen 4 and 6)
+	CK_FlagPoint flagPoints[30];
+	int flagTileSpotX, flagTileSpotY;
+
+	RF_State rf;
+	CA_MapState map;
+	IN_Demo demo;
+	US_RndState rnd;
+	SD_TimeState time;
+} CK_Context;
+
+extern CK_Context *ck_context;
+
+CK_Context *CK_CreateContext(void);
+void CK_DestroyContext(CK_Context *ctx);
+void CK_SetContext(CK_Context *ctx);
+
+#define ck_gameState (ck_context->gameState)
+#define ck_keenState (ck_context->keenState)
+#define ck_inputFrame (ck_context->inputFrame)
+#define ck_objArray (ck_context->objArray)
+#define ck_objArraySize (ck_context->objArraySize)
+#define ck_freeObject (ck_context->freeObject)
+#define ck_lastObject (ck_context->lastObject)
+#define ck_numObjects (ck_context->numObjects)
+#define ck_keenObj (ck_context->keenObj)
+#define ck_scoreBoxObj (ck_context->scoreBoxObj)
+#define ck_activeX0Tile (ck_context->activeX0Tile)
+#define ck_activeY0Tile (ck_context->activeY0Tile)
+#define ck_activeX1Tile (ck_context->activeX1Tile)
+#define ck_activeY1Tile (ck_context->activeY1Tile)
+#define ck_scrollDisabled (ck_context->scrollDisabled)
+#define ck_invincibilityTimer (ck_context->invincibilityTimer)
+#define ck_pogoTimer (ck_context->pogoTimer)
+#define ck_keenMoon (ck_context->keenMoon)
+#define ck6_smashScreenDistance (ck_context->smashScreenDistance)
+#define ck_nextX (ck_context->nextX)
+#define ck_nextY (ck_context->nextY)
+#define ck_keenIgnoreVertClip (ck_context->keenIgnoreVertClip)
+#define ck_oldRects (ck_context->oldRects)
+#define ck_deltaRects (ck_context->deltaRects)
+#define ck_startingSavedGame (ck_context->startingSavedGame)
+#define ck_lastLevelFinished (ck_context->lastLevelFinished)
+#define ck_flagPoints (ck_context->flagPoints)
+#define ck_flagTileSpotX (ck_context->flagTileSpotX)
+#define ck_flagTileSpotY (ck_context->flagTileSpotY)
 
 typedef struct CK_HighScore
 {
@@ -438,7 +538,6 @@ void CK_NewGame(void);
 void CK_ExitMenu(void);
 
 /* ck_inter.c */
-extern int ck_startingSavedGame;
 extern bool ck_inHighScores;
 
 typedef struct introbmptypestruct
@@ -460,6 +559,7 @@ void CK_SubmitHighScore(int score, uint16_t arg4);
 void CK_DoHighScores();
 
 /* ck_game.c */
+extern CK_Difficulty ck_demoDifficulty;
 bool CK_SaveGame(FS_File fp);
 bool CK_LoadGame(FS_File fp, bool fromMenu);
 
@@ -471,8 +571,6 @@ extern chunk_id_t ck_itemShadows[];
 void CK_IncreaseScore(int score);
 void CK_KillKeen();
 
-extern CK_object *ck_keenObj;
-
 void CK_OBJ_SetupFunctions();
 
 /* ck_main.c */
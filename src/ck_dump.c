@@ -0,0 +1,396 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "id_fs.h"
+#include "id_sd.h"
+#include "ck_cross.h"
+#include "ck_def.h"
+#include "ck_dump.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CK_ENABLE_PLAYLOOP_DUMPER
+
+bool CK_SaveObject(FS_File fp, CK_object *o);
+bool CK_SaveGameState(FS_File fp, CK_GameState *state);
+
+// Enough for the time count, the game state and all of the objects.
+#define CK_DUMP_MAX_RECORD 8192
+#define CK_DUMP_OBJ_WORDS 38
+
+/*
+ * Dump files come in two formats. The original one, which tools/kdumper also
+ * writes, is just one record after another, each made of the time count
+ * (32 bits), the game state and every object, as saved by CK_SaveGameState
+ * and CK_SaveObject. Like the original games', they have CK_MAX_OBJECTS
+ * objects, so on maps with a bigger object array only the first ones are
+ * dumped.
+ *
+ * The compact format (v2) is used for file names ending in .ckdump. Its
+ * 16-byte header is:
+ *   "CKDUMP2\0", episode (4-6), game state words, objects, words per object,
+ * all 16-bit. Every record starts with a type byte and a 32-bit payload
+ * length. Frame payloads start with the time count:
+ *   'K' (keyframe) - the payload is a whole record in the original format.
+ *   'D' (delta) - after the time count, every block (0 being the game state,
+ *   n being object n-1) which changed since the previous frame is stored as
+ *   its 16-bit number, a 64-bit mask of the words which changed, and those
+ *   words. The list ends with block 0xFFFF.
+ * There is a keyframe every CK_DUMP_KEYFRAME_INTERVAL frames. When the file
+ * is closed, an 'I' record with an index of the keyframes (the count, then
+ * the frame number and file offset of each) is appended, followed by the
+ * offset of that record and "CKDIDX2\0". All values are little-endian.
+ */
+#define CK_DUMP_KEYFRAME_INTERVAL 64
+#define CK_DUMP_END_BLOCK 0xFFFF
+
+typedef struct CK_DumpIndexEntry
+{
+	uint32_t frame;
+	uint32_t offset;
+} CK_DumpIndexEntry;
+
+static FILE *ck_dumpFile;
+static bool ck_dumpCompact;
+static long ck_dumpFrames;
+static uint8_t ck_dumpPrevRecord[CK_DUMP_MAX_RECORD];
+static uint8_t ck_dumpDelta[CK_DUMP_MAX_RECORD * 2];
+static CK_DumpIndexEntry *ck_dumpIndex;
+static int ck_dumpIndexSize, ck_dumpIndexCapacity;
+
+// Each frame is written to a memory buffer, to be verified or delta-encoded.
+static FILE *ck_dumpRecordFile;
+static uint8_t ck_dumpRecord[CK_DUMP_MAX_RECORD];
+
+// When verifying, each frame is compared with the next record of the
+// reference dump.
+static FILE *ck_verifyFile;
+static const char *ck_verifyFileName;
+static uint8_t ck_verifyReference[CK_DUMP_MAX_RECORD];
+static long ck_verifyFrames;
+
+static const char *ck_dumpObjFieldNames[CK_DUMP_OBJ_WORDS] = {
+	"type", "active", "visible", "clipped", "timeUntillThink", "posX", "posY",
+	"xDirection", "yDirection", "deltaPosX", "deltaPosY", "velX", "velY",
+	"actionTimer", "currentAction", "gfxChunk", "zLayer",
+	"clipRects.unitX1", "clipRects.unitY1", "clipRects.unitX2", "clipRects.unitY2", "clipRects.unitXmid",
+	"clipRects.tileX1", "clipRects.tileY1", "clipRects.tileX2", "clipRects.tileY2", "clipRects.tileXmid",
+	"topTI", "rightTI", "bottomTI", "leftTI",
+	"user1", "user2", "user3", "user4", "sde", "next", "prev"};
+
+static void CK_OpenDumpRecordBuffer(void)
+{
+	if (ck_dumpRecordFile)
+		return;
+#ifdef _WIN32
+	ck_dumpRecordFile = tmpfile();
+#else
+	ck_dumpRecordFile = fmemopen(ck_dumpRecord, sizeof(ck_dumpRecord), "wb");
+#endif
+	if (!ck_dumpRecordFile)
+		Quit("Couldn't create the dump record buffer!");
+}
+
+bool CK_DumpOpen(const char *fileName)
+{
+	size_t nameLen = strlen(fileName);
+	ck_dumpFile = fopen(fileName, "wb");
+	if (!ck_dumpFile)
+		return false;
+	ck_dumpCompact = nameLen >= 7 && !CK_Cross_strcasecmp(fileName + nameLen - 7, ".ckdump");
+	ck_dumpFrames = 0;
+	ck_dumpIndexSize = 0;
+	CK_OpenDumpRecordBuffer();
+	return true;
+}
+
+bool CK_VerifyDumpOpen(const char *fileName)
+{
+	ck_verifyFile = fopen(fileName, "rb");
+	if (!ck_verifyFile)
+		return false;
+	CK_OpenDumpRecordBuffer();
+	ck_verifyFileName = fileName;
+	ck_verifyFrames = 0;
+	return true;
+}
+
+static bool CK_WriteDumpRecord(FILE *fp)
+{
+	uint32_t timecountToDump = SD_GetTimeCount();
+	if (FS_WriteInt32LE(&timecountToDump, 1, fp) != 1)
+		return false;
+	if (!CK_SaveGameState(fp, &ck_gameState))
+		return false;
+	for (CK_object *currentObj = &ck_objArray[0]; currentObj != &ck_objArray[CK_MAX_OBJECTS]; ++currentObj)
+	{
+		if (!CK_SaveObject(fp, currentObj))
+			return false;
+	}
+	return true;
+}
+
+// Writes the current frame to ck_dumpRecord, returning its length.
+static size_t CK_DumpRecordToMemory(void)
+{
+	rewind(ck_dumpRecordFile);
+	if (!CK_WriteDumpRecord(ck_dumpRecordFile) || fflush(ck_dumpRecordFile))
+		Quit("Couldn't write a dump record to memory!");
+	size_t len = (size_t)ftell(ck_dumpRecordFile);
+#ifdef _WIN32
+	rewind(ck_dumpRecordFile);
+	if (fread(ck_dumpRecord, 1, len, ck_dumpRecordFile) != len)
+		Quit("Couldn't read a dump record back!");
+#endif
+	return len;
+}
+
+static void CK_PutLE16(uint8_t **p, uint16_t val)
+{
+	*(*p)++ = val & 0xFF;
+	*(*p)++ = val >> 8;
+}
+
+static void CK_PutLE32(uint8_t **p, uint32_t val)
+{
+	CK_PutLE16(p, val & 0xFFFF);
+	CK_PutLE16(p, val >> 16);
+}
+
+static uint16_t CK_GetLE16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static void CK_WriteCompactHeader(size_t len)
+{
+	static const char magic[8] = {'C', 'K', 'D', 'U', 'M', 'P', '2', '\0'};
+	uint16_t header[4];
+	header[0] = 4 + (ck_currentEpisode->ep - EP_CK4);
+	header[1] = (len - 4) / 2 - CK_MAX_OBJECTS * CK_DUMP_OBJ_WORDS;
+	header[2] = CK_MAX_OBJECTS;
+	header[3] = CK_DUMP_OBJ_WORDS;
+	fwrite(magic, 1, sizeof(magic), ck_dumpFile);
+	FS_WriteInt16LE(header, 4, ck_dumpFile);
+}
+
+static void CK_WriteCompactRecord(uint8_t type, const uint8_t *payload, size_t len)
+{
+	uint32_t payloadLen = len;
+	fwrite(&type, 1, 1, ck_dumpFile);
+	FS_WriteInt32LE(&payloadLen, 1, ck_dumpFile);
+	fwrite(payload, 1, len, ck_dumpFile);
+}
+
+static void CK_WriteCompactFrame(size_t len)
+{
+	if (ck_dumpFrames == 0)
+		CK_WriteCompactHeader(len);
+
+	if (ck_dumpFrames % CK_DUMP_KEYFRAME_INTERVAL == 0)
+	{
+		if (ck_dumpIndexSize == ck_dumpIndexCapacity)
+		{
+			ck_dumpIndexCapacity = ck_dumpIndexCapacity ? ck_dumpIndexCapacity * 2 : 256;
+			ck_dumpIndex = (CK_DumpIndexEntry *)realloc(ck_dumpIndex, ck_dumpIndexCapacity * sizeof(CK_DumpIndexEntry));
+			if (!ck_dumpIndex)
+				Quit("Couldn't allocate the dump index!");
+		}
+		ck_dumpIndex[ck_dumpIndexSize].frame = ck_dumpFrames;
+		ck_dumpIndex[ck_dumpIndexSize].offset = ftell(ck_dumpFile);
+		ck_dumpIndexSize++;
+		CK_WriteCompactRecord('K', ck_dumpRecord, len);
+	}
+	else
+	{
+		int gameStateWords = (len - 4) / 2 - CK_MAX_OBJECTS * CK_DUMP_OBJ_WORDS;
+		uint8_t *p = ck_dumpDelta;
+		memcpy(p, ck_dumpRecord, 4);
+		p += 4;
+		for (int block = 0; block <= CK_MAX_OBJECTS; ++block)
+		{
+			int words = block ? CK_DUMP_OBJ_WORDS : gameStateWords;
+			size_t start = block ? 4 + 2 * (gameStateWords + (block - 1) * CK_DUMP_OBJ_WORDS) : 4;
+			uint64_t mask = 0;
+			for (int i = 0; i < words; ++i)
+				if (memcmp(ck_dumpRecord + start + 2 * i, ck_dumpPrevRecord + start + 2 * i, 2))
+					mask |= (uint64_t)1 << i;
+			if (!mask)
+				continue;
+			CK_PutLE16(&p, block);
+			CK_PutLE32(&p, mask & 0xFFFFFFFF);
+			CK_PutLE32(&p, mask >> 32);
+			for (int i = 0; i < words; ++i)
+				if (mask & ((uint64_t)1 << i))
+					CK_PutLE16(&p, CK_GetLE16(ck_dumpRecord + start + 2 * i));
+		}
+		CK_PutLE16(&p, CK_DUMP_END_BLOCK);
+		CK_WriteCompactRecord('D', ck_dumpDelta, p - ck_dumpDelta);
+	}
+	memcpy(ck_dumpPrevRecord, ck_dumpRecord, len);
+}
+
+static void CK_WriteCompactIndex(void)
+{
+	static const char magic[8] = {'C', 'K', 'D', 'I', 'D', 'X', '2', '\0'};
+	uint8_t type = 'I';
+	uint32_t indexOffset = ftell(ck_dumpFile);
+	uint32_t payloadLen = 4 + 8 * ck_dumpIndexSize;
+	uint32_t count = ck_dumpIndexSize;
+	fwrite(&type, 1, 1, ck_dumpFile);
+	FS_WriteInt32LE(&payloadLen, 1, ck_dumpFile);
+	FS_WriteInt32LE(&count, 1, ck_dumpFile);
+	for (int i = 0; i < ck_dumpIndexSize; ++i)
+	{
+		FS_WriteInt32LE(&ck_dumpIndex[i].frame, 1, ck_dumpFile);
+		FS_WriteInt32LE(&ck_dumpIndex[i].offset, 1, ck_dumpFile);
+	}
+	FS_WriteInt32LE(&indexOffset, 1, ck_dumpFile);
+	fwrite(magic, 1, sizeof(magic), ck_dumpFile);
+}
+
+// Names the 16-bit word at the given index of a dumped game state.
+static void CK_DumpGameStateFieldName(int word, char *name, size_t len)
+{
+	int epWords = (ck_currentEpisode->ep == EP_CK4) ? 2 : (ck_currentEpisode->ep == EP_CK5) ? 3 : 4;
+	static const char *ck4Names[] = {"wetsuit", "membersRescued"};
+	static const char *ck5Names[] = {"securityCard", "word_4729C", "fusesRemaining"};
+	static const char *ck6Names[] = {"sandwich", "rope", "passcard", "inRocket"};
+	static const char *tailNames[] = {"currentLevel", "numLives", "difficulty", "platform"};
+
+	if (word < 2)
+		snprintf(name, len, word ? "mapPosY" : "mapPosX");
+	else if ((word -= 2) < 25)
+		snprintf(name, len, "levelsDone[%d]", word);
+	else if ((word -= 25) < 4)
+		snprintf(name, len, "%s (%s word)", (word < 2) ? "keenScore" : "nextKeenAt", (word & 1) ? "high" : "low");
+	else if ((word -= 4) < 2)
+		snprintf(name, len, word ? "numCentilife" : "numShots");
+	else if ((word -= 2) < epWords)
+		snprintf(name, len, "ep.%s",
+			(ck_currentEpisode->ep == EP_CK4) ? ck4Names[word] : (ck_currentEpisode->ep == EP_CK5) ? ck5Names[word] : ck6Names[word]);
+	else if ((word -= epWords) < 4)
+		snprintf(name, len, "keyGems[%d]", word);
+	else if ((word -= 4) < 4)
+		snprintf(name, len, "%s", tailNames[word]);
+	else
+		snprintf(name, len, "word %d", word);
+}
+
+// Prints every field which differs between the frame and the reference.
+static void CK_PrintDumpMismatch(size_t len)
+{
+	size_t objStart = len - CK_MAX_OBJECTS * CK_DUMP_OBJ_WORDS * 2;
+	uint32_t timecount, refTimecount;
+	char name[64];
+
+	memcpy(&timecount, ck_dumpRecord, 4);
+	memcpy(&refTimecount, ck_verifyReference, 4);
+	timecount = CK_Cross_SwapLE32(timecount);
+	refTimecount = CK_Cross_SwapLE32(refTimecount);
+	CK_Cross_LogMessage(CK_LOG_MSG_ERROR, "Dump mismatch with %s at frame %ld:\n", ck_verifyFileName, ck_verifyFrames);
+	if (timecount != refTimecount)
+		CK_Cross_LogMessage(CK_LOG_MSG_ERROR, "  Timecount: %08X, expected %08X\n", timecount, refTimecount);
+
+	for (size_t offset = 4; offset + 1 < len; offset += 2)
+	{
+		uint16_t val = CK_GetLE16(ck_dumpRecord + offset);
+		uint16_t ref = CK_GetLE16(ck_verifyReference + offset);
+		if (val == ref)
+			continue;
+		if (offset < objStart)
+		{
+			CK_DumpGameStateFieldName((offset - 4) / 2, name, sizeof(name));
+			CK_Cross_LogMessage(CK_LOG_MSG_ERROR, "  Gamestate %s: %04X, expected %04X\n", name, val, ref);
+		}
+		else
+		{
+			int word = (offset - objStart) / 2;
+			CK_Cross_LogMessage(CK_LOG_MSG_ERROR, "  Obj %02X %s: %04X, expected %04X\n",
+				word / CK_DUMP_OBJ_WORDS, ck_dumpObjFieldNames[word % CK_DUMP_OBJ_WORDS], val, ref);
+		}
+	}
+}
+
+static void CK_VerifyDumpFrame(size_t len)
+{
+	if (fread(ck_verifyReference, 1, len, ck_verifyFile) != len)
+	{
+		CK_Cross_LogMessage(CK_LOG_MSG_ERROR, "Dump mismatch with %s: the reference ends at frame %ld\n",
+			ck_verifyFileName, ck_verifyFrames);
+		Quit("Dump verification failed!");
+	}
+	if (memcmp(ck_dumpRecord, ck_verifyReference, len))
+	{
+		CK_PrintDumpMismatch(len);
+		Quit("Dump verification failed!");
+	}
+	ck_verifyFrames++;
+}
+
+void CK_DumpFrame(void)
+{
+	if (!ck_dumpFile && !ck_verifyFile)
+		return;
+
+	size_t len = CK_DumpRecordToMemory();
+	if (ck_dumpFile)
+	{
+		if (ck_dumpCompact)
+			CK_WriteCompactFrame(len);
+		else
+			fwrite(ck_dumpRecord, 1, len, ck_dumpFile);
+		ck_dumpFrames++;
+	}
+	if (ck_verifyFile)
+		CK_VerifyDumpFrame(len);
+}
+
+void CK_DumpClose(void)
+{
+	if (ck_dumpFile)
+	{
+		if (ck_dumpCompact)
+			CK_WriteCompactIndex();
+		fclose(ck_dumpFile);
+	}
+	ck_dumpFile = NULL;
+	free(ck_dumpIndex);
+	ck_dumpIndex = NULL;
+	ck_dumpIndexCapacity = 0;
+
+	if (ck_verifyFile)
+	{
+		FILE *reference = ck_verifyFile;
+		ck_verifyFile = NULL;
+		bool leftOver = fgetc(reference) != EOF;
+		fclose(reference);
+		if (leftOver)
+		{
+			CK_Cross_LogMessage(CK_LOG_MSG_ERROR, "Dump mismatch with %s: the demo ended at frame %ld\n",
+				ck_verifyFileName, ck_verifyFrames);
+			Quit("Dump verification failed!");
+		}
+		CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "Dump matched %s (%ld frames)\n", ck_verifyFileName, ck_verifyFrames);
+	}
+}
+
+#endif
@@ -0,0 +1,42 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CK_DUMP_H
+#define CK_DUMP_H
+
+#include <stdbool.h>
+
+/*
+ * The playloop dumper, in builds with CK_ENABLE_PLAYLOOP_DUMPER.
+ *
+ * Every frame, the time count, the game state and every object are written
+ * out in the same format as the DOS dumper (see tools/kdumper), either to a
+ * file (/DUMPFILE) or, to check for demo desyncs, compared with a reference
+ * dump (/VERIFYDUMP).
+ */
+
+bool CK_DumpOpen(const char *fileName);
+bool CK_VerifyDumpOpen(const char *fileName);
+// Writes or verifies the current frame. A mismatch is fatal.
+void CK_DumpFrame(void);
+// Finishes the dump. When verifying, it's fatal for the reference to have
+// frames left over.
+void CK_DumpClose(void);
+
+#endif
@@ -42,10 +42,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 // =========================================================================
 
-static int ck_lastLevelFinished;
-
-// =========================================================================
-
 // Purge stuff for endgame
 void CK_EndingPurge()
 {
@@ -311,6 +307,54 @@ static bool CK_LoadGameState(FS_File fp, CK_GameState *state)
 	return true;
 }
 
+// Saved games from maps too big for the original format, either because
+// objects past the first CK_MAX_OBJECTS are in use, or because a plane is
+// 64K or more, use an extended one. It starts with CK_EXTSAVE_MARKER where
+// the first plane's compressed size would be, which as it's odd, never is,
+// followed by the version and the size of the object array. The planes'
+// sizes are 32-bit, and each object is preceded by its index, so that it can
+// be put back where it was, keeping the 16-bit offsets of objects valid.
+#define CK_EXTSAVE_MARKER 0xFFFF
+#define CK_EXTSAVE_VERSION 1
+
+static bool CK_NeedsExtendedSave(void)
+{
+	if ((size_t)CA_GetMapWidth() * CA_GetMapHeight() * 2 > 0xFFFF)
+		return true;
+	for (CK_object *obj = ck_keenObj; obj != NULL; obj = obj->next)
+		if (obj >= ck_objArray + CK_MAX_OBJECTS)
+			return true;
+	return false;
+}
+
+static bool CK_SaveGameExtended(FS_File fp)
+{
+	uint16_t header[3] = {CK_EXTSAVE_MARKER, CK_EXTSAVE_VERSION, (uint16_t)ck_objArraySize};
+	size_t bufsize = (size_t)CA_GetMapWidth() * CA_GetMapHeight() * 2;
+	uint8_t *buf;
+	bool ok;
+
+	if (FS_WriteInt16LE(header, 3, fp) != 3)
+		return false;
+
+	// Each word can take up to three when compressed.
+	MM_GetPtr((mm_ptr_t *)&buf, bufsize * 3);
+	ok = true;
+	for (int i = 0; ok && i < 3; i++)
+	{
+		uint32_t cmplen = CAL_RLEWCompress(CA_TilePtrAtPos(0, 0, i), bufsize, buf, 0xABCD);
+		ok = (FS_WriteInt32LE(&cmplen, 1, fp) == 1) && (FS_WriteInt16LE(buf, cmplen / 2, fp) == cmplen / 2);
+	}
+	MM_FreePtr((mm_ptr_t *)&buf);
+
+	for (CK_object *obj = ck_keenObj; ok && obj != NULL; obj = obj->next)
+	{
+		uint16_t index = obj - ck_objArray;
+		ok = (FS_WriteInt16LE(&index, 1, fp) == 1) && CK_SaveObject(fp, obj);
+	}
+	return ok;
+}
+
 bool CK_SaveGame(FS_File fp)
 {
 	int i;
@@ -325,6 +369,9 @@ bool CK_SaveGame(FS_File fp)
 	if (!CK_SaveGameState(fp, &ck_gameState))
 		return false;
 
+	if (CK_NeedsExtendedSave())
+		return CK_SaveGameExtended(fp);
+
 	bufsize = CA_GetMapWidth() * CA_GetMapHeight() * 2;
 	MM_GetPtr((mm_ptr_t *)&buf, bufsize);
 
@@ -360,10 +407,49 @@ bool CK_SaveGame(FS_File fp)
 	return true;
 }
 
+// Reads the rest of the header, and the planes, of an extended saved game.
+static bool CK_LoadGameExtendedLevel(FS_File fp)
+{
+	uint16_t header[2];
+	size_t bufsize = (size_t)CA_GetMapWidth() * CA_GetMapHeight() * 2;
+	uint8_t *buf;
+	bool ok;
+
+	if (FS_ReadInt16LE(header, 2, fp) != 2 || header[0] != CK_EXTSAVE_VERSION)
+		return false;
+
+	// The objects go back where they were, so the array has to be as big.
+	if (header[1] > ck_objArraySize)
+		CK_SizeObjArray(header[1]);
+	if (header[1] > ck_objArraySize)
+		return false;
+
+	MM_GetPtr((mm_ptr_t *)&buf, bufsize * 3);
+	ok = true;
+	for (int i = 0; ok && i < 3; i++)
+	{
+		uint32_t cmplen;
+		ok = (FS_ReadInt32LE(&cmplen, 1, fp) == 1) && (cmplen <= bufsize * 3) &&
+			(FS_ReadInt16LE(buf, cmplen / 2, fp) == cmplen / 2);
+		if (ok)
+			CAL_RLEWExpand(buf, CA_TilePtrAtPos(0, 0, i), bufsize, 0xABCD);
+	}
+	MM_FreePtr((mm_ptr_t *)&buf);
+	return ok;
+}
+
+// Reads the index of the next object of an extended saved game, or returns -1.
+static int CK_LoadGameExtendedIndex(FS_File fp)
+{
+	uint16_t index;
+	return (FS_ReadInt16LE(&index, 1, fp) == 1) ? index : -1;
+}
+
 bool CK_LoadGame(FS_File fp, bool fromMenu)
 {
 	int i;
 	uint16_t cmplen, bufsize;
+	bool extended;
 	int16_t prevFuses = 0;
 	CK_object *objprev, *objnext, *moreObj;
 	uint8_t *buf;
@@ -402,47 +488,60 @@ bool CK_LoadGame(FS_File fp, bool fromMenu)
 		CK_LoadLevel(true, true);
 	}
 
-	bufsize = CA_GetMapWidth() * CA_GetMapHeight() * 2;
-	// MM_BombOnError(true) // TODO
-	MM_GetPtr((mm_ptr_t *)&buf, bufsize);
-	// TODO
-	/*
-	MM_BombOnError(false)
-	if (mmerror)
-	{
-		mmerror = false;
-		US_CenterWindow(20, 8);
-		US_SetPrintY(20);
-		US_Print("Not enough memory\nto load game!");
-		VH_UpdateScreen();
-		IN_Ack();
+	/* Decompress and load the level */
+	if (FS_ReadInt16LE(&cmplen, 1, fp) != 1)
 		return false;
+	extended = (cmplen == CK_EXTSAVE_MARKER);
+	if (extended)
+	{
+		if (!CK_LoadGameExtendedLevel(fp))
+			return false;
 	}
-*/
-	/* Decompress and load the level */
-	for (i = 0; i < 3; i++)
+	else
 	{
-		if (FS_ReadInt16LE(&cmplen, 1, fp) != 1)
+		bufsize = CA_GetMapWidth() * CA_GetMapHeight() * 2;
+		// MM_BombOnError(true) // TODO
+		MM_GetPtr((mm_ptr_t *)&buf, bufsize);
+		// TODO
+		/*
+		MM_BombOnError(false)
+		if (mmerror)
 		{
-			MM_FreePtr((mm_ptr_t *)&buf);
+			mmerror = false;
+			US_CenterWindow(20, 8);
+			US_SetPrintY(20);
+			US_Print("Not enough memory\nto load game!");
+			VH_UpdateScreen();
+			IN_Ack();
 			return false;
 		}
-		cmplen /= 2;
-		if (FS_ReadInt16LE(buf, cmplen, fp) != cmplen)
+		*/
+		for (i = 0; i < 3; i++)
 		{
-			MM_FreePtr((mm_ptr_t *)&buf);
-			return false;
+			if (i && FS_ReadInt16LE(&cmplen, 1, fp) != 1)
+			{
+				MM_FreePtr((mm_ptr_t *)&buf);
+				return false;
+			}
+			cmplen /= 2;
+			if (FS_ReadInt16LE(buf, cmplen, fp) != cmplen)
+			{
+				MM_FreePtr((mm_ptr_t *)&buf);
+				return false;
+			}
+
+			CAL_RLEWExpand(buf, CA_TilePtrAtPos(0, 0, i), bufsize, 0xABCD);
 		}
 
-		CAL_RLEWExpand(buf, CA_TilePtrAtPos(0, 0, i), bufsize, 0xABCD);
+		MM_FreePtr((mm_ptr_t *)&buf);
 	}
 
-	MM_FreePtr((mm_ptr_t *)&buf);
-
 	CK_SetupObjArray();
 	CK_object *newObj = ck_keenObj;
 
 	/* Read the first object (keen) from the list */
+	if (extended && CK_LoadGameExtendedIndex(fp) != newObj - ck_objArray)
+		return false;
 	objprev = newObj->prev;
 	objnext = newObj->next;
 	if (!CK_LoadObject(fp, newObj))
@@ -453,6 +552,8 @@ bool CK_LoadGame(FS_File fp, bool fromMenu)
 	newObj->visible = true;
 	newObj->sde = NULL;
 	newObj = ck_scoreBoxObj;
+	if (extended && CK_LoadGameExtendedIndex(fp) != newObj - ck_objArray)
+		return false;
 
 	while (1)
 	{
@@ -494,7 +595,12 @@ bool CK_LoadGame(FS_File fp, bool fromMenu)
 			break;
 
 		/* Otherwise we add a new object */
-		newObj = CK_GetNewObj(false);
+		if (extended)
+			newObj = CK_GetObjAtIndex(CK_LoadGameExtendedIndex(fp));
+		else
+			newObj = CK_GetNewObj(false);
+		if (!newObj)
+			return false;
 	}
 
 	ck_scoreBoxObj->user1 = -1;
@@ -508,6 +614,159 @@ bool CK_LoadGame(FS_File fp, bool fromMenu)
 	return true;
 }
 
+// In-memory savestates. Unlike CK_SaveGame/CK_LoadGame, these do no I/O and
+// no compression, and simply copy the simulation state into (and out of) a
+// caller-provided blob. Objects keep their raw pointers into the context's
+// object and sprite tables, and into the action tables, so a snapshot can
+// only be restored into the context it was taken from, and can't be carried
+// between runs. It is also only valid for the map which was loaded when it
+// was taken, and only while those tables haven't been grown (and so moved)
+// for a bigger map.
+
+typedef struct CK_Snapshot
+{
+	uint32_t size;
+	int16_t mapNumber;
+	int mapWidth, mapHeight;
+
+	CK_object *objArray; // Where the objects were
+	int objArraySize;
+	CK_object *freeObject;
+	CK_object *lastObject;
+	CK_object *keenObj;
+	CK_object *scoreBoxObj;
+	int numObjects;
+	int activeX0Tile, activeY0Tile, activeX1Tile, activeY1Tile;
+
+	CK_GameState gameState;
+	CK_keenState keenState;
+	IN_ControlFrame inputFrame;
+	int16_t invincibilityTimer;
+	int pogoTimer;
+	int16_t keenMoon;
+	int smashScreenDistance;
+	bool scrollDisabled;
+
+	int rndIndex;
+	IN_DemoSnapshot demo;
+	uint32_t timeCount;
+	int32_t lastTimeCount;
+	uint16_t spriteSync;
+
+	// Followed by the objects, the RF state and the three map planes.
+} CK_Snapshot;
+
+static size_t CK_SnapshotPlaneSize()
+{
+	return (size_t)CA_GetMapWidth() * CA_GetMapHeight() * 2;
+}
+
+size_t CK_SnapshotSize(void)
+{
+	return sizeof(CK_Snapshot) + ck_objArraySize * sizeof(CK_object) + RF_SnapshotSize() + 3 * CK_SnapshotPlaneSize();
+}
+
+bool CK_SnapshotState(void *buf, size_t size)
+{
+	CK_Snapshot *snap = (CK_Snapshot *)buf;
+	size_t planeSize = CK_SnapshotPlaneSize();
+	if (size < CK_SnapshotSize())
+		return false;
+
+	snap->size = (uint32_t)CK_SnapshotSize();
+	snap->mapNumber = ca_mapOn;
+	snap->mapWidth = CA_GetMapWidth();
+	snap->mapHeight = CA_GetMapHeight();
+
+	snap->objArray = ck_objArray;
+	snap->objArraySize = ck_objArraySize;
+	snap->freeObject = ck_freeObject;
+	snap->lastObject = ck_lastObject;
+	snap->keenObj = ck_keenObj;
+	snap->scoreBoxObj = ck_scoreBoxObj;
+	snap->numObjects = ck_numObjects;
+	snap->activeX0Tile = ck_activeX0Tile;
+	snap->activeY0Tile = ck_activeY0Tile;
+	snap->activeX1Tile = ck_activeX1Tile;
+	snap->activeY1Tile = ck_activeY1Tile;
+
+	snap->gameState = ck_gameState;
+	snap->keenState = ck_keenState;
+	snap->inputFrame = ck_inputFrame;
+	snap->invincibilityTimer = ck_invincibilityTimer;
+	snap->pogoTimer = ck_pogoTimer;
+	snap->keenMoon = ck_keenMoon;
+	snap->smashScreenDistance = ck6_smashScreenDistance;
+	snap->scrollDisabled = ck_scrollDisabled;
+
+	snap->rndIndex = US_GetRndI();
+	IN_DemoGetSnapshot(&snap->demo);
+	snap->timeCount = SD_GetTimeCount();
+	snap->lastTimeCount = SD_GetLastTimeCount();
+	snap->spriteSync = SD_GetSpriteSync();
+
+	uint8_t *tail = (uint8_t *)(snap + 1);
+	memcpy(tail, ck_objArray, ck_objArraySize * sizeof(CK_object));
+	tail += ck_objArraySize * sizeof(CK_object);
+	RF_SnapshotState(tail);
+	tail += RF_SnapshotSize();
+	for (int plane = 0; plane < 3; ++plane, tail += planeSize)
+		memcpy(tail, CA_TilePtrAtPos(0, 0, plane), planeSize);
+
+	return true;
+}
+
+bool CK_RestoreState(const void *buf, size_t size)
+{
+	const CK_Snapshot *snap = (const CK_Snapshot *)buf;
+	size_t planeSize = CK_SnapshotPlaneSize();
+	if (size < sizeof(CK_Snapshot) || snap->size != CK_SnapshotSize() || size < snap->size)
+		return false;
+	if (snap->mapNumber != ca_mapOn || snap->mapWidth != CA_GetMapWidth() || snap->mapHeight != CA_GetMapHeight())
+		return false;
+	// The objects point at each other, so can't have moved.
+	if (snap->objArray != ck_objArray || snap->objArraySize != ck_objArraySize)
+		return false;
+
+	const uint8_t *tail = (const uint8_t *)(snap + 1);
+	const uint8_t *objects = tail;
+	tail += ck_objArraySize * sizeof(CK_object);
+	if (!RF_RestoreState(tail))
+		return false;
+	tail += RF_SnapshotSize();
+
+	memcpy(ck_objArray, objects, ck_objArraySize * sizeof(CK_object));
+	ck_freeObject = snap->freeObject;
+	ck_lastObject = snap->lastObject;
+	ck_keenObj = snap->keenObj;
+	ck_scoreBoxObj = snap->scoreBoxObj;
+	ck_numObjects = snap->numObjects;
+	ck_activeX0Tile = snap->activeX0Tile;
+	ck_activeY0Tile = snap->activeY0Tile;
+	ck_activeX1Tile = snap->activeX1Tile;
+	ck_activeY1Tile = snap->activeY1Tile;
+
+	ck_gameState = snap->gameState;
+	ck_keenState = snap->keenState;
+	ck_inputFrame = snap->inputFrame;
+	ck_invincibilityTimer = snap->invincibilityTimer;
+	ck_pogoTimer = snap->pogoTimer;
+	ck_keenMoon = snap->keenMoon;
+	ck6_smashScreenDistance = snap->smashScreenDistance;
+	ck_scrollDisabled = snap->scrollDisabled;
+
+	US_SetRndI(snap->rndIndex);
+	IN_DemoRestoreSnapshot(&snap->demo);
+	SD_SetTimeCount(snap->timeCount);
+	SD_SetLastTimeCount(snap->lastTimeCount);
+	SD_SetSpriteSync(snap->spriteSync);
+
+	for (int plane = 0; plane < 3; ++plane, tail += planeSize)
+		memcpy(CA_TilePtrAtPos(0, 0, plane), tail, planeSize);
+
+	return true;
+}
+
 //TODO: KillKeen
 
 void CK_ExitMenu(void)
@@ -582,15 +841,19 @@ void CK_BeginFadeDrawing(void)
 	RF_SetDrawFunc(&CK_UpdateFadeDrawing);
 }
 
+// The difficulty levels are loaded on while a demo is recorded or played
+// back. Demos are always on Normal, but ck_lib.c loads levels on any.
+CK_Difficulty ck_demoDifficulty = D_Normal;
+
 void CK_LoadLevel(bool doCache, bool silent)
 {
 	if (IN_DemoGetMode() != IN_Demo_Off)
 	{
 		// If we're recording or playing back a demo, the game needs
 		// to be deterministic. Seed the RNG at 0 and set difficulty
-		// to normal.
+		// to normal (or whatever ck_demoDifficulty says).
 		US_InitRndT(false);
-		ck_gameState.difficulty = D_Normal;
+		ck_gameState.difficulty = ck_demoDifficulty;
 	}
 	else
 	{
@@ -598,6 +861,7 @@ void CK_LoadLevel(bool doCache, bool silent)
 	}
 
 	CA_CacheMap(ck_gameState.currentLevel);
+	CK_SizeObjArray(CK_ObjArraySizeForMap());
 	RF_NewMap();
 	CA_ClearMarks();
 
@@ -20,6 +20,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #ifndef CK_GAME_H
 #define CK_GAME_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 void CK_GameLoop();
 void CK_LoadLevel(bool doCache, bool silent);
 
@@ -27,4 +30,8 @@ void CK_BeginCacheBox(const char *title, int numChunks);
 void CK_UpdateCacheBox();
 void CK_FinishCacheBox();
 
+size_t CK_SnapshotSize(void);
+bool CK_SnapshotState(void *buf, size_t size);
+bool CK_RestoreState(const void *buf, size_t size);
+
 #endif
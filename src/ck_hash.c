@@ -0,0 +1,294 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "id_rf.h"
+#include "id_sd.h"
+#include "ck_cross.h"
+#include "ck_def.h"
+#include "ck_hash.h"
+
+#include <stdio.h>
+
+// The hash is a single-lane variant of xxHash64's round function, fed with
+// the same 16-bit words which CK_SaveObject and CK_SaveGameState write out,
+// packed four at a time.
+#define CK_HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define CK_HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define CK_HASH_PRIME3 0x165667B19E3779F9ULL
+
+typedef struct CK_HashContext
+{
+	uint64_t acc;
+	uint64_t lane;
+	int laneWords;
+	int totalWords;
+} CK_HashContext;
+
+static uint64_t CK_HashRound(uint64_t acc, uint64_t input)
+{
+	acc += input * CK_HASH_PRIME2;
+	acc = (acc << 31) | (acc >> 33);
+	return acc * CK_HASH_PRIME1;
+}
+
+static uint64_t CK_HashAvalanche(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= CK_HASH_PRIME2;
+	h ^= h >> 29;
+	h *= CK_HASH_PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+static void CK_HashWord(CK_HashContext *ctx, uint16_t word)
+{
+	ctx->lane |= (uint64_t)word << (16 * ctx->laneWords);
+	ctx->totalWords++;
+	if (++ctx->laneWords == 4)
+	{
+		ctx->acc = CK_HashRound(ctx->acc, ctx->lane);
+		ctx->lane = 0;
+		ctx->laneWords = 0;
+	}
+}
+
+static uint64_t CK_HashFinish(CK_HashContext *ctx)
+{
+	uint64_t h = CK_HashRound(ctx->acc, ctx->lane) ^ (uint64_t)ctx->totalWords;
+	return CK_HashAvalanche(h);
+}
+
+static void CK_HashObject(CK_HashContext *ctx, CK_object *o)
+{
+	CK_HashWord(ctx, o->type);
+	CK_HashWord(ctx, o->active);
+	CK_HashWord(ctx, o->visible);
+	CK_HashWord(ctx, o->clipped);
+	CK_HashWord(ctx, o->timeUntillThink);
+	CK_HashWord(ctx, o->posX);
+	CK_HashWord(ctx, o->posY);
+	CK_HashWord(ctx, o->xDirection);
+	CK_HashWord(ctx, o->yDirection);
+	CK_HashWord(ctx, o->deltaPosX);
+	CK_HashWord(ctx, o->deltaPosY);
+	CK_HashWord(ctx, o->velX);
+	CK_HashWord(ctx, o->velY);
+	CK_HashWord(ctx, o->actionTimer);
+	CK_HashWord(ctx, o->currentAction ? o->currentAction->compatDosPointer : 0);
+	CK_HashWord(ctx, o->gfxChunk);
+	CK_HashWord(ctx, o->zLayer);
+	CK_HashWord(ctx, o->clipRects.unitX1);
+	CK_HashWord(ctx, o->clipRects.unitY1);
+	CK_HashWord(ctx, o->clipRects.unitX2);
+	CK_HashWord(ctx, o->clipRects.unitY2);
+	CK_HashWord(ctx, o->clipRects.unitXmid);
+	CK_HashWord(ctx, o->clipRects.tileX1);
+	CK_HashWord(ctx, o->clipRects.tileY1);
+	CK_HashWord(ctx, o->clipRects.tileX2);
+	CK_HashWord(ctx, o->clipRects.tileY2);
+	CK_HashWord(ctx, o->clipRects.tileXmid);
+	CK_HashWord(ctx, o->topTI);
+	CK_HashWord(ctx, o->rightTI);
+	CK_HashWord(ctx, o->bottomTI);
+	CK_HashWord(ctx, o->leftTI);
+	CK_HashWord(ctx, o->user1);
+	CK_HashWord(ctx, o->user2);
+	CK_HashWord(ctx, o->user3);
+	CK_HashWord(ctx, o->user4);
+	CK_HashWord(ctx, RF_ConvertSpriteArrayPtrTo16BitOffset(o->sde));
+	CK_HashWord(ctx, CK_ConvertObjPointerTo16BitOffset(o->next));
+	CK_HashWord(ctx, CK_ConvertObjPointerTo16BitOffset(o->prev));
+}
+
+static void CK_HashGameState(CK_HashContext *ctx, CK_GameState *state)
+{
+	CK_HashWord(ctx, state->mapPosX);
+	CK_HashWord(ctx, state->mapPosY);
+	for (int i = 0; i < (int)(sizeof(state->levelsDone) / 2); ++i)
+		CK_HashWord(ctx, state->levelsDone[i]);
+	CK_HashWord(ctx, (uint32_t)state->keenScore & 0xFFFF);
+	CK_HashWord(ctx, (uint32_t)state->keenScore >> 16);
+	CK_HashWord(ctx, (uint32_t)state->nextKeenAt & 0xFFFF);
+	CK_HashWord(ctx, (uint32_t)state->nextKeenAt >> 16);
+	CK_HashWord(ctx, state->numShots);
+	CK_HashWord(ctx, state->numCentilife);
+	switch (ck_currentEpisode->ep)
+	{
+	case EP_CK4:
+		CK_HashWord(ctx, state->ep.ck4.wetsuit);
+		CK_HashWord(ctx, state->ep.ck4.membersRescued);
+		break;
+	case EP_CK5:
+		CK_HashWord(ctx, state->ep.ck5.securityCard);
+		CK_HashWord(ctx, state->ep.ck5.word_4729C);
+		CK_HashWord(ctx, state->ep.ck5.fusesRemaining);
+		break;
+	case EP_CK6:
+		CK_HashWord(ctx, state->ep.ck6.sandwich);
+		CK_HashWord(ctx, state->ep.ck6.rope);
+		CK_HashWord(ctx, state->ep.ck6.passcard);
+		CK_HashWord(ctx, state->ep.ck6.inRocket);
+		break;
+	default:
+		break;
+	}
+	for (int i = 0; i < 4; ++i)
+		CK_HashWord(ctx, state->keyGems[i]);
+	CK_HashWord(ctx, state->currentLevel);
+	CK_HashWord(ctx, state->numLives);
+	CK_HashWord(ctx, state->difficulty);
+	CK_HashWord(ctx, CK_ConvertObjPointerTo16BitOffset(ck_keenState.platform));
+}
+
+uint64_t CK_HashFrameState(void)
+{
+	CK_HashContext ctx = {/*.acc =*/CK_HASH_PRIME3, /*.lane =*/0, /*.laneWords =*/0, /*.totalWords =*/0};
+	uint32_t timecount = SD_GetTimeCount();
+
+	CK_HashWord(&ctx, timecount & 0xFFFF);
+	CK_HashWord(&ctx, timecount >> 16);
+	CK_HashGameState(&ctx, &ck_gameState);
+	for (CK_object *currentObj = &ck_objArray[0]; currentObj != &ck_objArray[CK_MAX_OBJECTS]; ++currentObj)
+		CK_HashObject(&ctx, currentObj);
+	// Of the objects past the original array, only the ones in use are
+	// hashed, so maps with bigger arrays hash the same until they're used.
+	for (CK_object *currentObj = ck_keenObj; currentObj; currentObj = currentObj->next)
+		if (currentObj >= &ck_objArray[CK_MAX_OBJECTS])
+			CK_HashObject(&ctx, currentObj);
+	return CK_HashFinish(&ctx);
+}
+
+static FILE *ck_hashFile;
+static FILE *ck_verifyHashFile;
+static const char *ck_verifyHashFileName;
+static bool ck_hashing;
+static long ck_hashFrames;
+static uint64_t ck_chainedHash;
+
+uint64_t CK_GetChainedHash(void)
+{
+	return ck_chainedHash;
+}
+
+static void CK_HashStart(void)
+{
+	ck_hashing = true;
+	ck_hashFrames = 0;
+	ck_chainedHash = 0;
+}
+
+bool CK_HashOpen(const char *fileName)
+{
+	ck_hashFile = fopen(fileName, "w");
+	if (!ck_hashFile)
+		return false;
+	CK_HashStart();
+	return true;
+}
+
+bool CK_VerifyHashOpen(const char *fileName)
+{
+	ck_verifyHashFile = fopen(fileName, "r");
+	if (!ck_verifyHashFile)
+		return false;
+	ck_verifyHashFileName = fileName;
+	CK_HashStart();
+	return true;
+}
+
+// Each line of a hash file holds the frame number, the frame's hash and the
+// chained hash, the hashes as 16 hex digits.
+static bool CK_ReadHashLine(FILE *fp, long *frame, uint64_t *hash)
+{
+	unsigned int hashHi, hashLo, chainHi, chainLo;
+	if (fscanf(fp, "%ld %8x%8x %8x%8x", frame, &hashHi, &hashLo, &chainHi, &chainLo) != 5)
+		return false;
+	*hash = ((uint64_t)hashHi << 32) | hashLo;
+	return true;
+}
+
+void CK_HashFrame(void)
+{
+	if (!ck_hashing)
+		return;
+
+	uint64_t hash = CK_HashFrameState();
+	ck_chainedHash = CK_HashAvalanche(CK_HashRound(ck_chainedHash, hash));
+
+	if (ck_hashFile)
+	{
+		fprintf(ck_hashFile, "%ld %08X%08X %08X%08X\n", ck_hashFrames,
+			(unsigned int)(hash >> 32), (unsigned int)hash,
+			(unsigned int)(ck_chainedHash >> 32), (unsigned int)ck_chainedHash);
+	}
+
+	if (ck_verifyHashFile)
+	{
+		long refFrame;
+		uint64_t refHash;
+		if (!CK_ReadHashLine(ck_verifyHashFile, &refFrame, &refHash))
+		{
+			CK_Cross_LogMessage(CK_LOG_MSG_ERROR, "Hash mismatch with %s: the reference ends at frame %ld\n",
+				ck_verifyHashFileName, ck_hashFrames);
+			Quit("Hash verification failed!");
+		}
+		if (refFrame != ck_hashFrames || refHash != hash)
+		{
+			CK_Cross_LogMessage(CK_LOG_MSG_ERROR, "Hash mismatch with %s at frame %ld: %08X%08X, expected %08X%08X\n",
+				ck_verifyHashFileName, ck_hashFrames,
+				(unsigned int)(hash >> 32), (unsigned int)hash,
+				(unsigned int)(refHash >> 32), (unsigned int)refHash);
+			Quit("Hash verification failed!");
+		}
+	}
+
+	ck_hashFrames++;
+}
+
+void CK_HashClose(void)
+{
+	if (!ck_hashing)
+		return;
+	ck_hashing = false;
+
+	if (ck_hashFile)
+		fclose(ck_hashFile);
+	ck_hashFile = NULL;
+
+	if (ck_verifyHashFile)
+	{
+		FILE *reference = ck_verifyHashFile;
+		long refFrame;
+		uint64_t refHash;
+		ck_verifyHashFile = NULL;
+		bool leftOver = CK_ReadHashLine(reference, &refFrame, &refHash);
+		fclose(reference);
+		if (leftOver)
+		{
+			CK_Cross_LogMessage(CK_LOG_MSG_ERROR, "Hash mismatch with %s: the demo ended at frame %ld\n",
+				ck_verifyHashFileName, ck_hashFrames);
+			Quit("Hash verification failed!");
+		}
+		CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "Hashes matched %s (%ld frames)\n", ck_verifyHashFileName, ck_hashFrames);
+	}
+
+	CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "State hash after %ld frames: %08X%08X\n", ck_hashFrames,
+		(unsigned int)(ck_chainedHash >> 32), (unsigned int)ck_chainedHash);
+}
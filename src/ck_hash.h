@@ -0,0 +1,49 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CK_HASH_H
+#define CK_HASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A cheap determinism check, available in every build.
+ *
+ * Each frame, the fields which the playloop dumper writes (the time count, the
+ * game state and every object) are hashed to 64 bits, and the hashes are
+ * chained together. The hashes can be written to a small text file
+ * (/HASHFILE) with one line per frame, or checked against such a file
+ * (/VERIFYHASH).
+ */
+
+// Returns the hash of the current frame's state.
+uint64_t CK_HashFrameState(void);
+// Returns the hash of all of the frames so far.
+uint64_t CK_GetChainedHash(void);
+
+bool CK_HashOpen(const char *fileName);
+bool CK_VerifyHashOpen(const char *fileName);
+// Hashes the current frame, and writes or verifies it. A mismatch is fatal.
+void CK_HashFrame(void);
+// Finishes the hash file. When verifying, it's fatal for the reference to
+// have frames left over.
+void CK_HashClose(void);
+
+#endif
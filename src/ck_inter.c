@@ -27,7 +27,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "ck_game.h"
 #include "ck_play.h"
 #include "ck_act.h"
+#include "ck_hash.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -35,7 +37,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  * CK_INTER: Holds an assortment of screen drawing and state switching routines
  */
 
-int ck_startingSavedGame = 0;
 bool ck_inHighScores = false;
 CK_Difficulty ck_startingDifficulty = D_NotPlaying;
 
@@ -1552,6 +1553,85 @@ void CK_PlayDemo(int demoNumber)
 	CK_HandleDemoKeys();
 }
 
+// Plays back a demo in two contexts at once, stepping them alternately, and
+// quits with an error at the first frame where their states differ. Used by
+// /CHECKCONTEXTS to show that contexts don't share any simulation state.
+void CK_CheckDemoContexts(int demoNumber)
+{
+	CK_Context *contexts[2];
+	uint8_t *demoBufs[2];
+
+	int demoChunk = CK_CHUNKNUM(DEMOSTART) + demoNumber;
+
+	CA_CacheGrChunk(demoChunk);
+	uint8_t *demo = (uint8_t *)(ca_graphChunks[demoChunk]);
+	uint16_t demoMap = *demo;
+	uint16_t demoLen = CK_Cross_SwapLE16(*((uint16_t *)(demo + 2)));
+
+	// Each context needs a copy of its own, as ID_IN modifies the buffer.
+	for (int i = 0; i < 2; ++i)
+	{
+		demoBufs[i] = (uint8_t *)malloc(demoLen + 1);
+		if (!demoBufs[i])
+			Quit("CK_CheckDemoContexts: Out of memory!");
+		memcpy(demoBufs[i], demo + 4, demoLen);
+	}
+	MM_FreePtr(&ca_graphChunks[demoChunk]);
+
+	contexts[0] = ck_context;
+	contexts[1] = CK_CreateContext();
+
+	for (int i = 0; i < 2; ++i)
+	{
+		CK_SetContext(contexts[i]);
+		CK_NewGame();
+		ck_gameState.currentLevel = demoMap;
+		IN_DemoStartPlaying(demoBufs[i], demoLen);
+		CK_LoadLevel(true, true);
+		CK_PlayLoopStart();
+	}
+
+	long frame = 0;
+	for (;;)
+	{
+		uint64_t hashes[2];
+		int levelStates[2];
+
+		for (int i = 0; i < 2; ++i)
+		{
+			CK_SetContext(contexts[i]);
+			CK_PlayLoopStep();
+			if (IN_DemoGetMode() == IN_Demo_PlayDone)
+				ck_gameState.levelState = LS_LevelComplete;
+			hashes[i] = CK_HashFrameState();
+			levelStates[i] = ck_gameState.levelState;
+		}
+		frame++;
+
+		if (hashes[0] != hashes[1] || levelStates[0] != levelStates[1])
+		{
+			static char msg[128];
+			snprintf(msg, sizeof(msg), "Demo %d differed between contexts at frame %ld: %016llx != %016llx",
+				demoNumber, frame, (unsigned long long)hashes[0], (unsigned long long)hashes[1]);
+			Quit(msg);
+		}
+		if (levelStates[0] != LS_Playing)
+			break;
+	}
+
+	for (int i = 0; i < 2; ++i)
+	{
+		CK_SetContext(contexts[i]);
+		IN_DemoStopPlaying();
+		CK_PlayLoopEnd();
+		free(demoBufs[i]);
+	}
+	CK_DestroyContext(contexts[1]);
+	CK_SetContext(contexts[0]);
+
+	CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "Demo %d matched in both contexts for %ld frames\n", demoNumber, frame);
+}
+
 /*
  * High scores
  */
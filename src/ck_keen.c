@@ -44,9 +44,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "id_vl.h"
 
 void CK_SpawnKeen(int tileX, int tileY, int direction);
-extern CK_object *ck_keenObj;
-
-CK_keenState ck_keenState;
 
 void CK_BasicDrawFunc1(CK_object *obj);
 
@@ -69,9 +66,6 @@ chunk_id_t ck_itemShadows[] = {
 #endif
 };
 
-// Episode dependent stuff
-int16_t ck_keenMoon;
-
 extern void CK6_ToggleBigSwitch(CK_object *obj, bool p);
 
 void CK_KeenColFunc(CK_object *a, CK_object *b)
@@ -1165,8 +1159,6 @@ void CK_KeenJumpThink(CK_object *obj)
 	}
 }
 
-extern int rf_scrollXUnit, rf_scrollYUnit;
-
 void CK_KeenJumpDrawFunc(CK_object *obj)
 {
 	if (obj->rightTI && obj->xDirection == -1)
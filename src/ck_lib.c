@@ -0,0 +1,289 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+ * CK_LIB: The embeddable stepping library (see omnispeak.h).
+ */
+
+#include "id_ca.h"
+#include "id_cfg.h"
+#include "id_fs.h"
+#include "id_in.h"
+#include "id_mm.h"
+#include "id_sd.h"
+#include "id_us.h"
+#include "id_vl.h"
+#include "ck_def.h"
+#include "ck_game.h"
+#include "ck_play.h"
+#ifdef WITH_KEEN4
+#include "ck4_ep.h"
+#endif
+#ifdef WITH_KEEN5
+#include "ck5_ep.h"
+#endif
+#ifdef WITH_KEEN6
+#include "ck6_ep.h"
+#endif
+#include "omnispeak.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// From id_vl_null.c
+uint8_t *VL_NULL_GetScreenPixels(int *w, int *h);
+void VL_NULL_GetPalette(uint8_t palette[16][3]);
+
+void CK_InitGame();
+
+struct OMNI_Env
+{
+	CK_Context *context;
+	bool levelLoaded;
+	CK_Difficulty difficulty;
+	// Each frame is played back as a one-entry demo: a count, then controls.
+	uint8_t demoBuf[2];
+	// A copy of the screen, made when another environment draws over it.
+	uint8_t *framePixels;
+	OMNI_Frame frame;
+};
+
+// The engine is started by the first environment, and shut down with the
+// last. The arguments are kept for as long as us_argv points at them.
+static int omni_numEnvs;
+static int omni_episode;
+static const char *omni_argv[3];
+
+// The environment which drew what's on the screen now.
+static OMNI_Env *omni_drawnEnv;
+
+// Nothing is ever shown, so anything waiting for a key gets one right away.
+static void OMNI_PresentHook(void)
+{
+	IN_SetLastScan(IN_SC_Space);
+}
+
+static void OMNI_Shutdown(void)
+{
+	VL_SetPresentHook(NULL);
+	CK_ShutdownID();
+}
+
+// Starts the engine, as the game's main() would.
+static bool OMNI_Startup(int episode, const char *dataPath)
+{
+	switch (episode)
+	{
+#ifdef WITH_KEEN4
+	case 4:
+		ck_currentEpisode = &ck4_episode;
+		break;
+#endif
+#ifdef WITH_KEEN5
+	case 5:
+		ck_currentEpisode = &ck5_episode;
+		break;
+#endif
+#ifdef WITH_KEEN6
+	case 6:
+		ck_currentEpisode = &ck6_episode;
+		break;
+#endif
+	default:
+		return false;
+	}
+
+	// The data path is passed on the way the game's /GAMEPATH is.
+	omni_argv[0] = "omnispeak";
+	omni_argv[1] = "/GAMEPATH";
+	omni_argv[2] = dataPath ? dataPath : ".";
+	us_argc = 3;
+	us_argv = omni_argv;
+
+	FS_Startup();
+	if (!ck_currentEpisode->isPresent())
+		return false;
+	MM_Startup();
+	CFG_Startup();
+	ck_currentEpisode->hasCreatureQuestion = false;
+
+	CK_InitGame();
+	SD_SetMuted(true);
+	VL_SetPresentHook(OMNI_PresentHook);
+	omni_episode = episode;
+	return true;
+}
+
+OMNI_Env *OMNI_Create(int episode, const char *dataPath)
+{
+	if (omni_numEnvs ? episode != omni_episode : !OMNI_Startup(episode, dataPath))
+		return NULL;
+
+	OMNI_Env *env = (OMNI_Env *)calloc(1, sizeof(OMNI_Env));
+	if (!env)
+	{
+		if (!omni_numEnvs)
+			OMNI_Shutdown();
+		return NULL;
+	}
+	env->context = CK_CreateContext();
+	env->difficulty = D_Normal;
+	omni_numEnvs++;
+	return env;
+}
+
+void OMNI_Destroy(OMNI_Env *env)
+{
+	if (!env)
+		return;
+	CK_SetContext(env->context);
+	if (env->levelLoaded)
+		CK_PlayLoopEnd();
+	CK_DestroyContext(env->context);
+	if (omni_drawnEnv == env)
+		omni_drawnEnv = NULL;
+	free(env->framePixels);
+	free(env);
+	if (!--omni_numEnvs)
+		OMNI_Shutdown();
+}
+
+// Saves the screen drawn by omni_drawnEnv before env draws over it, and
+// makes env's context the current one.
+static void OMNI_Switch(OMNI_Env *env)
+{
+	OMNI_Env *drawn = omni_drawnEnv;
+	if (drawn && drawn != env)
+	{
+		uint8_t *pixels = VL_NULL_GetScreenPixels(&drawn->frame.width, &drawn->frame.height);
+		size_t size = (size_t)drawn->frame.width * drawn->frame.height;
+		if (!drawn->framePixels)
+			drawn->framePixels = (uint8_t *)malloc(size);
+		if (!drawn->framePixels)
+			Quit("OMNI_Switch: Out of memory!");
+		memcpy(drawn->framePixels, pixels, size);
+		drawn->frame.pixels = drawn->framePixels;
+		drawn->frame.scrollX = VL_GetScrollX();
+		drawn->frame.scrollY = VL_GetScrollY();
+		VL_NULL_GetPalette(drawn->frame.palette);
+	}
+	omni_drawnEnv = env;
+	CK_SetContext(env->context);
+}
+
+static void OMNI_StartFrame(OMNI_Env *env, uint8_t input)
+{
+	uint8_t ctrl = 0;
+
+	// Fire is played back as jump + pogo (two-button firing).
+	if (input & OMNI_INPUT_FIRE)
+		input |= OMNI_INPUT_JUMP | OMNI_INPUT_POGO;
+
+	// See IN_ReadControls for the format.
+	if (input & OMNI_INPUT_UP)
+		ctrl |= IN_motion_Up + 1;
+	else if (input & OMNI_INPUT_DOWN)
+		ctrl |= IN_motion_Down + 1;
+	else
+		ctrl |= IN_motion_None + 1;
+	if (input & OMNI_INPUT_LEFT)
+		ctrl |= (IN_motion_Left + 1) << 2;
+	else if (input & OMNI_INPUT_RIGHT)
+		ctrl |= (IN_motion_Right + 1) << 2;
+	else
+		ctrl |= (IN_motion_None + 1) << 2;
+	if (input & OMNI_INPUT_JUMP)
+		ctrl |= 1 << 4;
+	if (input & OMNI_INPUT_POGO)
+		ctrl |= 1 << 5;
+
+	env->demoBuf[0] = 1;
+	env->demoBuf[1] = ctrl;
+	IN_ClearKeysDown();
+	IN_DemoStartPlaying(env->demoBuf, sizeof(env->demoBuf));
+}
+
+void OMNI_SetDifficulty(OMNI_Env *env, int difficulty)
+{
+	if (difficulty >= D_Easy && difficulty <= D_Hard)
+		env->difficulty = (CK_Difficulty)difficulty;
+}
+
+void OMNI_Reset(OMNI_Env *env, int level, uint32_t seed)
+{
+	OMNI_Switch(env);
+	if (env->levelLoaded)
+		CK_PlayLoopEnd();
+	VL_FixRefreshBuffer();
+
+	CK_NewGame();
+	ck_gameState.currentLevel = level;
+
+	// Loading a level in demo mode makes it deterministic, but would put
+	// it on Normal.
+	OMNI_StartFrame(env, 0);
+	ck_demoDifficulty = env->difficulty;
+	CK_LoadLevel(true, true);
+	ck_demoDifficulty = D_Normal;
+	CK_PlayLoopStart();
+	US_SetRndI(seed & 0xFF);
+	env->levelLoaded = true;
+}
+
+int OMNI_Step(OMNI_Env *env, uint8_t input, int tics)
+{
+	if (!env->levelLoaded)
+		return LS_AbortGame;
+
+	OMNI_Switch(env);
+	int elapsed = 0;
+	while (ck_gameState.levelState == LS_Playing)
+	{
+		OMNI_StartFrame(env, input);
+		CK_PlayLoopStep();
+		elapsed += SD_GetSpriteSync();
+		if (elapsed >= tics)
+			break;
+	}
+	return ck_gameState.levelState;
+}
+
+void OMNI_GetFrame(OMNI_Env *env, OMNI_Frame *frame)
+{
+	if (env != omni_drawnEnv && env->framePixels)
+	{
+		*frame = env->frame;
+		return;
+	}
+	frame->pixels = VL_NULL_GetScreenPixels(&frame->width, &frame->height);
+	frame->scrollX = VL_GetScrollX();
+	frame->scrollY = VL_GetScrollY();
+	VL_NULL_GetPalette(frame->palette);
+}
+
+void OMNI_GetRAM(OMNI_Env *env, OMNI_RAM *ram)
+{
+	CK_Context *ctx = env->context;
+	ram->gameState = &ctx->gameState;
+	ram->gameStateSize = sizeof(ctx->gameState);
+	ram->objects = ctx->objArray;
+	ram->objectSize = sizeof(CK_object);
+	ram->numObjects = ctx->objArraySize;
+	ram->keenObject = ctx->keenObj ? (int)(ctx->keenObj - ctx->objArray) : -1;
+}
@@ -0,0 +1,405 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+ * CK_LIB_BATCH: Steps a batch of environments in parallel (see omnispeak.h).
+ *
+ * Each environment runs in a worker process, forked from one started engine.
+ * Environments have contexts of their own (see ck_lib.c), but the memory
+ * manager, the graphics cache and the screen are shared and aren't
+ * thread-safe, so workers can't be threads of one process yet. The parent sends each worker a one-byte command over a socket, and the
+ * worker replies with the same byte once it has written its results to the
+ * shared buffers.
+ */
+
+#include "ck_def.h"
+#include "omnispeak.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define OMNI_FRAME_SIZE (OMNI_FRAME_WIDTH * OMNI_FRAME_HEIGHT)
+
+typedef enum OMNI_BatchCommand
+{
+	OMNI_Batch_Reset = 'R',
+	OMNI_Batch_Step = 'S',
+	OMNI_Batch_Quit = 'Q'
+} OMNI_BatchCommand;
+
+// Lives in memory shared with the workers, followed by the frames.
+typedef struct OMNI_BatchEntry
+{
+	// Arguments
+	int32_t level;
+	uint32_t seed;
+	int32_t difficulty;
+	uint8_t input;
+	// Results
+	uint8_t done;
+	int32_t reward;
+	int32_t levelState;
+	uint8_t palette[16][3];
+} OMNI_BatchEntry;
+
+struct OMNI_Batch
+{
+	int numEnvs;
+	OMNI_Env *env;
+	int tics;
+
+	void *shared;
+	size_t sharedSize;
+	OMNI_BatchEntry *entries;
+	uint8_t *frames;
+
+	// Copies of the results, laid out as the API returns them.
+	uint8_t (*palettes)[16][3];
+	int32_t *rewards;
+	uint8_t *dones;
+	int32_t *levelStates;
+
+	pid_t *pids;
+	int *sockets; // -1 once the worker has gone
+	bool *busy;
+};
+
+static void OMNI_BatchCopyFrame(OMNI_Env *env, OMNI_BatchEntry *entry, uint8_t *dst)
+{
+	OMNI_Frame frame;
+	OMNI_GetFrame(env, &frame);
+	for (int y = 0; y < OMNI_FRAME_HEIGHT; ++y)
+		memcpy(dst + y * OMNI_FRAME_WIDTH, frame.pixels + (y + frame.scrollY) * frame.width + frame.scrollX, OMNI_FRAME_WIDTH);
+	memcpy(entry->palette, frame.palette, sizeof(entry->palette));
+}
+
+static int32_t OMNI_BatchScore(OMNI_Env *env)
+{
+	OMNI_RAM ram;
+	OMNI_GetRAM(env, &ram);
+	return ((const CK_GameState *)ram.gameState)->keenScore;
+}
+
+static void OMNI_BatchWorker(OMNI_Batch *batch, int i, int sock)
+{
+	OMNI_BatchEntry *entry = &batch->entries[i];
+	uint8_t *frame = batch->frames + (size_t)i * OMNI_FRAME_SIZE;
+	bool levelLoaded = false;
+	char cmd;
+
+	while (recv(sock, &cmd, 1, 0) == 1)
+	{
+		switch (cmd)
+		{
+		case OMNI_Batch_Reset:
+			OMNI_SetDifficulty(batch->env, entry->difficulty);
+			OMNI_Reset(batch->env, entry->level, entry->seed);
+			levelLoaded = true;
+			entry->reward = 0;
+			entry->levelState = LS_Playing;
+			break;
+		case OMNI_Batch_Step:
+		{
+			int32_t score = OMNI_BatchScore(batch->env);
+			entry->levelState = OMNI_Step(batch->env, entry->input, batch->tics);
+			entry->reward = OMNI_BatchScore(batch->env) - score;
+			break;
+		}
+		case OMNI_Batch_Quit:
+		default:
+			_exit(0);
+		}
+		entry->done = entry->levelState != LS_Playing;
+		if (levelLoaded)
+			OMNI_BatchCopyFrame(batch->env, entry, frame);
+		if (send(sock, &cmd, 1, MSG_NOSIGNAL) != 1)
+			break;
+	}
+	// The engine is a copy of the parent's, so it isn't shut down here:
+	// that would save the config once per worker.
+	_exit(0);
+}
+
+static void OMNI_BatchSend(OMNI_Batch *batch, int i, char cmd)
+{
+	batch->busy[i] = false;
+	if (batch->sockets[i] < 0)
+		return;
+	if (send(batch->sockets[i], &cmd, 1, MSG_NOSIGNAL) == 1)
+		batch->busy[i] = true;
+}
+
+// Waits for every worker which was sent a command. A worker which has gone
+// (e.g. after a fatal error) is done for good.
+static void OMNI_BatchWait(OMNI_Batch *batch)
+{
+	for (int i = 0; i < batch->numEnvs; ++i)
+	{
+		char reply;
+		if (batch->busy[i] && recv(batch->sockets[i], &reply, 1, 0) != 1)
+		{
+			close(batch->sockets[i]);
+			batch->sockets[i] = -1;
+			batch->entries[i].done = 1;
+			batch->entries[i].reward = 0;
+			batch->entries[i].levelState = LS_AbortGame;
+		}
+		batch->busy[i] = false;
+
+		memcpy(batch->palettes[i], batch->entries[i].palette, sizeof(batch->palettes[i]));
+		batch->rewards[i] = batch->entries[i].reward;
+		batch->dones[i] = batch->entries[i].done;
+		batch->levelStates[i] = batch->entries[i].levelState;
+	}
+}
+
+OMNI_Batch *OMNI_BatchCreate(int numEnvs, int episode, const char *dataPath)
+{
+	if (numEnvs <= 0)
+		return NULL;
+
+	OMNI_Env *env = OMNI_Create(episode, dataPath);
+	if (!env)
+		return NULL;
+
+	OMNI_Batch *batch = (OMNI_Batch *)calloc(1, sizeof(OMNI_Batch));
+	if (!batch)
+	{
+		OMNI_Destroy(env);
+		return NULL;
+	}
+	batch->numEnvs = numEnvs;
+	batch->env = env;
+	batch->sharedSize = numEnvs * (sizeof(OMNI_BatchEntry) + OMNI_FRAME_SIZE);
+	batch->shared = mmap(NULL, batch->sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	batch->palettes = (uint8_t(*)[16][3])calloc(numEnvs, sizeof(batch->palettes[0]));
+	batch->rewards = (int32_t *)calloc(numEnvs, sizeof(int32_t));
+	batch->dones = (uint8_t *)calloc(numEnvs, sizeof(uint8_t));
+	batch->levelStates = (int32_t *)calloc(numEnvs, sizeof(int32_t));
+	batch->pids = (pid_t *)calloc(numEnvs, sizeof(pid_t));
+	batch->sockets = (int *)malloc(numEnvs * sizeof(int));
+	batch->busy = (bool *)calloc(numEnvs, sizeof(bool));
+	if (batch->shared == MAP_FAILED || !batch->palettes || !batch->rewards || !batch->dones ||
+		!batch->levelStates || !batch->pids || !batch->sockets || !batch->busy)
+	{
+		if (batch->shared == MAP_FAILED)
+			batch->shared = NULL;
+		batch->numEnvs = 0;
+		OMNI_BatchDestroy(batch);
+		return NULL;
+	}
+	batch->entries = (OMNI_BatchEntry *)batch->shared;
+	batch->frames = (uint8_t *)(batch->entries + numEnvs);
+
+	for (int i = 0; i < numEnvs; ++i)
+		batch->sockets[i] = -1;
+
+	// Otherwise, anything buffered would be written out by each worker.
+	fflush(NULL);
+
+	for (int i = 0; i < numEnvs; ++i)
+	{
+		int socks[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, socks))
+			break;
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			// Only keep our own end of our own socket.
+			for (int j = 0; j < i; ++j)
+				close(batch->sockets[j]);
+			close(socks[0]);
+			OMNI_BatchWorker(batch, i, socks[1]);
+		}
+		close(socks[1]);
+		if (pid < 0)
+		{
+			close(socks[0]);
+			break;
+		}
+		batch->pids[i] = pid;
+		batch->sockets[i] = socks[0];
+	}
+
+	for (int i = 0; i < numEnvs; ++i)
+	{
+		// Like OMNI_Step() before the first reset.
+		batch->dones[i] = batch->entries[i].done = 1;
+		batch->levelStates[i] = batch->entries[i].levelState = LS_AbortGame;
+		batch->entries[i].difficulty = D_Normal;
+		if (batch->sockets[i] < 0)
+		{
+			OMNI_BatchDestroy(batch);
+			return NULL;
+		}
+	}
+	return batch;
+}
+
+void OMNI_BatchDestroy(OMNI_Batch *batch)
+{
+	if (!batch)
+		return;
+	for (int i = 0; i < batch->numEnvs; ++i)
+	{
+		OMNI_BatchSend(batch, i, OMNI_Batch_Quit);
+		if (batch->sockets[i] >= 0)
+			close(batch->sockets[i]);
+		if (batch->pids[i] > 0)
+			waitpid(batch->pids[i], NULL, 0);
+	}
+	if (batch->shared)
+		munmap(batch->shared, batch->sharedSize);
+	free(batch->palettes);
+	free(batch->rewards);
+	free(batch->dones);
+	free(batch->levelStates);
+	free(batch->pids);
+	free(batch->sockets);
+	free(batch->busy);
+	OMNI_Destroy(batch->env);
+	free(batch);
+}
+
+int OMNI_BatchSize(OMNI_Batch *batch)
+{
+	return batch->numEnvs;
+}
+
+void OMNI_BatchReset(OMNI_Batch *batch, const int *levels, const uint32_t *seeds)
+{
+	for (int i = 0; i < batch->numEnvs; ++i)
+	{
+		if (levels[i] < 0)
+			continue;
+		batch->entries[i].level = levels[i];
+		batch->entries[i].seed = seeds[i];
+		OMNI_BatchSend(batch, i, OMNI_Batch_Reset);
+	}
+	OMNI_BatchWait(batch);
+}
+
+void OMNI_BatchSetDifficulty(OMNI_Batch *batch, int difficulty)
+{
+	// Passed on with the next reset.
+	for (int i = 0; i < batch->numEnvs; ++i)
+		batch->entries[i].difficulty = difficulty;
+}
+
+void OMNI_BatchStep(OMNI_Batch *batch, const uint8_t *inputs, int tics)
+{
+	batch->tics = tics;
+	for (int i = 0; i < batch->numEnvs; ++i)
+	{
+		batch->entries[i].reward = 0;
+		if (batch->entries[i].done)
+			continue;
+		batch->entries[i].input = inputs[i];
+		OMNI_BatchSend(batch, i, OMNI_Batch_Step);
+	}
+	OMNI_BatchWait(batch);
+}
+
+#else // _WIN32
+
+struct OMNI_Batch
+{
+	int numEnvs;
+	uint8_t *frames;
+	uint8_t (*palettes)[16][3];
+	int32_t *rewards;
+	uint8_t *dones;
+	int32_t *levelStates;
+};
+
+OMNI_Batch *OMNI_BatchCreate(int numEnvs, int episode, const char *dataPath)
+{
+	(void)numEnvs;
+	(void)episode;
+	(void)dataPath;
+	return NULL;
+}
+
+void OMNI_BatchDestroy(OMNI_Batch *batch)
+{
+	(void)batch;
+}
+
+int OMNI_BatchSize(OMNI_Batch *batch)
+{
+	return batch->numEnvs;
+}
+
+void OMNI_BatchReset(OMNI_Batch *batch, const int *levels, const uint32_t *seeds)
+{
+	(void)batch;
+	(void)levels;
+	(void)seeds;
+}
+
+void OMNI_BatchSetDifficulty(OMNI_Batch *batch, int difficulty)
+{
+	(void)batch;
+	(void)difficulty;
+}
+
+void OMNI_BatchStep(OMNI_Batch *batch, const uint8_t *inputs, int tics)
+{
+	(void)batch;
+	(void)inputs;
+	(void)tics;
+}
+
+#endif
+
+const uint8_t *OMNI_BatchFrames(OMNI_Batch *batch)
+{
+	return batch->frames;
+}
+
+const uint8_t (*OMNI_BatchPalettes(OMNI_Batch *batch))[16][3]
+{
+	return batch->palettes;
+}
+
+const int32_t *OMNI_BatchRewards(OMNI_Batch *batch)
+{
+	return batch->rewards;
+}
+
+const uint8_t *OMNI_BatchDones(OMNI_Batch *batch)
+{
+	return batch->dones;
+}
+
+const int32_t *OMNI_BatchLevelStates(OMNI_Batch *batch)
+{
+	return batch->levelStates;
+}
@@ -0,0 +1,121 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+ * A benchmark for libomnispeak batches: plays a level with random input on
+ * 1, 2, 4, ... worker processes (one environment each), and prints the total
+ * game time simulated per second of real time for each.
+ *
+ * Usage: omnispeak-bench <episode> <datapath> [level] [maxWorkers] [steps]
+ */
+
+#include "omnispeak.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_TICS_PER_STEP 3
+
+static double Bench_Seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs the first numWorkers environments of the batch. Since the number only
+// ever goes up, the rest have never been reset, and are left alone.
+static void Bench_Run(OMNI_Batch *batch, int numWorkers, int level, int steps)
+{
+	int *levels = (int *)malloc(OMNI_BatchSize(batch) * sizeof(int));
+	uint32_t *seeds = (uint32_t *)malloc(OMNI_BatchSize(batch) * sizeof(uint32_t));
+	uint8_t *inputs = (uint8_t *)malloc(OMNI_BatchSize(batch));
+	uint32_t rnd = 1;
+	long resets = 0;
+
+	for (int i = 0; i < OMNI_BatchSize(batch); ++i)
+	{
+		levels[i] = i < numWorkers ? level : -1;
+		seeds[i] = i;
+	}
+	OMNI_BatchReset(batch, levels, seeds);
+
+	double start = Bench_Seconds();
+	for (int step = 0; step < steps; ++step)
+	{
+		for (int i = 0; i < numWorkers; ++i)
+		{
+			rnd = rnd * 1103515245 + 12345;
+			inputs[i] = (uint8_t)(rnd >> 16) & 0x7F;
+		}
+		OMNI_BatchStep(batch, inputs, BENCH_TICS_PER_STEP);
+
+		// Start over any level which has ended.
+		const uint8_t *dones = OMNI_BatchDones(batch);
+		for (int i = 0; i < numWorkers; ++i)
+		{
+			levels[i] = dones[i] ? level : -1;
+			seeds[i] = rnd >> 8;
+			resets += dones[i];
+		}
+		OMNI_BatchReset(batch, levels, seeds);
+	}
+	double seconds = Bench_Seconds() - start;
+
+	printf("%4d workers: %10.0f tics/s (%8.0f per worker), %ld resets\n", numWorkers,
+		(double)numWorkers * steps * BENCH_TICS_PER_STEP / seconds,
+		(double)steps * BENCH_TICS_PER_STEP / seconds, resets);
+
+	free(levels);
+	free(seeds);
+	free(inputs);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		printf("Usage: %s <episode> <datapath> [level] [maxWorkers] [steps]\n", argv[0]);
+		return 1;
+	}
+	int episode = atoi(argv[1]);
+	const char *dataPath = argv[2];
+	int level = argc > 3 ? atoi(argv[3]) : 1;
+	int maxWorkers = argc > 4 ? atoi(argv[4]) : 8;
+	int steps = argc > 5 ? atoi(argv[5]) : 2000;
+
+	OMNI_Batch *batch = OMNI_BatchCreate(maxWorkers, episode, dataPath);
+	if (!batch)
+	{
+		fprintf(stderr, "Couldn't start a batch of %d worker processes.\n", maxWorkers);
+		return 1;
+	}
+	// 1, 2, 4, ..., and finally maxWorkers.
+	for (int numWorkers = 1;; numWorkers *= 2)
+	{
+		if (numWorkers > maxWorkers)
+			numWorkers = maxWorkers;
+		Bench_Run(batch, numWorkers, level, steps);
+		if (numWorkers == maxWorkers)
+			break;
+	}
+	OMNI_BatchDestroy(batch);
+	return 0;
+}
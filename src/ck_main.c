@@ -21,14 +21,19 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "id_fs.h"
 #include "id_in.h"
 #include "id_mm.h"
+#include "id_prof.h"
 #include "id_rf.h"
 #include "id_us.h"
 #include "id_vl.h"
 #include "ck_act.h"
+#include "ck_collide.h"
 #include "ck_cross.h"
 #include "ck_def.h"
+#include "ck_dump.h"
 #include "ck_game.h"
+#include "ck_hash.h"
 #include "ck_play.h"
+#include "ck_rewind.h"
 #ifdef WITH_KEEN4
 #include "ck4_ep.h"
 #endif
@@ -91,9 +96,13 @@ void CK_ShutdownID(void)
 	//TODO: Some managers don't have shutdown implemented yet
 	VL_DestroySurface(ck_backupSurface);
 	VL_DestroySurface(ck_statusSurface);
+	CK_ShutdownRewind();
 	US_Shutdown();
 	SD_Shutdown();
 	//IN
+#ifdef WITH_PROFILER
+	PROF_Shutdown();
+#endif
 	RF_Shutdown();
 	//VH
 	VL_Shutdown();
@@ -121,6 +130,8 @@ void CK_InitGame()
 #endif
 
 	// Compile the actions
+	// (In linked builds, they've been compiled by tools/varparser already.)
+#ifndef CK_VARS_LINKED
 	CK_ACT_SetupFunctions();
 	CK_KeenSetupFunctions();
 	CK_OBJ_SetupFunctions();
@@ -130,7 +141,8 @@ void CK_InitGame()
 
 	
 	CK_VAR_Startup();
-	CK_VAR_LoadVars("EPISODE.EXT");
+	CK_VAR_LoadVarsWithCache("EPISODE.EXT", CFG_GetConfigBool("varCache", true) ? "VARCACHE.EXT" : NULL);
+#endif
 
 	// Load the core datafiles
 	CA_Startup();
@@ -180,6 +192,10 @@ void CK_InitGame()
 
 	RF_Startup();
 
+#ifdef WITH_PROFILER
+	PROF_Startup();
+#endif
+
 	VL_ColorBorder(3);
 	VL_ClearScreen(0);
 	VL_Present();
@@ -486,7 +502,8 @@ int main(int argc, char *argv[])
 
 #else // !CK_RUN_ACTION_VALIDATOR
 
-#ifndef _CONSOLE
+// The embeddable library (ck_lib.c) has no main().
+#if !defined(_CONSOLE) && !defined(OMNISPEAK_LIBRARY)
 CK_EpisodeDef *ck_episodes[] = {
 #ifdef WITH_KEEN4
 	&ck4_episode,
@@ -535,8 +552,13 @@ int main(int argc, char *argv[])
 	bool isIntegerScaled = CFG_GetConfigBool("integer", false);
 	bool overrideCopyProtection = CFG_GetConfigBool("ck6_noCreatureQuestion", false);
 	int swapInterval = CFG_GetConfigInt("swapInterval", 1);
+	const char *hashFilename = NULL;
+	const char *varTraceFilename = NULL;
+	const char *collideLogFilename = NULL;
+	const char *verifyHashFilename = NULL;
 #ifdef CK_ENABLE_PLAYLOOP_DUMPER
 	const char *dumperFilename = NULL;
+	const char *verifyFilename = NULL;
 #endif
 
 	for (int i = 1; i < argc; ++i)
@@ -603,12 +625,45 @@ int main(int argc, char *argv[])
 		{
 			overrideCopyProtection = true;
 		}
+		else if (!CK_Cross_strcasecmp(argv[i], "/HASHFILE"))
+		{
+			if (i + 1 < argc)
+				hashFilename = argv[++i];
+		}
+		else if (!CK_Cross_strcasecmp(argv[i], "/VERIFYHASH"))
+		{
+			if (i + 1 < argc)
+				verifyHashFilename = argv[++i];
+		}
+		else if (!CK_Cross_strcasecmp(argv[i], "/COLLIDELOG"))
+		{
+			if (i + 1 < argc)
+				collideLogFilename = argv[++i];
+		}
+		else if (!CK_Cross_strcasecmp(argv[i], "/BROADPHASE"))
+		{
+			ck_collideMode = CK_COLLIDE_BROADPHASE;
+		}
+		else if (!CK_Cross_strcasecmp(argv[i], "/NOBROADPHASE"))
+		{
+			ck_collideMode = CK_COLLIDE_BRUTEFORCE;
+		}
+		else if (!CK_Cross_strcasecmp(argv[i], "/VARTRACE"))
+		{
+			if (i + 1 < argc)
+				varTraceFilename = argv[++i];
+		}
 #ifdef CK_ENABLE_PLAYLOOP_DUMPER
 		else if (!CK_Cross_strcasecmp(argv[i], "/DUMPFILE"))
 		{
 			if (i < argc + 1)
 				dumperFilename = argv[++i]; // Yes, we increment i twice
 		}
+		else if (!CK_Cross_strcasecmp(argv[i], "/VERIFYDUMP"))
+		{
+			if (i + 1 < argc)
+				verifyFilename = argv[++i];
+		}
 #endif
 	}
 
@@ -618,18 +673,44 @@ int main(int argc, char *argv[])
 	}
 
 #ifdef CK_ENABLE_PLAYLOOP_DUMPER
-	extern FILE *ck_dumperFile;
 	if (dumperFilename != NULL)
 	{
-		ck_dumperFile = fopen(dumperFilename, "wb");
-		if (ck_dumperFile == NULL)
+		if (!CK_DumpOpen(dumperFilename))
 		{
 			fprintf(stderr, "Couldn't open dumper file for writing.\n");
 			return 1;
 		}
 		printf("Writing to dump file %s\n", dumperFilename);
 	}
+	if (verifyFilename != NULL)
+	{
+		if (!CK_VerifyDumpOpen(verifyFilename))
+		{
+			fprintf(stderr, "Couldn't open dump file %s for verifying.\n", verifyFilename);
+			return 1;
+		}
+	}
 #endif
+	if (hashFilename != NULL && !CK_HashOpen(hashFilename))
+	{
+		fprintf(stderr, "Couldn't open hash file %s for writing.\n", hashFilename);
+		return 1;
+	}
+	if (verifyHashFilename != NULL && !CK_VerifyHashOpen(verifyHashFilename))
+	{
+		fprintf(stderr, "Couldn't open hash file %s for verifying.\n", verifyHashFilename);
+		return 1;
+	}
+	if (collideLogFilename != NULL && !CK_CollideLogOpen(collideLogFilename))
+	{
+		fprintf(stderr, "Couldn't open collision log %s for writing.\n", collideLogFilename);
+		return 1;
+	}
+	if (varTraceFilename != NULL && !CK_VAR_TraceLookups(varTraceFilename))
+	{
+		fprintf(stderr, "Couldn't open trace file %s for writing.\n", varTraceFilename);
+		return 1;
+	}
 
 	vl_swapInterval = swapInterval;
 	VL_SetParams(isFullScreen, isAspectCorrected, hasBorder, isIntegerScaled);
@@ -647,14 +728,31 @@ int main(int argc, char *argv[])
 			ck_gameState.levelState = LS_Playing;
 
 			CK_PlayDemoFile(argv[i + 1]);
+			CK_HashClose();
+			CK_CollideLogClose();
+#ifdef CK_ENABLE_PLAYLOOP_DUMPER
+			CK_DumpClose();
+#endif
 			Quit(0);
 		}
-		else if (!CK_Cross_strcasecmp(argv[i], "/PLAYDEMO"))
+		else if (!CK_Cross_strcasecmp(argv[i], "/PLAYDEMO") || !CK_Cross_strcasecmp(argv[i], "/TIMEDEMO"))
 		{
+			// /TIMEDEMO plays the demo the same way, ID_RF just
+			// doesn't wait for real time to pass between frames.
 			// A bit of stuff from the usual demo loop
 			ck_gameState.levelState = LS_Playing;
 
 			CK_PlayDemo(atoi(argv[i + 1]));
+			CK_HashClose();
+			CK_CollideLogClose();
+#ifdef CK_ENABLE_PLAYLOOP_DUMPER
+			CK_DumpClose();
+#endif
+			Quit(0);
+		}
+		else if (!CK_Cross_strcasecmp(argv[i], "/CHECKCONTEXTS"))
+		{
+			CK_CheckDemoContexts(atoi(argv[i + 1]));
 			Quit(0);
 		}
 
@@ -665,10 +763,11 @@ int main(int argc, char *argv[])
 
 	// Draw the ANSI "Press Key When Ready Screen" here
 	CK_DemoLoop();
+	CK_HashClose();
+	CK_CollideLogClose();
 	CK_ShutdownID();
 #ifdef CK_ENABLE_PLAYLOOP_DUMPER
-	if (ck_dumperFile)
-		fclose(ck_dumperFile);
+	CK_DumpClose();
 #endif
 	return 0;
 }
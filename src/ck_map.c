@@ -248,9 +248,16 @@ void CK_UpdateScoreBox(CK_object *scorebox)
 
 	if (updated)
 	{
-		CAL_ShiftSprite(spr->data, &spr->data[spr->sprShiftOffset[1]], box->width, box->height, 2);
-		CAL_ShiftSprite(spr->data, &spr->data[spr->sprShiftOffset[2]], box->width, box->height, 4);
-		CAL_ShiftSprite(spr->data, &spr->data[spr->sprShiftOffset[3]], box->width, box->height, 6);
+		if (spr->chunky)
+		{
+			CA_UpdateChunkySprite(CK_CHUNKNUM(SPR_SCOREBOX));
+		}
+		else
+		{
+			CAL_ShiftSprite(spr->data, &spr->data[spr->sprShiftOffset[1]], box->width, box->height, 2);
+			CAL_ShiftSprite(spr->data, &spr->data[spr->sprShiftOffset[2]], box->width, box->height, 4);
+			CAL_ShiftSprite(spr->data, &spr->data[spr->sprShiftOffset[3]], box->width, box->height, 6);
+		}
 		RF_AddSpriteDraw(&scorebox->sde, scorebox->posX + 0x40, scorebox->posY + 0x40, CK_CHUNKNUM(SPR_SCOREBOX), false, 3);
 	}
 }
@@ -557,13 +564,6 @@ void CK_AnimateMapTeleporter(int tileX, int tileY)
 #endif
 // =========================================================================
 // Map Flags
-typedef struct
-{
-	uint16_t x, y;
-
-} CK_FlagPoint;
-
-static CK_FlagPoint ck_flagPoints[30];
 
 void CK_MapFlagSpawn(int tileX, int tileY)
 {
@@ -591,7 +591,6 @@ void CK_MapFlagSpawn(int tileX, int tileY)
 }
 #if defined(WITH_KEEN4) || defined(WITH_KEEN6)
 
-int ck_flagTileSpotX, ck_flagTileSpotY;
 void CK_FlippingFlagSpawn(int tileX, int tileY)
 {
 	int32_t dx, dy;
@@ -38,16 +38,6 @@ static int16_t ck_physSlopeHeight[8][16] = {
 	{0x0F8, 0x0F0, 0x0E8, 0x0E0, 0x0D8, 0x0D0, 0x0C8, 0x0C0, 0x0B8, 0x0B0, 0x0A8, 0x0A0, 0x098, 0x090, 0x088, 0x080},
 	{0x0F0, 0x0E0, 0x0D0, 0x0C0, 0x0B0, 0x0A0, 0x090, 0x080, 0x070, 0x060, 0x050, 0x040, 0x030, 0x020, 0x010, 0x000}};
 
-CK_objPhysData ck_oldRects;
-CK_objPhysDataDelta ck_deltaRects;
-int16_t ck_nextX;
-int16_t ck_nextY;
-
-// Present in ck6; set when keen is being moved by a gik or blooglet
-bool ck_keenIgnoreVertClip;
-
-extern CK_object *ck_keenObj;
-
 void CK_ResetClipRects(CK_object *obj)
 {
 	//NOTE: As tile rects are rarely used, keen does not calculate them here.
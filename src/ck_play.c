@@ -20,14 +20,20 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 //#inclucd "id_heads.h"
 #include "ck_play.h"
 #include "id_ca.h"
+#include "id_cfg.h"
 #include "id_fs.h"
 #include "id_in.h"
+#include "id_prof.h"
 #include "id_rf.h"
 #include "id_sd.h"
 #include "id_us.h"
 #include "id_vl.h"
+#include "ck_collide.h"
 #include "ck_def.h"
+#include "ck_dump.h"
 #include "ck_game.h"
+#include "ck_hash.h"
+#include "ck_rewind.h"
 
 #include "ck_act.h"
 #include "ck_text.h"
@@ -35,54 +41,30 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "ck_cross.h" /* For CK_Cross_SwapLE16 */
 
+#include <setjmp.h> /* For run-ahead */
 #include <stdio.h>  /* for sscanf() */
 #include <stdlib.h> /* For abs() */
 #include <string.h> /* For memset() */
 
-CK_object ck_objArray[CK_MAX_OBJECTS];
-
-CK_object *ck_freeObject;
-CK_object *ck_lastObject;
-int ck_numObjects;
-
-CK_object *ck_keenObj;
-
-static CK_object tempObj;
-
-#ifdef CK_ENABLE_PLAYLOOP_DUMPER
-FILE *ck_dumperFile;
-#endif
-
-// The rectangle within which objects are active.
-int ck_activeX0Tile;
-int ck_activeY0Tile;
-int ck_activeX1Tile;
-int ck_activeY1Tile;
+// The object array, the game state and the rest of the simulation state
+// live in the current CK_Context (see ck_context.c).
+#define tempObj (ck_context->tempObj)
 
 void CK_KeenCheckSpecialTileInfo(CK_object *obj);
 
 // Set to enable F10 debugging tools
 bool ck_debugActive = false;
 
-CK_GameState ck_gameState;
-
 static bool ck_slowMotionEnabled = false;
 
-// Switch to toggle Camera following keen.
-bool ck_scrollDisabled = false;
-
 // Set if game started with /DEMO parm
 int ck_demoParm;
 
 // invincibility switch
 bool ck_godMode;
 
-// invincibility timer
-int16_t ck_invincibilityTimer;
-
 // ScoreBox
 bool ck_scoreBoxEnabled;
-CK_object *ck_scoreBoxObj;
 
 // Two button firing
 bool ck_twoButtonFiring;
@@ -96,21 +78,13 @@ bool ck_svgaCompatibility;
 // Gamepad
 bool ck_gamePadEnabled;
 
-// Pogo timer for two-button firing
-int ck_pogoTimer;
-
-// current frame's input state
-IN_ControlFrame ck_inputFrame;
-
 // A bunch of global variables from other modules that should be
 // handled better, but are just defined here for now
 
 extern int game_in_progress;
-extern int load_game_error, ck_startingSavedGame;
+extern int load_game_error;
 extern CK_Difficulty ck_startingDifficulty;
-extern CK_object *ck_scoreBoxObj;
 
-extern int ck6_smashScreenDistance;
 extern int16_t ck6_smashScreenOfs[];
 
 void CK_CountActiveObjects()
@@ -373,15 +347,75 @@ void CK_ItemCheat()
 				ck_gameState.keyGems[3] = 1;
 }
 
+/*** Used for saved games compatibility ***/
+#define COMPAT_ORIG_OBJ_SIZE 76
+
+// The most objects which can have distinct 16-bit offsets, none of which is
+// zero or tempObj's.
+static int CK_MaxObjArraySize(void)
+{
+	uint16_t objArrayOffset = CK_INT(ck_exe_objArrayOffset, 0x0000);
+	uint16_t tempObjOffset = CK_INT(ck_exe_tempObjOffset, 0xFEFE);
+	int n = 0;
+	while (n < 0x10000 / COMPAT_ORIG_OBJ_SIZE)
+	{
+		uint16_t offset = objArrayOffset + n * COMPAT_ORIG_OBJ_SIZE;
+		if (!offset || offset == tempObjOffset)
+			break;
+		++n;
+	}
+	return CK_Cross_max(n, CK_MAX_OBJECTS);
+}
+
+// The size of the object array for the current map. Every nonzero spot in
+// the info plane could spawn an object, and levels with no more of them than
+// CK_MAX_OBJECTS get an array of that size, so behave exactly as the original
+// when it runs out. Denser ones get an extra CK_MAX_OBJECTS for the objects
+// spawned during play.
+int CK_ObjArraySizeForMap(void)
+{
+	int spawnSpots = 0;
+	for (int y = 0; y < CA_GetMapHeight(); ++y)
+		for (int x = 0; x < CA_GetMapWidth(); ++x)
+			if (CA_TileAtPos(x, y, 2))
+				spawnSpots++;
+
+	return (spawnSpots <= CK_MAX_OBJECTS) ? CK_MAX_OBJECTS : spawnSpots + CK_MAX_OBJECTS;
+}
+
+// Sizes the object array, and the sprite table to match. Growing the array
+// may move it, so this has to be followed by CK_SetupObjArray.
+void CK_SizeObjArray(int size)
+{
+	size = CK_Cross_max(CK_MAX_OBJECTS, CK_Cross_min(size, CK_MaxObjArraySize()));
+	if (size > ck_context->objArrayAllocated)
+	{
+		CK_object *objArray = (CK_object *)realloc(ck_objArray, size * sizeof(CK_object));
+		if (!objArray)
+			Quit("CK_SizeObjArray: Couldn't allocate the object array!");
+		memset(objArray + ck_context->objArrayAllocated, 0, (size - ck_context->objArrayAllocated) * sizeof(CK_object));
+		ck_objArray = objArray;
+		ck_context->objArrayAllocated = size;
+	}
+	ck_objArraySize = size;
+
+	// The original has 60 sprites for 100 objects, but that's too few once
+	// there are enough objects that they can't all be offscreen.
+	RF_SizeSpriteTable(size > CK_MAX_OBJECTS ? size : RF_MAX_SPRITETABLEENTRIES);
+}
+
 void CK_SetupObjArray()
 {
-	for (int i = 0; i < CK_MAX_OBJECTS; ++i)
+	if (!ck_objArraySize)
+		CK_SizeObjArray(CK_MAX_OBJECTS);
+
+	for (int i = 0; i < ck_objArraySize; ++i)
 	{
 		ck_objArray[i].prev = &(ck_objArray[i + 1]);
 		ck_objArray[i].next = 0;
 	}
 
-	ck_objArray[CK_MAX_OBJECTS - 1].prev = 0;
+	ck_objArray[ck_objArraySize - 1].prev = 0;
 
 	ck_freeObject = &ck_objArray[0];
 	ck_lastObject = 0;
@@ -426,6 +460,39 @@ CK_object *CK_GetNewObj(bool nonCritical)
 	return newObj;
 }
 
+// Takes the object at the given index from the free list, and adds it to the
+// end of the object list, as CK_GetNewObj does. Used to put the objects of
+// saved games back where they were. Returns NULL if it's taken.
+CK_object *CK_GetObjAtIndex(int index)
+{
+	if (index < 0 || index >= ck_objArraySize)
+		return NULL;
+
+	CK_object *obj = &ck_objArray[index];
+	CK_object **link = &ck_freeObject;
+	while (*link && *link != obj)
+		link = &(*link)->prev;
+	if (!*link)
+		return NULL;
+	*link = obj->prev;
+
+	memset(obj, 0, sizeof(CK_object));
+
+	if (ck_lastObject)
+	{
+		ck_lastObject->next = obj;
+	}
+	obj->prev = ck_lastObject;
+
+	obj->active = OBJ_ACTIVE;
+	obj->clipped = CLIP_normal;
+
+	ck_lastObject = obj;
+	ck_numObjects++;
+
+	return obj;
+}
+
 void CK_RemoveObj(CK_object *obj)
 {
 	if (obj == ck_keenObj)
@@ -455,12 +522,12 @@ void CK_RemoveObj(CK_object *obj)
 	ck_numObjects--;
 }
 
-/*** Used for saved games compatibility ***/
-#define COMPAT_ORIG_OBJ_SIZE 76
+// Objects past the first CK_MAX_OBJECTS get offsets beyond the end of the
+// original array, wrapping around, which CK_MaxObjArraySize keeps distinct.
 uint16_t CK_ConvertObjPointerTo16BitOffset(CK_object *obj)
 {
-	if ((obj >= ck_objArray) && (obj < ck_objArray + CK_MAX_OBJECTS))
-		return (obj - ck_objArray) * COMPAT_ORIG_OBJ_SIZE + CK_INT(ck_exe_objArrayOffset, 0x0000);
+	if ((obj >= ck_objArray) && (obj < ck_objArray + ck_objArraySize))
+		return (uint16_t)((obj - ck_objArray) * COMPAT_ORIG_OBJ_SIZE + CK_INT(ck_exe_objArrayOffset, 0x0000));
 	if (obj == &tempObj)
 		return CK_INT(ck_exe_tempObjOffset, 0xFEFE);
 	return 0;
@@ -469,11 +536,14 @@ uint16_t CK_ConvertObjPointerTo16BitOffset(CK_object *obj)
 CK_object *CK_ConvertObj16BitOffsetToPointer(uint16_t offset)
 {
 	uint16_t objArrayOffset = CK_INT(ck_exe_objArrayOffset, 0x0000);
-	// Original size of each object was 76 bytes
-	if ((offset >= objArrayOffset) && (offset < objArrayOffset + COMPAT_ORIG_OBJ_SIZE * CK_MAX_OBJECTS))
-		return ck_objArray + (offset - objArrayOffset) / COMPAT_ORIG_OBJ_SIZE;
+	// tempObj's offset is past the end of the original array, but may be
+	// within a bigger one.
 	if (offset == CK_INT(ck_exe_tempObjOffset, 0xFEFE))
 		return &tempObj;
+	// Original size of each object was 76 bytes
+	uint16_t arrayOffset = offset - objArrayOffset;
+	if (arrayOffset < COMPAT_ORIG_OBJ_SIZE * ck_objArraySize)
+		return ck_objArray + arrayOffset / COMPAT_ORIG_OBJ_SIZE;
 	return NULL;
 }
 
@@ -830,6 +900,8 @@ void CK_WallDebug()
 			}
 		}
 	}
+	// The chunky copies of the tiles no longer match, so fall back to the planar ones.
+	CA_FreeTileAtlas();
 	// Hack to work around F10-Y not updating the screen immediately.
 	RF_Reposition(rf_scrollXUnit, rf_scrollYUnit);
 }
@@ -895,6 +967,21 @@ bool CK_DebugKeys()
 		// Nope, no return of "true"
 	}
 
+#ifdef WITH_PROFILER
+	// Frame profiler overlay
+	if (IN_GetKeyState(IN_SC_F) && game_in_progress)
+	{
+		US_CenterWindow(18, 3);
+		if (PROF_ToggleOverlay())
+			US_PrintCentered("Profiler overlay ON");
+		else
+			US_PrintCentered("Profiler overlay OFF");
+		VH_UpdateScreen();
+		IN_WaitButton();
+		return true;
+	}
+#endif
+
 	// God Mode
 	if (IN_GetKeyState(IN_SC_G) && game_in_progress)
 	{
@@ -986,6 +1073,19 @@ bool CK_DebugKeys()
 
 	// Pause
 
+	// Rewind buffer overlay
+	if (IN_GetKeyState(IN_SC_R) && game_in_progress && CK_RewindEnabled())
+	{
+		US_CenterWindow(18, 3);
+		if (CK_ToggleRewindOverlay())
+			US_PrintCentered("Rewind overlay ON");
+		else
+			US_PrintCentered("Rewind overlay OFF");
+		VH_UpdateScreen();
+		IN_WaitButton();
+		return true;
+	}
+
 	// Slow Motion
 	if (IN_GetKeyState(IN_SC_S) && game_in_progress)
 	{
@@ -1864,9 +1964,6 @@ void CK_ShowStatusWindow(void)
 
 // ===========================================================================
 
-extern int rf_scrollXUnit;
-extern int rf_scrollYUnit;
-
 // The intended y-coordinate of the bottom of the keen sprite
 // in pixels from the top of the screen.
 static uint16_t screenYpx;
@@ -2151,7 +2248,240 @@ void CK_NormalCamera(CK_object *obj)
 
 // Play a level.
 
-void CK_PlayLoop()
+// Set while run-ahead simulates frames which will be thrown away, so they
+// aren't dumped or hashed.
+static bool ck_runningAhead;
+
+// Runs one frame of the simulation: activates, thinks and collides the
+// objects, then draws them and moves the camera.
+static void CK_PlayLoopSimulate(void)
+{
+	// Set, unset active objects.
+	PROF_BEGIN(Think);
+	for (CK_object *currentObj = ck_keenObj; currentObj; currentObj = currentObj->next)
+	{
+
+		if (!currentObj->active &&
+			(currentObj->clipRects.tileX2 >= RF_UnitToTile(rf_scrollXUnit) - 1) &&
+			(currentObj->clipRects.tileX1 <= RF_UnitToTile(rf_scrollXUnit) + RF_PixelToTile(320) + 1) &&
+			(currentObj->clipRects.tileY1 <= RF_UnitToTile(rf_scrollYUnit) + RF_PixelToTile(208) + 1) &&
+			(currentObj->clipRects.tileY2 >= RF_UnitToTile(rf_scrollYUnit) - 1))
+		{
+			currentObj->active = OBJ_ACTIVE;
+			currentObj->visible = true;
+		}
+		if (currentObj->active)
+		{
+			if ((currentObj->clipRects.tileX2 < ck_activeX0Tile) ||
+				(currentObj->clipRects.tileX1 > ck_activeX1Tile) ||
+				(currentObj->clipRects.tileY1 > ck_activeY1Tile) ||
+				(currentObj->clipRects.tileY2 < ck_activeY0Tile))
+			{
+				//TODO: Add an Episode callback. Ep 4 requires
+				// type 33 to remove int33 (Andy's decomp)
+				// For Ep 5 that's type 7
+				if (currentObj->active == OBJ_EXISTS_ONLY_ONSCREEN)
+				{
+					CK_RemoveObj(currentObj);
+					continue;
+				}
+				else if (currentObj->active != OBJ_ALWAYS_ACTIVE)
+				{
+					if (US_RndT() < SD_GetSpriteSync() * 2 || vl_screenFaded || ck_startingSavedGame)
+					{
+						RF_RemoveSpriteDraw(&currentObj->sde);
+						if (currentObj->type == CT_CLASS(StunnedCreature))
+							RF_RemoveSpriteDrawUsing16BitOffset(&currentObj->user3);
+						currentObj->active = OBJ_INACTIVE;
+						continue;
+					}
+				}
+			}
+			CK_RunAction(currentObj);
+		}
+	}
+	PROF_END(Think);
+	if (!ck_runningAhead)
+	{
+#ifdef CK_ENABLE_PLAYLOOP_DUMPER
+		CK_DumpFrame();
+#endif
+		CK_HashFrame();
+	}
+
+	if (ck_keenState.platform)
+		CK_KeenRidePlatform(ck_keenObj);
+
+	PROF_BEGIN(Collide);
+	CK_CollideObjects(!ck_runningAhead);
+	PROF_END(Collide);
+
+	//TODO: If world map and keen4, check wetsuit.
+
+	//TODO: If not world map, check keen -> item-tile collision.
+
+	if (ca_mapOn == 0)
+		ck_currentEpisode->mapMiscFlagsCheck(ck_keenObj);
+	else
+		CK_KeenCheckSpecialTileInfo(ck_keenObj);
+
+	PROF_BEGIN(Draw);
+	for (CK_object *currentObj = ck_keenObj; currentObj; currentObj = currentObj->next)
+	{
+		if (currentObj->active)
+		{
+			if (currentObj->clipRects.tileY2 >= (CA_GetMapHeight() - 1))
+			{
+				if (currentObj->type == CT_Player)
+				{
+					// Kill Keen if he exits the bottom of the map.
+					ck_gameState.levelState = LS_Died;
+					continue;
+				}
+				else
+				{
+					CK_RemoveObj(currentObj);
+					continue;
+				}
+			}
+			if (currentObj->visible && currentObj->currentAction->draw)
+			{
+				currentObj->visible = false; //We don't need to render it twice!
+				currentObj->currentAction->draw(currentObj);
+			}
+		}
+	}
+	PROF_END(Draw);
+
+	// Follow the player with the camera.
+	if (ca_mapOn == 0 || (ck_currentEpisode->ep == EP_CK4 && ca_mapOn == 17))
+		CK_MapCamera(ck_keenObj);
+	else
+		CK_NormalCamera(ck_keenObj);
+
+	//Draw the scorebox
+	CK_UpdateScoreBox(ck_scoreBoxObj);
+}
+
+// Counts down the timers which run between frames.
+static void CK_PlayLoopTimers(void)
+{
+	if (ck_invincibilityTimer)
+	{
+		ck_invincibilityTimer -= SD_GetSpriteSync();
+		if (ck_invincibilityTimer < 0)
+			ck_invincibilityTimer = 0;
+	}
+
+#ifdef WITH_KEEN6
+	if (ck_currentEpisode->ep == EP_CK6 && ck6_smashScreenDistance)
+	{
+		if ((ck6_smashScreenDistance -= SD_GetSpriteSync()) < 0)
+			ck6_smashScreenDistance = 0;
+	}
+#endif
+}
+
+// Run-ahead hides some of the input latency. After each real frame has been
+// simulated, the state is saved, ck_runAheadFrames more frames are simulated
+// with the same input, and the last of those is shown before the real state
+// is restored. The hidden frames are silent, and if one tries to present
+// something (e.g. an item message, which waits for a key) it is abandoned,
+// and the real frame is shown instead.
+#define CK_MAX_RUNAHEAD 4
+
+static int ck_runAheadFrames;
+static void *ck_runAheadState;
+static size_t ck_runAheadStateSize;
+static jmp_buf ck_runAheadAbort;
+
+static void CK_RunAheadPresentHook(void)
+{
+	longjmp(ck_runAheadAbort, 1);
+}
+
+static void CK_StartRunAhead(void)
+{
+	ck_runAheadFrames = CK_Cross_max(0, CK_Cross_min(CFG_GetConfigInt("runAheadFrames", 0), CK_MAX_RUNAHEAD));
+	if (!ck_runAheadFrames)
+		return;
+
+	// The snapshot size depends on the size of the map and its pools.
+	if (CK_SnapshotSize() != ck_runAheadStateSize)
+	{
+		free(ck_runAheadState);
+		ck_runAheadStateSize = CK_SnapshotSize();
+		ck_runAheadState = malloc(ck_runAheadStateSize);
+		if (!ck_runAheadState)
+			Quit("Couldn't allocate the run-ahead state!");
+	}
+}
+
+// Goes back to the real state saved by CK_RunAheadRefresh.
+static void CK_RunAheadRestore(void)
+{
+	if (!CK_RestoreState(ck_runAheadState, ck_runAheadStateSize))
+	{
+		CK_Cross_LogMessage(CK_LOG_MSG_WARNING, "Run-ahead: Couldn't restore the game state, disabling run-ahead for this level.\n");
+		ck_runAheadFrames = 0;
+	}
+
+	// The scorebox sprite is only redrawn when the values it shows change,
+	// and still holds the ones from the frames run ahead.
+	if (ck_scoreBoxObj)
+	{
+		ck_scoreBoxObj->user1 = ck_scoreBoxObj->user2 = -1;
+		ck_scoreBoxObj->user3 = ck_scoreBoxObj->user4 = -1;
+	}
+}
+
+static void CK_RunAheadRefresh(void)
+{
+	RF_AnimateTiles();
+	if (!CK_SnapshotState(ck_runAheadState, ck_runAheadStateSize))
+	{
+		CK_Cross_LogMessage(CK_LOG_MSG_WARNING, "Run-ahead: Couldn't save the game state, disabling run-ahead for this level.\n");
+		ck_runAheadFrames = 0;
+		RF_RefreshScreen();
+		return;
+	}
+
+	SD_SetMuted(true);
+	VL_SetPresentHook(CK_RunAheadPresentHook);
+	ck_runningAhead = true;
+	if (setjmp(ck_runAheadAbort))
+	{
+		ck_runningAhead = false;
+		VL_SetPresentHook(NULL);
+		SD_SetMuted(false);
+		CK_RunAheadRestore();
+		RF_RefreshScreen();
+		return;
+	}
+	for (int i = 0; i < ck_runAheadFrames && ck_gameState.levelState == LS_Playing; ++i)
+	{
+		CK_PlayLoopTimers();
+		CK_PlayLoopSimulate();
+		RF_AnimateTiles();
+	}
+	ck_runningAhead = false;
+	VL_SetPresentHook(NULL);
+	SD_SetMuted(false);
+
+	RF_RefreshScreen();
+
+	// Keep the time which passed while showing the frame.
+	uint32_t timeCount = SD_GetTimeCount();
+	int32_t lastTimeCount = SD_GetLastTimeCount();
+	uint16_t spriteSync = SD_GetSpriteSync();
+	CK_RunAheadRestore();
+	SD_SetTimeCount(timeCount);
+	SD_SetLastTimeCount(lastTimeCount);
+	SD_SetSpriteSync(spriteSync);
+}
+
+// Sets up the level which has just been loaded for playing.
+void CK_PlayLoopStart(void)
 {
 	StartMusic(ck_gameState.currentLevel);
 	ck_pogoTimer = 0;
@@ -2176,160 +2506,61 @@ void CK_PlayLoop()
 	SD_SetSpriteSync(3);
 	SD_SetLastTimeCount(3);
 	SD_SetTimeCount(3);
+}
+
+// Runs and draws one frame, without any of the interactive parts of the play
+// loop (menus, cheats, rewind and run-ahead). Used to step the game from
+// outside (see ck_lib.c).
+void CK_PlayLoopStep(void)
+{
+	CK_HandleInput();
+	CK_PlayLoopSimulate();
+	ck_startingSavedGame = 0;
+	RF_Refresh();
+	CK_PlayLoopTimers();
+}
+
+void CK_PlayLoopEnd(void)
+{
+	game_in_progress = 0;
+	StopMusic();
+}
+
+void CK_PlayLoop()
+{
+	CK_PlayLoopStart();
+	CK_ResetRewind();
+	CK_StartRunAhead();
 
 	while (ck_gameState.levelState == LS_Playing)
 	{
+		PROF_FRAME();
 
+		PROF_BEGIN(Input);
 		IN_PumpEvents();
 		CK_HandleInput();
+		PROF_END(Input);
 
-		// Set, unset active objects.
-		for (CK_object *currentObj = ck_keenObj; currentObj; currentObj = currentObj->next)
+		// Holding Backspace steps back a frame instead of running one.
+		if (IN_GetKeyState(IN_SC_Backspace) && CK_RewindStep())
 		{
-
-			if (!currentObj->active &&
-				(currentObj->clipRects.tileX2 >= RF_UnitToTile(rf_scrollXUnit) - 1) &&
-				(currentObj->clipRects.tileX1 <= RF_UnitToTile(rf_scrollXUnit) + RF_PixelToTile(320) + 1) &&
-				(currentObj->clipRects.tileY1 <= RF_UnitToTile(rf_scrollYUnit) + RF_PixelToTile(208) + 1) &&
-				(currentObj->clipRects.tileY2 >= RF_UnitToTile(rf_scrollYUnit) - 1))
-			{
-				currentObj->active = OBJ_ACTIVE;
-				currentObj->visible = true;
-			}
-			if (currentObj->active)
-			{
-				if ((currentObj->clipRects.tileX2 < ck_activeX0Tile) ||
-					(currentObj->clipRects.tileX1 > ck_activeX1Tile) ||
-					(currentObj->clipRects.tileY1 > ck_activeY1Tile) ||
-					(currentObj->clipRects.tileY2 < ck_activeY0Tile))
-				{
-					//TODO: Add an Episode callback. Ep 4 requires
-					// type 33 to remove int33 (Andy's decomp)
-					// For Ep 5 that's type 7
-					if (currentObj->active == OBJ_EXISTS_ONLY_ONSCREEN)
-					{
-						CK_RemoveObj(currentObj);
-						continue;
-					}
-					else if (currentObj->active != OBJ_ALWAYS_ACTIVE)
-					{
-						if (US_RndT() < SD_GetSpriteSync() * 2 || vl_screenFaded || ck_startingSavedGame)
-						{
-							RF_RemoveSpriteDraw(&currentObj->sde);
-							if (currentObj->type == CT_CLASS(StunnedCreature))
-								RF_RemoveSpriteDrawUsing16BitOffset(&currentObj->user3);
-							currentObj->active = OBJ_INACTIVE;
-							continue;
-						}
-					}
-				}
-				CK_RunAction(currentObj);
-			}
-		}
-#ifdef CK_ENABLE_PLAYLOOP_DUMPER
-		if (ck_dumperFile)
-		{
-			bool CK_SaveObject(FS_File fp, CK_object * o);
-			bool CK_SaveGameState(FS_File fp, CK_GameState * state);
-
-			uint32_t timecountToDump = SD_GetTimeCount();
-			FS_WriteInt32LE(&timecountToDump, 1, ck_dumperFile);
-			CK_SaveGameState(ck_dumperFile, &ck_gameState);
-			for (CK_object *currentObj = &ck_objArray[0]; currentObj != &ck_objArray[CK_MAX_OBJECTS]; ++currentObj)
-				CK_SaveObject(ck_dumperFile, currentObj);
-		}
-#endif
-
-		if (ck_keenState.platform)
-			CK_KeenRidePlatform(ck_keenObj);
-
-		for (CK_object *currentObj = ck_keenObj; currentObj; currentObj = currentObj->next)
-		{
-			// Some strange Keen4 stuff here. Ignoring for now.
-
-			if (!currentObj->active)
-				continue;
-			for (CK_object *collideObj = currentObj->next; collideObj; collideObj = collideObj->next)
-			{
-				if (!collideObj->active)
-					continue;
-
-				if ((currentObj->clipRects.unitX2 > collideObj->clipRects.unitX1) &&
-					(currentObj->clipRects.unitX1 < collideObj->clipRects.unitX2) &&
-					(currentObj->clipRects.unitY1 < collideObj->clipRects.unitY2) &&
-					(currentObj->clipRects.unitY2 > collideObj->clipRects.unitY1))
-				{
-					if (currentObj->currentAction->collide)
-						currentObj->currentAction->collide(currentObj, collideObj);
-					if (collideObj->currentAction->collide)
-						collideObj->currentAction->collide(collideObj, currentObj);
-				}
-			}
-		}
-
-		//TODO: If world map and keen4, check wetsuit.
-
-		//TODO: If not world map, check keen -> item-tile collision.
-
-		if (ca_mapOn == 0)
-			ck_currentEpisode->mapMiscFlagsCheck(ck_keenObj);
-		else
-			CK_KeenCheckSpecialTileInfo(ck_keenObj);
-
-		for (CK_object *currentObj = ck_keenObj; currentObj; currentObj = currentObj->next)
-		{
-			if (currentObj->active)
-			{
-				if (currentObj->clipRects.tileY2 >= (CA_GetMapHeight() - 1))
-				{
-					if (currentObj->type == CT_Player)
-					{
-						// Kill Keen if he exits the bottom of the map.
-						ck_gameState.levelState = LS_Died;
-						continue;
-					}
-					else
-					{
-						CK_RemoveObj(currentObj);
-						continue;
-					}
-				}
-				if (currentObj->visible && currentObj->currentAction->draw)
-				{
-					currentObj->visible = false; //We don't need to render it twice!
-					currentObj->currentAction->draw(currentObj);
-				}
-			}
+			CK_UpdateScoreBox(ck_scoreBoxObj);
+			RF_Refresh();
+			continue;
 		}
+		CK_CaptureRewindFrame();
 
-		// Follow the player with the camera.
-		if (ca_mapOn == 0 || (ck_currentEpisode->ep == EP_CK4 && ca_mapOn == 17))
-			CK_MapCamera(ck_keenObj);
-		else
-			CK_NormalCamera(ck_keenObj);
-
-		//Draw the scorebox
-		CK_UpdateScoreBox(ck_scoreBoxObj);
+		CK_PlayLoopSimulate();
 
 		if (ck_startingSavedGame)
 			ck_startingSavedGame = 0;
 
-		RF_Refresh();
-
-		if (ck_invincibilityTimer)
-		{
-			ck_invincibilityTimer -= SD_GetSpriteSync();
-			if (ck_invincibilityTimer < 0)
-				ck_invincibilityTimer = 0;
-		}
+		if (ck_runAheadFrames && IN_DemoGetMode() == IN_Demo_Off)
+			CK_RunAheadRefresh();
+		else
+			RF_Refresh();
 
-#ifdef WITH_KEEN6
-		if (ck_currentEpisode->ep == EP_CK6 && ck6_smashScreenDistance)
-		{
-			if ((ck6_smashScreenDistance -= SD_GetSpriteSync()) < 0)
-				ck6_smashScreenDistance = 0;
-		}
-#endif
+		CK_PlayLoopTimers();
 
 		//TODO: Slow-mo, extra VBLs.
 		if (ck_slowMotionEnabled)
@@ -2381,6 +2612,5 @@ void CK_PlayLoop()
 #endif
 		}
 	}
-	game_in_progress = 0;
-	StopMusic();
+	CK_PlayLoopEnd();
 }
@@ -32,21 +32,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 struct CK_object;
 
-extern int ck_activeX0Tile;
-extern int ck_activeY0Tile;
-extern int ck_activeX1Tile;
-extern int ck_activeY1Tile;
-
-extern bool ck_scrollDisabled;
-
 extern bool ck_godMode;
 
 extern bool ck_debugActive;
 
-extern int16_t ck_invincibilityTimer;
-
 extern bool ck_scoreBoxEnabled;
-extern struct CK_object *ck_scoreBoxObj;
 
 extern bool ck_twoButtonFiring;
 
@@ -57,6 +47,9 @@ extern bool ck_gamePadEnabled;
 
 // Object Mgmt
 struct CK_object *CK_GetNewObj(bool nonCritical);
+struct CK_object *CK_GetObjAtIndex(int index);
+int CK_ObjArraySizeForMap(void);
+void CK_SizeObjArray(int size);
 void CK_SetupObjArray();
 void CK_RemoveObj(struct CK_object *obj);
 
@@ -73,6 +66,10 @@ void CK_ShowStatusWindow(void);
 
 // Playing
 void CK_PlayDemo(int demoChunk);
+void CK_CheckDemoContexts(int demoNumber);
 void CK_PlayLoop();
+void CK_PlayLoopStart(void);
+void CK_PlayLoopStep(void);
+void CK_PlayLoopEnd(void);
 
 #endif //!CK_PLAY_H
@@ -0,0 +1,404 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// Hold-to-rewind.
+//
+// A CK_SnapshotState blob is captured at the start of every frame and stored
+// in a fixed-size byte ring. Every CK_REWIND_KEYFRAME_INTERVAL frames, a
+// keyframe is stored; the frames between are stored as the XOR against that
+// keyframe, run-length encoded word by word. Most of the map planes and
+// objects don't change between frames, so those deltas are tiny. When the
+// ring is full, the oldest keyframe is dropped along with its deltas.
+//
+// Each entry is a sequence of (unchanged words, changed words) counts, each
+// a 7-bit varint, with the changed words' XOR following the second count.
+// Trailing unchanged words are omitted. Keyframes are encoded the same way,
+// against an all-zero buffer.
+
+#include "ck_rewind.h"
+#include "id_cfg.h"
+#include "id_in.h"
+#include "id_rf.h"
+#include "id_sd.h"
+#include "id_us.h"
+#include "id_vh.h"
+#include "ck_cross.h"
+#include "ck_def.h"
+#include "ck_game.h"
+#include "ck_play.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CK_REWIND_KEYFRAME_INTERVAL 64
+#define CK_REWIND_MAX_ENTRIES 16384
+
+typedef struct CK_RewindEntry
+{
+	size_t offset;
+	uint32_t length;
+	uint16_t tics;
+	bool keyframe;
+} CK_RewindEntry;
+
+static bool ck_rewindConfigured;
+static uint8_t *ck_rewindArena;
+static size_t ck_rewindArenaSize;
+
+static CK_RewindEntry *ck_rewindEntries; // CK_REWIND_MAX_ENTRIES, allocated with the arena
+static int ck_rewindFirst;
+static int ck_rewindCount;
+static size_t ck_rewindBytes; // Sum of the lengths of all entries
+static long ck_rewindTics;    // Sum of the tics of all entries
+static int ck_rewindSinceKeyframe;
+
+// Snapshot-sized scratch buffers.
+static int ck_rewindWords;
+static uint32_t *ck_rewindCurrent;
+static uint32_t *ck_rewindKeyframe; // The newest keyframe, decoded
+static uint32_t *ck_rewindZero;
+static uint8_t *ck_rewindEncodeBuf;
+
+static bool ck_rewindOverlay;
+static uint32_t ck_rewindCaptureUs; // Running average
+
+#define CK_RewindEntryAt(i) (&ck_rewindEntries[(ck_rewindFirst + (i)) % CK_REWIND_MAX_ENTRIES])
+
+static uint8_t *CK_RewindPutCount(uint8_t *dst, uint32_t n)
+{
+	while (n >= 0x80)
+	{
+		*dst++ = (uint8_t)(n | 0x80);
+		n >>= 7;
+	}
+	*dst++ = (uint8_t)n;
+	return dst;
+}
+
+static const uint8_t *CK_RewindGetCount(const uint8_t *src, uint32_t *n)
+{
+	uint32_t val = 0;
+	int shift = 0;
+	while (*src & 0x80)
+	{
+		val |= (uint32_t)(*src++ & 0x7F) << shift;
+		shift += 7;
+	}
+	*n = val | ((uint32_t)*src++ << shift);
+	return src;
+}
+
+static size_t CK_RewindEncode(const uint32_t *cur, const uint32_t *ref, uint8_t *dst)
+{
+	uint8_t *out = dst;
+	int i = 0;
+	while (i < ck_rewindWords)
+	{
+		int skipStart = i;
+		while (i < ck_rewindWords && cur[i] == ref[i])
+			i++;
+		if (i == ck_rewindWords)
+			break;
+
+		int litStart = i;
+		while (i < ck_rewindWords && cur[i] != ref[i])
+			i++;
+
+		out = CK_RewindPutCount(out, litStart - skipStart);
+		out = CK_RewindPutCount(out, i - litStart);
+		for (int w = litStart; w < i; ++w)
+		{
+			uint32_t x = cur[w] ^ ref[w];
+			memcpy(out, &x, 4);
+			out += 4;
+		}
+	}
+	return out - dst;
+}
+
+// Applies an encoded entry to dst, which must already hold its reference.
+static void CK_RewindDecode(const uint8_t *src, size_t length, uint32_t *dst)
+{
+	const uint8_t *end = src + length;
+	while (src < end)
+	{
+		uint32_t skip, lit;
+		src = CK_RewindGetCount(src, &skip);
+		src = CK_RewindGetCount(src, &lit);
+		dst += skip;
+		for (uint32_t w = 0; w < lit; ++w)
+		{
+			uint32_t x;
+			memcpy(&x, src, 4);
+			src += 4;
+			*dst++ ^= x;
+		}
+	}
+}
+
+static void CK_RewindDecodeKeyframe(const CK_RewindEntry *entry, uint32_t *dst)
+{
+	memset(dst, 0, ck_rewindWords * 4);
+	CK_RewindDecode(ck_rewindArena + entry->offset, entry->length, dst);
+}
+
+static void CK_RewindDropFirst(void)
+{
+	CK_RewindEntry *entry = CK_RewindEntryAt(0);
+	ck_rewindBytes -= entry->length;
+	ck_rewindTics -= entry->tics;
+	ck_rewindFirst = (ck_rewindFirst + 1) % CK_REWIND_MAX_ENTRIES;
+	ck_rewindCount--;
+}
+
+// Drops the oldest keyframe, and all of the deltas which depend on it.
+static void CK_RewindDropOldest(void)
+{
+	CK_RewindDropFirst();
+	while (ck_rewindCount && !CK_RewindEntryAt(0)->keyframe)
+		CK_RewindDropFirst();
+}
+
+// Finds room for 'length' bytes after the newest entry, dropping old entries
+// as needed. Returns the offset into the arena.
+static size_t CK_RewindAlloc(size_t length)
+{
+	while (ck_rewindCount)
+	{
+		const CK_RewindEntry *first = CK_RewindEntryAt(0);
+		const CK_RewindEntry *last = CK_RewindEntryAt(ck_rewindCount - 1);
+		size_t head = last->offset + last->length;
+
+		if (last->offset >= first->offset)
+		{
+			// The used region doesn't wrap: there is room after it and before it.
+			if (length <= ck_rewindArenaSize - head)
+				return head;
+			if (length <= first->offset)
+				return 0;
+		}
+		else if (head + length <= first->offset)
+		{
+			return head;
+		}
+		CK_RewindDropOldest();
+	}
+	return 0;
+}
+
+static void CK_RewindFreeBuffers(void)
+{
+	free(ck_rewindCurrent);
+	free(ck_rewindKeyframe);
+	free(ck_rewindZero);
+	free(ck_rewindEncodeBuf);
+	ck_rewindCurrent = ck_rewindKeyframe = ck_rewindZero = NULL;
+	ck_rewindEncodeBuf = NULL;
+	ck_rewindWords = 0;
+}
+
+void CK_ShutdownRewind(void)
+{
+	CK_RewindFreeBuffers();
+	free(ck_rewindArena);
+	free(ck_rewindEntries);
+	ck_rewindArena = NULL;
+	ck_rewindEntries = NULL;
+	ck_rewindArenaSize = 0;
+}
+
+void CK_ResetRewind(void)
+{
+	if (!ck_rewindConfigured)
+	{
+		int megabytes = CFG_GetConfigInt("rewindBufferMB", 0);
+		ck_rewindConfigured = true;
+		if (megabytes > 0)
+		{
+			ck_rewindArenaSize = (size_t)megabytes << 20;
+			ck_rewindArena = (uint8_t *)malloc(ck_rewindArenaSize);
+			ck_rewindEntries = (CK_RewindEntry *)malloc(CK_REWIND_MAX_ENTRIES * sizeof(CK_RewindEntry));
+			if (!ck_rewindArena || !ck_rewindEntries)
+				Quit("Couldn't allocate the rewind buffer!");
+			CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "Rewind: Using a %d MB buffer.\n", megabytes);
+			RF_SetOverlayFunc(CK_DrawRewindOverlay);
+		}
+	}
+
+	ck_rewindFirst = 0;
+	ck_rewindCount = 0;
+	ck_rewindBytes = 0;
+	ck_rewindTics = 0;
+	ck_rewindSinceKeyframe = 0;
+
+	if (!ck_rewindArena)
+		return;
+
+	// The snapshot size depends on the map and pool sizes.
+	int words = (int)((CK_SnapshotSize() + 3) / 4);
+	if (words != ck_rewindWords)
+	{
+		CK_RewindFreeBuffers();
+		ck_rewindWords = words;
+		ck_rewindCurrent = (uint32_t *)calloc(words, 4);
+		ck_rewindKeyframe = (uint32_t *)calloc(words, 4);
+		ck_rewindZero = (uint32_t *)calloc(words, 4);
+		// Worst case: every other word changed, costing two counts each.
+		ck_rewindEncodeBuf = (uint8_t *)malloc((size_t)words * 6 + 16);
+		if (!ck_rewindCurrent || !ck_rewindKeyframe || !ck_rewindZero || !ck_rewindEncodeBuf)
+			Quit("Couldn't allocate the rewind buffer!");
+	}
+}
+
+bool CK_RewindEnabled(void)
+{
+	return ck_rewindArena && ck_rewindWords && IN_DemoGetMode() == IN_Demo_Off;
+}
+
+void CK_CaptureRewindFrame(void)
+{
+	if (!CK_RewindEnabled())
+		return;
+
+	uint64_t startTime = CK_Cross_GetMicroseconds();
+
+	CK_SnapshotState(ck_rewindCurrent, ck_rewindWords * 4);
+
+	if (ck_rewindCount == CK_REWIND_MAX_ENTRIES)
+		CK_RewindDropOldest();
+
+	bool keyframe = !ck_rewindCount || ck_rewindSinceKeyframe >= CK_REWIND_KEYFRAME_INTERVAL - 1;
+	size_t length = CK_RewindEncode(ck_rewindCurrent, keyframe ? ck_rewindZero : ck_rewindKeyframe, ck_rewindEncodeBuf);
+	size_t offset;
+	for (;;)
+	{
+		if (length > ck_rewindArenaSize)
+		{
+			CK_Cross_LogMessage(CK_LOG_MSG_WARNING, "Rewind: A %u byte frame doesn't fit in the buffer, disabling rewind.\n", (unsigned)length);
+			CK_ShutdownRewind();
+			return;
+		}
+		offset = CK_RewindAlloc(length);
+		if (keyframe || ck_rewindCount)
+			break;
+
+		// Making room dropped the keyframe this delta was made against, so
+		// store a keyframe instead. It's usually bigger, so check it fits.
+		keyframe = true;
+		length = CK_RewindEncode(ck_rewindCurrent, ck_rewindZero, ck_rewindEncodeBuf);
+	}
+
+	memcpy(ck_rewindArena + offset, ck_rewindEncodeBuf, length);
+	CK_RewindEntry *entry = CK_RewindEntryAt(ck_rewindCount++);
+	entry->offset = offset;
+	entry->length = (uint32_t)length;
+	entry->tics = SD_GetSpriteSync();
+	entry->keyframe = keyframe;
+	ck_rewindBytes += length;
+	ck_rewindTics += entry->tics;
+
+	if (keyframe)
+	{
+		memcpy(ck_rewindKeyframe, ck_rewindCurrent, ck_rewindWords * 4);
+		ck_rewindSinceKeyframe = 0;
+	}
+	else
+	{
+		ck_rewindSinceKeyframe++;
+	}
+
+	uint32_t us = (uint32_t)(CK_Cross_GetMicroseconds() - startTime);
+	ck_rewindCaptureUs = (ck_rewindCaptureUs * 31 + us) / 32;
+}
+
+bool CK_RewindStep(void)
+{
+	if (!CK_RewindEnabled() || !ck_rewindCount)
+		return false;
+
+	CK_RewindEntry *entry = CK_RewindEntryAt(ck_rewindCount - 1);
+	if (entry->keyframe)
+	{
+		CK_RewindDecodeKeyframe(entry, ck_rewindCurrent);
+	}
+	else
+	{
+		memcpy(ck_rewindCurrent, ck_rewindKeyframe, ck_rewindWords * 4);
+		CK_RewindDecode(ck_rewindArena + entry->offset, entry->length, ck_rewindCurrent);
+	}
+
+	// Drop the entry, finding the previous keyframe if we've just dropped one.
+	bool droppedKeyframe = entry->keyframe;
+	ck_rewindBytes -= entry->length;
+	ck_rewindTics -= entry->tics;
+	ck_rewindCount--;
+	if (!droppedKeyframe)
+	{
+		ck_rewindSinceKeyframe--;
+	}
+	else if (ck_rewindCount)
+	{
+		int key = ck_rewindCount - 1;
+		while (!CK_RewindEntryAt(key)->keyframe)
+			key--;
+		CK_RewindDecodeKeyframe(CK_RewindEntryAt(key), ck_rewindKeyframe);
+		ck_rewindSinceKeyframe = ck_rewindCount - 1 - key;
+	}
+
+	if (!CK_RestoreState(ck_rewindCurrent, ck_rewindWords * 4))
+	{
+		CK_ResetRewind();
+		return false;
+	}
+
+	// The scorebox sprite is only redrawn when the values it shows change.
+	if (ck_scoreBoxObj)
+	{
+		ck_scoreBoxObj->user1 = ck_scoreBoxObj->user2 = -1;
+		ck_scoreBoxObj->user3 = ck_scoreBoxObj->user4 = -1;
+	}
+	return true;
+}
+
+bool CK_ToggleRewindOverlay(void)
+{
+	ck_rewindOverlay = !ck_rewindOverlay;
+	return ck_rewindOverlay;
+}
+
+void CK_DrawRewindOverlay(void)
+{
+	if (!ck_rewindOverlay || !ck_rewindArena)
+		return;
+
+	// Two lines in the bottom-right corner.
+	const int boxW = 112;
+	uint16_t w, h;
+	char str[2][40];
+	snprintf(str[0], sizeof(str[0]), "Rewind %ld.%lds %d", ck_rewindTics / 70, (ck_rewindTics % 70) / 7, ck_rewindCount);
+	snprintf(str[1], sizeof(str[1]), "%uK/%uK %uus", (unsigned)(ck_rewindBytes >> 10), (unsigned)(ck_rewindArenaSize >> 10), ck_rewindCaptureUs);
+	VH_MeasurePropString("0", &w, &h, US_GetPrintFont());
+	int x0 = 320 - boxW, y0 = 200 - 2 * h - 2;
+
+	VHB_Bar(x0, y0, boxW, 2 * h + 2, 0);
+	for (int i = 0; i < 2; ++i)
+		VHB_DrawPropString(str[i], x0 + 2, y0 + 1 + i * h, US_GetPrintFont(), 15);
+}
@@ -0,0 +1,43 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CK_REWIND_H
+#define CK_REWIND_H
+
+#include <stdbool.h>
+
+/*
+ * Hold-to-rewind.
+ *
+ * While 'rewindBufferMB' is nonzero in the config file, a snapshot of the
+ * simulation is captured every frame into a ring buffer of (at most) that
+ * many megabytes. Holding Backspace steps back one frame at a time.
+ */
+
+void CK_ShutdownRewind(void);
+// Drops all captured frames. Must be called whenever a new map is loaded.
+void CK_ResetRewind(void);
+void CK_CaptureRewindFrame(void);
+// Restores the last captured frame and drops it from the buffer.
+bool CK_RewindStep(void);
+bool CK_RewindEnabled(void);
+bool CK_ToggleRewindOverlay(void);
+void CK_DrawRewindOverlay(void);
+
+#endif
@@ -238,7 +238,7 @@ void CK_US_DrawSavegameItemBorder(US_CardItem *item)
 	VH_VLine(item->y, item->y + 9, item->x + 148, c);
 }
 
-extern int load_game_error, ck_startingSavedGame;
+extern int load_game_error;
 extern US_CardCommand us_currentCommand;
 extern bool command_confirmed;
 const char *US_GetSavefileName(int index);
@@ -28,6 +28,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "id_fs.h"
 #include "id_us.h"
 #include "id_vh.h"
+#include "id_vl.h"
 #include "ck_cross.h"
 #include "ck_def.h"
 #include "ck_ep.h"
@@ -161,9 +162,11 @@ SD_SoundMode oldsoundmode;
 ca_audinfo ca_audInfoE;
 
 uint8_t ca_levelnum = 0, ca_levelbit = 0;
-int16_t ca_mapOn = 0;
 uint8_t ca_graphChunkNeeded[CA_MAX_GRAPH_CHUNKS] = {0};
 
+// Set while more than one context exists (see CA_SetMapSharing).
+static bool ca_shareMaps;
+
 ca_gfxinfo ca_gfxInfoE;
 mm_ptr_t ca_graphChunks[CA_MAX_GRAPH_CHUNKS];
 
@@ -333,7 +336,9 @@ int CAL_RLEWCompress(void *src, int expLength, void *dest, uint16_t rletag)
 		count = 1;
 		uint16_t val = *srcptr++;
 		expLength -= 2;
-		while (*srcptr == val && expLength)
+		// Runs are limited to what a count can hold, which matters for maps
+		// bigger than the original games'.
+		while (expLength && *srcptr == val && count < 0xFFFF)
 		{
 			count++;
 			expLength -= 2;
@@ -504,6 +509,142 @@ void CAL_ShiftSprite(uint8_t *srcImage, uint8_t *dstImage, int width, int height
 	}
 }
 
+// Classifies a pixel of an unshifted planar sprite for span encoding:
+// 0 is fully transparent, 1 is opaque, and 2 is transparent with colour bits set.
+static int CAL_SpritePixelKind(const uint8_t *planar, size_t planeSize, int byteWidth, int x, int y, uint8_t *colour)
+{
+	size_t offset = y * byteWidth + (x >> 3);
+	int bit = 0x80 >> (x & 7);
+
+	*colour = ((planar[planeSize * 4 + offset] & bit) ? 8 : 0) |
+		((planar[planeSize * 3 + offset] & bit) ? 4 : 0) |
+		((planar[planeSize * 2 + offset] & bit) ? 2 : 0) |
+		((planar[planeSize * 1 + offset] & bit) ? 1 : 0);
+
+	if (!(planar[offset] & bit))
+		return 1;
+	return *colour ? 2 : 0;
+}
+
+// Converts an unshifted planar sprite into spans. If spr is NULL, the spans
+// and pixels are only counted, so the sprite's memory can be allocated.
+static void CAL_EncodeSpanSprite(VL_SpanSprite *spr, const uint8_t *planar, int byteWidth, int height, int *numSpans, int *numPixels)
+{
+	size_t planeSize = byteWidth * height;
+	int spans = 0, pixels = 0;
+
+	for (int y = 0; y < height; ++y)
+	{
+		if (spr)
+			spr->rows[y] = spans;
+
+		for (int x = 0; x < byteWidth * 8;)
+		{
+			uint8_t colour;
+			int kind = CAL_SpritePixelKind(planar, planeSize, byteWidth, x, y, &colour);
+			if (!kind)
+			{
+				x++;
+				continue;
+			}
+
+			int spanStart = x;
+			int spanPixels = pixels;
+			while (x < byteWidth * 8 && CAL_SpritePixelKind(planar, planeSize, byteWidth, x, y, &colour) == kind)
+			{
+				if (spr)
+					spr->pixels[pixels] = colour;
+				pixels++;
+				x++;
+			}
+
+			if (spr)
+			{
+				spr->spans[spans].x = spanStart;
+				spr->spans[spans].w = x - spanStart;
+				spr->spans[spans].pixels = spanPixels;
+				spr->spans[spans].blend = (kind == 2);
+			}
+			spans++;
+		}
+	}
+
+	if (spr)
+		spr->rows[height] = spans;
+	*numSpans = spans;
+	*numPixels = pixels;
+}
+
+// The span sprite follows the planar data, aligned for its pointers.
+static size_t CAL_SpanSpriteOffset(size_t planarSize)
+{
+	return (planarSize + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+}
+
+static size_t CAL_SpanSpriteSize(int height, int numSpans, int numPixels)
+{
+	return sizeof(VL_SpanSprite) + numSpans * sizeof(VL_SpriteSpan) + (height + 1) * sizeof(uint32_t) + numPixels;
+}
+
+// Allocates a sprite chunk holding the unshifted planar data and its chunky copy.
+static VH_ShiftedSprite *CAL_CacheChunkySprite(int chunkNumber, const uint8_t *planar, VH_SpriteTableEntry *sprite)
+{
+	size_t planarSize = sprite->width * sprite->height * 5;
+	int numSpans, numPixels;
+
+	CAL_EncodeSpanSprite(NULL, planar, sprite->width, sprite->height, &numSpans, &numPixels);
+
+	MM_GetPtr(&ca_graphChunks[chunkNumber], sizeof(VH_ShiftedSprite) + CAL_SpanSpriteOffset(planarSize) + CAL_SpanSpriteSize(sprite->height, numSpans, numPixels));
+	VH_ShiftedSprite *shifted = (VH_ShiftedSprite *)ca_graphChunks[chunkNumber];
+	memcpy(shifted->data, planar, planarSize);
+
+	VL_SpanSprite *spr = (VL_SpanSprite *)(shifted->data + CAL_SpanSpriteOffset(planarSize));
+	spr->w = sprite->width * 8;
+	spr->h = sprite->height;
+	spr->numSpans = numSpans;
+	spr->numPixels = numPixels;
+	spr->spans = (VL_SpriteSpan *)(spr + 1);
+	spr->rows = (uint32_t *)(spr->spans + numSpans);
+	spr->pixels = (uint8_t *)(spr->rows + sprite->height + 1);
+	CAL_EncodeSpanSprite(spr, planar, sprite->width, sprite->height, &numSpans, &numPixels);
+
+	shifted->chunky = spr;
+	return shifted;
+}
+
+// Re-encodes the chunky copy of a sprite whose planar data has been
+// modified in place (e.g. the scorebox).
+void CA_UpdateChunkySprite(int chunkNumber)
+{
+	VH_ShiftedSprite *shifted = (VH_ShiftedSprite *)ca_graphChunks[chunkNumber];
+	VH_SpriteTableEntry *sprite = VH_GetSpriteTableEntry(chunkNumber - ca_gfxInfoE.offSprites);
+	int numSpans, numPixels;
+
+	if (!shifted || !shifted->chunky)
+		return;
+
+	CAL_EncodeSpanSprite(NULL, shifted->data, sprite->width, sprite->height, &numSpans, &numPixels);
+	if (numSpans == shifted->chunky->numSpans && numPixels == shifted->chunky->numPixels)
+	{
+		CAL_EncodeSpanSprite(shifted->chunky, shifted->data, sprite->width, sprite->height, &numSpans, &numPixels);
+		return;
+	}
+
+	// The spans don't fit any more, so rebuild the whole chunk.
+	VH_ShiftedSprite header = *shifted;
+	mm_ptr_t planar;
+	size_t planarSize = sprite->width * sprite->height * 5;
+	MM_GetPtr(&planar, planarSize);
+	memcpy(planar, shifted->data, planarSize);
+	MM_FreePtr(&ca_graphChunks[chunkNumber]);
+	shifted = CAL_CacheChunkySprite(chunkNumber, (uint8_t *)planar, sprite);
+	MM_FreePtr(&planar);
+
+	memcpy(shifted->sprShiftOffset, header.sprShiftOffset, sizeof(header.sprShiftOffset));
+	memcpy(shifted->sprShiftByteWidths, header.sprShiftByteWidths, sizeof(header.sprShiftByteWidths));
+	memcpy(shifted->sprShiftPixels, header.sprShiftPixels, sizeof(header.sprShiftPixels));
+}
+
 void CAL_CacheSprite(int chunkNumber, uint8_t *compressed, int compLength)
 {
 	int spriteNumber = chunkNumber - ca_gfxInfoE.offSprites;
@@ -515,20 +656,38 @@ void CAL_CacheSprite(int chunkNumber, uint8_t *compressed, int compLength)
 	// The size of one plane of a shifted sprite (+ 1 byte/row)
 	size_t bigPlane = (sprite->width + 1) * sprite->height;
 
-	size_t fullSize = (smallPlane + (sprite->shifts - 1) * bigPlane) * 5;
+	VH_ShiftedSprite *shifted;
+	size_t shiftOffsets[5];
 
-	MM_GetPtr(&ca_graphChunks[chunkNumber], sizeof(VH_ShiftedSprite) + fullSize);
-	VH_ShiftedSprite *shifted = (VH_ShiftedSprite *)ca_graphChunks[chunkNumber];
+	// Chunky sprites can be drawn at any x position, so we only
+	// need the shifted planar copies if the backend can't draw them.
+	if (VL_SupportsChunky())
+	{
+		mm_ptr_t planar;
+		MM_GetPtr(&planar, smallPlane * 5);
+		CAL_HuffExpand(compressed, planar, smallPlane * 5, ca_gr_huffdict, compLength);
+		shifted = CAL_CacheChunkySprite(chunkNumber, (uint8_t *)planar, sprite);
+		MM_FreePtr(&planar);
+
+		for (int i = 0; i < 5; ++i)
+			shiftOffsets[i] = 0;
+	}
+	else
+	{
+		size_t fullSize = (smallPlane + (sprite->shifts - 1) * bigPlane) * 5;
 
-	size_t shiftOffsets[5];
+		MM_GetPtr(&ca_graphChunks[chunkNumber], sizeof(VH_ShiftedSprite) + fullSize);
+		shifted = (VH_ShiftedSprite *)ca_graphChunks[chunkNumber];
+		shifted->chunky = NULL;
 
-	shiftOffsets[0] = 0;
-	shiftOffsets[1] = smallPlane * 5;
-	shiftOffsets[2] = shiftOffsets[1] + bigPlane * 5;
-	shiftOffsets[3] = shiftOffsets[2] + bigPlane * 5;
-	shiftOffsets[4] = shiftOffsets[3] + bigPlane * 5;
+		shiftOffsets[0] = 0;
+		shiftOffsets[1] = smallPlane * 5;
+		shiftOffsets[2] = shiftOffsets[1] + bigPlane * 5;
+		shiftOffsets[3] = shiftOffsets[2] + bigPlane * 5;
+		shiftOffsets[4] = shiftOffsets[3] + bigPlane * 5;
 
-	CAL_HuffExpand(compressed, shifted->data, smallPlane * 5, ca_gr_huffdict, compLength);
+		CAL_HuffExpand(compressed, shifted->data, smallPlane * 5, ca_gr_huffdict, compLength);
+	}
 
 	switch (sprite->shifts)
 	{
@@ -537,6 +696,7 @@ void CAL_CacheSprite(int chunkNumber, uint8_t *compressed, int compLength)
 		{
 			shifted->sprShiftByteWidths[i] = sprite->width;
 			shifted->sprShiftOffset[i] = shiftOffsets[0];
+			shifted->sprShiftPixels[i] = 0;
 		}
 		break;
 	case 2:
@@ -544,13 +704,16 @@ void CAL_CacheSprite(int chunkNumber, uint8_t *compressed, int compLength)
 		{
 			shifted->sprShiftByteWidths[i] = sprite->width;
 			shifted->sprShiftOffset[i] = shiftOffsets[0];
+			shifted->sprShiftPixels[i] = 0;
 		}
 		for (int i = 2; i < 4; ++i)
 		{
 			shifted->sprShiftByteWidths[i] = sprite->width + 1;
 			shifted->sprShiftOffset[i] = shiftOffsets[1];
+			shifted->sprShiftPixels[i] = 4;
 		}
-		CAL_ShiftSprite(shifted->data, &shifted->data[shiftOffsets[1]], sprite->width, sprite->height, 4);
+		if (!shifted->chunky)
+			CAL_ShiftSprite(shifted->data, &shifted->data[shiftOffsets[1]], sprite->width, sprite->height, 4);
 		break;
 	case 4:
 		shifted->sprShiftByteWidths[0] = sprite->width;
@@ -563,9 +726,15 @@ void CAL_CacheSprite(int chunkNumber, uint8_t *compressed, int compLength)
 		shifted->sprShiftOffset[2] = shiftOffsets[2];
 		shifted->sprShiftOffset[3] = shiftOffsets[3];
 
-		CAL_ShiftSprite(shifted->data, &shifted->data[shiftOffsets[1]], sprite->width, sprite->height, 2);
-		CAL_ShiftSprite(shifted->data, &shifted->data[shiftOffsets[2]], sprite->width, sprite->height, 4);
-		CAL_ShiftSprite(shifted->data, &shifted->data[shiftOffsets[3]], sprite->width, sprite->height, 6);
+		for (int i = 0; i < 4; ++i)
+			shifted->sprShiftPixels[i] = i * 2;
+
+		if (!shifted->chunky)
+		{
+			CAL_ShiftSprite(shifted->data, &shifted->data[shiftOffsets[1]], sprite->width, sprite->height, 2);
+			CAL_ShiftSprite(shifted->data, &shifted->data[shiftOffsets[2]], sprite->width, sprite->height, 4);
+			CAL_ShiftSprite(shifted->data, &shifted->data[shiftOffsets[3]], sprite->width, sprite->height, 6);
+		}
 		break;
 	default:
 		Quit("CAL_CacheSprite: Bad shifts number!");
@@ -774,6 +943,104 @@ void CA_ClearMarks(void)
 	{
 		ca_graphChunkNeeded[i] &= ~ca_levelbit;
 	}
+
+	// The atlas only covers the tiles of the old set of marks.
+	CA_FreeTileAtlas();
+}
+
+// The chunky tile atlas keeps PAL8 copies of the 16x16 tiles needed by the
+// current level, so RF can draw them with plain copies instead of converting
+// the planar data every time. It is a single MM block, laid out as:
+//   uint16_t index16[numTiles16], index16m[numTiles16m]; // slot + 1, 0 = not present
+//   uint8_t tiles16[slots16][16 * 16];
+//   uint8_t tiles16m[slots16m][16 * 16 pixels, then 16 * 16 mask];
+static mm_ptr_t ca_tileAtlas;
+static uint16_t *ca_tileAtlasIndex16;
+static uint16_t *ca_tileAtlasIndex16m;
+static uint8_t *ca_tileAtlasTiles16;
+static uint8_t *ca_tileAtlasTiles16m;
+
+#define CA_CHUNKYTILE16_SIZE (16 * 16)
+#define CA_CHUNKYTILE16M_SIZE (16 * 16 * 2)
+
+static bool CAL_TileInAtlas(int chunk)
+{
+	return (ca_graphChunkNeeded[chunk] & ca_levelbit) && ca_graphChunks[chunk];
+}
+
+static void CAL_BuildTileAtlas(void)
+{
+	int slots16 = 0, slots16m = 0;
+
+	// Backends without byte-per-pixel surfaces keep using the planar path.
+	if (ca_tileAtlas || !VL_SupportsChunky())
+		return;
+
+	for (int i = 0; i < ca_gfxInfoE.numTiles16; ++i)
+		if (CAL_TileInAtlas(ca_gfxInfoE.offTiles16 + i))
+			slots16++;
+	for (int i = 0; i < ca_gfxInfoE.numTiles16m; ++i)
+		if (CAL_TileInAtlas(ca_gfxInfoE.offTiles16m + i))
+			slots16m++;
+
+	if (!slots16 && !slots16m)
+		return;
+
+	size_t indexSize = (ca_gfxInfoE.numTiles16 + ca_gfxInfoE.numTiles16m) * sizeof(uint16_t);
+	MM_GetPtr(&ca_tileAtlas, indexSize + slots16 * CA_CHUNKYTILE16_SIZE + slots16m * CA_CHUNKYTILE16M_SIZE);
+
+	ca_tileAtlasIndex16 = (uint16_t *)ca_tileAtlas;
+	ca_tileAtlasIndex16m = ca_tileAtlasIndex16 + ca_gfxInfoE.numTiles16;
+	ca_tileAtlasTiles16 = (uint8_t *)ca_tileAtlas + indexSize;
+	ca_tileAtlasTiles16m = ca_tileAtlasTiles16 + slots16 * CA_CHUNKYTILE16_SIZE;
+	memset(ca_tileAtlas, 0, indexSize);
+
+	slots16 = 0;
+	for (int i = 0; i < ca_gfxInfoE.numTiles16; ++i)
+	{
+		int chunk = ca_gfxInfoE.offTiles16 + i;
+		if (!CAL_TileInAtlas(chunk))
+			continue;
+		uint8_t *dst = ca_tileAtlasTiles16 + slots16 * CA_CHUNKYTILE16_SIZE;
+		VL_UnmaskedToPAL8(ca_graphChunks[chunk], dst, 0, 0, 16, 16, 16);
+		ca_tileAtlasIndex16[i] = ++slots16;
+	}
+
+	slots16m = 0;
+	for (int i = 0; i < ca_gfxInfoE.numTiles16m; ++i)
+	{
+		int chunk = ca_gfxInfoE.offTiles16m + i;
+		if (!CAL_TileInAtlas(chunk))
+			continue;
+		uint8_t *dst = ca_tileAtlasTiles16m + slots16m * CA_CHUNKYTILE16M_SIZE;
+		uint8_t *mask = dst + CA_CHUNKYTILE16_SIZE;
+		// The mask plane comes first, followed by the four colour planes.
+		VL_UnmaskedToPAL8((uint8_t *)ca_graphChunks[chunk] + 32, dst, 0, 0, 16, 16, 16);
+		memset(mask, 0, CA_CHUNKYTILE16_SIZE);
+		VL_1bppBlitToPAL8(ca_graphChunks[chunk], mask, 0, 0, 16, 16, 16, 0xFF);
+		ca_tileAtlasIndex16m[i] = ++slots16m;
+	}
+}
+
+void CA_FreeTileAtlas(void)
+{
+	if (ca_tileAtlas)
+		MM_FreePtr(&ca_tileAtlas);
+}
+
+uint8_t *CA_GetChunkyTile16(int tile)
+{
+	if (!ca_tileAtlas || tile >= ca_gfxInfoE.numTiles16 || !ca_tileAtlasIndex16[tile])
+		return NULL;
+	return ca_tileAtlasTiles16 + (ca_tileAtlasIndex16[tile] - 1) * CA_CHUNKYTILE16_SIZE;
+}
+
+// Returns the pixels of a masked tile; its mask follows 16 * 16 bytes later.
+uint8_t *CA_GetChunkyTile16m(int tile)
+{
+	if (!ca_tileAtlas || tile >= ca_gfxInfoE.numTiles16m || !ca_tileAtlasIndex16m[tile])
+		return NULL;
+	return ca_tileAtlasTiles16m + (ca_tileAtlasIndex16m[tile] - 1) * CA_CHUNKYTILE16M_SIZE;
 }
 
 void CA_SetGrPurge(void)
@@ -814,7 +1081,8 @@ void CA_CacheMarks(const char *msg)
 		}
 		else
 		{
-			if (ca_graphChunks[i])
+			// Another context may be playing a level that needs it.
+			if (ca_graphChunks[i] && !ca_shareMaps)
 			{
 				MM_SetPurge(&ca_graphChunks[i], 3);
 			}
@@ -822,7 +1090,10 @@ void CA_CacheMarks(const char *msg)
 	}
 
 	if (!numChunksToCache)
+	{
+		CAL_BuildTileAtlas();
 		return;
+	}
 
 	//Loading screen.
 	if (isMessage && ca_beginCacheBox)
@@ -846,6 +1117,8 @@ void CA_CacheMarks(const char *msg)
 		}
 	}
 
+	CAL_BuildTileAtlas();
+
 	//Finish Loading Screen
 	if (isMessage && ca_finishCacheBox)
 		ca_finishCacheBox();
@@ -940,7 +1213,31 @@ FS_File ca_GameMaps;
 
 CA_MapHeader *CA_MapHeaders[CA_NUMMAPS];
 
-uint16_t *CA_mapPlanes[CA_NUMMAPPLANES];
+// Decompressed map planes, as loaded from GAMEMAPS. While more than one
+// context exists, CA_CacheMap keeps these and copies them into the current
+// context, so each map is only read and expanded once.
+static uint16_t *ca_mapCache[CA_NUMMAPS][CA_NUMMAPPLANES];
+
+static void CAL_FreeMapCache(void)
+{
+	for (int map = 0; map < CA_NUMMAPS; ++map)
+	{
+		for (int plane = 0; plane < CA_NUMMAPPLANES; ++plane)
+		{
+			if (ca_mapCache[map][plane])
+				MM_FreePtr((void **)&ca_mapCache[map][plane]);
+		}
+	}
+}
+
+// Called by CK_CreateContext and CK_DestroyContext. The cache is freed as
+// soon as sharing stops, so a single game doesn't keep every map it visits.
+void CA_SetMapSharing(bool share)
+{
+	ca_shareMaps = share;
+	if (!share)
+		CAL_FreeMapCache();
+}
 
 extern uint8_t *ti_tileInfo;
 void CAL_SetupMapFile(void)
@@ -1076,11 +1373,17 @@ void CA_CacheMap(int mapIndex)
 	//Load the map data
 	for (int plane = 0; plane < CA_NUMMAPPLANES; ++plane)
 	{
+		MM_GetPtr((void **)&CA_mapPlanes[plane], planeSize);
+
+		if (ca_mapCache[mapIndex][plane])
+		{
+			memcpy(CA_mapPlanes[plane], ca_mapCache[mapIndex][plane], planeSize);
+			continue;
+		}
+
 		int32_t planeOffset = CA_MapHeaders[mapIndex]->planeOffsets[plane];
 		int32_t planeCompLength = CA_MapHeaders[mapIndex]->planeLengths[plane];
 
-		MM_GetPtr((void **)&CA_mapPlanes[plane], planeSize);
-
 		FS_SeekTo(ca_GameMaps, planeOffset);
 
 		uint16_t *compBuffer;
@@ -1107,6 +1410,12 @@ void CA_CacheMap(int mapIndex)
 		CAL_CarmackExpand(compBuffer + 1, rlewBuffer, carmackExpanded);
 		CAL_RLEWExpand(rlewBuffer + 1, CA_mapPlanes[plane], planeSize, ca_MapHead->rleTag);
 
+		if (ca_shareMaps)
+		{
+			MM_GetPtr((void **)&ca_mapCache[mapIndex][plane], planeSize);
+			memcpy(ca_mapCache[mapIndex][plane], CA_mapPlanes[plane], planeSize);
+		}
+
 		//Release the temp buffers.
 		//MM_UnLockPtr(&compBuffer);
 		MM_FreePtr((void **)(&compBuffer));
@@ -1134,6 +1443,7 @@ void CA_Startup(void)
 
 void CA_Shutdown(void)
 {
+	CAL_FreeMapCache();
 	if (ca_GameMaps)
 		FS_CloseFile(ca_GameMaps);
 	if (ca_graphHandle)
@@ -72,7 +72,6 @@ typedef struct ca_gfxinfo
 } ca_gfxinfo;
 
 extern uint8_t ca_levelnum, ca_levelbit;
-extern int16_t ca_mapOn;
 extern uint8_t ca_graphChunkNeeded[CA_MAX_GRAPH_CHUNKS];
 extern ca_gfxinfo ca_gfxInfoE;
 
@@ -87,8 +86,12 @@ void CA_LockGrChunk(int chunk);
 
 // For the score box.
 void CAL_ShiftSprite(uint8_t *srcImage, uint8_t *dstImage, int width, int height, int pxShift);
+void CA_UpdateChunkySprite(int chunkNumber);
 
 void CA_CacheMarks(const char *msg);
+void CA_FreeTileAtlas(void);
+uint8_t *CA_GetChunkyTile16(int tile);
+uint8_t *CA_GetChunkyTile16m(int tile);
 void CA_UpLevel(void);
 void CA_DownLevel(void);
 
@@ -108,7 +111,17 @@ typedef CK_PACKED_STRUCT(CA_MapHeader
 
 extern CA_MapHeader *CA_MapHeaders[CA_NUMMAPS];
 
-extern uint16_t *CA_mapPlanes[CA_NUMMAPPLANES];
+// The map a context is playing on. Each context has its own copy of the
+// planes, as the game modifies them, while the map headers are shared.
+typedef struct CA_MapState
+{
+	int16_t mapOn;
+	uint16_t *planes[CA_NUMMAPPLANES];
+} CA_MapState;
+
+extern CA_MapState *ca_mapState;
+#define ca_mapOn (ca_mapState->mapOn)
+#define CA_mapPlanes (ca_mapState->planes)
 
 extern uint8_t *CA_audio[CA_MAX_AUDIO_CHUNKS];
 
@@ -118,6 +131,7 @@ extern void (*ca_updateCacheBox)(void);
 extern void (*ca_finishCacheBox)(void);
 
 void CA_CacheMap(int mapIndex);
+void CA_SetMapSharing(bool share);
 uint16_t *CA_TilePtrAtPos(int16_t x, int16_t y, int16_t plane);
 uint16_t CA_TileAtPos(int16_t x, int16_t y, int16_t plane);
 void CA_SetTileAtPos(int16_t x, int16_t y, int16_t plane, uint16_t value);
@@ -462,10 +462,11 @@ void IN_Default(bool gotit, int16_t inputChoice)
 	in_controlType = (IN_ControlType)inputChoice;
 }
 
-uint8_t *in_demoBuf;
-int in_demoPtr;
-int in_demoBytes;
-IN_DemoMode in_demoState;
+// The demo state lives in the current context (see CK_SetContext).
+#define in_demoBuf (in_demo->buf)
+#define in_demoPtr (in_demo->ptr)
+#define in_demoBytes (in_demo->bytes)
+#define in_demoDelay (in_demo->delay)
 
 bool IN_DemoStartRecording(int bufferSize)
 {
@@ -488,6 +489,7 @@ void IN_DemoStartPlaying(uint8_t *data, int len)
 	in_demoBuf = data;
 	in_demoBytes = len;
 	in_demoPtr = 0;
+	in_demoDelay = len ? data[0] : 0;
 	in_demoState = IN_Demo_Playback;
 }
 
@@ -511,6 +513,28 @@ IN_DemoMode IN_DemoGetMode()
 	return in_demoState;
 }
 
+void IN_DemoGetSnapshot(IN_DemoSnapshot *snap)
+{
+	snap->state = in_demoState;
+	snap->ptr = in_demoPtr;
+	snap->delay = in_demoDelay;
+	// While recording, the current entry is still being counted up in place.
+	snap->count = (in_demoBuf && in_demoPtr + 1 < in_demoBytes) ? in_demoBuf[in_demoPtr] : 0;
+	snap->ctrl = (in_demoBuf && in_demoPtr + 1 < in_demoBytes) ? in_demoBuf[in_demoPtr + 1] : 0;
+}
+
+void IN_DemoRestoreSnapshot(const IN_DemoSnapshot *snap)
+{
+	in_demoState = snap->state;
+	in_demoPtr = snap->ptr;
+	in_demoDelay = snap->delay;
+	if (in_demoState == IN_Demo_Record && in_demoBuf && in_demoPtr + 1 < in_demoBytes)
+	{
+		in_demoBuf[in_demoPtr] = snap->count;
+		in_demoBuf[in_demoPtr + 1] = snap->ctrl;
+	}
+}
+
 void IN_DemoFreeBuffer()
 {
 	if (in_demoBuf)
@@ -732,11 +756,13 @@ void IN_ReadControls(int player, IN_ControlFrame *controls)
 		controls->pogo = (ctrlByte >> 5) & 1;
 
 		// Delay for n frames.
-		if ((--in_demoBuf[in_demoPtr]) == 0)
+		if ((--in_demoDelay) == 0)
 		{
 			in_demoPtr += 2;
 			if (in_demoPtr >= in_demoBytes)
 				in_demoState = IN_Demo_PlayDone;
+			else
+				in_demoDelay = in_demoBuf[in_demoPtr];
 		}
 	}
 	else if (in_demoState == IN_Demo_PlayDone)
@@ -253,7 +253,28 @@ typedef struct IN_Cursor
 	IN_Motion yMotion;
 } IN_Cursor;
 
-extern IN_DemoMode in_demoState;
+typedef struct IN_Demo
+{
+	uint8_t *buf;
+	int ptr;
+	int bytes;
+	IN_DemoMode state;
+	// Frames left on the current playback entry. Kept separately (rather
+	// than counting down the buffer in place) so that playback can be rewound.
+	uint8_t delay;
+} IN_Demo;
+
+extern IN_Demo *in_demo;
+#define in_demoState (in_demo->state)
+
+// The demo playback/recording position, for in-memory savestates.
+typedef struct IN_DemoSnapshot
+{
+	IN_DemoMode state;
+	int ptr;
+	uint8_t delay;
+	uint8_t count, ctrl; // The entry being recorded
+} IN_DemoSnapshot;
 extern IN_ControlType in_controlType;
 
 extern bool in_Paused;
@@ -298,6 +319,8 @@ void IN_Default(bool gotit, int16_t inputChoice);
 bool IN_DemoStartRecording(int bufferSize);
 void IN_DemoStartPlaying(uint8_t *data, int len);
 void IN_DemoStopPlaying();
+void IN_DemoGetSnapshot(IN_DemoSnapshot *snap);
+void IN_DemoRestoreSnapshot(const IN_DemoSnapshot *snap);
 void IN_DemoFreeBuffer();
 #if 0
 bool IN_DemoIsPlaying();
@@ -0,0 +1,176 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// Per-frame phase profiler.
+//
+// The time spent in each phase of the play loop is recorded for every frame
+// into a ring buffer holding the last PROF_HISTORY frames. F10+F shows the
+// averages over the last few frames on screen, and '/PROFILE <file.csv>'
+// writes the min/avg/p99/max of each phase over the whole ring buffer on exit.
+
+#ifdef WITH_PROFILER
+
+#include "id_prof.h"
+#include "id_rf.h"
+#include "id_us.h"
+#include "id_vh.h"
+#include "ck_cross.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROF_HISTORY 4096
+// The number of frames averaged for the overlay.
+#define PROF_OVERLAY_FRAMES 32
+
+static const char *prof_phaseNames[PROF_NumPhases] = {
+	"Input",
+	"Think",
+	"Collide",
+	"Draw",
+	"AnimTiles",
+	"UpdTiles",
+	"Erasers",
+	"Sprites",
+	"Present",
+	"CalcTics",
+};
+
+static uint32_t prof_history[PROF_HISTORY][PROF_NumPhases];
+static uint32_t prof_current[PROF_NumPhases];
+static long prof_numFrames; // Total frames recorded, including those overwritten.
+static bool prof_frameStarted;
+static bool prof_overlay;
+static const char *prof_csvFileName;
+
+void PROF_Startup(void)
+{
+	for (int i = 1; i < us_argc - 1; ++i)
+	{
+		if (!CK_Cross_strcasecmp(us_argv[i], "/PROFILE"))
+			prof_csvFileName = us_argv[i + 1];
+	}
+	RF_SetOverlayFunc(PROF_DrawOverlay);
+}
+
+static int PROF_CompareTimes(const void *a, const void *b)
+{
+	uint32_t ta = *(const uint32_t *)a, tb = *(const uint32_t *)b;
+	return (ta > tb) - (ta < tb);
+}
+
+void PROF_Shutdown(void)
+{
+	int frames = (int)CK_Cross_min(prof_numFrames, (long)PROF_HISTORY);
+	if (!prof_csvFileName || !frames)
+		return;
+
+	FILE *csv = fopen(prof_csvFileName, "w");
+	if (!csv)
+	{
+		CK_Cross_LogMessage(CK_LOG_MSG_WARNING, "PROF: Couldn't open \"%s\" for writing.\n", prof_csvFileName);
+		return;
+	}
+
+	uint32_t *sorted = (uint32_t *)malloc(frames * sizeof(uint32_t));
+	fprintf(csv, "phase,frames,min_us,avg_us,p99_us,max_us\n");
+	for (int phase = 0; phase <= PROF_NumPhases; ++phase)
+	{
+		// The last row is the whole frame.
+		uint64_t total = 0;
+		for (int f = 0; f < frames; ++f)
+		{
+			uint32_t t = 0;
+			if (phase == PROF_NumPhases)
+				for (int p = 0; p < PROF_NumPhases; ++p)
+					t += prof_history[f][p];
+			else
+				t = prof_history[f][phase];
+			sorted[f] = t;
+			total += t;
+		}
+		qsort(sorted, frames, sizeof(uint32_t), PROF_CompareTimes);
+		fprintf(csv, "%s,%d,%u,%.2f,%u,%u\n", phase == PROF_NumPhases ? "Frame" : prof_phaseNames[phase], frames,
+			sorted[0], (double)total / frames, sorted[(frames * 99) / 100], sorted[frames - 1]);
+	}
+	free(sorted);
+	fclose(csv);
+	CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "PROF: Wrote timings for the last %d frames to %s\n", frames, prof_csvFileName);
+}
+
+void PROF_NextFrame(void)
+{
+	if (prof_frameStarted)
+	{
+		memcpy(prof_history[prof_numFrames % PROF_HISTORY], prof_current, sizeof(prof_current));
+		prof_numFrames++;
+	}
+	memset(prof_current, 0, sizeof(prof_current));
+	prof_frameStarted = true;
+}
+
+void PROF_AddTime(PROF_Phase phase, uint32_t us)
+{
+	prof_current[phase] += us;
+}
+
+bool PROF_ToggleOverlay(void)
+{
+	prof_overlay = !prof_overlay;
+	return prof_overlay;
+}
+
+void PROF_DrawOverlay(void)
+{
+	if (!prof_overlay)
+		return;
+
+	int frames = (int)CK_Cross_min(prof_numFrames, (long)PROF_OVERLAY_FRAMES);
+	uint32_t avg[PROF_NumPhases + 1];
+	memset(avg, 0, sizeof(avg));
+	for (int f = 0; f < frames; ++f)
+	{
+		const uint32_t *sample = prof_history[(prof_numFrames - 1 - f) % PROF_HISTORY];
+		for (int p = 0; p < PROF_NumPhases; ++p)
+		{
+			avg[p] += sample[p];
+			avg[PROF_NumPhases] += sample[p];
+		}
+	}
+	for (int p = 0; p <= PROF_NumPhases; ++p)
+		avg[p] = frames ? avg[p] / frames : 0;
+
+	// Two columns of "name time" pairs in the bottom-left corner.
+	const int colW = 96, rows = (PROF_NumPhases + 2) / 2;
+	uint16_t w, h;
+	char str[32];
+	VH_MeasurePropString("0", &w, &h, US_GetPrintFont());
+	int y0 = 200 - rows * h - 2;
+
+	VHB_Bar(0, y0, colW * 2, rows * h + 2, 0);
+	for (int p = 0; p <= PROF_NumPhases; ++p)
+	{
+		int x = (p / rows) * colW + 2, y = y0 + 1 + (p % rows) * h;
+		snprintf(str, sizeof(str), "%s %u", p == PROF_NumPhases ? "Frame" : prof_phaseNames[p], avg[p]);
+		VHB_DrawPropString(str, x, y, US_GetPrintFont(), 15);
+	}
+}
+
+#endif // WITH_PROFILER
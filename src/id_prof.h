@@ -0,0 +1,74 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef ID_PROF_H
+#define ID_PROF_H
+
+/*
+ * Per-frame phase profiler.
+ *
+ * Build with -DWITH_PROFILER=ON to enable it. Otherwise, all of the macros
+ * below expand to nothing, and none of the profiler is compiled in.
+ */
+
+#ifdef WITH_PROFILER
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ck_cross.h"
+
+typedef enum PROF_Phase
+{
+	PROF_Input,
+	PROF_Think,
+	PROF_Collide,
+	PROF_Draw,
+	PROF_AnimateTiles,
+	PROF_UpdateTiles,
+	PROF_SpriteErasers,
+	PROF_DrawSprites,
+	PROF_Present,
+	PROF_CalcTics,
+	PROF_NumPhases
+} PROF_Phase;
+
+void PROF_Startup(void);
+void PROF_Shutdown(void);
+void PROF_NextFrame(void);
+void PROF_AddTime(PROF_Phase phase, uint32_t us);
+bool PROF_ToggleOverlay(void);
+void PROF_DrawOverlay(void);
+
+// Times the code between PROF_BEGIN(phase) and PROF_END(phase), which must be
+// in the same scope, and adds it to the current frame.
+#define PROF_BEGIN(phase) uint64_t prof_start_##phase = CK_Cross_GetMicroseconds()
+#define PROF_END(phase) PROF_AddTime(PROF_##phase, (uint32_t)(CK_Cross_GetMicroseconds() - prof_start_##phase))
+// Finishes the current frame and starts recording the next.
+#define PROF_FRAME() PROF_NextFrame()
+
+#else
+
+#define PROF_BEGIN(phase)
+#define PROF_END(phase)
+#define PROF_FRAME()
+
+#endif
+
+#endif // ID_PROF_H
@@ -21,17 +21,20 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "id_rf.h"
 #include "id_ca.h"
 #include "id_mm.h"
+#include "id_prof.h"
 #include "id_ti.h"
 #include "id_us.h"
 #include "id_vh.h"
 #include "id_vl.h"
 #include "id_cfg.h"
+#include "ck_act.h"
 #include "ck_cross.h"
 #include "ck_ep.h"
 #include "ck_play.h"
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 // Maximum number of pages we can write to.
@@ -46,31 +49,17 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 // tile-by-tile, not pixel by pixel. The smooth-scrolling effect
 // is implemented by changing which part of the buffer is displayed.
 
-// Scroll blocks prevent the camera from moving beyond a certain row/column
-#define RF_MAX_SCROLLBLOCKS 6
-static int rf_horzScrollBlocks[RF_MAX_SCROLLBLOCKS];
-static int rf_vertScrollBlocks[RF_MAX_SCROLLBLOCKS];
-static int rf_numHorzScrollBlocks;
-static int rf_numVertScrollBlocks;
+// The state the game simulation depends on lives in the current context's
+// RF_State (see id_rf.h). These are shorthands for its members.
+#define rf_horzScrollBlocks (rf_state->horzScrollBlocks)
+#define rf_vertScrollBlocks (rf_state->vertScrollBlocks)
+#define rf_numHorzScrollBlocks (rf_state->numHorzScrollBlocks)
+#define rf_numVertScrollBlocks (rf_state->numVertScrollBlocks)
 
 void *rf_tileBuffer;
 //static void *rf_screenBuffer;
-static int rf_mapWidthTiles;
-static int rf_mapHeightTiles;
-
-//Scroll variables
-//static int rf_scrollXTile;
-//static int rf_scrollYTile;
-int rf_scrollXUnit;
-int rf_scrollYUnit;
-//static int rf_scrollX
-int rf_scrollXMinUnit;
-int rf_scrollYMinUnit;
-int rf_scrollXMaxUnit;
-int rf_scrollYMaxUnit;
-
-#define RF_MAX_SPRITETABLEENTRIES 60
-#define RF_NUM_SPRITE_Z_LAYERS 4
+#define rf_mapWidthTiles (rf_state->mapWidthTiles)
+#define rf_mapHeightTiles (rf_state->mapHeightTiles)
 
 // Rectangle of previous sprite position.
 typedef struct RF_SpriteEraser
@@ -82,60 +71,67 @@ typedef struct RF_SpriteEraser
 } RF_SpriteEraser;
 
 // Pool from which sprite draw entries are allocated.
-RF_SpriteDrawEntry rf_spriteTable[RF_MAX_SPRITETABLEENTRIES];
-RF_SpriteDrawEntry *rf_freeSpriteTableEntry;
+#define rf_spriteTable (rf_state->spriteTable)
+#define rf_spriteTableSize (rf_state->spriteTableSize)
+#define rf_freeSpriteTableEntry (rf_state->freeSpriteTableEntry)
 
-RF_SpriteDrawEntry *rf_firstSpriteTableEntry[RF_NUM_SPRITE_Z_LAYERS];
-static int rf_numSpriteDraws;
+#define rf_firstSpriteTableEntry (rf_state->firstSpriteTableEntry)
+#define rf_numSpriteDraws (rf_state->numSpriteDraws)
 
+// Each page has room for as many erasers as the biggest sprite table yet.
 int rf_freeSpriteEraserIndex[RF_MAX_BUFFERS] = {0};
-RF_SpriteEraser rf_spriteErasers[RF_MAX_SPRITETABLEENTRIES * RF_MAX_BUFFERS];
-// Animated tile management
-// (This is hairy)
+RF_SpriteEraser *rf_spriteErasers;
+static int rf_spriteErasersPerPage;
 
-// A pointer (index into array when 32-bit) to this struct
-// is stored in the info-plane of each animated tile.
+// Grows one of the pools to hold at least 'size' elements, zeroing the new
+// ones. As it may move, pointers into it are invalidated.
+static void *RFL_GrowPool(void *pool, int *allocated, int size, size_t elemSize)
+{
+	if (size <= *allocated)
+		return pool;
+	pool = realloc(pool, (size_t)size * elemSize);
+	if (!pool)
+		Quit("RF: Couldn't grow a sprite or animated tile pool!");
+	memset((uint8_t *)pool + (size_t)*allocated * elemSize, 0, (size_t)(size - *allocated) * elemSize);
+	*allocated = size;
+	return pool;
+}
 
-typedef struct RF_AnimTileTimer
+// The number of entries, 'stride' bytes apart from 'base', which have distinct
+// nonzero 16-bit offsets.
+static int RFL_Max16BitOffsetEntries(uint16_t base, int stride)
 {
-	int tileNumber;
-	int timeToSwitch;
-	// These are in Keen 6 only, used for emitting sounds (levels 6, 8)
-	int tileWithSound;
-	int numOfOnScreenTiles;
-	int sound;
-} RF_AnimTileTimer;
+	int n = 0;
+	while (n < 0x10000 / stride && (uint16_t)(base + n * stride) != 0)
+		++n;
+	return n;
+}
+
+// Animated tile management
+// (This is hairy)
 
 /*** Used for saved games compatibility ***/
+// Offsets past the end of the original array wrap around.
 static uint16_t RFL_ConvertAnimTileTimerIndexTo16BitOffset(int i)
 {
-	return CK_INT(ck_exe_animTileSize, 4) * i + CK_INT(ck_exe_animTilesOffset, 0x0000);
+	return (uint16_t)(CK_INT(ck_exe_animTileSize, 4) * i + CK_INT(ck_exe_animTilesOffset, 0x0000));
 }
 
 static int RFL_ConvertAnimTileTimer16BitOffsetToIndex(uint16_t offset)
 {
-	return (offset - CK_INT(ck_exe_animTilesOffset, 0x0000)) / CK_INT(ck_exe_animTileSize, 4);
+	return (uint16_t)(offset - CK_INT(ck_exe_animTilesOffset, 0x0000)) / CK_INT(ck_exe_animTileSize, 4);
 }
 
-typedef struct RF_OnscreenAnimTile
-{
-	int tileX;
-	int tileY;
-	int tile;
-	int plane;
-	int timerIndex;
-	struct RF_OnscreenAnimTile *next;
-	struct RF_OnscreenAnimTile *prev;
-} RF_OnscreenAnimTile;
-#define RF_MAX_ANIMTILETIMERS 180
-#define RF_MAX_ONSCREENANIMTILES 90
 #define RF_MAX_ANIM_LOOP 20
 
-int rf_numAnimTileTimers;
-RF_AnimTileTimer rf_animTileTimers[RF_MAX_ANIMTILETIMERS];
+#define rf_numAnimTileTimers (rf_state->numAnimTileTimers)
+#define rf_animTileTimers (rf_state->animTileTimers)
+#define rf_animTileTimersSize (rf_state->animTileTimersSize)
 
-RF_OnscreenAnimTile rf_onscreenAnimTiles[RF_MAX_ONSCREENANIMTILES];
-RF_OnscreenAnimTile *rf_firstOnscreenAnimTile, *rf_freeOnscreenAnimTile;
+#define rf_onscreenAnimTiles (rf_state->onscreenAnimTiles)
+#define rf_onscreenAnimTilesSize (rf_state->onscreenAnimTilesSize)
+#define rf_firstOnscreenAnimTile (rf_state->firstOnscreenAnimTile)
+#define rf_freeOnscreenAnimTile (rf_state->freeOnscreenAnimTile)
 
 // The minimum number of ticks permitted per frame. 
 // Defaults to 2 (35Hz).
@@ -212,18 +208,18 @@ void RFL_SetupOnscreenAnimList()
 {
 	rf_freeOnscreenAnimTile = rf_onscreenAnimTiles;
 
-	for (int i = 0; i < RF_MAX_ONSCREENANIMTILES - 1; ++i)
+	for (int i = 0; i < rf_onscreenAnimTilesSize - 1; ++i)
 	{
 		rf_onscreenAnimTiles[i].next = &rf_onscreenAnimTiles[i + 1];
 	}
 
-	rf_onscreenAnimTiles[RF_MAX_ONSCREENANIMTILES - 1].next = 0;
+	rf_onscreenAnimTiles[rf_onscreenAnimTilesSize - 1].next = 0;
 
 	rf_firstOnscreenAnimTile = 0;
 
 	if (ck_currentEpisode->ep == EP_CK6)
-		for (RF_AnimTileTimer *animTileTimer = rf_animTileTimers; animTileTimer->tileNumber; ++animTileTimer)
-			animTileTimer->numOfOnScreenTiles = 0;
+		for (int i = 0; i < rf_numAnimTileTimers; ++i)
+			rf_animTileTimers[i].numOfOnScreenTiles = 0;
 }
 
 void RFL_SetupSpriteTable()
@@ -231,13 +227,13 @@ void RFL_SetupSpriteTable()
 	rf_freeSpriteTableEntry = rf_spriteTable;
 	rf_numSpriteDraws = 0;
 
-	for (int i = 0; i < RF_MAX_SPRITETABLEENTRIES - 1; ++i)
+	for (int i = 0; i < rf_spriteTableSize - 1; ++i)
 	{
 		rf_spriteTable[i].next = &rf_spriteTable[i + 1];
 		rf_spriteTable[i + 1].prevNextPtr = &(rf_spriteTable[i].next);
 	}
 
-	rf_spriteTable[RF_MAX_SPRITETABLEENTRIES - 1].next = 0;
+	rf_spriteTable[rf_spriteTableSize - 1].next = 0;
 
 	for (int i = 0; i < RF_NUM_SPRITE_Z_LAYERS; ++i)
 	{
@@ -260,9 +256,47 @@ void RFL_MarkTileWithSound(RF_AnimTileTimer *animTileTimer, int tile)
 		}
 }
 
+// Counts the distinct animated tiles in the map, each of which gets a timer.
+static int RFL_CountAnimTileTimers()
+{
+	// Background tiles, then foreground ones.
+	uint8_t *seen = (uint8_t *)calloc(0x20000, 1);
+	if (!seen)
+		Quit("RF_MarkTileGraphics: Out of memory!");
+
+	int count = 0;
+	for (int tileY = 0; tileY < rf_mapHeightTiles; ++tileY)
+	{
+		for (int tileX = 0; tileX < rf_mapWidthTiles; ++tileX)
+		{
+			int backTile = CA_TileAtPos(tileX, tileY, 0);
+			int foreTile = CA_TileAtPos(tileX, tileY, 1);
+			if (TI_BackAnimTile(backTile) && TI_BackAnimTime(backTile) && !seen[backTile])
+			{
+				seen[backTile] = 1;
+				count++;
+			}
+			if (TI_ForeAnimTile(foreTile) && TI_ForeAnimTime(foreTile) && !seen[0x10000 + foreTile])
+			{
+				seen[0x10000 + foreTile] = 1;
+				count++;
+			}
+		}
+	}
+
+	free(seen);
+	return count;
+}
+
 void RF_MarkTileGraphics()
 {
-	memset(rf_animTileTimers, 0, sizeof(rf_animTileTimers));
+	// The timers are referred to by index, so they can be moved.
+	int numTimers = CK_Cross_max(RF_MAX_ANIMTILETIMERS, RFL_CountAnimTileTimers());
+	numTimers = CK_Cross_min(numTimers, 0x10000 / CK_INT(ck_exe_animTileSize, 4));
+	rf_animTileTimers = (RF_AnimTileTimer *)RFL_GrowPool(rf_animTileTimers, &rf_state->animTileTimersAllocated, numTimers, sizeof(RF_AnimTileTimer));
+	rf_animTileTimersSize = numTimers;
+
+	memset(rf_animTileTimers, 0, rf_animTileTimersSize * sizeof(RF_AnimTileTimer));
 	rf_numAnimTileTimers = 0;
 	// WARNING: As in the original codebase, the given variable is NOT initialized.
 	// This may lead to undefined behaviors in calls to RFL_MarkTileWithSound,
@@ -301,7 +335,7 @@ void RF_MarkTileGraphics()
 
 					if (needNewTimer)
 					{
-						if (i >= RF_MAX_ANIMTILETIMERS)
+						if (i >= rf_animTileTimersSize)
 							Quit("RF_MarkTileGraphics: Too many unique animations");
 
 						RF_AnimTileTimer *animTileTimer = &rf_animTileTimers[i];
@@ -369,7 +403,7 @@ void RF_MarkTileGraphics()
 
 					if (needNewTimer)
 					{
-						if (i >= RF_MAX_ANIMTILETIMERS)
+						if (i >= rf_animTileTimersSize)
 							Quit("RF_MarkTileGraphics: Too many unique animations");
 
 						RF_AnimTileTimer *animTileTimer = &rf_animTileTimers[i];
@@ -602,13 +636,63 @@ void RFL_AnimateTiles()
 
 void (*rf_drawFunc)(void);
 
+// Drawn on top of everything else, including rf_drawFunc, in the order they
+// were set.
+#define RF_MAX_OVERLAYS 4
+static void (*rf_overlayFuncs[RF_MAX_OVERLAYS])(void);
+static int rf_numOverlayFuncs;
+
 void RF_SetDrawFunc(void (*func)(void))
 {
 	rf_drawFunc = func;
 }
 
+void RF_SetOverlayFunc(void (*func)(void))
+{
+	for (int i = 0; i < rf_numOverlayFuncs; ++i)
+		if (rf_overlayFuncs[i] == func)
+			return;
+	if (rf_numOverlayFuncs == RF_MAX_OVERLAYS)
+		Quit("RF_SetOverlayFunc: Too many overlays!");
+	rf_overlayFuncs[rf_numOverlayFuncs++] = func;
+}
+
+// Sprite drawing benchmark: with /SPRITEBENCH, the time spent drawing sprites
+// is totalled up and printed on shutdown. Run the same demo with and without
+// /NOCHUNKY to compare the chunky and planar sprite paths.
+static bool rf_spriteBench = false;
+static uint64_t rf_spriteBenchTime;
+static long rf_spriteBenchFrames;
+static long rf_spriteBenchSprites;
+
+// Timedemo: with /TIMEDEMO, demos are played back without waiting for real
+// time to catch up, and the frame times are printed on shutdown.
+static bool rf_timeDemo = false;
+static uint64_t rf_timeDemoLastFrame;
+static uint32_t *rf_timeDemoFrameTimes;
+static long rf_timeDemoFrames;
+static long rf_timeDemoMaxFrames;
+// Variables should only be looked up by name the first time each one is used.
+static unsigned long rf_timeDemoFirstLookups, rf_timeDemoLastLookups;
+static long rf_timeDemoLookupFrames, rf_timeDemoLastLookupFrame;
+
+static const char *rf_parmStrings[] = {"SPRITEBENCH", "TIMEDEMO", ""};
+
 void RF_Startup()
 {
+	for (int i = 1; i < us_argc; ++i)
+	{
+		switch (US_CheckParm(us_argv[i], rf_parmStrings))
+		{
+		case 0:
+			rf_spriteBench = true;
+			break;
+		case 1:
+			rf_timeDemo = true;
+			break;
+		}
+	}
+
 	// Create the tile backing buffer
 	rf_tileBuffer = VL_CreateSurface(RF_BUFFER_WIDTH_PIXELS, RF_BUFFER_HEIGHT_PIXELS);
 	rf_minTics = CFG_GetConfigInt("rf_minTics", 2);
@@ -616,16 +700,231 @@ void RF_Startup()
 	rf_demoTics = CFG_GetConfigInt("rf_demoTics", 3);
 }
 
+static int RFL_CompareFrameTimes(const void *a, const void *b)
+{
+	uint32_t ta = *(const uint32_t *)a, tb = *(const uint32_t *)b;
+	return (ta > tb) - (ta < tb);
+}
+
+static double RFL_TimeDemoPercentile(int percent)
+{
+	return rf_timeDemoFrameTimes[(rf_timeDemoFrames - 1) * percent / 100] / 1000.0;
+}
+
+static void RFL_PrintTimeDemoStats()
+{
+	uint64_t total = 0;
+	for (long i = 0; i < rf_timeDemoFrames; ++i)
+		total += rf_timeDemoFrameTimes[i];
+
+	qsort(rf_timeDemoFrameTimes, rf_timeDemoFrames, sizeof(uint32_t), RFL_CompareFrameTimes);
+	CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "RF: Timedemo: %ld frames in %.3f s: %.2f fps\n",
+		rf_timeDemoFrames, total / 1000000.0, total ? rf_timeDemoFrames * 1000000.0 / total : 0.0);
+	CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "RF: Frame time (ms): avg %.3f, p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+		total / 1000.0 / rf_timeDemoFrames, RFL_TimeDemoPercentile(50), RFL_TimeDemoPercentile(90),
+		RFL_TimeDemoPercentile(99), RFL_TimeDemoPercentile(100));
+	CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "RF: Variables looked up by name %lu times, in %ld frames (the last being frame %ld)\n",
+		rf_timeDemoLastLookups - rf_timeDemoFirstLookups, rf_timeDemoLookupFrames, rf_timeDemoLastLookupFrame);
+}
+
+// Records the time since the previous frame of a timedemo.
+static void RFL_TimeDemoFrame()
+{
+	uint64_t now = CK_Cross_GetMicroseconds();
+	if (rf_timeDemoLastFrame)
+	{
+		if (rf_timeDemoFrames == rf_timeDemoMaxFrames)
+		{
+			rf_timeDemoMaxFrames = rf_timeDemoMaxFrames ? rf_timeDemoMaxFrames * 2 : 4096;
+			rf_timeDemoFrameTimes = (uint32_t *)realloc(rf_timeDemoFrameTimes, rf_timeDemoMaxFrames * sizeof(uint32_t));
+			if (!rf_timeDemoFrameTimes)
+				Quit("RF: Couldn't allocate timedemo frame times!");
+		}
+		rf_timeDemoFrameTimes[rf_timeDemoFrames++] = (uint32_t)(now - rf_timeDemoLastFrame);
+		if (CK_VAR_GetLookupCount() != rf_timeDemoLastLookups)
+		{
+			rf_timeDemoLookupFrames++;
+			rf_timeDemoLastLookupFrame = rf_timeDemoFrames;
+		}
+	}
+	else
+	{
+		rf_timeDemoFirstLookups = CK_VAR_GetLookupCount();
+	}
+	rf_timeDemoLastLookups = CK_VAR_GetLookupCount();
+	rf_timeDemoLastFrame = now;
+}
+
 void RF_Shutdown()
 {
+	if (rf_spriteBench && rf_spriteBenchFrames)
+	{
+		CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "RF: Drew %ld sprites (%s) in %ld frames: %.2f us/frame, %.3f us/sprite\n",
+			rf_spriteBenchSprites, VL_SupportsChunky() ? "chunky" : "planar", rf_spriteBenchFrames,
+			(double)rf_spriteBenchTime / rf_spriteBenchFrames,
+			rf_spriteBenchSprites ? (double)rf_spriteBenchTime / rf_spriteBenchSprites : 0.0);
+	}
+	if (rf_timeDemo && rf_timeDemoFrames)
+		RFL_PrintTimeDemoStats();
+	free(rf_timeDemoFrameTimes);
+	rf_timeDemoFrameTimes = NULL;
 	VL_DestroySurface(rf_tileBuffer);
 }
 
+// Set by RF_RestoreState and RF_ScheduleRedraw: the tile buffer no longer
+// matches the map, and is redrawn at the start of the next refresh.
+static bool rf_redrawPending;
+
+// The tile buffer and sprite erasers are shared by every context, so after
+// switching to another, they hold what the previous one drew.
+void RF_ScheduleRedraw(void)
+{
+	rf_redrawPending = true;
+}
+
+// The RF_State, followed by the pools it uses.
+size_t RF_SnapshotSize(void)
+{
+	return sizeof(RF_State) + rf_spriteTableSize * sizeof(RF_SpriteDrawEntry) +
+		rf_animTileTimersSize * sizeof(RF_AnimTileTimer) +
+		rf_onscreenAnimTilesSize * sizeof(RF_OnscreenAnimTile);
+}
+
+// The sprite and anim-tile lists hold raw pointers into the RF_State's own
+// pools, so a snapshot can only be restored into the context it came from,
+// and only if they haven't been moved since.
+void RF_SnapshotState(void *dst)
+{
+	uint8_t *p = (uint8_t *)dst;
+	memcpy(p, rf_state, sizeof(RF_State));
+	p += sizeof(RF_State);
+	memcpy(p, rf_spriteTable, rf_spriteTableSize * sizeof(RF_SpriteDrawEntry));
+	p += rf_spriteTableSize * sizeof(RF_SpriteDrawEntry);
+	memcpy(p, rf_animTileTimers, rf_animTileTimersSize * sizeof(RF_AnimTileTimer));
+	p += rf_animTileTimersSize * sizeof(RF_AnimTileTimer);
+	memcpy(p, rf_onscreenAnimTiles, rf_onscreenAnimTilesSize * sizeof(RF_OnscreenAnimTile));
+}
+
+bool RF_RestoreState(const void *src)
+{
+	const RF_State *state = (const RF_State *)src;
+	if (state->spriteTable != rf_spriteTable || state->spriteTableSize != rf_spriteTableSize ||
+		state->animTileTimers != rf_animTileTimers || state->animTileTimersSize != rf_animTileTimersSize ||
+		state->onscreenAnimTiles != rf_onscreenAnimTiles || state->onscreenAnimTilesSize != rf_onscreenAnimTilesSize)
+		return false;
+
+	const uint8_t *p = (const uint8_t *)src;
+	memcpy(rf_state, p, sizeof(RF_State));
+	p += sizeof(RF_State);
+	memcpy(rf_spriteTable, p, rf_spriteTableSize * sizeof(RF_SpriteDrawEntry));
+	p += rf_spriteTableSize * sizeof(RF_SpriteDrawEntry);
+	memcpy(rf_animTileTimers, p, rf_animTileTimersSize * sizeof(RF_AnimTileTimer));
+	p += rf_animTileTimersSize * sizeof(RF_AnimTileTimer);
+	memcpy(rf_onscreenAnimTiles, p, rf_onscreenAnimTilesSize * sizeof(RF_OnscreenAnimTile));
+
+	// Don't redraw here: callers may restore many times per frame.
+	rf_redrawPending = true;
+	return true;
+}
+
+// Redraws the whole tile buffer at the current scroll position. Unlike
+// RF_Reposition, this leaves the onscreen anim-tile list alone, since it
+// was restored along with the map.
+static void RFL_RedrawAfterRestore()
+{
+	int scrollXtile = RF_UnitToTile(rf_scrollXUnit);
+	int scrollYtile = RF_UnitToTile(rf_scrollYUnit);
+
+	for (int ty = 0; ty < RF_BUFFER_HEIGHT_TILES; ++ty)
+	{
+		for (int tx = 0; tx < RF_BUFFER_WIDTH_TILES; ++tx)
+		{
+			RF_RenderTile16(tx, ty, CA_TileAtPos(tx + scrollXtile, ty + scrollYtile, 0));
+			RF_RenderTile16m(tx, ty, CA_TileAtPos(tx + scrollXtile, ty + scrollYtile, 1));
+			RFL_MarkBlockDirty(tx, ty, 1, -1);
+		}
+	}
+
+	// Every block is redrawn, so the old sprite positions needn't be.
+	for (int page = 0; page < VL_GetNumBuffers(); ++page)
+		rf_freeSpriteEraserIndex[page] = 0;
+
+	rf_redrawPending = false;
+}
+
+// Sizes the sprite table (and the erasers) for the current map, emptying it
+// if its size changes. Past RF_MAX_SPRITETABLEENTRIES, entries get offsets
+// beyond the end of the original array, but always distinct nonzero ones.
+void RF_SizeSpriteTable(int numEntries)
+{
+	numEntries = CK_Cross_min(numEntries, RFL_Max16BitOffsetEntries(CK_INT(ck_exe_spriteArrayOffset, 0x0000), 32));
+	numEntries = CK_Cross_max(numEntries, RF_MAX_SPRITETABLEENTRIES);
+	if (numEntries == rf_spriteTableSize)
+		return;
+
+	rf_spriteTable = (RF_SpriteDrawEntry *)RFL_GrowPool(rf_spriteTable, &rf_state->spriteTableAllocated, numEntries, sizeof(RF_SpriteDrawEntry));
+	rf_spriteTableSize = numEntries;
+	RFL_SetupSpriteTable();
+
+	if (numEntries > rf_spriteErasersPerPage)
+	{
+		free(rf_spriteErasers);
+		rf_spriteErasers = (RF_SpriteEraser *)malloc((size_t)numEntries * RF_MAX_BUFFERS * sizeof(RF_SpriteEraser));
+		if (!rf_spriteErasers)
+			Quit("RF_SizeSpriteTable: Couldn't allocate the sprite erasers!");
+		rf_spriteErasersPerPage = numEntries;
+		for (int page = 0; page < RF_MAX_BUFFERS; ++page)
+			rf_freeSpriteEraserIndex[page] = 0;
+	}
+}
+
+// The onscreen animated tiles are those in the tile buffer, of which there
+// can't be more than there are in the map.
+static int RFL_CountOnscreenAnimTiles()
+{
+	int count = 0;
+	for (int tileY = 0; tileY < rf_mapHeightTiles; ++tileY)
+	{
+		for (int tileX = 0; tileX < rf_mapWidthTiles; ++tileX)
+		{
+			int backTile = CA_TileAtPos(tileX, tileY, 0);
+			int foreTile = CA_TileAtPos(tileX, tileY, 1);
+			if (TI_BackAnimTile(backTile) && TI_BackAnimTime(backTile))
+				count++;
+			if (TI_ForeAnimTile(foreTile) && TI_ForeAnimTime(foreTile))
+				count++;
+		}
+	}
+	return CK_Cross_min(count, 2 * RF_BUFFER_SIZE);
+}
+
+// Frees the pools of a context's RF_State.
+void RF_FreeState(RF_State *state)
+{
+	free(state->spriteTable);
+	free(state->animTileTimers);
+	free(state->onscreenAnimTiles);
+	state->spriteTable = NULL;
+	state->animTileTimers = NULL;
+	state->onscreenAnimTiles = NULL;
+	state->spriteTableSize = state->spriteTableAllocated = 0;
+	state->animTileTimersSize = state->animTileTimersAllocated = 0;
+	state->onscreenAnimTilesSize = state->onscreenAnimTilesAllocated = 0;
+}
+
 // TODO: More to change? Also, originally mapNum is a global variable.
 void RF_NewMap(void)
 {
 	rf_mapWidthTiles = CA_MapHeaders[ca_mapOn]->width;
 	rf_mapHeightTiles = CA_MapHeaders[ca_mapOn]->height;
+
+	// Unless RF_SizeSpriteTable was called first, the pools are as big as
+	// the original's.
+	if (!rf_spriteTableSize)
+		RF_SizeSpriteTable(RF_MAX_SPRITETABLEENTRIES);
+	int numOnscreenAnimTiles = CK_Cross_max(RF_MAX_ONSCREENANIMTILES, RFL_CountOnscreenAnimTiles());
+	rf_onscreenAnimTiles = (RF_OnscreenAnimTile *)RFL_GrowPool(rf_onscreenAnimTiles, &rf_state->onscreenAnimTilesAllocated, numOnscreenAnimTiles, sizeof(RF_OnscreenAnimTile));
+	rf_onscreenAnimTilesSize = numOnscreenAnimTiles;
 	rf_scrollXMinUnit = 0x0200; //Two-tile wide border around map
 	rf_scrollYMinUnit = 0x0200;
 	rf_scrollXMaxUnit = RF_TileToUnit(CA_MapHeaders[ca_mapOn]->width - RF_SCREEN_WIDTH_TILES - 2);
@@ -633,6 +932,7 @@ void RF_NewMap(void)
 
 	// Reset the scroll-blocks
 	rf_numVertScrollBlocks = rf_numHorzScrollBlocks = 0;
+	rf_redrawPending = false;
 
 	RFL_SetupOnscreenAnimList();
 	RFL_SetupSpriteTable();
@@ -653,6 +953,13 @@ void RF_NewMap(void)
 
 void RF_RenderTile16(int x, int y, int tile)
 {
+	uint8_t *chunky = CA_GetChunkyTile16(tile);
+	if (chunky)
+	{
+		VL_ChunkyToSurface(chunky, rf_tileBuffer, x * 16, y * 16, 16, 16);
+		return;
+	}
+
 	void *src = CA_GetGrChunk(ca_gfxInfoE.offTiles16, tile, "Tile16", false);
 
 	// Some levels, notably Keen 6's "Guard Post 3" use empty background tiles (i.e. tiles with offset
@@ -669,6 +976,12 @@ void RF_RenderTile16m(int x, int y, int tile)
 {
 	if (!tile)
 		return;
+	uint8_t *chunky = CA_GetChunkyTile16m(tile);
+	if (chunky)
+	{
+		VL_ChunkyMaskedBlitToSurface(chunky, chunky + 16 * 16, rf_tileBuffer, x * 16, y * 16, 16, 16);
+		return;
+	}
 	VL_MaskedBlitToSurface(CA_GetGrChunk(ca_gfxInfoE.offTiles16m, tile, "Tile16m", true), rf_tileBuffer, x * 16, y * 16, 16, 16);
 }
 
@@ -794,6 +1107,12 @@ void RFL_RenderForeTiles()
 				continue;
 			if (!(TI_ForeMisc(tile) & 0x80))
 				continue;
+			uint8_t *chunky = CA_GetChunkyTile16m(tile);
+			if (chunky)
+			{
+				VL_ChunkyMaskedBlitToScreen(chunky, chunky + 16 * 16, bufferX * 16, bufferY * 16, 16, 16);
+				continue;
+			}
 			VL_MaskedBlitToScreen(CA_GetGrChunk(ca_gfxInfoE.offTiles16m, tile, "Tile16m", true),
 				(stx - scrollXtile) * 16, (sty - scrollYtile) * 16, 16, 16);
 		}
@@ -986,10 +1305,19 @@ void RFL_CalcTics()
 	{
 		// If we're recording or playing a demo, we need the speed to be deterministic.
 		uint32_t new_time = SD_GetLastTimeCount();
-		while (new_time + (rf_demoTics * 2) > SD_GetTimeCount())
+		if (rf_timeDemo && in_demoState == IN_Demo_Playback)
 		{
-			// As long as this takes no more than 10ms...
-			SD_WaitTick();
+			// The time counter is set below regardless of how much real
+			// time has passed, so there's no need to wait for it.
+			RFL_TimeDemoFrame();
+		}
+		else
+		{
+			while (new_time + (rf_demoTics * 2) > SD_GetTimeCount())
+			{
+				// As long as this takes no more than 10ms...
+				SD_WaitTick();
+			}
 		}
 		// We do not want to lose demo sync
 		SD_SetLastTimeCount(new_time + rf_demoTics);
@@ -1107,8 +1435,8 @@ void RF_SmoothScroll(int scrollXdelta, int scrollYdelta)
 void RF_PlaceEraser(int pxX, int pxY, int pxW, int pxH, int page)
 {
 #ifndef ALWAYS_REDRAW
-	int arrayBase = RF_MAX_SPRITETABLEENTRIES * page;
-	if (rf_freeSpriteEraserIndex[page] == RF_MAX_SPRITETABLEENTRIES)
+	int arrayBase = rf_spriteErasersPerPage * page;
+	if (rf_freeSpriteEraserIndex[page] == rf_spriteErasersPerPage)
 		Quit("Too many sprite erasers.");
 	int newIndex = rf_freeSpriteEraserIndex[page] + arrayBase;
 	rf_spriteErasers[newIndex].pxX = pxX;
@@ -1168,7 +1496,7 @@ void RF_RemoveSpriteDraw(RF_SpriteDrawEntry **drawEntry)
 void RFL_ProcessSpriteErasers()
 {
 #ifndef ALWAYS_REDRAW
-	int arrayBase = RF_MAX_SPRITETABLEENTRIES * VL_GetActiveBuffer();
+	int arrayBase = rf_spriteErasersPerPage * VL_GetActiveBuffer();
 	for (int i = arrayBase; i < arrayBase + rf_freeSpriteEraserIndex[VL_GetActiveBuffer()]; ++i)
 	{
 		rf_spriteErasers[i].pxX -= RF_UnitToTile(rf_scrollXUnit) * 16;
@@ -1310,14 +1638,16 @@ void RF_AddSpriteDraw(RF_SpriteDrawEntry **drawEntry, int unitX, int unitY, int
 	*drawEntry = sde;
 }
 
+// Offsets past the end of the original array wrap around (see
+// RF_SizeSpriteTable).
 RF_SpriteDrawEntry *RF_ConvertSpriteArray16BitOffsetToPtr(uint16_t drawEntryoffset)
 {
-	return drawEntryoffset ? &rf_spriteTable[(drawEntryoffset - CK_INT(ck_exe_spriteArrayOffset, 0x0000)) / 32] : NULL;
+	return drawEntryoffset ? &rf_spriteTable[(uint16_t)(drawEntryoffset - CK_INT(ck_exe_spriteArrayOffset, 0x0000)) / 32] : NULL;
 }
 
 uint16_t RF_ConvertSpriteArrayPtrTo16BitOffset(RF_SpriteDrawEntry *drawEntry)
 {
-	return drawEntry ? ((drawEntry - rf_spriteTable) * 32 + CK_INT(ck_exe_spriteArrayOffset, 0x0000)) : 0;
+	return drawEntry ? (uint16_t)((drawEntry - rf_spriteTable) * 32 + CK_INT(ck_exe_spriteArrayOffset, 0x0000)) : 0;
 }
 
 void RF_RemoveSpriteDrawUsing16BitOffset(int16_t *drawEntryOffset)
@@ -1339,6 +1669,8 @@ void RF_AddSpriteDrawUsing16BitOffset(int16_t *drawEntryOffset, int unitX, int u
 
 void RFL_DrawSpriteList()
 {
+	uint64_t benchStart = rf_spriteBench ? CK_Cross_GetMicroseconds() : 0;
+
 	for (int zLayer = 0; zLayer < RF_NUM_SPRITE_Z_LAYERS; ++zLayer)
 	{
 		// All but the final z layer (3) are below fore-foreground tiles.
@@ -1387,6 +1719,7 @@ void RFL_DrawSpriteList()
 				{
 					VH_DrawShiftedSprite(pixelX, pixelY, sde->chunk, sde->shift);
 				}
+				rf_spriteBenchSprites++;
 				for (int y = tileY1; y <= tileY2; ++y)
 				{
 					for (int x = tileX1; x <= tileX2; ++x)
@@ -1398,6 +1731,12 @@ void RFL_DrawSpriteList()
 			}
 		}
 	}
+
+	if (rf_spriteBench)
+	{
+		rf_spriteBenchTime += CK_Cross_GetMicroseconds() - benchStart;
+		rf_spriteBenchFrames++;
+	}
 }
 
 RF_SpriteDrawEntry *tmp = 0;
@@ -1416,19 +1755,33 @@ void RFL_UpdateTiles()
 #endif
 }
 
-void RF_Refresh()
+void RF_AnimateTiles()
 {
+	PROF_BEGIN(AnimateTiles);
 	RFL_AnimateTiles();
+	PROF_END(AnimateTiles);
+}
+
+void RF_RefreshScreen()
+{
+	if (rf_redrawPending)
+		RFL_RedrawAfterRestore();
 
 #ifdef ALWAYS_REDRAW
 	VL_SurfaceToScreen(rf_tileBuffer, 0, 0, 0, 0, RF_BUFFER_WIDTH_PIXELS, RF_BUFFER_HEIGHT_PIXELS);
 #endif
 
 	//TODO: Work out how to do scrolling before using this
+	PROF_BEGIN(UpdateTiles);
 	RFL_UpdateTiles();
+	PROF_END(UpdateTiles);
+	PROF_BEGIN(SpriteErasers);
 	RFL_ProcessSpriteErasers();
+	PROF_END(SpriteErasers);
 
+	PROF_BEGIN(DrawSprites);
 	RFL_DrawSpriteList();
+	PROF_END(DrawSprites);
 
 	// No blocks should be dirty on this page after the frame has been rendered.
 	for (int y = 0; y < RF_BUFFER_HEIGHT_TILES; ++y)
@@ -1438,10 +1791,23 @@ void RF_Refresh()
 	if (rf_drawFunc)
 		rf_drawFunc();
 
+	for (int i = 0; i < rf_numOverlayFuncs; ++i)
+		rf_overlayFuncs[i]();
+
 	// 0xef for the X-direction to match EGA keen's 2px horz scrolling.
 	VL_SetScrollCoords(RF_UnitToPixel(rf_scrollXUnit & 0xef), RF_UnitToPixel(rf_scrollYUnit & 0xff));
 	VL_SwapOnNextPresent();
+	PROF_BEGIN(Present);
 	VL_Present();
+	PROF_END(Present);
 
+	PROF_BEGIN(CalcTics);
 	RFL_CalcTics();
+	PROF_END(CalcTics);
+}
+
+void RF_Refresh()
+{
+	RF_AnimateTiles();
+	RF_RefreshScreen();
 }
@@ -21,6 +21,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define ID_RF_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 // Sprite Draw object
@@ -68,11 +69,79 @@ typedef struct RF_SpriteDrawEntry
 #define RF_PixelToTile(p) ((p) >> P_T_SHIFT)
 #define RF_TileToPixel(t) ((t) << P_T_SHIFT)
 
-extern int rf_scrollXUnit, rf_scrollYUnit;
-extern int rf_scrollXMinUnit;
-extern int rf_scrollYMinUnit;
-extern int rf_scrollXMaxUnit;
-extern int rf_scrollYMaxUnit;
+#define RF_MAX_SCROLLBLOCKS 6
+#define RF_NUM_SPRITE_Z_LAYERS 4
+// The sizes of the original games' sprite and animated tile arrays. These
+// are now the minimum sizes of pools which are sized for each map.
+#define RF_MAX_SPRITETABLEENTRIES 60
+#define RF_MAX_ANIMTILETIMERS 180
+#define RF_MAX_ONSCREENANIMTILES 90
+
+// A pointer (index into array when 32-bit) to this struct
+// is stored in the info-plane of each animated tile.
+typedef struct RF_AnimTileTimer
+{
+	int tileNumber;
+	int timeToSwitch;
+	// These are in Keen 6 only, used for emitting sounds (levels 6, 8)
+	int tileWithSound;
+	int numOfOnScreenTiles;
+	int sound;
+} RF_AnimTileTimer;
+
+typedef struct RF_OnscreenAnimTile
+{
+	int tileX;
+	int tileY;
+	int tile;
+	int plane;
+	int timerIndex;
+	struct RF_OnscreenAnimTile *next;
+	struct RF_OnscreenAnimTile *prev;
+} RF_OnscreenAnimTile;
+
+// The part of the refresh manager's state which the game simulation depends
+// on. Each context has its own (see CK_SetContext); the buffers used for
+// drawing are shared, and redrawn after a switch (see RF_ScheduleRedraw).
+typedef struct RF_State
+{
+	int scrollXUnit, scrollYUnit;
+	int scrollXMinUnit, scrollYMinUnit;
+	int scrollXMaxUnit, scrollYMaxUnit;
+
+	// Scroll blocks prevent the camera from moving beyond a certain row/column
+	int horzScrollBlocks[RF_MAX_SCROLLBLOCKS];
+	int vertScrollBlocks[RF_MAX_SCROLLBLOCKS];
+	int numHorzScrollBlocks;
+	int numVertScrollBlocks;
+
+	int mapWidthTiles;
+	int mapHeightTiles;
+
+	// The pools are allocated by RF_SizeSpriteTable, RF_NewMap and
+	// RF_MarkTileGraphics, and are only ever grown.
+	RF_SpriteDrawEntry *spriteTable;
+	int spriteTableSize, spriteTableAllocated;
+	RF_SpriteDrawEntry *freeSpriteTableEntry;
+	RF_SpriteDrawEntry *firstSpriteTableEntry[RF_NUM_SPRITE_Z_LAYERS];
+	int numSpriteDraws;
+
+	int numAnimTileTimers;
+	RF_AnimTileTimer *animTileTimers;
+	int animTileTimersSize, animTileTimersAllocated;
+	RF_OnscreenAnimTile *onscreenAnimTiles;
+	int onscreenAnimTilesSize, onscreenAnimTilesAllocated;
+	RF_OnscreenAnimTile *firstOnscreenAnimTile, *freeOnscreenAnimTile;
+} RF_State;
+
+extern RF_State *rf_state;
+
+#define rf_scrollXUnit (rf_state->scrollXUnit)
+#define rf_scrollYUnit (rf_state->scrollYUnit)
+#define rf_scrollXMinUnit (rf_state->scrollXMinUnit)
+#define rf_scrollYMinUnit (rf_state->scrollYMinUnit)
+#define rf_scrollXMaxUnit (rf_state->scrollXMaxUnit)
+#define rf_scrollYMaxUnit (rf_state->scrollYMaxUnit)
 
 extern void (*rf_drawFunc)(void);
 
@@ -82,9 +151,12 @@ uint8_t RFL_IsBlockDirty(int x, int y, int page);
 void RF_SetScrollBlock(int tileX, int tileY, bool vertical);
 void RF_MarkTileGraphics();
 void RF_SetDrawFunc(void (*func)(void));
+void RF_SetOverlayFunc(void (*func)(void));
 void RF_Startup();
 void RF_Shutdown();
+void RF_SizeSpriteTable(int numEntries);
 void RF_NewMap(void);
+void RF_FreeState(RF_State *state);
 void RF_RenderTile16(int x, int y, int tile);
 void RF_RenderTile16m(int x, int y, int tile);
 void RF_ForceRefresh(void);
@@ -97,6 +169,14 @@ void RF_AddSpriteDraw(RF_SpriteDrawEntry **drawEntry, int unitX, int unitY, int
 void RF_RemoveSpriteDrawUsing16BitOffset(int16_t *drawEntryOffset);
 void RF_AddSpriteDrawUsing16BitOffset(int16_t *drawEntryOffset, int unitX, int unitY, int chunk, bool allWhite, int zLayer);
 void RF_Refresh();
+// RF_Refresh() is RF_AnimateTiles() followed by RF_RefreshScreen(), which
+// draws, presents and waits for the next frame. Run-ahead calls them apart.
+void RF_AnimateTiles();
+void RF_RefreshScreen();
+size_t RF_SnapshotSize(void);
+void RF_SnapshotState(void *dst);
+bool RF_RestoreState(const void *src);
+void RF_ScheduleRedraw(void);
 /*** Used for dumper (and, partially, for saved games compatibility) ***/
 RF_SpriteDrawEntry *RF_ConvertSpriteArray16BitOffsetToPtr(uint16_t drawEntryoffset);
 uint16_t RF_ConvertSpriteArrayPtrTo16BitOffset(RF_SpriteDrawEntry *drawEntry);
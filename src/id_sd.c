@@ -43,6 +43,8 @@ bool sd_haveAdlib;
 SD_SoundMode sd_soundMode;
 ID_MusicMode sd_musicMode;
 bool sd_quietAdlibSfx;
+// Set while simulating frames which are never shown (see CK_PlayLoop).
+static bool sd_muted;
 
 // Internal globals
 static bool sd_started = false;
@@ -64,45 +66,39 @@ static int sd_sfxPartRate = 140;
  */
 #define SD_SOUND_PART_RATE_BASE 1192030
 
-// Kind of same as Wolf3D's TimeCount from ID_SD.C
-static volatile uint32_t sd_timeCount = 0;
-// Same as Wolf3D's lasttimecount from WL_DRAW.C?
-static volatile int32_t sd_lastTimeCount = 0;
-// Number of sprite "think" ticks.
-static volatile uint16_t sd_SpriteSync = 0;
 // PIT timer divisor, scaled (bt 8 if music is on, 2 otherwise).
 // NOT initialized to 0 since this can lead to division by zero on startup.
 static int16_t sd_scaledPITTimerDivisor = 1;
 
 uint32_t SD_GetTimeCount()
 {
-	return sd_timeCount;
+	return sd_timeState->timeCount;
 }
 
 void SD_SetTimeCount(uint32_t newval)
 {
 	SD_GetTimeCount(); // Refresh SD_LastPITTickTime to be in sync with SDL_GetTicks()
-	sd_timeCount = newval;
+	sd_timeState->timeCount = newval;
 }
 
 int32_t SD_GetLastTimeCount()
 {
-	return sd_lastTimeCount;
+	return sd_timeState->lastTimeCount;
 }
 
 void SD_SetLastTimeCount(int32_t newval)
 {
-	sd_lastTimeCount = newval;
+	sd_timeState->lastTimeCount = newval;
 }
 
 uint16_t SD_GetSpriteSync()
 {
-	return sd_SpriteSync;
+	return sd_timeState->spriteSync;
 }
 
 void SD_SetSpriteSync(uint16_t newval)
 {
-	sd_SpriteSync = newval;
+	sd_timeState->spriteSync = newval;
 }
 
 /* NEVER call this from the SDL callback!!! (Or you want a deadlock?) */
@@ -523,6 +519,12 @@ bool SD_GetQuietSfx()
 	return sd_quietAdlibSfx;
 }
 
+// Ignore all sound effect starts and stops, e.g. while running ahead.
+void SD_SetMuted(bool muted)
+{
+	sd_muted = muted;
+}
+
 // Check to see if an Adlib card (i.e., Adlib backend) is present.
 bool SD_IsAdlibPresent()
 {
@@ -631,7 +633,7 @@ void SD_PlaySound(soundnames sound)
 {
 	uint32_t length;
 	uint16_t priority;
-	if (sd_soundMode == sdm_Off)
+	if (sd_soundMode == sdm_Off || sd_muted)
 		return;
 	if (!sd_sfxChunkArray[sound])
 		Quit("SD_PlaySound() - Uncached sound");
@@ -669,6 +671,8 @@ uint16_t SD_SoundPlaying(void)
 // Stop the currently playing sound effect
 void SD_StopSound(void)
 {
+	if (sd_muted)
+		return;
 	switch (sd_soundMode)
 	{
 	case sdm_Off:
@@ -763,7 +767,7 @@ void SDL_t0Service(void)
 		++count;
 		if (!(count & 7))
 		{
-			sd_timeCount++;
+			sd_timeState->timeCount++;
 		}
 		if (!(count & 3))
 		{
@@ -785,7 +789,7 @@ void SDL_t0Service(void)
 		++count;
 		if (!(count & 1))
 		{
-			sd_timeCount++;
+			sd_timeState->timeCount++;
 		}
 		switch (sd_soundMode)
 		{
@@ -47,6 +47,7 @@ SD_SoundMode SD_GetSoundMode();
 ID_MusicMode SD_GetMusicMode();
 void SD_SetQuietSfx(bool value);
 bool SD_GetQuietSfx();
+void SD_SetMuted(bool muted);
 bool SD_IsAdlibPresent();
 void SD_Startup(void);
 void SD_Default(bool gotit, SD_SoundMode sd, ID_MusicMode sm);
@@ -102,6 +103,21 @@ typedef struct SD_Backend
 SD_Backend *SD_Impl_GetBackend();
 /* Timing related functions */
 
+// The time counts, which the game's speed (and so the simulation) depends
+// on. Each context has its own (see CK_SetContext), and the timer service
+// advances the current one's.
+typedef struct SD_TimeState
+{
+	// Kind of same as Wolf3D's TimeCount from ID_SD.C
+	volatile uint32_t timeCount;
+	// Same as Wolf3D's lasttimecount from WL_DRAW.C?
+	volatile int32_t lastTimeCount;
+	// Number of sprite "think" ticks.
+	volatile uint16_t spriteSync;
+} SD_TimeState;
+
+extern SD_TimeState *volatile sd_timeState;
+
 uint32_t SD_GetTimeCount(void);
 void SD_SetTimeCount(uint32_t newval);
 int32_t SD_GetLastTimeCount(void);
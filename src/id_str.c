@@ -29,65 +29,107 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 /* String manager, allows objects to be indexed by strings */
 
-// Hash a string using an xor variant of the djb2 hash
-static unsigned int STR_HashString(const char *str)
+// Hash a string with FNV-1a, finished with MurmurHash3's mixer so that the low
+// bits (which pick the slot) depend on all of the others. Also returns the
+// length of the string, saving a strlen().
+static uint32_t STR_HashString(const char *str, uint32_t *length)
 {
-	size_t slen = strlen(str);
-	unsigned int hash = 0;
-	for (int i = 0; i < slen; ++i)
+	const char *c = str;
+	uint32_t hash = 2166136261u;
+	for (; *c; ++c)
 	{
-		hash = ((hash << 5) + hash) ^ (unsigned int)(str[i]);
+		hash ^= (uint8_t)*c;
+		hash *= 16777619u;
 	}
+	*length = c - str;
+
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6Bu;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35u;
+	hash ^= hash >> 16;
 	return hash;
 }
 
-// Allocate a table 'tabl' of size 'size'
+// The entries are allocated separately from the table, so that they can be
+// moved when it grows (which the memory manager can't do).
+static STR_Entry *STRL_AllocEntries(size_t size)
+{
+	STR_Entry *entries = (STR_Entry *)calloc(size, sizeof(STR_Entry));
+	if (!entries)
+		Quit("STR: Out of memory!");
+	return entries;
+}
+
+// Allocate a table 'tabl' of (at least) size 'size'
 void STR_AllocTable(STR_Table **tabl, size_t size)
 {
-	MM_GetPtr((mm_ptr_t *)(tabl), sizeof(STR_Table) + size * (sizeof(STR_Entry)));
+	MM_GetPtr((mm_ptr_t *)(tabl), sizeof(STR_Table));
 	// Lock it in memory so that it doesn't get purged.
 	MM_SetLock((mm_ptr_t *)(tabl), true);
-	(*tabl)->size = size;
-#ifdef CK_DEBUG
+	(*tabl)->size = 1;
+	while ((*tabl)->size < size)
+		(*tabl)->size <<= 1;
 	(*tabl)->numElements = 0;
-#endif
-	for (size_t i = 0; i < size; ++i)
+	(*tabl)->arr = STRL_AllocEntries((*tabl)->size);
+}
+
+// Moves everything into a new array of (at least) size 'size'.
+void STR_ResizeTable(STR_Table *tabl, size_t size)
+{
+	size_t newSize = 1;
+	while (newSize < size || newSize < tabl->numElements * 2)
+		newSize <<= 1;
+	STR_Entry *newArr = STRL_AllocEntries(newSize);
+
+	// Duplicate keys are found in the order they were added, as they're
+	// further along the same run of entries. Starting after an empty slot
+	// (there always is one) means we never start in the middle of a run, so
+	// they're moved in that order, too.
+	size_t start = 0;
+	while (tabl->numElements && tabl->arr[start].str)
+		start++;
+	for (size_t n = 0; n < tabl->size; ++n)
 	{
-		(*tabl)->arr[i].str = 0;
-		(*tabl)->arr[i].ptr = 0;
+		STR_Entry *entry = &tabl->arr[(start + n) & (tabl->size - 1)];
+		if (!entry->str)
+			continue;
+		size_t i = entry->hash & (newSize - 1);
+		while (newArr[i].str)
+			i = (i + 1) & (newSize - 1);
+		newArr[i] = *entry;
 	}
+
+	free(tabl->arr);
+	tabl->arr = newArr;
+	tabl->size = newSize;
 }
 
-// Checks if an entry 'str' in 'tabl' exists.
-bool STR_DoesEntryExist(STR_Table *tabl, const char *str)
+static STR_Entry *STRL_FindEntry(STR_Table *tabl, const char *str)
 {
-	int hash = STR_HashString(str) % tabl->size;
-	for (size_t i = hash;; i = (i + 1) % tabl->size)
+	uint32_t length;
+	uint32_t hash = STR_HashString(str, &length);
+	for (size_t i = hash & (tabl->size - 1);; i = (i + 1) & (tabl->size - 1))
 	{
-		if (tabl->arr[i].str == 0)
-			break;
-		if (strcmp(str, tabl->arr[i].str) == 0)
-		{
-			return true;
-		}
+		STR_Entry *entry = &tabl->arr[i];
+		if (!entry->str)
+			return NULL;
+		if (entry->hash == hash && entry->length == length && !memcmp(entry->str, str, length))
+			return entry;
 	}
-	return false;
+}
+
+// Checks if an entry 'str' in 'tabl' exists.
+bool STR_DoesEntryExist(STR_Table *tabl, const char *str)
+{
+	return STRL_FindEntry(tabl, str) != NULL;
 }
 
 // Returns the pointer associated with 'str' in 'tabl', defaulting to 'def'
 void *STR_LookupEntryWithDefault(STR_Table *tabl, const char *str, void *def)
 {
-	int hash = STR_HashString(str) % tabl->size;
-	for (size_t i = hash;; i = (i + 1) % tabl->size)
-	{
-		if (tabl->arr[i].str == 0)
-			break;
-		if (strcmp(str, tabl->arr[i].str) == 0)
-		{
-			return (tabl->arr[i].ptr);
-		}
-	}
-	return def;
+	STR_Entry *entry = STRL_FindEntry(tabl, str);
+	return entry ? entry->ptr : def;
 }
 
 // Returns the pointer associated with 'str' in 'tabl'
@@ -97,26 +139,32 @@ void *STR_LookupEntry(STR_Table *tabl, const char *str)
 }
 
 // Add an entry 'str' with pointer 'value' to 'tabl'. Returns 'true' on success
+// (If 'str' is already there, the old entry is still the one found.)
 bool STR_AddEntry(STR_Table *tabl, const char *str, void *value)
 {
-	int hash = STR_HashString(str) % tabl->size;
-	for (size_t i = hash;; i = (i + 1) % tabl->size)
-	{
-		if (tabl->arr[i].str == 0)
-		{
-			tabl->arr[i].str = str;
-			tabl->arr[i].ptr = value;
-#ifdef CK_DEBUG
-			tabl->numElements++;
-			if (tabl->numElements == tabl->size)
-			{
-				Quit("Tried to over-fill a hashtable!");
-			}
-#endif
-			return true;
-		}
-	}
-	return false;
+	if ((tabl->numElements + 1) * 4 > tabl->size * 3)
+		STR_ResizeTable(tabl, tabl->size * 2);
+
+	uint32_t length;
+	uint32_t hash = STR_HashString(str, &length);
+	size_t i = hash & (tabl->size - 1);
+	while (tabl->arr[i].str)
+		i = (i + 1) & (tabl->size - 1);
+	tabl->arr[i].str = str;
+	tabl->arr[i].ptr = value;
+	tabl->arr[i].hash = hash;
+	tabl->arr[i].length = length;
+	tabl->numElements++;
+	return true;
+}
+
+void STR_PlaceEntry(STR_Table *tabl, size_t slot, const char *str, void *value)
+{
+	STR_Entry *entry = &tabl->arr[slot];
+	entry->str = str;
+	entry->ptr = value;
+	entry->hash = STR_HashString(str, &entry->length);
+	tabl->numElements++;
 }
 
 // Iterate through the entires in the hashtable. "index" will be updated afterwards.
@@ -31,18 +31,24 @@ typedef struct STR_Entry
 {
 	const char *str;
 	void *ptr;
+	// The full hash and length of 'str', checked before comparing it.
+	uint32_t hash;
+	uint32_t length;
 } STR_Entry;
 
+// An open-addressed table, which doubles in size (moving 'arr') whenever it
+// gets over 3/4 full. The size is always a power of two.
 typedef struct STR_Table
 {
 	size_t size;
-#ifdef CK_DEBUG
 	size_t numElements;
-#endif
-	STR_Entry arr[];
+	STR_Entry *arr;
 } STR_Table;
 
 void STR_AllocTable(STR_Table **tabl, size_t size);
+void STR_ResizeTable(STR_Table *tabl, size_t size);
+// Puts an entry in a given slot, for restoring a table's exact layout.
+void STR_PlaceEntry(STR_Table *tabl, size_t slot, const char *str, void *value);
 bool STR_DoesEntryExist(STR_Table *tabl, const char *str);
 void *STR_LookupEntryWithDefault(STR_Table *tabl, const char *str, void *def);
 void *STR_LookupEntry(STR_Table *tabl, const char *str);
@@ -64,6 +64,13 @@ void US_RestoreWindow(US_WindowRec *win);
 bool US_LineInput(uint16_t x, uint16_t y, char *buf, char *def, bool escok, uint16_t maxchars, uint16_t maxwidth);
 
 // Random Number Generation
+typedef struct US_RndState
+{
+	uint16_t index; // Was 16-bit, even if storing just a 8-bit val
+} US_RndState;
+
+extern US_RndState *us_rndState;
+
 void US_InitRndT(bool randomize);
 int US_RndT();
 void US_SetRndI(int index);
@@ -603,7 +603,8 @@ uint8_t us_RandomTable[256] = {
 	197, 242, 98, 43, 39, 175, 254, 145, 190, 84, 118, 222, 187, 136,
 	120, 163, 236, 249};
 
-static uint16_t us_randomIndex; // Was 16-bit, even if storing just a 8-bit val
+// The index lives in the current context's US_RndState (see CK_SetContext).
+#define us_randomIndex (us_rndState->index)
 
 // Seed the random number generator.
 
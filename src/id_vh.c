@@ -125,6 +125,12 @@ void VH_DrawSprite(int x, int y, int chunk)
 
 	int shift = (x & 7) / 2;
 
+	if (shifted->chunky)
+	{
+		VL_SpanSpriteToScreen(shifted->chunky, (x & ~7) + shifted->sprShiftPixels[shift], y);
+		return;
+	}
+
 	uint8_t *data = &shifted->data[shifted->sprShiftOffset[shift]];
 
 	int width = shifted->sprShiftByteWidths[shift] * 8;
@@ -142,6 +148,12 @@ void VH_DrawSpriteMask(int x, int y, int chunk, int colour)
 
 	int shift = (x & 7) / 2;
 
+	if (shifted->chunky)
+	{
+		VL_SpanSpriteMaskToScreen(shifted->chunky, (x & ~7) + shifted->sprShiftPixels[shift], y, colour);
+		return;
+	}
+
 	uint8_t *data = &shifted->data[shifted->sprShiftOffset[shift]];
 
 	int width = shifted->sprShiftByteWidths[shift] * 8;
@@ -157,6 +169,12 @@ void VH_DrawShiftedSprite(int x, int y, int chunk, int shift)
 
 	VH_ShiftedSprite *shifted = VH_GetShiftedSprite(chunk);
 
+	if (shifted->chunky)
+	{
+		VL_SpanSpriteToScreen(shifted->chunky, x + shifted->sprShiftPixels[shift], y);
+		return;
+	}
+
 	uint8_t *data = &shifted->data[shifted->sprShiftOffset[shift]];
 
 	int width = shifted->sprShiftByteWidths[shift] * 8;
@@ -172,6 +190,12 @@ void VH_DrawShiftedSpriteMask(int x, int y, int chunk, int shift, int colour)
 
 	VH_ShiftedSprite *shifted = VH_GetShiftedSprite(chunk);
 
+	if (shifted->chunky)
+	{
+		VL_SpanSpriteMaskToScreen(shifted->chunky, x + shifted->sprShiftPixels[shift], y, colour);
+		return;
+	}
+
 	uint8_t *data = &shifted->data[shifted->sprShiftOffset[shift]];
 
 	int width = shifted->sprShiftByteWidths[shift] * 8;
@@ -301,6 +325,11 @@ void VHB_DrawSprite(int x, int y, int chunk)
 
 	if (VH_MarkUpdateBlock(realX, realY, realX + spr->width * 8, realY + spr->height))
 	{
+		if (shifted->chunky)
+		{
+			VL_SpanSpriteToScreen(shifted->chunky, realX + shifted->sprShiftPixels[shift], realY);
+			return;
+		}
 		VL_MaskedBlitToScreen(data,
 			realX, realY,
 			width, spr->height);
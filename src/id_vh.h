@@ -56,6 +56,11 @@ typedef struct VH_ShiftedSprite
 {
 	size_t sprShiftOffset[VH_MAXSPRSHIFTS];
 	int sprShiftByteWidths[VH_MAXSPRSHIFTS];
+	// How many pixels each shift moves the sprite right of its byte-aligned position.
+	int sprShiftPixels[VH_MAXSPRSHIFTS];
+	// If set, the sprite is drawn from this chunky copy, and 'data' only holds
+	// the unshifted planar sprite (all the sprShiftOffsets are 0).
+	struct VL_SpanSprite *chunky;
 	uint8_t data[];
 } VH_ShiftedSprite;
 
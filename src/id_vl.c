@@ -26,6 +26,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "id_us.h"
 
 #include <stdlib.h>
+#include <string.h>
 #ifdef WITH_SDL
 #include <SDL.h>
 #endif
@@ -75,6 +76,27 @@ static VL_Backend *vl_currentBackend;
 
 static int vl_mapMask = 0xF;
 
+// The vectorised planar conversion kernels in use, or NULL for scalar code.
+static const VL_PlanarKernels *vl_planarKernels = NULL;
+
+void VL_SetPlanarKernels(const VL_PlanarKernels *kernels)
+{
+	vl_planarKernels = kernels;
+}
+
+// Returns how many pixels starting at planar bit offset 'bitOff' can be given
+// to the vectorised kernels (always a whole number of groups), or 0 if the
+// next pixel must be converted by the scalar code.
+static int VL_PlanarRunLength(int bitOff, int remaining)
+{
+	if (!vl_planarKernels || (bitOff & 7) || remaining < vl_planarKernels->width)
+		return 0;
+	return remaining - (remaining % vl_planarKernels->width);
+}
+
+// The vectorised palette lookup kernels in use, or NULL for scalar code.
+static const VL_PaletteKernels *vl_paletteKernels = NULL;
+
 #if 0
 VL_EGAPaletteEntry VL_EGAPalette[16];
 
@@ -250,6 +272,15 @@ void VL_UnmaskedToPAL8(void *src, void *dest, int x, int y, int pitch, int w, in
 		{
 			int plane_off = (sy * w + sx) >> 3;
 			int plane_bit = 1 << (7 - ((sy * w + sx) & 7));
+			int run = VL_PlanarRunLength(sy * w + sx, w - sx);
+
+			if (run)
+			{
+				vl_planarKernels->unmasked(srcptr_b + plane_off, srcptr_g + plane_off, srcptr_r + plane_off, srcptr_i + plane_off,
+					dstptr + (sy + y) * pitch + (sx + x), run / vl_planarKernels->width);
+				sx += run - 1;
+				continue;
+			}
 
 			int pixel = ((srcptr_i[plane_off] & plane_bit) ? 8 : 0) |
 				((srcptr_r[plane_off] & plane_bit) ? 4 : 0) |
@@ -337,6 +368,15 @@ void VL_MaskedToPAL8(void *src, void *dest, int x, int y, int pitch, int w, int
 		{
 			int plane_off = (sy * w + sx) >> 3;
 			int plane_bit = 1 << (7 - ((sy * w + sx) & 7));
+			int run = VL_PlanarRunLength(sy * w + sx, w - sx);
+
+			if (run)
+			{
+				vl_planarKernels->masked(srcptr_a + plane_off, srcptr_b + plane_off, srcptr_g + plane_off, srcptr_r + plane_off, srcptr_i + plane_off,
+					dstptr + (sy + y) * pitch + (sx + x), run / vl_planarKernels->width);
+				sx += run - 1;
+				continue;
+			}
 
 			int pixel = ((srcptr_i[plane_off] & plane_bit) ? 8 : 0) |
 				((srcptr_r[plane_off] & plane_bit) ? 4 : 0) |
@@ -399,6 +439,15 @@ void VL_MaskedBlitToPAL8(void *src, void *dest, int x, int y, int pitch, int w,
 		{
 			int plane_off = (sy * w + sx) >> 3;
 			int plane_bit = 1 << (7 - ((sy * w + sx) & 7));
+			int run = VL_PlanarRunLength(sy * w + sx, w - sx);
+
+			if (run)
+			{
+				vl_planarKernels->maskedBlit(srcptr_a + plane_off, srcptr_b + plane_off, srcptr_g + plane_off, srcptr_r + plane_off, srcptr_i + plane_off,
+					dstptr + (sy + y) * pitch + (sx + x), run / vl_planarKernels->width);
+				sx += run - 1;
+				continue;
+			}
 
 			if ((srcptr_a[plane_off] & plane_bit) == 0)
 			{
@@ -473,6 +522,15 @@ void VL_MaskedBlitClipToPAL8(void *src, void *dest, int x, int y, int pitch, int
 		{
 			int plane_off = (sy * w + sx) >> 3;
 			int plane_bit = 1 << (7 - ((sy * w + sx) & 7));
+			int run = VL_PlanarRunLength(sy * w + sx, finalW - sx);
+
+			if (run)
+			{
+				vl_planarKernels->maskedBlit(srcptr_a + plane_off, srcptr_b + plane_off, srcptr_g + plane_off, srcptr_r + plane_off, srcptr_i + plane_off,
+					dstptr + (sy + y) * pitch + (sx + x), run / vl_planarKernels->width);
+				sx += run - 1;
+				continue;
+			}
 
 			if ((srcptr_a[plane_off] & plane_bit) == 0)
 			{
@@ -524,6 +582,14 @@ void VL_1bppToPAL8(void *src, void *dest, int x, int y, int pitch, int w, int h,
 		{
 			int plane_off = (sy * w + sx) >> 3;
 			int plane_bit = 1 << (7 - ((sy * w + sx) & 7));
+			int run = VL_PlanarRunLength(sy * w + sx, w - sx);
+
+			if (run)
+			{
+				vl_planarKernels->bit(srcptr + plane_off, dstptr + (sy + y) * pitch + (sx + x), run / vl_planarKernels->width, colour);
+				sx += run - 1;
+				continue;
+			}
 
 			int pixel = ((srcptr[plane_off] & plane_bit) ? colour : colour & 0xF0);
 
@@ -595,6 +661,14 @@ void VL_1bppXorWithPAL8(void *src, void *dest, int x, int y, int pitch, int w, i
 		{
 			int plane_off = (sy * spitch + sx) >> 3;
 			int plane_bit = 1 << (7 - ((sy * spitch + sx) & 7));
+			int run = VL_PlanarRunLength(sy * spitch + sx, w - sx);
+
+			if (run)
+			{
+				vl_planarKernels->bitXor(srcptr + plane_off, dstptr + (sy + y) * pitch + (sx + x), run / vl_planarKernels->width, colour);
+				sx += run - 1;
+				continue;
+			}
 
 			if (!(srcptr[plane_off] & plane_bit))
 				continue;
@@ -646,6 +720,14 @@ void VL_1bppBlitToPAL8(void *src, void *dest, int x, int y, int pitch, int w, in
 		{
 			int plane_off = (sy * spitch + sx) >> 3;
 			int plane_bit = 1 << (7 - ((sy * spitch + sx) & 7));
+			int run = VL_PlanarRunLength(sy * spitch + sx, w - sx);
+
+			if (run)
+			{
+				vl_planarKernels->bitBlit(srcptr + plane_off, dstptr + (sy + y) * pitch + (sx + x), run / vl_planarKernels->width, colour);
+				sx += run - 1;
+				continue;
+			}
 
 			if (!(srcptr[plane_off] & plane_bit))
 				continue;
@@ -669,6 +751,14 @@ void VL_1bppInvBlitToPAL8(void *src, void *dest, int x, int y, int pitch, int w,
 		{
 			int plane_off = (sy * spitch + sx) >> 3;
 			int plane_bit = 1 << (7 - ((sy * spitch + sx) & 7));
+			int run = VL_PlanarRunLength(sy * spitch + sx, w - sx);
+
+			if (run)
+			{
+				vl_planarKernels->bitInvBlit(srcptr + plane_off, dstptr + (sy + y) * pitch + (sx + x), run / vl_planarKernels->width, colour);
+				sx += run - 1;
+				continue;
+			}
 
 			if ((srcptr[plane_off] & plane_bit))
 				continue;
@@ -694,6 +784,14 @@ void VL_1bppInvBlitClipToPAL8(void *src, void *dest, int x, int y, int pitch, in
 		{
 			int plane_off = (sy * spitch + sx) >> 3;
 			int plane_bit = 1 << (7 - ((sy * spitch + sx) & 7));
+			int run = VL_PlanarRunLength(sy * spitch + sx, finalW - sx);
+
+			if (run)
+			{
+				vl_planarKernels->bitInvBlit(srcptr + plane_off, dstptr + (sy + y) * pitch + (sx + x), run / vl_planarKernels->width, colour);
+				sx += run - 1;
+				continue;
+			}
 
 			if ((srcptr[plane_off] & plane_bit))
 				continue;
@@ -703,6 +801,100 @@ void VL_1bppInvBlitClipToPAL8(void *src, void *dest, int x, int y, int pitch, in
 	}
 }
 
+// Copies pre-converted (chunky) PAL8 pixels, one byte per pixel, to a PAL8 buffer.
+void VL_ChunkyToPAL8(const uint8_t *src, void *dest, int x, int y, int pitch, int w, int h)
+{
+	uint8_t *dstptr = (uint8_t *)dest + y * pitch + x;
+
+	for (int sy = 0; sy < h; ++sy)
+	{
+		memcpy(dstptr, src, w);
+		dstptr += pitch;
+		src += w;
+	}
+}
+
+// Masked equivalent of VL_ChunkyToPAL8: 'mask' holds 0xFF for each pixel where the
+// destination shows through, and 0x00 elsewhere, which matches VL_MaskedBlitToPAL8.
+void VL_ChunkyMaskedBlitClipToPAL8(const uint8_t *src, const uint8_t *mask, void *dest, int x, int y, int pitch, int w, int h, int dw, int dh)
+{
+	uint8_t *dstptr = (uint8_t *)dest;
+	int initialX = CK_Cross_max(-x, 0);
+	int initialY = CK_Cross_max(-y, 0);
+	int finalW = CK_Cross_min(CK_Cross_max(dw - x, 0), w);
+	int finalH = CK_Cross_min(CK_Cross_max(dh - y, 0), h);
+
+	for (int sy = initialY; sy < finalH; ++sy)
+	{
+		uint8_t *dstrow = dstptr + (sy + y) * pitch + x;
+		const uint8_t *srcrow = src + sy * w;
+		const uint8_t *maskrow = mask + sy * w;
+		for (int sx = initialX; sx < finalW; ++sx)
+		{
+			dstrow[sx] = (dstrow[sx] & maskrow[sx]) | srcrow[sx];
+		}
+	}
+}
+
+// Draws a span sprite, clipped to a dw x dh buffer. If colour is not -1, the
+// opaque area is filled with it instead, like VL_1bppInvBlitClipToPAL8 does
+// with a sprite's mask plane.
+void VL_SpanSpriteClipToPAL8(const VL_SpanSprite *spr, void *dest, int x, int y, int pitch, int dw, int dh, int colour)
+{
+	uint8_t *dstptr = (uint8_t *)dest;
+	int initialY = CK_Cross_max(-y, 0);
+	int finalH = CK_Cross_min(CK_Cross_max(dh - y, 0), spr->h);
+	int minX = -x;
+	int maxX = dw - x;
+
+	for (int sy = initialY; sy < finalH; ++sy)
+	{
+		uint8_t *dstrow = dstptr + (sy + y) * pitch + x;
+		for (uint32_t i = spr->rows[sy]; i < spr->rows[sy + 1]; ++i)
+		{
+			const VL_SpriteSpan *span = &spr->spans[i];
+			int sx1 = CK_Cross_max((int)span->x, minX);
+			int sx2 = CK_Cross_min((int)span->x + (int)span->w, maxX);
+			if (sx2 <= sx1)
+				continue;
+
+			const uint8_t *srcptr = spr->pixels + span->pixels + (sx1 - span->x);
+			if (colour != -1)
+			{
+				if (!span->blend)
+					memset(dstrow + sx1, colour, sx2 - sx1);
+			}
+			else if (span->blend)
+			{
+				for (int sx = sx1; sx < sx2; ++sx)
+					dstrow[sx] |= *srcptr++;
+			}
+			else
+			{
+				memcpy(dstrow + sx1, srcptr, sx2 - sx1);
+			}
+		}
+	}
+}
+
+// Converts PAL8 pixels to 32-bit colours for backends which can't do the palette
+// lookup on the GPU. Only the low nibble of each pixel is used, as on the EGA,
+// to index the 16-entry 'lut'.
+void VL_PAL8ToRGB32(const uint8_t *src, int srcPitch, void *dest, int destPitch, int w, int h, const uint32_t *lut)
+{
+	int run = vl_paletteKernels ? w - (w % vl_paletteKernels->width) : 0;
+
+	for (int y = 0; y < h; ++y)
+	{
+		const uint8_t *srcrow = src + y * srcPitch;
+		uint32_t *dstrow = (uint32_t *)((uint8_t *)dest + y * destPitch);
+		if (run)
+			vl_paletteKernels->pal8ToRGB32(srcrow, dstrow, run / vl_paletteKernels->width, lut);
+		for (int x = run; x < w; ++x)
+			dstrow[x] = lut[srcrow[x] & 0xF];
+	}
+}
+
 int VL_MemUsed()
 {
 	return vl_memused;
@@ -726,10 +918,12 @@ void VL_InitScreen(void)
 	vl_started = true;
 }
 
-static const char *vl_parmStrings[] = { "HIDDENCARD", "NOPAN", "" };
+static const char *vl_parmStrings[] = { "HIDDENCARD", "NOPAN", "NOSIMD", "NOCHUNKY", "" };
 
 bool vl_hiddenCard = false;
 bool vl_noPan = false;
+bool vl_noSIMD = false;
+bool vl_noChunky = false;
 
 void VL_Startup()
 {
@@ -745,8 +939,22 @@ void VL_Startup()
 		case 1:
 			vl_noPan = true;
 			break;
+		case 2:
+			vl_noSIMD = true;
+			break;
+		case 3:
+			vl_noChunky = true;
+			break;
 		}
 	}
+
+	vl_planarKernels = vl_noSIMD ? NULL : VL_SIMD_DetectPlanarKernels();
+	if (vl_planarKernels)
+		CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "VL: Using %s planar conversion.\n", vl_planarKernels->name);
+	vl_paletteKernels = vl_noSIMD ? NULL : VL_SIMD_DetectPaletteKernels();
+	if (vl_paletteKernels)
+		CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "VL: Using %s palette conversion.\n", vl_paletteKernels->name);
+
 	VL_InitScreen();
 }
 
@@ -942,6 +1150,37 @@ void VL_1bppInvBlitToScreen(void *src, int x, int y, int w, int h, int colour)
 	vl_currentBackend->bitInvBlitToSurface(src, vl_emuegavgaadapter.screen, x, y, w, h, colour);
 }
 
+bool VL_SupportsChunky(void)
+{
+	return !vl_noChunky && vl_currentBackend && vl_currentBackend->chunkyToSurface &&
+		vl_currentBackend->chunkyMaskedBlitToSurface && vl_currentBackend->spanSpriteToSurface;
+}
+
+void VL_ChunkyToSurface(const uint8_t *src, void *dest, int x, int y, int w, int h)
+{
+	vl_currentBackend->chunkyToSurface(src, dest, x, y, w, h);
+}
+
+void VL_ChunkyMaskedBlitToSurface(const uint8_t *src, const uint8_t *mask, void *dest, int x, int y, int w, int h)
+{
+	vl_currentBackend->chunkyMaskedBlitToSurface(src, mask, dest, x, y, w, h);
+}
+
+void VL_ChunkyMaskedBlitToScreen(const uint8_t *src, const uint8_t *mask, int x, int y, int w, int h)
+{
+	vl_currentBackend->chunkyMaskedBlitToSurface(src, mask, vl_emuegavgaadapter.screen, x, y, w, h);
+}
+
+void VL_SpanSpriteToScreen(const VL_SpanSprite *spr, int x, int y)
+{
+	vl_currentBackend->spanSpriteToSurface(spr, vl_emuegavgaadapter.screen, x, y, -1);
+}
+
+void VL_SpanSpriteMaskToScreen(const VL_SpanSprite *spr, int x, int y, int colour)
+{
+	vl_currentBackend->spanSpriteToSurface(spr, vl_emuegavgaadapter.screen, x, y, colour);
+}
+
 void VL_ScrollScreen(int x, int y)
 {
 	vl_currentBackend->scrollSurface(vl_emuegavgaadapter.screen, x, y);
@@ -1128,8 +1367,21 @@ void VL_SwapOnNextPresent()
 	vl_swapOnNextPresent = true;
 }
 
+// While set, VL_Present calls this instead of presenting anything.
+static void (*vl_presentHook)(void);
+
+void VL_SetPresentHook(void (*hook)(void))
+{
+	vl_presentHook = hook;
+}
+
 void VL_Present()
 {
+	if (vl_presentHook)
+	{
+		vl_presentHook();
+		return;
+	}
 	vl_lastFrameTime = SD_GetTimeCount();
 	vl_currentBackend->present(vl_emuegavgaadapter.screen, vl_scrollXpixels, vl_scrollYpixels, !vl_swapOnNextPresent);
 	vl_swapOnNextPresent = false;
@@ -33,6 +33,8 @@ extern bool vl_hasOverscanBorder;
 extern int vl_swapInterval;
 extern bool vl_hiddenCard; //TODO: Use this to enable even unwise fallbacks.
 extern bool vl_noPan;
+extern bool vl_noSIMD;
+extern bool vl_noChunky;
 
 // EGA signal palettes (the 17th entry of each row is the overscan border color)
 // NOTE: Vanilla Keen can modify some of these (e.g. the border color)
@@ -76,6 +78,29 @@ void VL_1bppXorWithPAL8(void *src, void *dest, int x, int y, int pitch, int w, i
 void VL_1bppBlitToPAL8(void *src, void *dest, int x, int y, int pitch, int w, int h, int colour);
 void VL_1bppInvBlitToPAL8(void *src, void *dest, int x, int y, int pitch, int w, int h, int colour);
 void VL_1bppInvBlitClipToPAL8(void *src, void *dest, int x, int y, int pitch, int w, int h, int dw, int dh, int colour);
+// A masked graphic converted to PAL8, with each row stored as a list of spans.
+// Copy spans replace the destination pixels. Blend spans are ORed in: they
+// cover the (rare) pixels which are transparent but still have colour bits set.
+typedef struct VL_SpriteSpan
+{
+	uint16_t x, w;
+	uint32_t pixels; // Offset of the span's first pixel in VL_SpanSprite::pixels
+	bool blend;
+} VL_SpriteSpan;
+
+typedef struct VL_SpanSprite
+{
+	int w, h;
+	int numSpans, numPixels;
+	uint32_t *rows; // h + 1 entries: the spans of row y are rows[y] .. rows[y + 1] - 1
+	VL_SpriteSpan *spans;
+	uint8_t *pixels;
+} VL_SpanSprite;
+
+void VL_ChunkyToPAL8(const uint8_t *src, void *dest, int x, int y, int pitch, int w, int h);
+void VL_ChunkyMaskedBlitClipToPAL8(const uint8_t *src, const uint8_t *mask, void *dest, int x, int y, int pitch, int w, int h, int dw, int dh);
+void VL_SpanSpriteClipToPAL8(const VL_SpanSprite *spr, void *dest, int x, int y, int pitch, int dw, int dh, int colour);
+void VL_PAL8ToRGB32(const uint8_t *src, int srcPitch, void *dest, int destPitch, int w, int h, const uint32_t *lut);
 
 int VL_MemUsed();
 int VL_NumSurfaces();
@@ -118,6 +143,12 @@ typedef struct VL_Backend
 	void (*updateRect)(void *surface, int x, int y, int w, int h);
 	void (*flushParams)();
 	void (*waitVBLs)(int vbls);
+	// Optional: blits pre-converted PAL8 data. Backends whose surfaces are
+	// not byte-per-pixel (e.g. DOS) leave these NULL.
+	void (*chunkyToSurface)(const uint8_t *src, void *dst_surface, int x, int y, int w, int h);
+	void (*chunkyMaskedBlitToSurface)(const uint8_t *src, const uint8_t *mask, void *dst_surface, int x, int y, int w, int h);
+	// Draws a span sprite; a colour of -1 draws its pixels, anything else fills its opaque area.
+	void (*spanSpriteToSurface)(const VL_SpanSprite *spr, void *dst_surface, int x, int y, int colour);
 } VL_Backend;
 
 void VL_InitScreen(void);
@@ -153,6 +184,12 @@ void VL_1bppToScreen_PM(void *src, int x, int y, int w, int h, int colour);
 void VL_1bppXorWithScreen(void *src, int x, int y, int w, int h, int colour);
 void VL_1bppBlitToScreen(void *src, int x, int y, int w, int h, int colour);
 void VL_1bppInvBlitToScreen(void *src, int x, int y, int w, int h, int colour);
+bool VL_SupportsChunky(void);
+void VL_ChunkyToSurface(const uint8_t *src, void *dest, int x, int y, int w, int h);
+void VL_ChunkyMaskedBlitToSurface(const uint8_t *src, const uint8_t *mask, void *dest, int x, int y, int w, int h);
+void VL_ChunkyMaskedBlitToScreen(const uint8_t *src, const uint8_t *mask, int x, int y, int w, int h);
+void VL_SpanSpriteToScreen(const VL_SpanSprite *spr, int x, int y);
+void VL_SpanSpriteMaskToScreen(const VL_SpanSprite *spr, int x, int y, int colour);
 void VL_ScrollScreen(int x, int y);
 
 void VL_DelayTics(int tics);
@@ -169,6 +206,7 @@ void VL_FixRefreshBuffer();
 void VL_UpdateRect(int x, int y, int w, int h);
 void VL_SwapOnNextPresent();
 void VL_Present();
+void VL_SetPresentHook(void (*hook)(void));
 
 VL_Backend *VL_Impl_GetBackend(void);
 
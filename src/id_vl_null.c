@@ -5,9 +5,15 @@
 
 #include "ck_cross.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <pthread.h>
+#define VL_NULL_CAPTURE_THREADED
+#endif
+
 static int vl_null_screenWidth;
 static int vl_null_screenHeight;
 
@@ -23,15 +29,406 @@ typedef struct VL_NULL_Surface
 	void *data;
 } VL_NULL_Surface;
 
+/*
+ * Frame capture (/CAPTURE <file>)
+ *
+ * Every presented frame is copied, still in PAL8 form and with the scroll
+ * offset applied, into a bounded queue together with the palette in use. A
+ * worker thread resolves the palette and writes the frames out, so the game
+ * loop only ever waits if the writer falls a whole queue behind. If writing
+ * fails, the worker stops, and the game quits when it next queues a frame.
+ *
+ * The format is picked from the file extension:
+ * - .y4m: YUV4MPEG2 (4:4:4, 70 fps) video, which most encoders can read.
+ * - .png: A sequence of paletted PNGs, named <file>_000000.png and so on.
+ * - Anything else: Raw 24-bit RGB frames, one after another.
+ */
+
+#define VL_NULL_CAPTURE_QUEUE_LENGTH 32
+#define VL_NULL_CAPTURE_FRAME_SIZE (VL_EGAVGA_GFX_WIDTH * VL_EGAVGA_GFX_HEIGHT)
+
+typedef enum VL_NULL_CaptureFormat
+{
+	VL_NULL_Capture_RGB,
+	VL_NULL_Capture_Y4M,
+	VL_NULL_Capture_PNG
+} VL_NULL_CaptureFormat;
+
+typedef struct VL_NULL_CaptureFrame
+{
+	uint8_t palette[16][3];
+	uint8_t pixels[VL_NULL_CAPTURE_FRAME_SIZE];
+} VL_NULL_CaptureFrame;
+
+static bool vl_null_captureActive;
+static VL_NULL_CaptureFormat vl_null_captureFormat;
+static char vl_null_capturePath[1024];
+static FILE *vl_null_captureFile;
+static uint8_t vl_null_capturePalette[16][3];
+static uint8_t *vl_null_captureScratch;
+static long vl_null_captureFrames;
+static long vl_null_captureStalls;
+// Set by the encoder when a write fails, after which it writes nothing more.
+static const char *vl_null_captureWriteError;
+
+// Ring buffer of frames waiting to be written.
+static VL_NULL_CaptureFrame *vl_null_captureQueue;
+static int vl_null_captureQueueHead;
+static int vl_null_captureQueueCount;
+
+#ifdef VL_NULL_CAPTURE_THREADED
+static pthread_t vl_null_captureThread;
+static pthread_mutex_t vl_null_captureLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t vl_null_captureNotEmpty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t vl_null_captureNotFull = PTHREAD_COND_INITIALIZER;
+static bool vl_null_captureStopping;
+// vl_null_captureWriteError, handed over to the game thread under the lock.
+static const char *vl_null_captureError;
+#endif
+
+static void VL_NULL_CaptureWrite(const void *data, size_t len)
+{
+	if (vl_null_captureWriteError)
+		return;
+	if (fwrite(data, 1, len, vl_null_captureFile) != len)
+		vl_null_captureWriteError = "Couldn't write to the capture file!";
+}
+
+static void VL_NULL_CaptureWriteRGB(const VL_NULL_CaptureFrame *frame)
+{
+	uint8_t *dst = vl_null_captureScratch;
+	for (int i = 0; i < VL_NULL_CAPTURE_FRAME_SIZE; ++i, dst += 3)
+		memcpy(dst, frame->palette[frame->pixels[i] & 0xF], 3);
+	VL_NULL_CaptureWrite(vl_null_captureScratch, VL_NULL_CAPTURE_FRAME_SIZE * 3);
+}
+
+static void VL_NULL_CaptureWriteY4M(const VL_NULL_CaptureFrame *frame)
+{
+	// Convert the 16 palette entries to (full range, BT.601) YCbCr once,
+	// so each pixel is just three table lookups.
+	uint8_t yuv[3][16];
+	for (int i = 0; i < 16; ++i)
+	{
+		int r = frame->palette[i][0], g = frame->palette[i][1], b = frame->palette[i][2];
+		yuv[0][i] = (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+		yuv[1][i] = (uint8_t)((-43 * r - 85 * g + 128 * b + 128 * 256 + 128) >> 8);
+		yuv[2][i] = (uint8_t)((128 * r - 107 * g - 21 * b + 128 * 256 + 128) >> 8);
+	}
+
+	for (int plane = 0; plane < 3; ++plane)
+	{
+		uint8_t *dst = vl_null_captureScratch + plane * VL_NULL_CAPTURE_FRAME_SIZE;
+		for (int i = 0; i < VL_NULL_CAPTURE_FRAME_SIZE; ++i)
+			dst[i] = yuv[plane][frame->pixels[i] & 0xF];
+	}
+	VL_NULL_CaptureWrite("FRAME\n", 6);
+	VL_NULL_CaptureWrite(vl_null_captureScratch, VL_NULL_CAPTURE_FRAME_SIZE * 3);
+}
+
+static uint32_t vl_null_crcTable[256];
+
+static uint32_t VL_NULL_CRC32(uint32_t crc, const uint8_t *data, size_t len)
+{
+	crc = ~crc;
+	while (len--)
+		crc = vl_null_crcTable[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void VL_NULL_PutBE32(uint8_t *dst, uint32_t val)
+{
+	dst[0] = (uint8_t)(val >> 24);
+	dst[1] = (uint8_t)(val >> 16);
+	dst[2] = (uint8_t)(val >> 8);
+	dst[3] = (uint8_t)val;
+}
+
+static void VL_NULL_WritePNGChunk(const char *type, const uint8_t *data, size_t len)
+{
+	uint8_t header[8], crcBytes[4];
+	VL_NULL_PutBE32(header, (uint32_t)len);
+	memcpy(header + 4, type, 4);
+	uint32_t crc = VL_NULL_CRC32(0, header + 4, 4);
+	crc = VL_NULL_CRC32(crc, data, len);
+	VL_NULL_PutBE32(crcBytes, crc);
+	VL_NULL_CaptureWrite(header, 8);
+	VL_NULL_CaptureWrite(data, len);
+	VL_NULL_CaptureWrite(crcBytes, 4);
+}
+
+// Writes one 8-bit paletted PNG. The image data is stored uncompressed
+// (which keeps the writer fast), but at one byte per pixel it is still much
+// smaller than the RGB output.
+static void VL_NULL_CaptureWritePNG(const VL_NULL_CaptureFrame *frame)
+{
+	static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	const size_t rowLen = VL_EGAVGA_GFX_WIDTH + 1;
+	const size_t rawLen = rowLen * VL_EGAVGA_GFX_HEIGHT;
+	uint8_t ihdr[13];
+	char fileName[sizeof(vl_null_capturePath) + 16];
+
+	snprintf(fileName, sizeof(fileName), "%s_%06ld.png", vl_null_capturePath, vl_null_captureFrames);
+	vl_null_captureFile = fopen(fileName, "wb");
+	if (!vl_null_captureFile)
+	{
+		vl_null_captureWriteError = "Couldn't create a capture PNG file!";
+		return;
+	}
+
+	VL_NULL_CaptureWrite(signature, 8);
+
+	VL_NULL_PutBE32(ihdr, VL_EGAVGA_GFX_WIDTH);
+	VL_NULL_PutBE32(ihdr + 4, VL_EGAVGA_GFX_HEIGHT);
+	ihdr[8] = 8;  // Bit depth
+	ihdr[9] = 3;  // Colour type: indexed
+	ihdr[10] = 0; // Compression
+	ihdr[11] = 0; // Filter
+	ihdr[12] = 0; // Interlace
+	VL_NULL_WritePNGChunk("IHDR", ihdr, sizeof(ihdr));
+	VL_NULL_WritePNGChunk("PLTE", &frame->palette[0][0], sizeof(frame->palette));
+
+	// Build a zlib stream of 'stored' deflate blocks, each row of which
+	// starts with filter type 0.
+	uint8_t *raw = vl_null_captureScratch;
+	uint8_t *zlib = vl_null_captureScratch + rawLen;
+	uint8_t *out = zlib;
+	uint32_t adlerA = 1, adlerB = 0;
+	for (int y = 0; y < VL_EGAVGA_GFX_HEIGHT; ++y)
+	{
+		uint8_t *row = raw + y * rowLen;
+		row[0] = 0;
+		for (int x = 0; x < VL_EGAVGA_GFX_WIDTH; ++x)
+			row[x + 1] = frame->pixels[y * VL_EGAVGA_GFX_WIDTH + x] & 0xF;
+	}
+	for (size_t i = 0; i < rawLen; ++i)
+	{
+		adlerA = (adlerA + raw[i]) % 65521;
+		adlerB = (adlerB + adlerA) % 65521;
+	}
+	*out++ = 0x78;
+	*out++ = 0x01;
+	for (size_t offset = 0; offset < rawLen; offset += 0xFFFF)
+	{
+		size_t blockLen = CK_Cross_min(rawLen - offset, (size_t)0xFFFF);
+		*out++ = (offset + blockLen == rawLen) ? 1 : 0;
+		*out++ = (uint8_t)blockLen;
+		*out++ = (uint8_t)(blockLen >> 8);
+		*out++ = (uint8_t)~blockLen;
+		*out++ = (uint8_t)(~blockLen >> 8);
+		memcpy(out, raw + offset, blockLen);
+		out += blockLen;
+	}
+	VL_NULL_PutBE32(out, (adlerB << 16) | adlerA);
+	out += 4;
+	VL_NULL_WritePNGChunk("IDAT", zlib, out - zlib);
+	VL_NULL_WritePNGChunk("IEND", NULL, 0);
+
+	fclose(vl_null_captureFile);
+	vl_null_captureFile = NULL;
+}
+
+static void VL_NULL_CaptureEncode(const VL_NULL_CaptureFrame *frame)
+{
+	switch (vl_null_captureFormat)
+	{
+	case VL_NULL_Capture_RGB:
+		VL_NULL_CaptureWriteRGB(frame);
+		break;
+	case VL_NULL_Capture_Y4M:
+		VL_NULL_CaptureWriteY4M(frame);
+		break;
+	case VL_NULL_Capture_PNG:
+		VL_NULL_CaptureWritePNG(frame);
+		break;
+	}
+	vl_null_captureFrames++;
+}
+
+#ifdef VL_NULL_CAPTURE_THREADED
+static void *VL_NULL_CaptureThread(void *param)
+{
+	(void)param;
+	pthread_mutex_lock(&vl_null_captureLock);
+	for (;;)
+	{
+		while (!vl_null_captureQueueCount && !vl_null_captureStopping)
+			pthread_cond_wait(&vl_null_captureNotEmpty, &vl_null_captureLock);
+		if (!vl_null_captureQueueCount)
+			break;
+
+		// The head slot stays ours until we release it below, so it can be
+		// encoded without holding the lock.
+		VL_NULL_CaptureFrame *frame = &vl_null_captureQueue[vl_null_captureQueueHead];
+		pthread_mutex_unlock(&vl_null_captureLock);
+		VL_NULL_CaptureEncode(frame);
+		pthread_mutex_lock(&vl_null_captureLock);
+
+		// Quitting from here would shut the capture down from under the
+		// game thread, so leave that to it.
+		if (vl_null_captureWriteError)
+		{
+			vl_null_captureError = vl_null_captureWriteError;
+			pthread_cond_signal(&vl_null_captureNotFull);
+			break;
+		}
+
+		vl_null_captureQueueHead = (vl_null_captureQueueHead + 1) % VL_NULL_CAPTURE_QUEUE_LENGTH;
+		vl_null_captureQueueCount--;
+		pthread_cond_signal(&vl_null_captureNotFull);
+	}
+	pthread_mutex_unlock(&vl_null_captureLock);
+	return NULL;
+}
+#endif
+
+static void VL_NULL_StartCapture(const char *path)
+{
+	const char *ext = strrchr(path, '.');
+	size_t pathLen = strlen(path);
+
+	if (ext && !CK_Cross_strcasecmp(ext, ".y4m"))
+		vl_null_captureFormat = VL_NULL_Capture_Y4M;
+	else if (ext && !CK_Cross_strcasecmp(ext, ".png"))
+	{
+		vl_null_captureFormat = VL_NULL_Capture_PNG;
+		pathLen = ext - path; // The frame number goes before the extension.
+	}
+	else
+		vl_null_captureFormat = VL_NULL_Capture_RGB;
+
+	if (pathLen >= sizeof(vl_null_capturePath))
+		Quit("The capture file name is too long!");
+	memcpy(vl_null_capturePath, path, pathLen);
+	vl_null_capturePath[pathLen] = '\0';
+
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		uint32_t c = i;
+		for (int k = 0; k < 8; ++k)
+			c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+		vl_null_crcTable[i] = c;
+	}
+
+	if (vl_null_captureFormat != VL_NULL_Capture_PNG)
+	{
+		vl_null_captureFile = fopen(vl_null_capturePath, "wb");
+		if (!vl_null_captureFile)
+			Quit("Couldn't open the capture file!");
+	}
+	if (vl_null_captureFormat == VL_NULL_Capture_Y4M)
+	{
+		// The pixel aspect ratio of 5:6 stretches 320x200 to 4:3.
+		fprintf(vl_null_captureFile, "YUV4MPEG2 W%d H%d F70:1 Ip A5:6 C444 XCOLORRANGE=FULL\n",
+			VL_EGAVGA_GFX_WIDTH, VL_EGAVGA_GFX_HEIGHT);
+	}
+
+	// Enough for a whole RGB/YUV frame, which is more than the PNG rows
+	// plus their zlib-wrapped copy.
+	vl_null_captureScratch = (uint8_t *)malloc(VL_NULL_CAPTURE_FRAME_SIZE * 3);
+	vl_null_captureQueue = (VL_NULL_CaptureFrame *)malloc(sizeof(VL_NULL_CaptureFrame) * VL_NULL_CAPTURE_QUEUE_LENGTH);
+	if (!vl_null_captureScratch || !vl_null_captureQueue)
+		Quit("Couldn't allocate the capture buffers!");
+	vl_null_captureQueueHead = vl_null_captureQueueCount = 0;
+	vl_null_captureFrames = vl_null_captureStalls = 0;
+	vl_null_captureWriteError = NULL;
+
+#ifdef VL_NULL_CAPTURE_THREADED
+	vl_null_captureStopping = false;
+	vl_null_captureError = NULL;
+	if (pthread_create(&vl_null_captureThread, NULL, VL_NULL_CaptureThread, NULL))
+		Quit("Couldn't start the capture thread!");
+#endif
+	vl_null_captureActive = true;
+	CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "VL: Capturing frames to %s\n", path);
+}
+
+static void VL_NULL_StopCapture(void)
+{
+	if (!vl_null_captureActive)
+		return;
+
+#ifdef VL_NULL_CAPTURE_THREADED
+	pthread_mutex_lock(&vl_null_captureLock);
+	vl_null_captureStopping = true;
+	pthread_cond_signal(&vl_null_captureNotEmpty);
+	pthread_mutex_unlock(&vl_null_captureLock);
+	pthread_join(vl_null_captureThread, NULL);
+#endif
+
+	if (vl_null_captureFile)
+		fclose(vl_null_captureFile);
+	vl_null_captureFile = NULL;
+	free(vl_null_captureQueue);
+	free(vl_null_captureScratch);
+	vl_null_captureQueue = NULL;
+	vl_null_captureScratch = NULL;
+	vl_null_captureActive = false;
+
+	if (vl_null_captureWriteError)
+		CK_Cross_LogMessage(CK_LOG_MSG_WARNING, "VL: %s\n", vl_null_captureWriteError);
+	CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "VL: Captured %ld frames (the game waited for the writer %ld times)\n",
+		vl_null_captureFrames, vl_null_captureStalls);
+}
+
+static void VL_NULL_QueueCaptureFrame(VL_NULL_Surface *surf, int scrlX, int scrlY)
+{
+	VL_NULL_CaptureFrame *frame;
+
+#ifdef VL_NULL_CAPTURE_THREADED
+	pthread_mutex_lock(&vl_null_captureLock);
+	if (vl_null_captureQueueCount == VL_NULL_CAPTURE_QUEUE_LENGTH && !vl_null_captureError)
+	{
+		vl_null_captureStalls++;
+		while (vl_null_captureQueueCount == VL_NULL_CAPTURE_QUEUE_LENGTH && !vl_null_captureError)
+			pthread_cond_wait(&vl_null_captureNotFull, &vl_null_captureLock);
+	}
+	if (vl_null_captureError)
+	{
+		// The writer has stopped, so it's safe to shut the capture down.
+		const char *error = vl_null_captureError;
+		pthread_mutex_unlock(&vl_null_captureLock);
+		Quit(error);
+	}
+	// Only the writer touches queued frames, so the free slot can be
+	// filled in without holding the lock.
+	frame = &vl_null_captureQueue[(vl_null_captureQueueHead + vl_null_captureQueueCount) % VL_NULL_CAPTURE_QUEUE_LENGTH];
+	pthread_mutex_unlock(&vl_null_captureLock);
+#else
+	frame = &vl_null_captureQueue[0];
+#endif
+
+	memcpy(frame->palette, vl_null_capturePalette, sizeof(frame->palette));
+	for (int y = 0; y < VL_EGAVGA_GFX_HEIGHT; ++y)
+		memcpy(frame->pixels + y * VL_EGAVGA_GFX_WIDTH, (uint8_t *)surf->data + (y + scrlY) * surf->w + scrlX, VL_EGAVGA_GFX_WIDTH);
+
+#ifdef VL_NULL_CAPTURE_THREADED
+	pthread_mutex_lock(&vl_null_captureLock);
+	vl_null_captureQueueCount++;
+	pthread_cond_signal(&vl_null_captureNotEmpty);
+	pthread_mutex_unlock(&vl_null_captureLock);
+#else
+	VL_NULL_CaptureEncode(frame);
+	if (vl_null_captureWriteError)
+		Quit(vl_null_captureWriteError);
+#endif
+}
+
 static void VL_NULL_SetVideoMode(int mode)
 {
 	if (mode == 0xD)
 	{
 		vl_null_screenWidth = VL_EGAVGA_GFX_WIDTH;
 		vl_null_screenHeight = VL_EGAVGA_GFX_HEIGHT;
+
+		for (int i = 1; i < us_argc - 1; ++i)
+		{
+			if (!CK_Cross_strcasecmp(us_argv[i], "/CAPTURE"))
+				VL_NULL_StartCapture(us_argv[i + 1]);
+		}
 	}
 	else
 	{
+		VL_NULL_StopCapture();
 	}
 }
 
@@ -70,6 +467,9 @@ static void VL_NULL_GetSurfaceDimensions(void *surface, int *w, int *h)
 
 static void VL_NULL_RefreshPaletteAndBorderColor(void *screen)
 {
+	(void)screen;
+	for (int i = 0; i < 16; i++)
+		memcpy(vl_null_capturePalette[i], VL_EGARGBColorTable[vl_emuegavgaadapter.palette[i]], 3);
 }
 
 static int VL_NULL_SurfacePGet(void *surface, int x, int y)
@@ -190,6 +590,24 @@ static void VL_NULL_BitInvBlitToSurface(void *src, void *dst_surface, int x, int
 	VL_1bppInvBlitClipToPAL8(src, surf->data, x, y, surf->w, w, h, surf->w, surf->h, colour);
 }
 
+static void VL_NULL_ChunkyToSurface(const uint8_t *src, void *dst_surface, int x, int y, int w, int h)
+{
+	VL_NULL_Surface *surf = (VL_NULL_Surface *)dst_surface;
+	VL_ChunkyToPAL8(src, surf->data, x, y, surf->w, w, h);
+}
+
+static void VL_NULL_ChunkyMaskedBlitToSurface(const uint8_t *src, const uint8_t *mask, void *dst_surface, int x, int y, int w, int h)
+{
+	VL_NULL_Surface *surf = (VL_NULL_Surface *)dst_surface;
+	VL_ChunkyMaskedBlitClipToPAL8(src, mask, surf->data, x, y, surf->w, w, h, surf->w, surf->h);
+}
+
+static void VL_NULL_SpanSpriteToSurface(const VL_SpanSprite *spr, void *dst_surface, int x, int y, int colour)
+{
+	VL_NULL_Surface *surf = (VL_NULL_Surface *)dst_surface;
+	VL_SpanSpriteClipToPAL8(spr, surf->data, x, y, surf->w, surf->w, surf->h, colour);
+}
+
 static int VL_NULL_GetActiveBufferId(void *surface)
 {
 	(void)surface;
@@ -247,6 +665,8 @@ static void VL_NULL_ScrollSurface(void *surface, int x, int y)
 
 static void VL_NULL_Present(void *surface, int scrlX, int scrlY, bool singleBuffered)
 {
+	if (vl_null_captureActive)
+		VL_NULL_QueueCaptureFrame((VL_NULL_Surface *)surface, scrlX, scrlY);
 	SD_SetTimeCount(SD_GetTimeCount() + 1);
 }
 
@@ -289,9 +709,27 @@ VL_Backend vl_null_backend =
 		/*.syncBuffers =*/&VL_NULL_SyncBuffers,
 		/*.updateRect =*/&VL_NULL_UpdateRect,
 		/*.flushParams =*/&VL_NULL_FlushParams,
-		/*.waitVBLs =*/&VL_NULL_WaitVBLs};
+		/*.waitVBLs =*/&VL_NULL_WaitVBLs,
+		/*.chunkyToSurface =*/&VL_NULL_ChunkyToSurface,
+		/*.chunkyMaskedBlitToSurface =*/&VL_NULL_ChunkyMaskedBlitToSurface,
+		/*.spanSpriteToSurface =*/&VL_NULL_SpanSpriteToSurface};
 
 VL_Backend *VL_Impl_GetBackend()
 {
 	return &vl_null_backend;
 }
+
+// Lets the embedding library (ck_lib.c) read the screen in place.
+uint8_t *VL_NULL_GetScreenPixels(int *w, int *h)
+{
+	VL_NULL_Surface *surf = (VL_NULL_Surface *)vl_emuegavgaadapter.screen;
+	if (!surf)
+		return NULL;
+	VL_NULL_GetSurfaceDimensions(surf, w, h);
+	return (uint8_t *)surf->data;
+}
+
+void VL_NULL_GetPalette(uint8_t palette[16][3])
+{
+	memcpy(palette, vl_null_capturePalette, sizeof(vl_null_capturePalette));
+}
@@ -105,4 +105,44 @@ void VL_CalculateRenderRegions(int realW, int realH);
 // Calculates a good default window size, given the desktop size.
 int VL_CalculateDefaultWindowScale(int desktopW, int desktopH);
 
+// Vectorised planar-to-PAL8 kernels (see id_vl_simd.c).
+// Each kernel converts 'groups' runs of 'width' pixels. The source pointers
+// point to the byte containing the first pixel, which must be byte-aligned.
+typedef struct VL_PlanarKernels
+{
+	const char *name;
+	int width;
+	void (*unmasked)(const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, uint8_t *dst, int groups);
+	void (*masked)(const uint8_t *a, const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, uint8_t *dst, int groups);
+	void (*maskedBlit)(const uint8_t *a, const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, uint8_t *dst, int groups);
+	void (*bit)(const uint8_t *src, uint8_t *dst, int groups, int colour);
+	void (*bitXor)(const uint8_t *src, uint8_t *dst, int groups, int colour);
+	void (*bitBlit)(const uint8_t *src, uint8_t *dst, int groups, int colour);
+	void (*bitInvBlit)(const uint8_t *src, uint8_t *dst, int groups, int colour);
+} VL_PlanarKernels;
+
+// Returns the best kernels supported by the running CPU, or NULL if only
+// the scalar code is available.
+const VL_PlanarKernels *VL_SIMD_DetectPlanarKernels(void);
+// Returns the index'th kernel set supported by the running CPU, best first,
+// or NULL once there are no more.
+const VL_PlanarKernels *VL_SIMD_GetPlanarKernels(int index);
+// Replaces the kernels picked by VL_Startup (NULL for the scalar code).
+// tools/simdcheck uses this to compare every set against the scalar code.
+void VL_SetPlanarKernels(const VL_PlanarKernels *kernels);
+
+// Vectorised PAL8-to-32-bit palette lookup (see id_vl_simd.c).
+// Converts 'groups' runs of 'width' pixels using the low nibble of each pixel
+// as an index into the 16-entry 'lut'.
+typedef struct VL_PaletteKernels
+{
+	const char *name;
+	int width;
+	void (*pal8ToRGB32)(const uint8_t *src, uint32_t *dst, int groups, const uint32_t *lut);
+} VL_PaletteKernels;
+
+// Returns the best palette kernels supported by the running CPU, or NULL if
+// only the scalar code is available.
+const VL_PaletteKernels *VL_SIMD_DetectPaletteKernels(void);
+
 #endif
@@ -331,6 +331,30 @@ static void VL_SDL12_Present(void *surface, int scrlX, int scrlY, bool singleBuf
 	SDL_Flip(vl_sdl12_screenSurface);
 }
 
+static void VL_SDL12_ChunkyToSurface(const uint8_t *src, void *dst_surface, int x, int y, int w, int h)
+{
+	SDL_Surface *surf = (SDL_Surface *)dst_surface;
+	SDL_LockSurface(surf);
+	VL_ChunkyToPAL8(src, surf->pixels, x, y, surf->pitch, w, h);
+	SDL_UnlockSurface(surf);
+}
+
+static void VL_SDL12_ChunkyMaskedBlitToSurface(const uint8_t *src, const uint8_t *mask, void *dst_surface, int x, int y, int w, int h)
+{
+	SDL_Surface *surf = (SDL_Surface *)dst_surface;
+	SDL_LockSurface(surf);
+	VL_ChunkyMaskedBlitClipToPAL8(src, mask, surf->pixels, x, y, surf->pitch, w, h, surf->w, surf->h);
+	SDL_UnlockSurface(surf);
+}
+
+static void VL_SDL12_SpanSpriteToSurface(const VL_SpanSprite *spr, void *dst_surface, int x, int y, int colour)
+{
+	SDL_Surface *surf = (SDL_Surface *)dst_surface;
+	SDL_LockSurface(surf);
+	VL_SpanSpriteClipToPAL8(spr, surf->pixels, x, y, surf->pitch, surf->w, surf->h, colour);
+	SDL_UnlockSurface(surf);
+}
+
 static int VL_SDL12_GetActiveBufferId(void *surface)
 {
 	(void)surface;
@@ -396,7 +420,10 @@ VL_Backend vl_sdl12_backend =
 		/*.syncBuffers =*/&VL_SDL12_SyncBuffers,
 		/*.updateRect =*/&VL_SDL12_UpdateRect,
 		/*.flushParams =*/&VL_SDL12_FlushParams,
-		/*.waitVBLs =*/&VL_SDL12_WaitVBLs};
+		/*.waitVBLs =*/&VL_SDL12_WaitVBLs,
+		/*.chunkyToSurface =*/&VL_SDL12_ChunkyToSurface,
+		/*.chunkyMaskedBlitToSurface =*/&VL_SDL12_ChunkyMaskedBlitToSurface,
+		/*.spanSpriteToSurface =*/&VL_SDL12_SpanSpriteToSurface};
 
 VL_Backend *VL_Impl_GetBackend()
 {
@@ -8,8 +8,8 @@
 static SDL_Window *vl_sdl2_window;
 static SDL_Renderer *vl_sdl2_renderer;
 static SDL_Texture *vl_sdl2_texture;
-static SDL_Palette *vl_sdl2_palette;
-static SDL_Surface *vl_sdl2_stagingSurface;
+// The current palette, as ARGB8888 colours.
+static uint32_t vl_sdl2_palette[16];
 static SDL_Texture *vl_sdl2_scaledTarget;
 static bool vl_sdl2_bilinearSupport = true;
 
@@ -90,12 +90,6 @@ static void VL_SDL2_SetVideoMode(int mode)
 		SDL_SetTextureScaleMode(vl_sdl2_texture, SDL_ScaleModeNearest);
 #endif
 
-		vl_sdl2_palette = SDL_AllocPalette(256);
-
-		// As we can't do on-GPU palette conversions with SDL2,
-		// we do a PAL8->RGBA conversion of the visible area to this surface each frame.
-		vl_sdl2_stagingSurface = SDL_CreateRGBSurface(0, VL_EGAVGA_GFX_WIDTH, VL_EGAVGA_GFX_HEIGHT, 32, 0, 0, 0, 0);
-
 		VL_SDL2_ResizeWindow();
 		SDL_ShowCursor(0);
 	}
@@ -143,17 +137,13 @@ static void VL_SDL2_GetSurfaceDimensions(void *surface, int *w, int *h)
 
 static void VL_SDL2_RefreshPaletteAndBorderColor(void *screen)
 {
-	SDL_Surface *surf = (SDL_Surface *)screen;
-	static SDL_Color sdl2_palette[16];
+	(void)screen;
 
 	for (int i = 0; i < 16; i++)
 	{
-		sdl2_palette[i].r = VL_EGARGBColorTable[vl_emuegavgaadapter.palette[i]][0];
-		sdl2_palette[i].g = VL_EGARGBColorTable[vl_emuegavgaadapter.palette[i]][1];
-		sdl2_palette[i].b = VL_EGARGBColorTable[vl_emuegavgaadapter.palette[i]][2];
+		const uint8_t *rgb = VL_EGARGBColorTable[vl_emuegavgaadapter.palette[i]];
+		vl_sdl2_palette[i] = 0xFF000000 | ((uint32_t)rgb[0] << 16) | ((uint32_t)rgb[1] << 8) | rgb[2];
 	}
-	SDL_SetPaletteColors(vl_sdl2_palette, sdl2_palette, 0, 16);
-	SDL_SetSurfacePalette(surf, vl_sdl2_palette);
 }
 
 static int VL_SDL2_SurfacePGet(void *surface, int x, int y)
@@ -337,14 +327,21 @@ static void VL_SDL2_Present(void *surface, int scrlX, int scrlY, bool singleBuff
 	// TODO: Verify this is a VL_SurfaceUsage_FrontBuffer
 	VL_SDL2_ResizeWindow();
 	SDL_Surface *surf = (SDL_Surface *)surface;
-	SDL_Rect srcr = {(Sint16)scrlX, (Sint16)scrlY, VL_EGAVGA_GFX_WIDTH, VL_EGAVGA_GFX_HEIGHT};
 	SDL_Rect renderRect = {(Sint16)vl_renderRgn_x, (Sint16)vl_renderRgn_y, vl_renderRgn_w, vl_renderRgn_h};
 	SDL_Rect fullRect = {(Sint16)vl_fullRgn_x, (Sint16)vl_fullRgn_y, vl_fullRgn_w, vl_fullRgn_h};
 
-	SDL_BlitSurface(surf, &srcr, vl_sdl2_stagingSurface, 0);
-	SDL_LockSurface(vl_sdl2_stagingSurface);
-	SDL_UpdateTexture(vl_sdl2_texture, 0, vl_sdl2_stagingSurface->pixels, vl_sdl2_stagingSurface->pitch);
-	SDL_UnlockSurface(vl_sdl2_stagingSurface);
+	// As we can't do on-GPU palette conversions with SDL2, convert the
+	// visible area straight into the (streaming) texture's memory.
+	void *texPixels;
+	int texPitch;
+	if (SDL_LockTexture(vl_sdl2_texture, NULL, &texPixels, &texPitch) == 0)
+	{
+		SDL_LockSurface(surf);
+		VL_PAL8ToRGB32((const uint8_t *)surf->pixels + scrlY * surf->pitch + scrlX, surf->pitch,
+			texPixels, texPitch, VL_EGAVGA_GFX_WIDTH, VL_EGAVGA_GFX_HEIGHT, vl_sdl2_palette);
+		SDL_UnlockSurface(surf);
+		SDL_UnlockTexture(vl_sdl2_texture);
+	}
 	if (vl_sdl2_scaledTarget)
 	{
 		SDL_SetRenderTarget(vl_sdl2_renderer, vl_sdl2_scaledTarget);
@@ -384,6 +381,30 @@ static void VL_SDL2_Present(void *surface, int scrlX, int scrlY, bool singleBuff
 	SDL_RenderPresent(vl_sdl2_renderer);
 }
 
+static void VL_SDL2_ChunkyToSurface(const uint8_t *src, void *dst_surface, int x, int y, int w, int h)
+{
+	SDL_Surface *surf = (SDL_Surface *)dst_surface;
+	SDL_LockSurface(surf);
+	VL_ChunkyToPAL8(src, surf->pixels, x, y, surf->pitch, w, h);
+	SDL_UnlockSurface(surf);
+}
+
+static void VL_SDL2_ChunkyMaskedBlitToSurface(const uint8_t *src, const uint8_t *mask, void *dst_surface, int x, int y, int w, int h)
+{
+	SDL_Surface *surf = (SDL_Surface *)dst_surface;
+	SDL_LockSurface(surf);
+	VL_ChunkyMaskedBlitClipToPAL8(src, mask, surf->pixels, x, y, surf->pitch, w, h, surf->w, surf->h);
+	SDL_UnlockSurface(surf);
+}
+
+static void VL_SDL2_SpanSpriteToSurface(const VL_SpanSprite *spr, void *dst_surface, int x, int y, int colour)
+{
+	SDL_Surface *surf = (SDL_Surface *)dst_surface;
+	SDL_LockSurface(surf);
+	VL_SpanSpriteClipToPAL8(spr, surf->pixels, x, y, surf->pitch, surf->w, surf->h, colour);
+	SDL_UnlockSurface(surf);
+}
+
 static int VL_SDL2_GetActiveBufferId(void *surface)
 {
 	(void)surface;
@@ -456,7 +477,9 @@ VL_Backend vl_sdl2_backend =
 		/*.updateRect =*/&VL_SDL2_UpdateRect,
 		/*.flushParams =*/&VL_SDL2_FlushParams,
 		/*.waitVBLs =*/&VL_SDL2_WaitVBLs,
-};
+		/*.chunkyToSurface =*/&VL_SDL2_ChunkyToSurface,
+		/*.chunkyMaskedBlitToSurface =*/&VL_SDL2_ChunkyMaskedBlitToSurface,
+		/*.spanSpriteToSurface =*/&VL_SDL2_SpanSpriteToSurface};
 
 VL_Backend *VL_Impl_GetBackend()
 {
@@ -3,6 +3,7 @@
 #include <SDL_opengl.h>
 #include <stdlib.h>
 #include <string.h>
+#include "id_cfg.h"
 #include "id_us.h"
 #include "id_vl.h"
 #include "id_vl_private.h"
@@ -10,6 +11,13 @@
 
 #define VL_SDL2GL_NUM_BUFFERS 2
 
+// Size of the blocks used to track which parts of a texture need uploading.
+#define VL_SDL2GL_DIRTY_BLOCK_SHIFT 4
+#define VL_SDL2GL_DIRTY_BLOCK_SIZE (1 << VL_SDL2GL_DIRTY_BLOCK_SHIFT)
+
+// Maximum number of pixel unpack buffers used to stream texture uploads.
+#define VL_SDL2GL_MAX_PBOS 3
+
 // OpenGL 1.0 and 1.1 Function Pointers:
 typedef const GLubyte *(APIENTRYP PFN_ID_GLGETSTRING)(GLenum name);
 PFN_ID_GLGETSTRING id_glGetString = 0;
@@ -53,6 +61,19 @@ typedef void(APIENTRYP PFN_ID_GLVERTEXPOINTER)(GLint size, GLenum type, GLsizei
 PFN_ID_GLVERTEXPOINTER id_glVertexPointer = 0;
 typedef void(APIENTRYP PFN_ID_GLTEXCOORDPOINTER)(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer);
 PFN_ID_GLTEXCOORDPOINTER id_glTexCoordPointer = 0;
+// OpenGL 1.5 Function Pointers:
+typedef void(APIENTRYP PFN_ID_GLGENBUFFERSPROC)(GLsizei n, GLuint *buffers);
+PFN_ID_GLGENBUFFERSPROC id_glGenBuffers = 0;
+typedef void(APIENTRYP PFN_ID_GLDELETEBUFFERSPROC)(GLsizei n, const GLuint *buffers);
+PFN_ID_GLDELETEBUFFERSPROC id_glDeleteBuffers = 0;
+typedef void(APIENTRYP PFN_ID_GLBINDBUFFERPROC)(GLenum target, GLuint buffer);
+PFN_ID_GLBINDBUFFERPROC id_glBindBuffer = 0;
+typedef void(APIENTRYP PFN_ID_GLBUFFERDATAPROC)(GLenum target, GLsizeiptr size, const void *data, GLenum usage);
+PFN_ID_GLBUFFERDATAPROC id_glBufferData = 0;
+typedef void *(APIENTRYP PFN_ID_GLMAPBUFFERPROC)(GLenum target, GLenum access);
+PFN_ID_GLMAPBUFFERPROC id_glMapBuffer = 0;
+typedef GLboolean(APIENTRYP PFN_ID_GLUNMAPBUFFERPROC)(GLenum target);
+PFN_ID_GLUNMAPBUFFERPROC id_glUnmapBuffer = 0;
 // OpenGL 1.3 Function Pointers:
 typedef void(APIENTRYP PFN_ID_GLACTIVETEXTUREPROC)(GLenum texture);
 PFN_ID_GLACTIVETEXTUREPROC id_glActiveTexture = 0;
@@ -102,6 +123,19 @@ typedef GLenum(APIENTRYP PFN_ID_GLCHECKFRAMEBUFFERSTATUSEXTPROC)(GLenum target);
 PFN_ID_GLCHECKFRAMEBUFFERSTATUSEXTPROC id_glCheckFramebufferStatusEXT = 0;
 typedef void(APIENTRYP PFN_ID_GLFRAMEBUFFERTEXTURE2DEXTPROC)(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
 PFN_ID_GLFRAMEBUFFERTEXTURE2DEXTPROC id_glFramebufferTexture2DEXT = 0;
+// ARB_map_buffer_range
+typedef void *(APIENTRYP PFN_ID_GLMAPBUFFERRANGEPROC)(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+PFN_ID_GLMAPBUFFERRANGEPROC id_glMapBufferRange = 0;
+// ARB_buffer_storage
+typedef void(APIENTRYP PFN_ID_GLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+PFN_ID_GLBUFFERSTORAGEPROC id_glBufferStorage = 0;
+// ARB_sync
+typedef GLsync(APIENTRYP PFN_ID_GLFENCESYNCPROC)(GLenum condition, GLbitfield flags);
+PFN_ID_GLFENCESYNCPROC id_glFenceSync = 0;
+typedef GLenum(APIENTRYP PFN_ID_GLCLIENTWAITSYNCPROC)(GLsync sync, GLbitfield flags, GLuint64 timeout);
+PFN_ID_GLCLIENTWAITSYNCPROC id_glClientWaitSync = 0;
+typedef void(APIENTRYP PFN_ID_GLDELETESYNCPROC)(GLsync sync);
+PFN_ID_GLDELETESYNCPROC id_glDeleteSync = 0;
 // EXT_framebuffer_blit
 typedef void(APIENTRYP PFN_ID_GLBLITFRAMEBUFFEREXTPROC)(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter);
 PFN_ID_GLBLITFRAMEBUFFEREXTPROC id_glBlitFramebufferEXT = 0;
@@ -140,6 +174,13 @@ static bool VL_SDL2GL_LoadGLProcs()
 	id_glDrawArrays = (PFN_ID_GLDRAWARRAYS)SDL_GL_GetProcAddress("glDrawArrays");
 	id_glVertexPointer = (PFN_ID_GLVERTEXPOINTER)SDL_GL_GetProcAddress("glVertexPointer");
 	id_glTexCoordPointer = (PFN_ID_GLTEXCOORDPOINTER)SDL_GL_GetProcAddress("glTexCoordPointer");
+	// OpenGL 1.5
+	id_glGenBuffers = (PFN_ID_GLGENBUFFERSPROC)SDL_GL_GetProcAddress("glGenBuffers");
+	id_glDeleteBuffers = (PFN_ID_GLDELETEBUFFERSPROC)SDL_GL_GetProcAddress("glDeleteBuffers");
+	id_glBindBuffer = (PFN_ID_GLBINDBUFFERPROC)SDL_GL_GetProcAddress("glBindBuffer");
+	id_glBufferData = (PFN_ID_GLBUFFERDATAPROC)SDL_GL_GetProcAddress("glBufferData");
+	id_glMapBuffer = (PFN_ID_GLMAPBUFFERPROC)SDL_GL_GetProcAddress("glMapBuffer");
+	id_glUnmapBuffer = (PFN_ID_GLUNMAPBUFFERPROC)SDL_GL_GetProcAddress("glUnmapBuffer");
 	// OpenGL 1.3
 	id_glActiveTexture = (PFN_ID_GLACTIVETEXTUREPROC)SDL_GL_GetProcAddress("glActiveTexture");
 	// OpenGL 2.0
@@ -172,6 +213,15 @@ static bool VL_SDL2GL_LoadGLProcs()
 	{
 		id_glBlitFramebufferEXT = (PFN_ID_GLBLITFRAMEBUFFEREXTPROC)SDL_GL_GetProcAddress("glBlitFramebufferEXT");
 	}
+	// Persistent mapping of pixel unpack buffers (optional)
+	if (SDL_GL_ExtensionSupported("GL_ARB_buffer_storage") && SDL_GL_ExtensionSupported("GL_ARB_map_buffer_range") && SDL_GL_ExtensionSupported("GL_ARB_sync"))
+	{
+		id_glMapBufferRange = (PFN_ID_GLMAPBUFFERRANGEPROC)SDL_GL_GetProcAddress("glMapBufferRange");
+		id_glBufferStorage = (PFN_ID_GLBUFFERSTORAGEPROC)SDL_GL_GetProcAddress("glBufferStorage");
+		id_glFenceSync = (PFN_ID_GLFENCESYNCPROC)SDL_GL_GetProcAddress("glFenceSync");
+		id_glClientWaitSync = (PFN_ID_GLCLIENTWAITSYNCPROC)SDL_GL_GetProcAddress("glClientWaitSync");
+		id_glDeleteSync = (PFN_ID_GLDELETESYNCPROC)SDL_GL_GetProcAddress("glDeleteSync");
+	}
 	return true;
 }
 
@@ -185,6 +235,17 @@ static int vl_sdl2gl_framebufferWidth, vl_sdl2gl_framebufferHeight;
 static int vl_sdl2gl_screenWidth;
 static int vl_sdl2gl_screenHeight;
 
+// Streaming texture uploads through a ring of pixel unpack buffers.
+// Enabled by setting 'vl_sdl2gl_pboBuffers' to 2 or 3 in the config file.
+static int vl_sdl2gl_numPBOs;
+static bool vl_sdl2gl_persistentPBOs;
+
+// Frame time counters, reported on shutdown.
+static long vl_sdl2gl_statFrames;
+static uint64_t vl_sdl2gl_statUploadTime;
+static uint64_t vl_sdl2gl_statPresentTime;
+static uint64_t vl_sdl2gl_statFirstPresent, vl_sdl2gl_statLastPresent;
+
 /* TODO (Overscan border):
  * - If a texture is used for offscreen rendering with scaling applied later,
  * it's better to have the borders within the texture itself.
@@ -199,6 +260,20 @@ typedef struct VL_SDL2GL_Surface
 	int activePage;
 	void *data;
 	void *dataPages[VL_SDL2GL_NUM_BUFFERS];
+	// Front buffers only: one byte per block per page, set when the block
+	// differs from what was last uploaded to that page's texture.
+	uint8_t *dirtyBlocks[VL_SDL2GL_NUM_BUFFERS];
+	int dirtyW, dirtyH;
+	// The textures are used as a ring buffer: pixel (x,y) of the surface
+	// lives at texel ((x + originX) % w, (y + originY) % h), so scrolling
+	// only moves the origin instead of forcing a full upload.
+	int originX, originY;
+	// Front buffers only: the ring of pixel unpack buffers, each laid out
+	// like a page. Only the dirty blocks are copied into them.
+	GLuint pbos[VL_SDL2GL_MAX_PBOS];
+	uint8_t *pboMappings[VL_SDL2GL_MAX_PBOS];
+	GLsync pboFences[VL_SDL2GL_MAX_PBOS];
+	int numPBOs, nextPBO;
 } VL_SDL2GL_Surface;
 
 const char *pxprog = "#version 110\n"
@@ -246,6 +321,18 @@ static void VL_SDL2GL_SetVideoMode(int mode)
 		if (SDL_GL_SetSwapInterval(vl_swapInterval) < 0)
 			vl_swapInterval = SDL_GL_GetSwapInterval();
 
+		vl_sdl2gl_numPBOs = CFG_GetConfigInt("vl_sdl2gl_pboBuffers", 0);
+		if (vl_sdl2gl_numPBOs && !SDL_GL_ExtensionSupported("GL_ARB_pixel_buffer_object"))
+		{
+			CK_Cross_LogMessage(CK_LOG_MSG_WARNING, "VL: GL_ARB_pixel_buffer_object is not supported, uploading from client memory.\n");
+			vl_sdl2gl_numPBOs = 0;
+		}
+		if (vl_sdl2gl_numPBOs)
+			vl_sdl2gl_numPBOs = CK_Cross_max(2, CK_Cross_min(vl_sdl2gl_numPBOs, VL_SDL2GL_MAX_PBOS));
+		vl_sdl2gl_persistentPBOs = vl_sdl2gl_numPBOs && id_glBufferStorage && CFG_GetConfigBool("vl_sdl2gl_pboPersistent", true);
+		vl_sdl2gl_statFrames = 0;
+		vl_sdl2gl_statUploadTime = vl_sdl2gl_statPresentTime = 0;
+
 		// Compile the shader we use to emulate EGA palettes.
 		int compileStatus = 0;
 		GLuint ps = id_glCreateShader(GL_FRAGMENT_SHADER);
@@ -290,6 +377,15 @@ static void VL_SDL2GL_SetVideoMode(int mode)
 	}
 	else
 	{
+		if (vl_sdl2gl_statFrames > 1)
+		{
+			CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "VL: Presented %ld frames (uploading from %s): %.2f us/frame uploading, %.2f us/frame presenting, %.2f ms/frame overall\n",
+				vl_sdl2gl_statFrames,
+				vl_sdl2gl_persistentPBOs ? "persistent PBOs" : (vl_sdl2gl_numPBOs ? "PBOs" : "client memory"),
+				(double)vl_sdl2gl_statUploadTime / vl_sdl2gl_statFrames,
+				(double)vl_sdl2gl_statPresentTime / vl_sdl2gl_statFrames,
+				(double)(vl_sdl2gl_statLastPresent - vl_sdl2gl_statFirstPresent) / ((vl_sdl2gl_statFrames - 1) * 1000.0));
+		}
 		if (vl_sdl2gl_framebufferTexture)
 			id_glDeleteTextures(1, &vl_sdl2gl_framebufferTexture);
 		if (vl_sdl2gl_framebufferObject)
@@ -312,6 +408,42 @@ static void VL_SDL2GL_SetSurfacePage(VL_SDL2GL_Surface *surf, int page)
 	surf->textureHandle = surf->textureHandles[page];
 }
 
+static void VL_SDL2GL_MarkPageDirty(VL_SDL2GL_Surface *surf, int page, int x, int y, int w, int h)
+{
+	if (surf->use != VL_SurfaceUsage_FrontBuffer)
+		return;
+
+	// Clip to the surface
+	if (x < 0)
+	{
+		w += x;
+		x = 0;
+	}
+	if (y < 0)
+	{
+		h += y;
+		y = 0;
+	}
+	if (x + w > surf->w)
+		w = surf->w - x;
+	if (y + h > surf->h)
+		h = surf->h - y;
+	if (w <= 0 || h <= 0)
+		return;
+
+	int bx1 = x >> VL_SDL2GL_DIRTY_BLOCK_SHIFT;
+	int by1 = y >> VL_SDL2GL_DIRTY_BLOCK_SHIFT;
+	int bx2 = (x + w - 1) >> VL_SDL2GL_DIRTY_BLOCK_SHIFT;
+	int by2 = (y + h - 1) >> VL_SDL2GL_DIRTY_BLOCK_SHIFT;
+	for (int by = by1; by <= by2; ++by)
+		memset(surf->dirtyBlocks[page] + by * surf->dirtyW + bx1, 1, bx2 - bx1 + 1);
+}
+
+static void VL_SDL2GL_MarkDirty(VL_SDL2GL_Surface *surf, int x, int y, int w, int h)
+{
+	VL_SDL2GL_MarkPageDirty(surf, surf->activePage, x, y, w, h);
+}
+
 static void VL_SDL2GL_SurfaceRect(void *dst_surface, int x, int y, int w, int h, int colour);
 static void *VL_SDL2GL_CreateSurface(int w, int h, VL_SurfaceUsage usage)
 {
@@ -322,15 +454,51 @@ static void *VL_SDL2GL_CreateSurface(int w, int h, VL_SurfaceUsage usage)
 	surf->h = h;
 	surf->textureHandle = 0;
 	surf->use = usage;
+	surf->activePage = 0;
 
 	if (usage == VL_SurfaceUsage_FrontBuffer)
 	{
 		surf->data = malloc(w * h * VL_SDL2GL_NUM_BUFFERS); // 8-bit pal for now
+		surf->dirtyW = (w + VL_SDL2GL_DIRTY_BLOCK_SIZE - 1) >> VL_SDL2GL_DIRTY_BLOCK_SHIFT;
+		surf->dirtyH = (h + VL_SDL2GL_DIRTY_BLOCK_SIZE - 1) >> VL_SDL2GL_DIRTY_BLOCK_SHIFT;
+		uint8_t *dirtyBlocks = (uint8_t *)malloc(surf->dirtyW * surf->dirtyH * VL_SDL2GL_NUM_BUFFERS);
+		if (!surf->data || !dirtyBlocks)
+			Quit("Couldn't create surface!");
+		// The textures start out undefined, so everything needs uploading.
+		memset(dirtyBlocks, 1, surf->dirtyW * surf->dirtyH * VL_SDL2GL_NUM_BUFFERS);
+		surf->originX = surf->originY = 0;
 		id_glGenTextures(VL_SDL2GL_NUM_BUFFERS, surf->textureHandles);
 		for (int i = 0; i < VL_SDL2GL_NUM_BUFFERS; ++i) {
 			id_glBindTexture(GL_TEXTURE_2D, surf->textureHandles[i]);
+			id_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			id_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 			id_glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8, surf->w, surf->h, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, 0);
 			surf->dataPages[i] = (void*)((uintptr_t)surf->data + i * w * h);
+			surf->dirtyBlocks[i] = dirtyBlocks + i * surf->dirtyW * surf->dirtyH;
+		}
+
+		surf->numPBOs = vl_sdl2gl_numPBOs;
+		surf->nextPBO = 0;
+		if (surf->numPBOs)
+		{
+			id_glGenBuffers(surf->numPBOs, surf->pbos);
+			for (int i = 0; i < surf->numPBOs; ++i)
+			{
+				id_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, surf->pbos[i]);
+				surf->pboFences[i] = 0;
+				surf->pboMappings[i] = 0;
+				if (vl_sdl2gl_persistentPBOs)
+				{
+					GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+					id_glBufferStorage(GL_PIXEL_UNPACK_BUFFER, w * h, 0, flags);
+					surf->pboMappings[i] = (uint8_t *)id_glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, w * h, flags);
+					if (!surf->pboMappings[i])
+						Quit("Couldn't map pixel unpack buffer!");
+				}
+				else
+					id_glBufferData(GL_PIXEL_UNPACK_BUFFER, w * h, 0, GL_STREAM_DRAW);
+			}
+			id_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 		}
 
 		VL_SDL2GL_SetSurfacePage(surf, 0);
@@ -348,7 +516,21 @@ static void VL_SDL2GL_DestroySurface(void *surface)
 	if (surf->use == VL_SurfaceUsage_FrontBuffer)
 	{
 		id_glDeleteTextures(VL_SDL2GL_NUM_BUFFERS, surf->textureHandles);
+		for (int i = 0; i < surf->numPBOs; ++i)
+		{
+			if (surf->pboFences[i])
+				id_glDeleteSync(surf->pboFences[i]);
+			if (surf->pboMappings[i])
+			{
+				id_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, surf->pbos[i]);
+				id_glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			}
+		}
+		id_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		if (surf->numPBOs)
+			id_glDeleteBuffers(surf->numPBOs, surf->pbos);
 		free(surf->dataPages[0]);
+		free(surf->dirtyBlocks[0]);
 	}
 	else
 	{
@@ -414,6 +596,7 @@ static void VL_SDL2GL_SurfaceRect(void *dst_surface, int x, int y, int w, int h,
 	{
 		memset(((uint8_t *)surf->data) + _y * surf->w + x, colour, w);
 	}
+	VL_SDL2GL_MarkDirty(surf, x, y, w, h);
 }
 
 static void VL_SDL2GL_SurfaceRect_PM(void *dst_surface, int x, int y, int w, int h, int colour, int mapmask)
@@ -431,6 +614,7 @@ static void VL_SDL2GL_SurfaceRect_PM(void *dst_surface, int x, int y, int w, int
 			*p |= colour;
 		}
 	}
+	VL_SDL2GL_MarkDirty(surf, x, y, w, h);
 }
 
 static void VL_SDL2GL_SurfaceToSurface(void *src_surface, void *dst_surface, int x, int y, int sx, int sy, int sw, int sh)
@@ -441,11 +625,11 @@ static void VL_SDL2GL_SurfaceToSurface(void *src_surface, void *dst_surface, int
 	{
 		memcpy(((uint8_t *)dest->data) + (_y - sy + y) * dest->w + x, ((uint8_t *)surf->data) + _y * surf->w + sx, sw);
 	}
+	VL_SDL2GL_MarkDirty(dest, x, y, sw, sh);
 }
 
-static void VL_SDL2GL_SurfaceToSelf(void *surface, int x, int y, int sx, int sy, int sw, int sh)
+static void VL_SDL2GL_MoveRect(VL_SDL2GL_Surface *srf, int x, int y, int sx, int sy, int sw, int sh)
 {
-	VL_SDL2GL_Surface *srf = (VL_SDL2GL_Surface *)surface;
 	bool directionY = sy > y;
 
 	if (directionY)
@@ -464,58 +648,126 @@ static void VL_SDL2GL_SurfaceToSelf(void *surface, int x, int y, int sx, int sy,
 	}
 }
 
+static void VL_SDL2GL_SurfaceToSelf(void *surface, int x, int y, int sx, int sy, int sw, int sh)
+{
+	VL_SDL2GL_Surface *srf = (VL_SDL2GL_Surface *)surface;
+	VL_SDL2GL_MoveRect(srf, x, y, sx, sy, sw, sh);
+	VL_SDL2GL_MarkDirty(srf, x, y, sw, sh);
+}
+
 static void VL_SDL2GL_UnmaskedToSurface(void *src, void *dst_surface, int x, int y, int w, int h)
 {
 	VL_SDL2GL_Surface *surf = (VL_SDL2GL_Surface *)dst_surface;
 	VL_UnmaskedToPAL8(src, surf->data, x, y, surf->w, w, h);
+	VL_SDL2GL_MarkDirty(surf, x, y, w, h);
 }
 
 static void VL_SDL2GL_UnmaskedToSurface_PM(void *src, void *dst_surface, int x, int y, int w, int h, int mapmask)
 {
 	VL_SDL2GL_Surface *surf = (VL_SDL2GL_Surface *)dst_surface;
 	VL_UnmaskedToPAL8_PM(src, surf->data, x, y, surf->w, w, h, mapmask);
+	VL_SDL2GL_MarkDirty(surf, x, y, w, h);
 }
 
 static void VL_SDL2GL_MaskedToSurface(void *src, void *dst_surface, int x, int y, int w, int h)
 {
 	VL_SDL2GL_Surface *surf = (VL_SDL2GL_Surface *)dst_surface;
 	VL_MaskedToPAL8(src, surf->data, x, y, surf->w, w, h);
+	VL_SDL2GL_MarkDirty(surf, x, y, w, h);
 }
 
 static void VL_SDL2GL_MaskedBlitToSurface(void *src, void *dst_surface, int x, int y, int w, int h)
 {
 	VL_SDL2GL_Surface *surf = (VL_SDL2GL_Surface *)dst_surface;
 	VL_MaskedBlitClipToPAL8(src, surf->data, x, y, surf->w, w, h, surf->w, surf->h);
+	VL_SDL2GL_MarkDirty(surf, x, y, w, h);
 }
 
 static void VL_SDL2GL_BitToSurface(void *src, void *dst_surface, int x, int y, int w, int h, int colour)
 {
 	VL_SDL2GL_Surface *surf = (VL_SDL2GL_Surface *)dst_surface;
 	VL_1bppToPAL8(src, surf->data, x, y, surf->w, w, h, colour);
+	VL_SDL2GL_MarkDirty(surf, x, y, w, h);
 }
 
 static void VL_SDL2GL_BitToSurface_PM(void *src, void *dst_surface, int x, int y, int w, int h, int colour, int mapmask)
 {
 	VL_SDL2GL_Surface *surf = (VL_SDL2GL_Surface *)dst_surface;
 	VL_1bppToPAL8_PM(src, surf->data, x, y, surf->w, w, h, colour, mapmask);
+	VL_SDL2GL_MarkDirty(surf, x, y, w, h);
 }
 
 static void VL_SDL2GL_BitXorWithSurface(void *src, void *dst_surface, int x, int y, int w, int h, int colour)
 {
 	VL_SDL2GL_Surface *surf = (VL_SDL2GL_Surface *)dst_surface;
 	VL_1bppXorWithPAL8(src, surf->data, x, y, surf->w, w, h, colour);
+	VL_SDL2GL_MarkDirty(surf, x, y, w, h);
 }
 
 static void VL_SDL2GL_BitBlitToSurface(void *src, void *dst_surface, int x, int y, int w, int h, int colour)
 {
 	VL_SDL2GL_Surface *surf = (VL_SDL2GL_Surface *)dst_surface;
 	VL_1bppBlitToPAL8(src, surf->data, x, y, surf->w, w, h, colour);
+	VL_SDL2GL_MarkDirty(surf, x, y, w, h);
 }
 
 static void VL_SDL2GL_BitInvBlitToSurface(void *src, void *dst_surface, int x, int y, int w, int h, int colour)
 {
 	VL_SDL2GL_Surface *surf = (VL_SDL2GL_Surface *)dst_surface;
 	VL_1bppInvBlitClipToPAL8(src, surf->data, x, y, surf->w, w, h, surf->w, surf->h, colour);
+	VL_SDL2GL_MarkDirty(surf, x, y, w, h);
+}
+
+// Moves the dirty block map of a page along with the surface contents, and
+// marks the strips which were scrolled in.
+static void VL_SDL2GL_ScrollDirtyBlocks(VL_SDL2GL_Surface *surf, int page, int x, int y)
+{
+	uint8_t *blocks = surf->dirtyBlocks[page];
+	int bx = x / VL_SDL2GL_DIRTY_BLOCK_SIZE, by = y / VL_SDL2GL_DIRTY_BLOCK_SIZE;
+	int cols = surf->dirtyW - CK_Cross_max(bx, -bx), rows = surf->dirtyH - CK_Cross_max(by, -by);
+
+	// Unaligned scrolls can't be tracked per-block, so just upload everything.
+	if ((x % VL_SDL2GL_DIRTY_BLOCK_SIZE) || (y % VL_SDL2GL_DIRTY_BLOCK_SIZE) || cols <= 0 || rows <= 0)
+	{
+		memset(blocks, 1, surf->dirtyW * surf->dirtyH);
+		return;
+	}
+
+	int dcol = (bx < 0) ? -bx : 0, scol = (bx > 0) ? bx : 0;
+	int drow = (by < 0) ? -by : 0, srow = (by > 0) ? by : 0;
+	if (by > 0)
+	{
+		for (int r = 0; r < rows; ++r)
+			memmove(blocks + (drow + r) * surf->dirtyW + dcol, blocks + (srow + r) * surf->dirtyW + scol, cols);
+	}
+	else
+	{
+		for (int r = rows - 1; r >= 0; --r)
+			memmove(blocks + (drow + r) * surf->dirtyW + dcol, blocks + (srow + r) * surf->dirtyW + scol, cols);
+	}
+
+	// The blocks which had no source are now stale.
+	for (int r = 0; r < surf->dirtyH; ++r)
+	{
+		if (r < drow || r >= drow + rows)
+		{
+			memset(blocks + r * surf->dirtyW, 1, surf->dirtyW);
+			continue;
+		}
+		memset(blocks + r * surf->dirtyW, 1, dcol);
+		memset(blocks + r * surf->dirtyW + dcol + cols, 1, surf->dirtyW - dcol - cols);
+	}
+
+	// If the surface isn't a whole number of blocks, the scrolled-in strip
+	// can start partway through a block.
+	if (x > 0)
+		VL_SDL2GL_MarkPageDirty(surf, page, surf->w - x, 0, x, surf->h);
+	else if (x < 0)
+		VL_SDL2GL_MarkPageDirty(surf, page, 0, 0, -x, surf->h);
+	if (y > 0)
+		VL_SDL2GL_MarkPageDirty(surf, page, 0, surf->h - y, surf->w, y);
+	else if (y < 0)
+		VL_SDL2GL_MarkPageDirty(surf, page, 0, 0, surf->w, -y);
 }
 
 static void VL_SDL2GL_ScrollSurface(void *surface, int x, int y)
@@ -550,16 +802,159 @@ static void VL_SDL2GL_ScrollSurface(void *surface, int x, int y)
 		for (int i = 0; i < VL_SDL2GL_NUM_BUFFERS; ++i)
 		{
 			VL_SDL2GL_SetSurfacePage(surf, i);
-			VL_SDL2GL_SurfaceToSelf(surface, dx, dy, sx, sy, w, h);
+			VL_SDL2GL_MoveRect(surf, dx, dy, sx, sy, w, h);
+			VL_SDL2GL_ScrollDirtyBlocks(surf, i, x, y);
 		}
 		VL_SDL2GL_SetSurfacePage(surf, oldPage);
+
+		// The texels already hold the scrolled contents: move the origin
+		// so they line up with the new pixel positions.
+		surf->originX = ((surf->originX + x) % surf->w + surf->w) % surf->w;
+		surf->originY = ((surf->originY + y) % surf->h + surf->h) % surf->h;
 	}
 	else
-		VL_SDL2GL_SurfaceToSelf(surface, dx, dy, sx, sy, w, h);
+		VL_SDL2GL_MoveRect(surf, dx, dy, sx, sy, w, h);
+}
+
+// Uploads a rectangle of the active page to its texture, splitting it where
+// it wraps around the edge of the (ring-buffered) texture. The pixels are
+// read from 'base', which is laid out like the page: either the page itself
+// or an offset into the bound pixel unpack buffer.
+static void VL_SDL2GL_UploadRect(VL_SDL2GL_Surface *surf, uintptr_t base, int x, int y, int w, int h)
+{
+	int tx = (x + surf->originX) % surf->w;
+	int ty = (y + surf->originY) % surf->h;
+
+	if (tx + w > surf->w)
+	{
+		int leftW = surf->w - tx;
+		VL_SDL2GL_UploadRect(surf, base, x, y, leftW, h);
+		VL_SDL2GL_UploadRect(surf, base, x + leftW, y, w - leftW, h);
+		return;
+	}
+	if (ty + h > surf->h)
+	{
+		int topH = surf->h - ty;
+		VL_SDL2GL_UploadRect(surf, base, x, y, w, topH);
+		VL_SDL2GL_UploadRect(surf, base, x, y + topH, w, h - topH);
+		return;
+	}
+
+	id_glTexSubImage2D(GL_TEXTURE_2D, 0, tx, ty, w, h, GL_RED, GL_UNSIGNED_BYTE, (const GLvoid *)(base + y * surf->w + x));
+}
+
+// Copies a rectangle of the active page into a mapped pixel unpack buffer.
+static void VL_SDL2GL_CopyRectToPBO(VL_SDL2GL_Surface *surf, uintptr_t base, int x, int y, int w, int h)
+{
+	for (int _y = y; _y < y + h; ++_y)
+	{
+		memcpy((uint8_t *)base + _y * surf->w + x, ((uint8_t *)surf->data) + _y * surf->w + x, w);
+	}
+}
+
+// Calls 'rectFunc' for every dirty region of the active page. Runs of dirty
+// blocks in a row are passed together, as are consecutive rows which are
+// entirely dirty.
+static void VL_SDL2GL_ForEachDirtyRect(VL_SDL2GL_Surface *surf, void (*rectFunc)(VL_SDL2GL_Surface *, uintptr_t, int, int, int, int), uintptr_t base)
+{
+	uint8_t *blocks = surf->dirtyBlocks[surf->activePage];
+	int fullRowsStart = -1;
+
+	for (int by = 0; by <= surf->dirtyH; ++by)
+	{
+		uint8_t *row = blocks + by * surf->dirtyW;
+		bool rowFull = (by < surf->dirtyH) && !memchr(row, 0, surf->dirtyW);
+
+		if (rowFull)
+		{
+			if (fullRowsStart < 0)
+				fullRowsStart = by;
+			continue;
+		}
+		if (fullRowsStart >= 0)
+		{
+			int y = fullRowsStart << VL_SDL2GL_DIRTY_BLOCK_SHIFT;
+			int h = CK_Cross_min(by << VL_SDL2GL_DIRTY_BLOCK_SHIFT, surf->h) - y;
+			rectFunc(surf, base, 0, y, surf->w, h);
+			fullRowsStart = -1;
+		}
+		if (by == surf->dirtyH)
+			break;
+
+		for (int bx = 0; bx < surf->dirtyW; ++bx)
+		{
+			if (!row[bx])
+				continue;
+			int runStart = bx;
+			while (bx < surf->dirtyW && row[bx])
+				bx++;
+			int x = runStart << VL_SDL2GL_DIRTY_BLOCK_SHIFT;
+			int y = by << VL_SDL2GL_DIRTY_BLOCK_SHIFT;
+			int w = CK_Cross_min(bx << VL_SDL2GL_DIRTY_BLOCK_SHIFT, surf->w) - x;
+			int h = CK_Cross_min(y + VL_SDL2GL_DIRTY_BLOCK_SIZE, surf->h) - y;
+			rectFunc(surf, base, x, y, w, h);
+		}
+	}
+}
+
+// Uploads every dirty block of the active page to its texture, either
+// directly from client memory or through the next pixel unpack buffer.
+static void VL_SDL2GL_UploadDirtyBlocks(VL_SDL2GL_Surface *surf)
+{
+	uint8_t *mapping = 0;
+	int pbo = surf->nextPBO;
+
+	if (surf->numPBOs)
+	{
+		surf->nextPBO = (pbo + 1) % surf->numPBOs;
+		id_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, surf->pbos[pbo]);
+
+		if (vl_sdl2gl_persistentPBOs)
+		{
+			// Make sure the GPU is done with the last upload from this buffer.
+			if (surf->pboFences[pbo])
+			{
+				id_glClientWaitSync(surf->pboFences[pbo], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+				id_glDeleteSync(surf->pboFences[pbo]);
+				surf->pboFences[pbo] = 0;
+			}
+			mapping = surf->pboMappings[pbo];
+			VL_SDL2GL_ForEachDirtyRect(surf, VL_SDL2GL_CopyRectToPBO, (uintptr_t)mapping);
+		}
+		else
+		{
+			// Orphan the old storage, so we never wait for a pending upload.
+			id_glBufferData(GL_PIXEL_UNPACK_BUFFER, surf->w * surf->h, 0, GL_STREAM_DRAW);
+			mapping = (uint8_t *)id_glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+			if (mapping)
+			{
+				VL_SDL2GL_ForEachDirtyRect(surf, VL_SDL2GL_CopyRectToPBO, (uintptr_t)mapping);
+				if (!id_glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+					mapping = 0;
+			}
+		}
+
+		if (!mapping)
+			id_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	id_glPixelStorei(GL_UNPACK_ROW_LENGTH, surf->w);
+	VL_SDL2GL_ForEachDirtyRect(surf, VL_SDL2GL_UploadRect, mapping ? 0 : (uintptr_t)surf->data);
+	id_glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	if (mapping)
+	{
+		if (vl_sdl2gl_persistentPBOs)
+			surf->pboFences[pbo] = id_glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		id_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	memset(surf->dirtyBlocks[surf->activePage], 0, surf->dirtyW * surf->dirtyH);
 }
 
 static void VL_SDL2GL_Present(void *surface, int scrlX, int scrlY, bool singleBuffered)
 {
+	uint64_t presentStart = CK_Cross_GetMicroseconds();
 	int realWinW, realWinH;
 	// Get the real window size
 	SDL_GL_GetDrawableSize(vl_sdl2gl_window, &realWinW, &realWinH);
@@ -621,8 +1016,18 @@ static void VL_SDL2GL_Present(void *surface, int scrlX, int scrlY, bool singleBu
 	id_glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	id_glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	id_glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	id_glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, surf->w, surf->h, GL_RED, GL_UNSIGNED_BYTE, surf->data);
+	uint64_t uploadStart = CK_Cross_GetMicroseconds();
+	if (surf->use == VL_SurfaceUsage_FrontBuffer)
+	{
+		VL_SDL2GL_UploadDirtyBlocks(surf);
+		scrlX += surf->originX;
+		scrlY += surf->originY;
+	}
+	else
+		id_glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, surf->w, surf->h, GL_RED, GL_UNSIGNED_BYTE, surf->data);
+	vl_sdl2gl_statUploadTime += CK_Cross_GetMicroseconds() - uploadStart;
 
+	// Texture coordinates past the edge of the texture wrap around (GL_REPEAT).
 	float scaleX = (float)vl_sdl2gl_screenWidth / ((float)surf->w);
 	float scaleY = (float)vl_sdl2gl_screenHeight / ((float)surf->h);
 	float offX = (float)(scrlX) / (float)(surf->w);
@@ -671,9 +1076,37 @@ static void VL_SDL2GL_Present(void *surface, int scrlX, int scrlY, bool singleBu
 
 	if (!singleBuffered && surf->use == VL_SurfaceUsage_FrontBuffer)
 		VL_SDL2GL_SetSurfacePage(surf, (surf->activePage + 1) % VL_SDL2GL_NUM_BUFFERS);
+
+	// The swap itself is left out, as it mostly measures waiting for vsync.
+	vl_sdl2gl_statPresentTime += CK_Cross_GetMicroseconds() - presentStart;
+	if (!vl_sdl2gl_statFrames++)
+		vl_sdl2gl_statFirstPresent = presentStart;
+	vl_sdl2gl_statLastPresent = presentStart;
+
 	SDL_GL_SwapWindow(vl_sdl2gl_window);
 }
 
+static void VL_SDL2GL_ChunkyToSurface(const uint8_t *src, void *dst_surface, int x, int y, int w, int h)
+{
+	VL_SDL2GL_Surface *surf = (VL_SDL2GL_Surface *)dst_surface;
+	VL_ChunkyToPAL8(src, surf->data, x, y, surf->w, w, h);
+	VL_SDL2GL_MarkDirty(surf, x, y, w, h);
+}
+
+static void VL_SDL2GL_ChunkyMaskedBlitToSurface(const uint8_t *src, const uint8_t *mask, void *dst_surface, int x, int y, int w, int h)
+{
+	VL_SDL2GL_Surface *surf = (VL_SDL2GL_Surface *)dst_surface;
+	VL_ChunkyMaskedBlitClipToPAL8(src, mask, surf->data, x, y, surf->w, w, h, surf->w, surf->h);
+	VL_SDL2GL_MarkDirty(surf, x, y, w, h);
+}
+
+static void VL_SDL2GL_SpanSpriteToSurface(const VL_SpanSprite *spr, void *dst_surface, int x, int y, int colour)
+{
+	VL_SDL2GL_Surface *surf = (VL_SDL2GL_Surface *)dst_surface;
+	VL_SpanSpriteClipToPAL8(spr, surf->data, x, y, surf->w, surf->w, surf->h, colour);
+	VL_SDL2GL_MarkDirty(surf, x, y, spr->w, spr->h);
+}
+
 static int VL_SDL2GL_GetActiveBufferId(void *surface)
 {
 	VL_SDL2GL_Surface *srf = (VL_SDL2GL_Surface*)surface;
@@ -712,6 +1145,7 @@ static void VL_SDL2GL_SyncBuffers(void *surface)
 		if (page == prevPage)
 			continue;
 		memcpy(srf->dataPages[page], srf->dataPages[prevPage], srf->w * srf->h);
+		VL_SDL2GL_MarkPageDirty(srf, page, 0, 0, srf->w, srf->h);
 	}
 }
 
@@ -726,6 +1160,7 @@ static void VL_SDL2GL_UpdateRect(void *surface, int x, int y, int w, int h)
 		{
 			memcpy(((uint8_t *)surf->dataPages[page]) + (_y) * surf->w + x, ((uint8_t *)surf->data) + _y * surf->w + x, w);
 		}
+		VL_SDL2GL_MarkPageDirty(surf, page, x, y, w, h);
 	}
 }
 
@@ -759,7 +1194,10 @@ VL_Backend vl_sdl2gl_backend =
 		/*.syncBuffers =*/&VL_SDL2GL_SyncBuffers,
 		/*.updateRect =*/&VL_SDL2GL_UpdateRect,
 		/*.flushParams =*/&VL_SDL2GL_FlushParams,
-		/*.waitVBLs =*/&VL_SDL2GL_WaitVBLs};
+		/*.waitVBLs =*/&VL_SDL2GL_WaitVBLs,
+		/*.chunkyToSurface =*/&VL_SDL2GL_ChunkyToSurface,
+		/*.chunkyMaskedBlitToSurface =*/&VL_SDL2GL_ChunkyMaskedBlitToSurface,
+		/*.spanSpriteToSurface =*/&VL_SDL2GL_SpanSpriteToSurface};
 
 VL_Backend *VL_Impl_GetBackend()
 {
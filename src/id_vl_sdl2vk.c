@@ -33,6 +33,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <SDL2/SDL_syswm.h>
 #include <SDL2/SDL_vulkan.h>
 #include <stdlib.h>
+#include "id_cfg.h"
 #include "id_mm.h"
 #include "id_us.h"
 #include "id_vl.h"
@@ -42,6 +43,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define VK_USE_PLATFORM_XCB_KHR
 #include <vulkan/vulkan.h>
 
+// The maximum number of frames which can be queued up on the GPU at once.
+#define VL_SDL2VK_MAX_FRAMES_IN_FLIGHT 3
+
 PFN_vkGetDeviceProcAddr id_vkGetDeviceProcAddr;
 PFN_vkGetPhysicalDeviceSurfaceSupportKHR id_vkGetPhysicalDeviceSurfaceSupportKHR;
 PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR id_vkGetPhysicalDeviceSurfaceCapabilitiesKHR;
@@ -83,12 +87,6 @@ static SDL_Window *vl_sdl2vk_window;
 static int vl_sdl2vk_framebufferWidth, vl_sdl2vk_framebufferHeight;
 static int vl_sdl2vk_screenWidth;
 static int vl_sdl2vk_screenHeight;
-static struct
-{
-	int left, right, top, bottom;
-} vl_sdl2vk_scaledBorders;
-static int vl_sdl2vk_screenHorizScaleFactor;
-static int vl_sdl2vk_screenVertScaleFactor;
 
 static ID_MM_Arena *vl_sdl2vk_arena;
 static ID_MM_Arena *vl_sdl2vk_tempArena;
@@ -109,6 +107,9 @@ static uint32_t vl_sdl2vk_numSwapchainImages;
 static VkImage *vl_sdl2vk_swapchainImages;
 static VkImageView *vl_sdl2vk_swapchainImageViews;
 static VkExtent2D vl_sdl2vk_swapchainSize;
+// The drawable size the swapchain was created for, which can differ from its
+// actual size (see VL_SDL2VK_SetupSwapchain()).
+static int vl_sdl2vk_swapchainDrawableWidth, vl_sdl2vk_swapchainDrawableHeight;
 static VkFormat vl_sdl2vk_swapchainFormat;
 static VkImage vl_sdl2vk_integerImage;
 static VkImageView vl_sdl2vk_integerImageView;
@@ -120,18 +121,34 @@ static VkPipelineLayout vl_sdl2vk_pipelineLayout;
 static VkRenderPass vl_sdl2vk_renderPass;
 static VkPipeline vl_sdl2vk_pipeline;
 static VkFramebuffer *vl_sdl2vk_framebuffers;
-static VkSemaphore vl_sdl2vk_imageAvailableSemaphore;
-static VkSemaphore vl_sdl2vk_frameCompleteSemaphore;
 static VkCommandPool vl_sdl2vk_commandPool;
-static VkCommandBuffer *vl_sdl2vk_commandBuffers;
-static VkBuffer vl_sdl2vk_uniformBuffer;
-static VkDeviceMemory vl_sdl2vk_uniformBufferMemory;
 static VkDescriptorSetLayout vl_sdl2vk_ubDescriptorSetLayout;
 static VkDescriptorPool vl_sdl2vk_ubDescriptorPool;
-static VkDescriptorSet vl_sdl2vk_ubDescriptorSet;
 static VkDescriptorSetLayout vl_sdl2vk_samplerDescriptorSetLayout;
-static VkDescriptorPool vl_sdl2vk_samplerDescriptorPool;
-static VkDescriptorSet vl_sdl2vk_samplerDescriptorSet;
+
+// Everything a frame needs while it is in flight. The fence is signalled once
+// the GPU has finished with the frame, and its resources can be reused.
+typedef struct VL_SDL2VK_Frame
+{
+	VkFence fence;
+	VkSemaphore imageAvailableSemaphore;
+	VkSemaphore frameCompleteSemaphore;
+	VkCommandBuffer commandBuffer;
+	VkBuffer uniformBuffer;
+	VkDeviceMemory uniformBufferMemory;
+	float *uniformData;
+	VkDescriptorSet ubDescriptorSet;
+	VkDescriptorSet samplerDescriptorSet;
+} VL_SDL2VK_Frame;
+
+static VL_SDL2VK_Frame vl_sdl2vk_frames[VL_SDL2VK_MAX_FRAMES_IN_FLIGHT];
+static int vl_sdl2vk_numFramesInFlight;
+static int vl_sdl2vk_currentFrame;
+
+// CPU time counters, reported on shutdown.
+static long vl_sdl2vk_statFrames;
+static uint64_t vl_sdl2vk_statPresentTime;
+static uint64_t vl_sdl2vk_statFenceWaitTime;
 
 static int vl_sdl2vk_integerWidth;
 static int vl_sdl2vk_integerHeight;
@@ -353,7 +370,7 @@ static void VL_SDL2VK_InitPhysicalDevice()
 	vl_sdl2vk_graphicsQueueIndex = -1;
 	vl_sdl2vk_presentQueueIndex = -1;
 
-	for (int i = 0; i < queueFamilyCount; ++i)
+	for (uint32_t i = 0; i < queueFamilyCount; ++i)
 	{
 		VkBool32 hasPresentSupport = false;
 		id_vkGetPhysicalDeviceSurfaceSupportKHR(vl_sdl2vk_physicalDevice, i, vl_sdl2vk_windowSurface, &hasPresentSupport);
@@ -409,7 +426,10 @@ static void VL_SDL2VK_InitPhysicalDevice()
 	vkGetDeviceQueue(vl_sdl2vk_device, vl_sdl2vk_presentQueueIndex, 0, &vl_sdl2vk_presentQueue);
 }
 
-static void VL_SDL2VK_SetupSwapchain(int width, int height)
+// Creates a swapchain for the window surface. Returns false, without
+// touching the current swapchain, if the surface has no area (e.g., the
+// window is minimised): there is nothing to present to until it's restored.
+static bool VL_SDL2VK_SetupSwapchain(int width, int height)
 {
 	VkResult result = VK_SUCCESS;
 	VkSurfaceCapabilitiesKHR surfaceCapabilities;
@@ -425,7 +445,7 @@ static void VL_SDL2VK_SetupSwapchain(int width, int height)
 	if (result != VK_SUCCESS)
 		Quit("Couldn't enumerate physical device surface formats.");
 
-	VkSurfaceFormatKHR *surfaceFormats = (VkSurfaceFormatKHR *)MM_ArenaAlloc(vl_sdl2vk_tempArena, sizeof(VkSurfaceFormatKHR) & surfaceFormatCount);
+	VkSurfaceFormatKHR *surfaceFormats = (VkSurfaceFormatKHR *)MM_ArenaAlloc(vl_sdl2vk_tempArena, sizeof(VkSurfaceFormatKHR) * surfaceFormatCount);
 	result = id_vkGetPhysicalDeviceSurfaceFormatsKHR(vl_sdl2vk_physicalDevice, vl_sdl2vk_windowSurface, &surfaceFormatCount, surfaceFormats);
 	if (result != VK_SUCCESS)
 		Quit("Couldn't enumerate physical device surface formats.");
@@ -433,7 +453,7 @@ static void VL_SDL2VK_SetupSwapchain(int width, int height)
 	vl_sdl2vk_swapchainSize = surfaceCapabilities.currentExtent;
 
 	// On Wayland, the currentExtent is never set, so take it from the given w/h
-	if ((vl_sdl2vk_swapchainSize.width == -1 || vl_sdl2vk_swapchainSize.height == -1))
+	if (vl_sdl2vk_swapchainSize.width == UINT32_MAX || vl_sdl2vk_swapchainSize.height == UINT32_MAX)
 	{
 		vl_sdl2vk_swapchainSize.width = width;
 		vl_sdl2vk_swapchainSize.height = height;
@@ -443,15 +463,8 @@ static void VL_SDL2VK_SetupSwapchain(int width, int height)
 	vl_sdl2vk_swapchainSize.width = CK_Cross_min(CK_Cross_max(vl_sdl2vk_swapchainSize.width, surfaceCapabilities.minImageExtent.width), surfaceCapabilities.maxImageExtent.width);
 	vl_sdl2vk_swapchainSize.height = CK_Cross_min(CK_Cross_max(vl_sdl2vk_swapchainSize.height, surfaceCapabilities.minImageExtent.height), surfaceCapabilities.maxImageExtent.height);
 
-	// We calculate the render regions here, as on X11,
-	// SDL_Vulkan_GetDrawableSize() is not always valid, so we can end up
-	// trying to blit to a fullRgn that exceeds the surface size.
-	// See, for example: https://bugzilla.libsdl.org/show_bug.cgi?id=4671
-	// By using the actual swapchain size here, it should always be correct
-	VL_CalculateRenderRegions(vl_sdl2vk_swapchainSize.width, vl_sdl2vk_swapchainSize.height);
-
-	int desiredFormat = 0;
-	for (int i = 0; i < surfaceFormatCount; ++i)
+	uint32_t desiredFormat = 0;
+	for (uint32_t i = 0; i < surfaceFormatCount; ++i)
 	{
 		if (surfaceFormats[i].colorSpace != VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
 			continue;
@@ -461,6 +474,18 @@ static void VL_SDL2VK_SetupSwapchain(int width, int height)
 
 	vl_sdl2vk_swapchainFormat = surfaceFormats[desiredFormat].format;
 
+	if (!vl_sdl2vk_swapchainSize.width || !vl_sdl2vk_swapchainSize.height)
+		return false;
+
+	// We calculate the render regions here, as on X11,
+	// SDL_Vulkan_GetDrawableSize() is not always valid, so we can end up
+	// trying to blit to a fullRgn that exceeds the surface size.
+	// See, for example: https://bugzilla.libsdl.org/show_bug.cgi?id=4671
+	// By using the actual swapchain size here, it should always be correct
+	VL_CalculateRenderRegions(vl_sdl2vk_swapchainSize.width, vl_sdl2vk_swapchainSize.height);
+	vl_sdl2vk_swapchainDrawableWidth = width;
+	vl_sdl2vk_swapchainDrawableHeight = height;
+
 	VkSwapchainCreateInfoKHR swapchainCreateInfo = {};
 	swapchainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
 	swapchainCreateInfo.pNext = 0;
@@ -515,13 +540,14 @@ static void VL_SDL2VK_SetupSwapchain(int width, int height)
 	imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
 	imageViewCreateInfo.flags = 0;
 
-	for (int i = 0; i < vl_sdl2vk_numSwapchainImages; ++i)
+	for (uint32_t i = 0; i < vl_sdl2vk_numSwapchainImages; ++i)
 	{
 		imageViewCreateInfo.image = vl_sdl2vk_swapchainImages[i];
 		result = vkCreateImageView(vl_sdl2vk_device, &imageViewCreateInfo, 0, &vl_sdl2vk_swapchainImageViews[i]);
 		if (result != VK_SUCCESS)
 			Quit("Couldn't create swapchain image view.");
 	}
+	return true;
 }
 
 static void VL_SDL2VK_CreateRenderPass()
@@ -779,7 +805,7 @@ static void VL_SDL2VK_CreateFramebuffers(int integerScaleX, int integerScaleY)
 	// We do this here, rather than in SetupSwapchain(), because we always have the command pool initialized by
 	// this point.
 	VkCommandBuffer layoutChange = VL_SDL2VK_StartCommandBuffer(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-	for (int i = 0; i < vl_sdl2vk_numSwapchainImages; ++i)
+	for (uint32_t i = 0; i < vl_sdl2vk_numSwapchainImages; ++i)
 	{
 		VL_SDL2VK_ImageLayoutBarrier(layoutChange, vl_sdl2vk_swapchainImages[i], vl_sdl2vk_swapchainFormat,
 			VK_IMAGE_LAYOUT_UNDEFINED, 0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
@@ -799,7 +825,7 @@ static void VL_SDL2VK_CreateFramebuffers(int integerScaleX, int integerScaleY)
 
 	vl_sdl2vk_framebuffers = (VkFramebuffer *)MM_ArenaAlloc(vl_sdl2vk_arena, vl_sdl2vk_numSwapchainImages * sizeof(VkFramebuffer));
 
-	for (int i = 0; i < vl_sdl2vk_numSwapchainImages; ++i)
+	for (uint32_t i = 0; i < vl_sdl2vk_numSwapchainImages; ++i)
 	{
 		VkImageView fbAttachments[] = {vl_sdl2vk_swapchainImageViews[i]};
 
@@ -817,17 +843,6 @@ static void VL_SDL2VK_CreateFramebuffers(int integerScaleX, int integerScaleY)
 			Quit("Couldn't create framebuffer.");
 	}
 
-	VkSemaphoreCreateInfo semaphoreInfo = {};
-	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-
-	result = vkCreateSemaphore(vl_sdl2vk_device, &semaphoreInfo, 0, &vl_sdl2vk_imageAvailableSemaphore);
-	if (result != VK_SUCCESS)
-		Quit("Couldn't create semaphore");
-
-	result = vkCreateSemaphore(vl_sdl2vk_device, &semaphoreInfo, 0, &vl_sdl2vk_frameCompleteSemaphore);
-	if (result != VK_SUCCESS)
-		Quit("Couldn't create semaphore");
-
 	// Now create a framebuffer with the integer scaled size.
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -894,45 +909,57 @@ static void VL_SDL2VK_CreateFramebuffers(int integerScaleX, int integerScaleY)
 	vl_sdl2vk_integerHeight = integerScaleY;
 }
 
-static void VL_SDL2VK_CreateUniformBuffer()
+static void VL_SDL2VK_CreateUniformBuffers()
 {
 	VkResult result = VK_SUCCESS;
 
-	VkBufferCreateInfo createInfo = {};
-	createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	createInfo.size = sizeof(float) * 4 * 17;
-	createInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-	createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	// Each frame in flight has its own uniform buffer (which stays mapped)
+	// and descriptor sets, so they can be updated while older frames are
+	// still being rendered.
+	for (int frame = 0; frame < vl_sdl2vk_numFramesInFlight; ++frame)
+	{
+		VL_SDL2VK_Frame *f = &vl_sdl2vk_frames[frame];
 
-	result = vkCreateBuffer(vl_sdl2vk_device, &createInfo, 0, &vl_sdl2vk_uniformBuffer);
-	if (result != VK_SUCCESS)
-		Quit("Couldn't create uniform buffer.");
+		VkBufferCreateInfo createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		createInfo.size = sizeof(float) * 4 * 17;
+		createInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+		createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	VkMemoryRequirements memoryRequirements = {};
-	vkGetBufferMemoryRequirements(vl_sdl2vk_device, vl_sdl2vk_uniformBuffer, &memoryRequirements);
+		result = vkCreateBuffer(vl_sdl2vk_device, &createInfo, 0, &f->uniformBuffer);
+		if (result != VK_SUCCESS)
+			Quit("Couldn't create uniform buffer.");
 
-	const VkMemoryPropertyFlags desiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-	uint32_t memTypeIndex = VL_SDL2VK_SelectMemoryType(memoryRequirements.memoryTypeBits, desiredFlags);
-	if (memTypeIndex == UINT32_MAX)
-		Quit("No suitable uniform buffer memory types.");
+		VkMemoryRequirements memoryRequirements = {};
+		vkGetBufferMemoryRequirements(vl_sdl2vk_device, f->uniformBuffer, &memoryRequirements);
 
-	VkMemoryAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocateInfo.allocationSize = memoryRequirements.size;
-	allocateInfo.memoryTypeIndex = memTypeIndex;
+		const VkMemoryPropertyFlags desiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		uint32_t memTypeIndex = VL_SDL2VK_SelectMemoryType(memoryRequirements.memoryTypeBits, desiredFlags);
+		if (memTypeIndex == UINT32_MAX)
+			Quit("No suitable uniform buffer memory types.");
 
-	result = vkAllocateMemory(vl_sdl2vk_device, &allocateInfo, 0, &vl_sdl2vk_uniformBufferMemory);
-	if (result != VK_SUCCESS)
-		Quit("Failed to allocate device memory for uniform buffer.");
+		VkMemoryAllocateInfo allocateInfo = {};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocateInfo.allocationSize = memoryRequirements.size;
+		allocateInfo.memoryTypeIndex = memTypeIndex;
 
-	vkBindBufferMemory(vl_sdl2vk_device, vl_sdl2vk_uniformBuffer, vl_sdl2vk_uniformBufferMemory, 0);
+		result = vkAllocateMemory(vl_sdl2vk_device, &allocateInfo, 0, &f->uniformBufferMemory);
+		if (result != VK_SUCCESS)
+			Quit("Failed to allocate device memory for uniform buffer.");
+
+		vkBindBufferMemory(vl_sdl2vk_device, f->uniformBuffer, f->uniformBufferMemory, 0);
+
+		result = vkMapMemory(vl_sdl2vk_device, f->uniformBufferMemory, 0, sizeof(float) * 4 * 17, 0, (void **)&f->uniformData);
+		if (result != VK_SUCCESS)
+			Quit("Couldn't map uniform buffer.");
+	}
 
 	VkDescriptorPoolSize ubDescriptorPoolSize = {};
 	ubDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	ubDescriptorPoolSize.descriptorCount = 1;
+	ubDescriptorPoolSize.descriptorCount = vl_sdl2vk_numFramesInFlight;
 	VkDescriptorPoolSize samplerDescriptorPoolSize = {};
 	samplerDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerDescriptorPoolSize.descriptorCount = 1;
+	samplerDescriptorPoolSize.descriptorCount = vl_sdl2vk_numFramesInFlight;
 
 	VkDescriptorPoolSize sizes[2] = {ubDescriptorPoolSize, samplerDescriptorPoolSize};
 
@@ -940,47 +967,52 @@ static void VL_SDL2VK_CreateUniformBuffer()
 	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	descriptorPoolInfo.poolSizeCount = 2;
 	descriptorPoolInfo.pPoolSizes = sizes;
-	descriptorPoolInfo.maxSets = 2;
+	descriptorPoolInfo.maxSets = 2 * vl_sdl2vk_numFramesInFlight;
 
 	result = vkCreateDescriptorPool(vl_sdl2vk_device, &descriptorPoolInfo, 0, &vl_sdl2vk_ubDescriptorPool);
 	if (result != VK_SUCCESS)
 		Quit("Couldn't create uniform buffer descriptor pool.");
 
-	VkDescriptorSetAllocateInfo ubDescriptorSetAllocInfo = {};
-	ubDescriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	ubDescriptorSetAllocInfo.descriptorPool = vl_sdl2vk_ubDescriptorPool;
-	ubDescriptorSetAllocInfo.descriptorSetCount = 1;
-	ubDescriptorSetAllocInfo.pSetLayouts = &vl_sdl2vk_ubDescriptorSetLayout;
+	for (int frame = 0; frame < vl_sdl2vk_numFramesInFlight; ++frame)
+	{
+		VL_SDL2VK_Frame *f = &vl_sdl2vk_frames[frame];
 
-	VkDescriptorSetAllocateInfo samplerDescriptorSetAllocInfo = {};
-	samplerDescriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	samplerDescriptorSetAllocInfo.descriptorPool = vl_sdl2vk_ubDescriptorPool;
-	samplerDescriptorSetAllocInfo.descriptorSetCount = 1;
-	samplerDescriptorSetAllocInfo.pSetLayouts = &vl_sdl2vk_samplerDescriptorSetLayout;
+		VkDescriptorSetAllocateInfo ubDescriptorSetAllocInfo = {};
+		ubDescriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		ubDescriptorSetAllocInfo.descriptorPool = vl_sdl2vk_ubDescriptorPool;
+		ubDescriptorSetAllocInfo.descriptorSetCount = 1;
+		ubDescriptorSetAllocInfo.pSetLayouts = &vl_sdl2vk_ubDescriptorSetLayout;
 
-	result = vkAllocateDescriptorSets(vl_sdl2vk_device, &ubDescriptorSetAllocInfo, &vl_sdl2vk_ubDescriptorSet);
-	if (result != VK_SUCCESS)
-		Quit("Couldn't allocate uniform buffer descriptor sets.");
+		VkDescriptorSetAllocateInfo samplerDescriptorSetAllocInfo = {};
+		samplerDescriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		samplerDescriptorSetAllocInfo.descriptorPool = vl_sdl2vk_ubDescriptorPool;
+		samplerDescriptorSetAllocInfo.descriptorSetCount = 1;
+		samplerDescriptorSetAllocInfo.pSetLayouts = &vl_sdl2vk_samplerDescriptorSetLayout;
 
-	result = vkAllocateDescriptorSets(vl_sdl2vk_device, &samplerDescriptorSetAllocInfo, &vl_sdl2vk_samplerDescriptorSet);
-	if (result != VK_SUCCESS)
-		Quit("Couldn't allocate sampler descriptor sets.");
-
-	VkDescriptorBufferInfo ubDescriptorBufferInfo = {};
-	ubDescriptorBufferInfo.buffer = vl_sdl2vk_uniformBuffer;
-	ubDescriptorBufferInfo.offset = 0;
-	ubDescriptorBufferInfo.range = 4 * 17 * sizeof(float);
-
-	VkWriteDescriptorSet ubWriteDescriptorSet = {};
-	ubWriteDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	ubWriteDescriptorSet.dstSet = vl_sdl2vk_ubDescriptorSet;
-	ubWriteDescriptorSet.dstBinding = 0;
-	ubWriteDescriptorSet.dstArrayElement = 0;
-	ubWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	ubWriteDescriptorSet.descriptorCount = 1;
-	ubWriteDescriptorSet.pBufferInfo = &ubDescriptorBufferInfo;
-
-	vkUpdateDescriptorSets(vl_sdl2vk_device, 1, &ubWriteDescriptorSet, 0, 0);
+		result = vkAllocateDescriptorSets(vl_sdl2vk_device, &ubDescriptorSetAllocInfo, &f->ubDescriptorSet);
+		if (result != VK_SUCCESS)
+			Quit("Couldn't allocate uniform buffer descriptor sets.");
+
+		result = vkAllocateDescriptorSets(vl_sdl2vk_device, &samplerDescriptorSetAllocInfo, &f->samplerDescriptorSet);
+		if (result != VK_SUCCESS)
+			Quit("Couldn't allocate sampler descriptor sets.");
+
+		VkDescriptorBufferInfo ubDescriptorBufferInfo = {};
+		ubDescriptorBufferInfo.buffer = f->uniformBuffer;
+		ubDescriptorBufferInfo.offset = 0;
+		ubDescriptorBufferInfo.range = 4 * 17 * sizeof(float);
+
+		VkWriteDescriptorSet ubWriteDescriptorSet = {};
+		ubWriteDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		ubWriteDescriptorSet.dstSet = f->ubDescriptorSet;
+		ubWriteDescriptorSet.dstBinding = 0;
+		ubWriteDescriptorSet.dstArrayElement = 0;
+		ubWriteDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		ubWriteDescriptorSet.descriptorCount = 1;
+		ubWriteDescriptorSet.pBufferInfo = &ubDescriptorBufferInfo;
+
+		vkUpdateDescriptorSets(vl_sdl2vk_device, 1, &ubWriteDescriptorSet, 0, 0);
+	}
 }
 
 static void VL_SDL2VK_CreateCommandBuffers()
@@ -996,29 +1028,57 @@ static void VL_SDL2VK_CreateCommandBuffers()
 	if (result != VK_SUCCESS)
 		Quit("Couldn't create command pool.");
 
-	vl_sdl2vk_commandBuffers = (VkCommandBuffer *)MM_ArenaAlloc(vl_sdl2vk_arena, vl_sdl2vk_numSwapchainImages * sizeof(VkCommandBuffer));
-
+	// Each frame in flight gets a command buffer, which is re-recorded once
+	// the frame's fence says the GPU is done with it, and its own
+	// synchronisation objects.
 	VkCommandBufferAllocateInfo cmdbufAllocInfo = {};
 	cmdbufAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	cmdbufAllocInfo.commandPool = vl_sdl2vk_commandPool;
 	cmdbufAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	cmdbufAllocInfo.commandBufferCount = vl_sdl2vk_numSwapchainImages;
+	cmdbufAllocInfo.commandBufferCount = 1;
 
-	result = vkAllocateCommandBuffers(vl_sdl2vk_device, &cmdbufAllocInfo, vl_sdl2vk_commandBuffers);
-	if (result != VK_SUCCESS)
-		Quit("Couldn't allocate command buffers.");
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	// Fences start signalled, as no frame is using the resources yet.
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (int frame = 0; frame < vl_sdl2vk_numFramesInFlight; ++frame)
+	{
+		VL_SDL2VK_Frame *f = &vl_sdl2vk_frames[frame];
+
+		result = vkAllocateCommandBuffers(vl_sdl2vk_device, &cmdbufAllocInfo, &f->commandBuffer);
+		if (result != VK_SUCCESS)
+			Quit("Couldn't allocate command buffers.");
+
+		result = vkCreateSemaphore(vl_sdl2vk_device, &semaphoreInfo, 0, &f->imageAvailableSemaphore);
+		if (result != VK_SUCCESS)
+			Quit("Couldn't create semaphore");
+
+		result = vkCreateSemaphore(vl_sdl2vk_device, &semaphoreInfo, 0, &f->frameCompleteSemaphore);
+		if (result != VK_SUCCESS)
+			Quit("Couldn't create semaphore");
+
+		result = vkCreateFence(vl_sdl2vk_device, &fenceInfo, 0, &f->fence);
+		if (result != VK_SUCCESS)
+			Quit("Couldn't create fence");
+	}
+	vl_sdl2vk_currentFrame = 0;
 }
 
-static void VL_SDL2VK_PopulateCommandBuffer(int i, VkRect2D fullRgn, VkRect2D renderRgn, VkClearColorValue borderColour)
+static void VL_SDL2VK_PopulateCommandBuffer(int frame, uint32_t imageIndex, VkRect2D fullRgn, VkRect2D renderRgn, VkClearColorValue borderColour)
 {
 	VkResult result = VK_SUCCESS;
+	VkCommandBuffer cmdBuf = vl_sdl2vk_frames[frame].commandBuffer;
 
 	VkCommandBufferBeginInfo beginInfo = {};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 	beginInfo.pInheritanceInfo = 0;
 
-	result = vkBeginCommandBuffer(vl_sdl2vk_commandBuffers[i], &beginInfo);
+	result = vkBeginCommandBuffer(cmdBuf, &beginInfo);
 	if (result != VK_SUCCESS)
 		Quit("Couldn't begin command buffer");
 
@@ -1071,21 +1131,25 @@ static void VL_SDL2VK_PopulateCommandBuffer(int i, VkRect2D fullRgn, VkRect2D re
 	blitRegion.srcSubresource.layerCount = 1;
 	blitRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 
-	VL_SDL2VK_ImageLayoutBarrier(vl_sdl2vk_commandBuffers[i], vl_sdl2vk_swapchainImages[i], vl_sdl2vk_swapchainFormat,
+	VL_SDL2VK_ImageLayoutBarrier(cmdBuf, vl_sdl2vk_swapchainImages[imageIndex], vl_sdl2vk_swapchainFormat,
 		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_MEMORY_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
 		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
-	vkCmdBeginRenderPass(vl_sdl2vk_commandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// The previous frame may still be blitting from the integer-scaled image.
+	VL_SDL2VK_ImageLayoutBarrier(cmdBuf, vl_sdl2vk_integerImage, vl_sdl2vk_swapchainFormat,
+		VK_IMAGE_LAYOUT_UNDEFINED, 0, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	vkCmdBeginRenderPass(cmdBuf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-	vkCmdSetViewport(vl_sdl2vk_commandBuffers[i], 0, 1, &viewport);
-	vkCmdSetScissor(vl_sdl2vk_commandBuffers[i], 0, 1, &scissor);
-	vkCmdBindDescriptorSets(vl_sdl2vk_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, vl_sdl2vk_pipelineLayout, 0, 1, &vl_sdl2vk_ubDescriptorSet, 0, 0);
-	vkCmdBindDescriptorSets(vl_sdl2vk_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, vl_sdl2vk_pipelineLayout, 1, 1, &vl_sdl2vk_samplerDescriptorSet, 0, 0);
+	vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
+	vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
+	vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, vl_sdl2vk_pipelineLayout, 0, 1, &vl_sdl2vk_frames[frame].ubDescriptorSet, 0, 0);
+	vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, vl_sdl2vk_pipelineLayout, 1, 1, &vl_sdl2vk_frames[frame].samplerDescriptorSet, 0, 0);
 
-	vkCmdBindPipeline(vl_sdl2vk_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, vl_sdl2vk_pipeline);
+	vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, vl_sdl2vk_pipeline);
 
-	vkCmdDraw(vl_sdl2vk_commandBuffers[i], 4, 1, 0, 0);
+	vkCmdDraw(cmdBuf, 4, 1, 0, 0);
 
-	vkCmdEndRenderPass(vl_sdl2vk_commandBuffers[i]);
+	vkCmdEndRenderPass(cmdBuf);
 
 	VkImageSubresourceRange dstSubresourceRange = {};
 	dstSubresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -1094,45 +1158,70 @@ static void VL_SDL2VK_PopulateCommandBuffer(int i, VkRect2D fullRgn, VkRect2D re
 	dstSubresourceRange.baseArrayLayer = 0;
 	dstSubresourceRange.layerCount = 1;
 
-	vkCmdClearColorImage(vl_sdl2vk_commandBuffers[i], vl_sdl2vk_swapchainImages[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	vkCmdClearColorImage(cmdBuf, vl_sdl2vk_swapchainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 		&clearColour.color,
 		1, &dstSubresourceRange);
 
-	VL_SDL2VK_ImageLayoutBarrier(vl_sdl2vk_commandBuffers[i], vl_sdl2vk_integerImage, vl_sdl2vk_swapchainFormat,
+	VL_SDL2VK_ImageLayoutBarrier(cmdBuf, vl_sdl2vk_integerImage, vl_sdl2vk_swapchainFormat,
 		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
 		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
-	vkCmdBlitImage(vl_sdl2vk_commandBuffers[i],
+	vkCmdBlitImage(cmdBuf,
 		vl_sdl2vk_integerImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-		vl_sdl2vk_swapchainImages[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		vl_sdl2vk_swapchainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 		1, &blitRegion, VK_FILTER_LINEAR);
 
-	VL_SDL2VK_ImageLayoutBarrier(vl_sdl2vk_commandBuffers[i], vl_sdl2vk_swapchainImages[i], vl_sdl2vk_swapchainFormat,
+	VL_SDL2VK_ImageLayoutBarrier(cmdBuf, vl_sdl2vk_swapchainImages[imageIndex], vl_sdl2vk_swapchainFormat,
 		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
 		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_MEMORY_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
-	result = vkEndCommandBuffer(vl_sdl2vk_commandBuffers[i]);
+	result = vkEndCommandBuffer(cmdBuf);
 
 	if (result != VK_SUCCESS)
 		Quit("Couldn't record command buffer.");
 }
 
+// Destroys everything which depends on the swapchain size, but not the
+// swapchain itself, which is retired when the next one is created. This can
+// be called again before anything has been recreated (e.g., while the
+// window is minimised), so handles are cleared as they're destroyed.
 void VL_SDL2VK_DestroySwapchain()
 {
 	vkDeviceWaitIdle(vl_sdl2vk_device);
-	for (int i = 0; i < vl_sdl2vk_numSwapchainImages; ++i)
+	for (uint32_t i = 0; i < vl_sdl2vk_numSwapchainImages; ++i)
 	{
 		vkDestroyFramebuffer(vl_sdl2vk_device, vl_sdl2vk_framebuffers[i], 0);
 		vkDestroyImageView(vl_sdl2vk_device, vl_sdl2vk_swapchainImageViews[i], 0);
 	}
-	vkDestroySemaphore(vl_sdl2vk_device, vl_sdl2vk_imageAvailableSemaphore, 0);
-	vkDestroySemaphore(vl_sdl2vk_device, vl_sdl2vk_frameCompleteSemaphore, 0);
+	vl_sdl2vk_numSwapchainImages = 0;
 
 	vkDestroyFramebuffer(vl_sdl2vk_device, vl_sdl2vk_integerFramebuffer, 0);
 	vkDestroyImageView(vl_sdl2vk_device, vl_sdl2vk_integerImageView, 0);
 	vkDestroyImage(vl_sdl2vk_device, vl_sdl2vk_integerImage, 0);
 	vkFreeMemory(vl_sdl2vk_device, vl_sdl2vk_integerMemory, 0);
+	vl_sdl2vk_integerFramebuffer = VK_NULL_HANDLE;
+	vl_sdl2vk_integerImageView = VK_NULL_HANDLE;
+	vl_sdl2vk_integerImage = VK_NULL_HANDLE;
+	vl_sdl2vk_integerMemory = VK_NULL_HANDLE;
 
 	vkDestroyPipeline(vl_sdl2vk_device, vl_sdl2vk_pipeline, 0);
 	vkDestroyPipelineLayout(vl_sdl2vk_device, vl_sdl2vk_pipelineLayout, 0);
+	vl_sdl2vk_pipeline = VK_NULL_HANDLE;
+	vl_sdl2vk_pipelineLayout = VK_NULL_HANDLE;
+}
+
+// Rebuilds the swapchain and everything sized to it, e.g., after the window
+// has been resized. Returns false if there's currently nothing to present to.
+static bool VL_SDL2VK_RecreateSwapchain(int width, int height)
+{
+	VL_SDL2VK_DestroySwapchain();
+	if (!VL_SDL2VK_SetupSwapchain(width, height))
+	{
+		vl_sdl2vk_flushSwapchain = true;
+		return false;
+	}
+	VL_SDL2VK_CreateFramebuffers(vl_integerWidth, vl_integerHeight);
+	VL_SDL2VK_CreatePipeline();
+	vl_sdl2vk_flushSwapchain = false;
+	return true;
 }
 
 /* TODO (Overscan border):
@@ -1143,8 +1232,14 @@ void VL_SDL2VK_DestroySwapchain()
 typedef struct VL_SDL2VK_Surface
 {
 	VL_SurfaceUsage use;
-	VkImage stagingImage;
-	VkDeviceMemory stagingMemory;
+	// Front buffers only: the game draws into 'data', which is copied into
+	// the current frame's staging buffer on present. The copy from there to
+	// the image is recorded once per frame in flight.
+	VkBuffer stagingBuffers[VL_SDL2VK_MAX_FRAMES_IN_FLIGHT];
+	VkDeviceMemory stagingMemory[VL_SDL2VK_MAX_FRAMES_IN_FLIGHT];
+	void *stagingData[VL_SDL2VK_MAX_FRAMES_IN_FLIGHT];
+	VkCommandBuffer uploadCommandBuffers[VL_SDL2VK_MAX_FRAMES_IN_FLIGHT];
+	int numFrames;
 	VkImage image;
 	VkDeviceMemory memory;
 	VkImageView view;
@@ -1194,7 +1289,9 @@ static void VL_SDL2VK_SetVideoMode(int mode)
 		VL_SDL2VK_InitPhysicalDevice();
 		VL_SDL2VK_LoadVKDeviceProcs();
 
-		VL_SDL2VK_SetupSwapchain(VL_DEFAULT_WINDOW_WIDTH(scale), VL_DEFAULT_WINDOW_HEIGHT(scale));
+		// If the window starts out minimised, the swapchain is created on the
+		// first present after it's restored.
+		vl_sdl2vk_flushSwapchain = !VL_SDL2VK_SetupSwapchain(VL_DEFAULT_WINDOW_WIDTH(scale), VL_DEFAULT_WINDOW_HEIGHT(scale));
 
 		VL_SDL2VK_CreateRenderPass();
 
@@ -1202,10 +1299,16 @@ static void VL_SDL2VK_SetVideoMode(int mode)
 		VL_SDL2VK_CreateDescriptorSetLayouts();
 		VL_SDL2VK_CreatePipeline();
 
+		vl_sdl2vk_numFramesInFlight = CFG_GetConfigInt("vkFramesInFlight", 2);
+		vl_sdl2vk_numFramesInFlight = CK_Cross_max(1, CK_Cross_min(vl_sdl2vk_numFramesInFlight, VL_SDL2VK_MAX_FRAMES_IN_FLIGHT));
+		vl_sdl2vk_statFrames = 0;
+		vl_sdl2vk_statPresentTime = vl_sdl2vk_statFenceWaitTime = 0;
+
 		VL_SDL2VK_CreateCommandBuffers();
-		VL_SDL2VK_CreateFramebuffers(vl_integerWidth, vl_integerHeight);
+		if (!vl_sdl2vk_flushSwapchain)
+			VL_SDL2VK_CreateFramebuffers(vl_integerWidth, vl_integerHeight);
 
-		VL_SDL2VK_CreateUniformBuffer();
+		VL_SDL2VK_CreateUniformBuffers();
 
 		// Compile the shader we use to emulate EGA palettes.
 
@@ -1220,17 +1323,33 @@ static void VL_SDL2VK_SetVideoMode(int mode)
 	}
 	else
 	{
+		if (vl_sdl2vk_statFrames)
+		{
+			CK_Cross_LogMessage(CK_LOG_MSG_NORMAL, "VL: Presented %ld frames (%d in flight): %.2f us/frame on the CPU, of which %.2f us waiting for fences\n",
+				vl_sdl2vk_statFrames, vl_sdl2vk_numFramesInFlight,
+				(double)vl_sdl2vk_statPresentTime / vl_sdl2vk_statFrames,
+				(double)vl_sdl2vk_statFenceWaitTime / vl_sdl2vk_statFrames);
+		}
 		SDL_ShowCursor(1);
 		vkDeviceWaitIdle(vl_sdl2vk_device);
-		vkFreeCommandBuffers(vl_sdl2vk_device, vl_sdl2vk_commandPool, vl_sdl2vk_numSwapchainImages, vl_sdl2vk_commandBuffers);
+		for (int frame = 0; frame < vl_sdl2vk_numFramesInFlight; ++frame)
+		{
+			VL_SDL2VK_Frame *f = &vl_sdl2vk_frames[frame];
+			vkFreeCommandBuffers(vl_sdl2vk_device, vl_sdl2vk_commandPool, 1, &f->commandBuffer);
+			vkDestroySemaphore(vl_sdl2vk_device, f->imageAvailableSemaphore, 0);
+			vkDestroySemaphore(vl_sdl2vk_device, f->frameCompleteSemaphore, 0);
+			vkDestroyFence(vl_sdl2vk_device, f->fence, 0);
+			vkUnmapMemory(vl_sdl2vk_device, f->uniformBufferMemory);
+			vkFreeMemory(vl_sdl2vk_device, f->uniformBufferMemory, 0);
+			vkDestroyBuffer(vl_sdl2vk_device, f->uniformBuffer, 0);
+		}
 		vkDestroyDescriptorPool(vl_sdl2vk_device, vl_sdl2vk_ubDescriptorPool, 0);
 		vkDestroyDescriptorSetLayout(vl_sdl2vk_device, vl_sdl2vk_ubDescriptorSetLayout, 0);
 		vkDestroyDescriptorSetLayout(vl_sdl2vk_device, vl_sdl2vk_samplerDescriptorSetLayout, 0);
-		vkFreeMemory(vl_sdl2vk_device, vl_sdl2vk_uniformBufferMemory, 0);
-		vkDestroyBuffer(vl_sdl2vk_device, vl_sdl2vk_uniformBuffer, 0);
+		VL_SDL2VK_DestroySwapchain();
 		vkDestroyRenderPass(vl_sdl2vk_device, vl_sdl2vk_renderPass, 0);
 		id_vkDestroySwapchainKHR(vl_sdl2vk_device, vl_sdl2vk_swapchain, 0);
-		VL_SDL2VK_DestroySwapchain();
+		vl_sdl2vk_swapchain = VK_NULL_HANDLE;
 		vkDestroyShaderModule(vl_sdl2vk_device, vl_sdl2vk_vertShaderModule, 0);
 		vkDestroyShaderModule(vl_sdl2vk_device, vl_sdl2vk_fragShaderModule, 0);
 		vkDestroyCommandPool(vl_sdl2vk_device, vl_sdl2vk_commandPool, 0);
@@ -1253,51 +1372,43 @@ static void *VL_SDL2VK_CreateSurface(int w, int h, VL_SurfaceUsage usage)
 	if (usage == VL_SurfaceUsage_FrontBuffer)
 	{
 		VkResult result = VK_SUCCESS;
-		VkImageCreateInfo stagingImageInfo = {};
-		stagingImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		stagingImageInfo.imageType = VK_IMAGE_TYPE_2D;
-		stagingImageInfo.extent.width = w;
-		stagingImageInfo.extent.height = h;
-		stagingImageInfo.extent.depth = 1;
-		stagingImageInfo.mipLevels = 1;
-		stagingImageInfo.arrayLayers = 1;
-		stagingImageInfo.format = VK_FORMAT_R8_UINT;
-		stagingImageInfo.tiling = VK_IMAGE_TILING_LINEAR;
-		stagingImageInfo.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
-		stagingImageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-		stagingImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		stagingImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-
-		result = vkCreateImage(vl_sdl2vk_device, &stagingImageInfo, 0, &surf->stagingImage);
-		if (result != VK_SUCCESS)
-			Quit("Failed to create staging image for front buffer surface.");
-
-		VkMemoryRequirements stagingMemoryRequirements;
-		vkGetImageMemoryRequirements(vl_sdl2vk_device, surf->stagingImage, &stagingMemoryRequirements);
-
-		VkMemoryAllocateInfo stagingAllocInfo = {};
-		stagingAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		stagingAllocInfo.allocationSize = stagingMemoryRequirements.size;
-		stagingAllocInfo.memoryTypeIndex = VL_SDL2VK_SelectMemoryType(stagingMemoryRequirements.memoryTypeBits,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-		result = vkAllocateMemory(vl_sdl2vk_device, &stagingAllocInfo, 0, &surf->stagingMemory);
-		if (result != VK_SUCCESS)
-			Quit("Couldn't allocate memory for staging image.");
-
-		vkBindImageMemory(vl_sdl2vk_device, surf->stagingImage, surf->stagingMemory, 0);
-
-		VkImageSubresource stagingSubresource = {};
-		stagingSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		stagingSubresource.mipLevel = 0;
-		stagingSubresource.arrayLayer = 0;
-
-		VkSubresourceLayout stagingSubresourceLayout;
-		vkGetImageSubresourceLayout(vl_sdl2vk_device, surf->stagingImage, &stagingSubresource, &stagingSubresourceLayout);
-
-		surf->pitch = stagingSubresourceLayout.rowPitch;
+		surf->data = malloc(w * h); // 8-bit pal for now
+		surf->pitch = w;
+		if (!surf->data)
+			Quit("Couldn't allocate memory for front buffer surface.");
 
-		vkMapMemory(vl_sdl2vk_device, surf->stagingMemory, 0, stagingSubresourceLayout.size, 0, &surf->data);
+		surf->numFrames = vl_sdl2vk_numFramesInFlight;
+		for (int frame = 0; frame < surf->numFrames; ++frame)
+		{
+			VkBufferCreateInfo stagingBufferInfo = {};
+			stagingBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			stagingBufferInfo.size = w * h;
+			stagingBufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+			stagingBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+			result = vkCreateBuffer(vl_sdl2vk_device, &stagingBufferInfo, 0, &surf->stagingBuffers[frame]);
+			if (result != VK_SUCCESS)
+				Quit("Failed to create staging buffer for front buffer surface.");
+
+			VkMemoryRequirements stagingMemoryRequirements;
+			vkGetBufferMemoryRequirements(vl_sdl2vk_device, surf->stagingBuffers[frame], &stagingMemoryRequirements);
+
+			VkMemoryAllocateInfo stagingAllocInfo = {};
+			stagingAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			stagingAllocInfo.allocationSize = stagingMemoryRequirements.size;
+			stagingAllocInfo.memoryTypeIndex = VL_SDL2VK_SelectMemoryType(stagingMemoryRequirements.memoryTypeBits,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+			result = vkAllocateMemory(vl_sdl2vk_device, &stagingAllocInfo, 0, &surf->stagingMemory[frame]);
+			if (result != VK_SUCCESS)
+				Quit("Couldn't allocate memory for staging buffer.");
+
+			vkBindBufferMemory(vl_sdl2vk_device, surf->stagingBuffers[frame], surf->stagingMemory[frame], 0);
+
+			result = vkMapMemory(vl_sdl2vk_device, surf->stagingMemory[frame], 0, w * h, 0, &surf->stagingData[frame]);
+			if (result != VK_SUCCESS)
+				Quit("Couldn't map staging buffer.");
+		}
 
 		VkImageCreateInfo imageInfo = {};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1367,7 +1478,6 @@ static void *VL_SDL2VK_CreateSurface(int w, int h, VL_SurfaceUsage usage)
 			Quit("Couldn't create sampler for surface.");
 
 		VkCommandBuffer layoutChange = VL_SDL2VK_StartCommandBuffer(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-		VL_SDL2VK_ImageLayoutBarrier(layoutChange, surf->stagingImage, VK_FORMAT_R8_UINT, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_ACCESS_HOST_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
 		VL_SDL2VK_ImageLayoutBarrier(layoutChange, surf->image, VK_FORMAT_R8_UINT, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_ACCESS_HOST_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
 		vkEndCommandBuffer(layoutChange);
 
@@ -1380,6 +1490,36 @@ static void *VL_SDL2VK_CreateSurface(int w, int h, VL_SurfaceUsage usage)
 		vkQueueWaitIdle(vl_sdl2vk_graphicsQueue);
 
 		vkFreeCommandBuffers(vl_sdl2vk_device, vl_sdl2vk_commandPool, 1, &layoutChange);
+
+		// Record the staging buffer to image copies up front: they're the
+		// same every frame.
+		VkBufferImageCopy bufferImageCopy = {};
+		bufferImageCopy.bufferOffset = 0;
+		bufferImageCopy.bufferRowLength = w;
+		bufferImageCopy.bufferImageHeight = h;
+		bufferImageCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		bufferImageCopy.imageSubresource.mipLevel = 0;
+		bufferImageCopy.imageSubresource.baseArrayLayer = 0;
+		bufferImageCopy.imageSubresource.layerCount = 1;
+		bufferImageCopy.imageOffset.x = 0;
+		bufferImageCopy.imageOffset.y = 0;
+		bufferImageCopy.imageOffset.z = 0;
+		bufferImageCopy.imageExtent.width = w;
+		bufferImageCopy.imageExtent.height = h;
+		bufferImageCopy.imageExtent.depth = 1;
+
+		for (int frame = 0; frame < surf->numFrames; ++frame)
+		{
+			VkCommandBuffer cmdBuf = VL_SDL2VK_StartCommandBuffer((VkCommandBufferUsageFlagBits)0);
+			// Wait for any earlier frame to finish sampling the image before overwriting it.
+			VL_SDL2VK_ImageLayoutBarrier(cmdBuf, surf->image, VK_FORMAT_R8_UINT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+			vkCmdCopyBufferToImage(cmdBuf, surf->stagingBuffers[frame], surf->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferImageCopy);
+			VL_SDL2VK_ImageLayoutBarrier(cmdBuf, surf->image, VK_FORMAT_R8_UINT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
+			result = vkEndCommandBuffer(cmdBuf);
+			if (result != VK_SUCCESS)
+				Quit("Couldn't record upload command buffer.");
+			surf->uploadCommandBuffers[frame] = cmdBuf;
+		}
 	}
 	else
 	{
@@ -1389,46 +1529,12 @@ static void *VL_SDL2VK_CreateSurface(int w, int h, VL_SurfaceUsage usage)
 	return surf;
 }
 
-static void VL_SDL2VK_UploadSurface(void *surface)
+// Copies the surface into the staging buffer of the given frame. The GPU
+// copy itself is part of the frame's submission.
+static void VL_SDL2VK_UploadSurface(void *surface, int frame)
 {
 	VL_SDL2VK_Surface *surf = (VL_SDL2VK_Surface *)surface;
-
-	VkResult result = VK_SUCCESS;
-
-	VkCommandBuffer copyImageCmdBuf = VL_SDL2VK_StartCommandBuffer(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-
-	VL_SDL2VK_ImageLayoutBarrier(copyImageCmdBuf, surf->image, VK_FORMAT_R8_UINT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
-	// Copy
-	VkImageSubresourceLayers subresourceLayers = {};
-	subresourceLayers.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subresourceLayers.baseArrayLayer = 0;
-	subresourceLayers.mipLevel = 0;
-	subresourceLayers.layerCount = 1;
-
-	VkImageCopy imageCopy = {};
-	imageCopy.srcSubresource = subresourceLayers;
-	imageCopy.srcOffset = (VkOffset3D){0, 0, 0};
-	imageCopy.dstSubresource = subresourceLayers;
-	imageCopy.dstOffset = (VkOffset3D){0, 0, 0};
-	imageCopy.extent.width = surf->w;
-	imageCopy.extent.height = surf->h;
-	imageCopy.extent.depth = 1;
-
-	vkCmdCopyImage(copyImageCmdBuf, surf->stagingImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, surf->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopy);
-
-	VL_SDL2VK_ImageLayoutBarrier(copyImageCmdBuf, surf->image, VK_FORMAT_R8_UINT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
-
-	vkEndCommandBuffer(copyImageCmdBuf);
-
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &copyImageCmdBuf;
-
-	vkQueueSubmit(vl_sdl2vk_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(vl_sdl2vk_graphicsQueue);
-
-	vkFreeCommandBuffers(vl_sdl2vk_device, vl_sdl2vk_commandPool, 1, &copyImageCmdBuf);
+	memcpy(surf->stagingData[frame], surf->data, surf->w * surf->h);
 }
 
 static void VL_SDL2VK_DestroySurface(void *surface)
@@ -1436,10 +1542,17 @@ static void VL_SDL2VK_DestroySurface(void *surface)
 	VL_SDL2VK_Surface *surf = (VL_SDL2VK_Surface *)surface;
 	if (surf->use == VL_SurfaceUsage_FrontBuffer)
 	{
-		vkUnmapMemory(vl_sdl2vk_device, surf->stagingMemory);
-		vkFreeMemory(vl_sdl2vk_device, surf->stagingMemory, 0);
+		// Frames in flight may still be using the surface.
+		vkDeviceWaitIdle(vl_sdl2vk_device);
+		for (int frame = 0; frame < surf->numFrames; ++frame)
+		{
+			vkFreeCommandBuffers(vl_sdl2vk_device, vl_sdl2vk_commandPool, 1, &surf->uploadCommandBuffers[frame]);
+			vkUnmapMemory(vl_sdl2vk_device, surf->stagingMemory[frame]);
+			vkFreeMemory(vl_sdl2vk_device, surf->stagingMemory[frame], 0);
+			vkDestroyBuffer(vl_sdl2vk_device, surf->stagingBuffers[frame], 0);
+		}
+		free(surf->data);
 		vkDestroySampler(vl_sdl2vk_device, surf->sampler, 0);
-		vkDestroyImage(vl_sdl2vk_device, surf->stagingImage, 0);
 		vkDestroyImageView(vl_sdl2vk_device, surf->view, 0);
 		vkFreeMemory(vl_sdl2vk_device, surf->memory, 0);
 		vkDestroyImage(vl_sdl2vk_device, surf->image, 0);
@@ -1534,7 +1647,6 @@ static void VL_SDL2VK_SurfaceToSurface(void *src_surface, void *dst_surface, int
 static void VL_SDL2VK_SurfaceToSelf(void *surface, int x, int y, int sx, int sy, int sw, int sh)
 {
 	VL_SDL2VK_Surface *srf = (VL_SDL2VK_Surface *)surface;
-	bool directionX = sx > x;
 	bool directionY = sy > y;
 
 	if (directionY)
@@ -1607,10 +1719,9 @@ static void VL_SDL2VK_BitInvBlitToSurface(void *src, void *dst_surface, int x, i
 	VL_1bppInvBlitClipToPAL8(src, surf->data, x, y, surf->pitch, w, h, surf->w, surf->h, colour);
 }
 
-static void VL_SDL2VK_BindTexture(void *surface)
+static void VL_SDL2VK_BindTexture(void *surface, int frame)
 {
 	VL_SDL2VK_Surface *surf = (VL_SDL2VK_Surface *)surface;
-	VkResult result = VK_SUCCESS;
 
 	VkDescriptorImageInfo descriptorInfo = {};
 	descriptorInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -1619,7 +1730,7 @@ static void VL_SDL2VK_BindTexture(void *surface)
 
 	VkWriteDescriptorSet writeSet = {};
 	writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeSet.dstSet = vl_sdl2vk_samplerDescriptorSet;
+	writeSet.dstSet = vl_sdl2vk_frames[frame].samplerDescriptorSet;
 	writeSet.dstBinding = 1;
 	writeSet.dstArrayElement = 0;
 	writeSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -1661,35 +1772,52 @@ static void VL_SDL2VK_Present(void *surface, int scrlX, int scrlY, bool singleBu
 {
 	VkResult result = VK_SUCCESS;
 	uint32_t framebufferIndex;
+	uint64_t presentStart = CK_Cross_GetMicroseconds();
+	VL_SDL2VK_Frame *frame = &vl_sdl2vk_frames[vl_sdl2vk_currentFrame];
 
 	int newW, newH;
 	SDL_Vulkan_GetDrawableSize(vl_sdl2vk_window, &newW, &newH);
-	if (vl_sdl2vk_flushSwapchain || vl_sdl2vk_swapchainSize.width != newW || vl_sdl2vk_swapchainSize.height != newH)
+	// Skip the frame while the window is minimised. The game keeps drawing
+	// into the surface's client memory, which the next present uploads.
+	if (newW <= 0 || newH <= 0)
+		return;
+	if (vl_sdl2vk_flushSwapchain || vl_sdl2vk_swapchainDrawableWidth != newW || vl_sdl2vk_swapchainDrawableHeight != newH)
 	{
-		VL_SDL2VK_DestroySwapchain();
-		VL_SDL2VK_SetupSwapchain(newW, newH);
-		VL_SDL2VK_CreateFramebuffers(vl_integerWidth, vl_integerHeight);
-		VL_SDL2VK_CreatePipeline();
-		vl_sdl2vk_flushSwapchain = false;
+		if (!VL_SDL2VK_RecreateSwapchain(newW, newH))
+			return;
 	}
 
-	result = vkAcquireNextImageKHR(vl_sdl2vk_device, vl_sdl2vk_swapchain, UINT64_MAX, vl_sdl2vk_imageAvailableSemaphore, VK_NULL_HANDLE, &framebufferIndex);
+	// Wait until the GPU has finished the last frame which used this slot,
+	// so that its staging buffer, uniforms and command buffer can be reused.
+	uint64_t waitStart = CK_Cross_GetMicroseconds();
+	vkWaitForFences(vl_sdl2vk_device, 1, &frame->fence, VK_TRUE, UINT64_MAX);
+	vl_sdl2vk_statFenceWaitTime += CK_Cross_GetMicroseconds() - waitStart;
+
+	result = id_vkAcquireNextImageKHR(vl_sdl2vk_device, vl_sdl2vk_swapchain, UINT64_MAX, frame->imageAvailableSemaphore, VK_NULL_HANDLE, &framebufferIndex);
 	if (result == VK_ERROR_OUT_OF_DATE_KHR)
 	{
-		VL_SDL2VK_DestroySwapchain();
-		VL_SDL2VK_SetupSwapchain(newW, newH);
-		VL_SDL2VK_CreateFramebuffers(vl_integerWidth, vl_integerHeight);
-		VL_SDL2VK_CreatePipeline();
-		result = vkAcquireNextImageKHR(vl_sdl2vk_device, vl_sdl2vk_swapchain, UINT64_MAX, vl_sdl2vk_imageAvailableSemaphore, VK_NULL_HANDLE, &framebufferIndex);
+		if (!VL_SDL2VK_RecreateSwapchain(newW, newH))
+			return;
+		result = id_vkAcquireNextImageKHR(vl_sdl2vk_device, vl_sdl2vk_swapchain, UINT64_MAX, frame->imageAvailableSemaphore, VK_NULL_HANDLE, &framebufferIndex);
+	}
+	if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+	{
+		// No image was acquired, so nothing will signal the semaphore the
+		// frame would wait on. Drop it, and retry with a new swapchain.
+		vl_sdl2vk_flushSwapchain = true;
+		return;
 	}
 
-	VkSemaphore waitSemaphores[] = {vl_sdl2vk_imageAvailableSemaphore};
+	vkResetFences(vl_sdl2vk_device, 1, &frame->fence);
+
+	VkSemaphore waitSemaphores[] = {frame->imageAvailableSemaphore};
 	VkPipelineStageFlags waitPipelineStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-	VkSemaphore doneSemaphores[] = {vl_sdl2vk_frameCompleteSemaphore};
+	VkSemaphore doneSemaphores[] = {frame->frameCompleteSemaphore};
 
-	VL_SDL2VK_UploadSurface(surface);
+	VL_SDL2VK_Surface *surf = (VL_SDL2VK_Surface *)surface;
+	VL_SDL2VK_UploadSurface(surface, vl_sdl2vk_currentFrame);
 
-	VL_SDL2VK_BindTexture(surface);
+	VL_SDL2VK_BindTexture(surface, vl_sdl2vk_currentFrame);
 
 	VkRect2D fullRgn = {{vl_fullRgn_x, vl_fullRgn_y}, {(uint32_t)vl_fullRgn_w, (uint32_t)vl_fullRgn_h}};
 	VkRect2D renderRgn = {{vl_renderRgn_x, vl_renderRgn_y}, {(uint32_t)vl_renderRgn_w, (uint32_t)vl_renderRgn_h}};
@@ -1697,20 +1825,22 @@ static void VL_SDL2VK_Present(void *surface, int scrlX, int scrlY, bool singleBu
 		(float)VL_EGARGBColorTable[vl_emuegavgaadapter.bordercolor][1] / 255,
 		(float)VL_EGARGBColorTable[vl_emuegavgaadapter.bordercolor][2] / 255,
 		1.0f}};
-	VL_SDL2VK_PopulateCommandBuffer(framebufferIndex, fullRgn, renderRgn, borderColour);
+	VL_SDL2VK_PopulateCommandBuffer(vl_sdl2vk_currentFrame, framebufferIndex, fullRgn, renderRgn, borderColour);
+
+	// The upload is recorded ahead of time, and runs before the frame is drawn.
+	VkCommandBuffer commandBuffers[] = {surf->uploadCommandBuffers[vl_sdl2vk_currentFrame], frame->commandBuffer};
 
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submitInfo.waitSemaphoreCount = 1;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitPipelineStages;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &vl_sdl2vk_commandBuffers[framebufferIndex];
+	submitInfo.commandBufferCount = 2;
+	submitInfo.pCommandBuffers = commandBuffers;
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = doneSemaphores;
 
-	float *data;
-	vkMapMemory(vl_sdl2vk_device, vl_sdl2vk_uniformBufferMemory, 0, sizeof(float) * 4 * 17, 0, (void **)&data);
+	float *data = frame->uniformData;
 	data[0] = scrlX;
 	data[1] = scrlY;
 	for (int i = 0; i < 16; ++i)
@@ -1720,14 +1850,11 @@ static void VL_SDL2VK_Present(void *surface, int scrlX, int scrlY, bool singleBu
 		data[6 + 4 * i] = (float)VL_EGARGBColorTable[vl_emuegavgaadapter.palette[i]][2] / 255.0;
 		data[7 + 4 * i] = 255.0;
 	}
-	vkUnmapMemory(vl_sdl2vk_device, vl_sdl2vk_uniformBufferMemory);
 
-	result = vkQueueSubmit(vl_sdl2vk_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	result = vkQueueSubmit(vl_sdl2vk_graphicsQueue, 1, &submitInfo, frame->fence);
 	if (result != VK_SUCCESS)
 		Quit("Couldn't submit command buffer.");
 
-	vkQueueWaitIdle(vl_sdl2vk_graphicsQueue);
-
 	VkSwapchainKHR swapchains[] = {vl_sdl2vk_swapchain};
 
 	VkPresentInfoKHR presentInfo = {};
@@ -1739,7 +1866,31 @@ static void VL_SDL2VK_Present(void *surface, int scrlX, int scrlY, bool singleBu
 	presentInfo.pImageIndices = &framebufferIndex;
 	presentInfo.pResults = 0;
 
-	vkQueuePresentKHR(vl_sdl2vk_presentQueue, &presentInfo);
+	result = id_vkQueuePresentKHR(vl_sdl2vk_presentQueue, &presentInfo);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+		vl_sdl2vk_flushSwapchain = true;
+
+	vl_sdl2vk_currentFrame = (vl_sdl2vk_currentFrame + 1) % vl_sdl2vk_numFramesInFlight;
+	vl_sdl2vk_statPresentTime += CK_Cross_GetMicroseconds() - presentStart;
+	vl_sdl2vk_statFrames++;
+}
+
+static void VL_SDL2VK_ChunkyToSurface(const uint8_t *src, void *dst_surface, int x, int y, int w, int h)
+{
+	VL_SDL2VK_Surface *surf = (VL_SDL2VK_Surface *)dst_surface;
+	VL_ChunkyToPAL8(src, surf->data, x, y, surf->pitch, w, h);
+}
+
+static void VL_SDL2VK_ChunkyMaskedBlitToSurface(const uint8_t *src, const uint8_t *mask, void *dst_surface, int x, int y, int w, int h)
+{
+	VL_SDL2VK_Surface *surf = (VL_SDL2VK_Surface *)dst_surface;
+	VL_ChunkyMaskedBlitClipToPAL8(src, mask, surf->data, x, y, surf->pitch, w, h, surf->w, surf->h);
+}
+
+static void VL_SDL2VK_SpanSpriteToSurface(const VL_SpanSprite *spr, void *dst_surface, int x, int y, int colour)
+{
+	VL_SDL2VK_Surface *surf = (VL_SDL2VK_Surface *)dst_surface;
+	VL_SpanSpriteClipToPAL8(spr, surf->data, x, y, surf->pitch, surf->w, surf->h, colour);
 }
 
 static int VL_SDL2VK_GetActiveBufferId(void *surface)
@@ -1809,7 +1960,10 @@ VL_Backend vl_sdl2vk_backend =
 		/*.syncBuffers =*/&VL_SDL2VK_SyncBuffers,
 		/*.updateRect =*/&VL_SDL2VK_UpdateRect,
 		/*.flushParams =*/&VL_SDL2VK_FlushParams,
-		/*.waitVBLs =*/&VL_SDL2VK_WaitVBLs};
+		/*.waitVBLs =*/&VL_SDL2VK_WaitVBLs,
+		/*.chunkyToSurface =*/&VL_SDL2VK_ChunkyToSurface,
+		/*.chunkyMaskedBlitToSurface =*/&VL_SDL2VK_ChunkyMaskedBlitToSurface,
+		/*.spanSpriteToSurface =*/&VL_SDL2VK_SpanSpriteToSurface};
 
 VL_Backend *VL_Impl_GetBackend()
 {
@@ -0,0 +1,623 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// Vectorised planar-to-chunky (PAL8) conversion kernels.
+//
+// The EGA graphics are stored as separate bitplanes, with the leftmost pixel
+// in the most significant bit of each byte. Each kernel here takes one source
+// byte per plane for every 8 pixels, broadcasts each byte across 8 lanes, and
+// tests each lane against its own bit (0x80, 0x40, ... 0x01) to get a 0x00/0xFF
+// mask per pixel. The masks for the four colour planes are then weighted and
+// ORed together to build the 4-bit pixel values.
+//
+// The row drivers in id_vl.c handle the unaligned head and tail of each row with
+// the scalar code, so kernels only ever see whole groups starting on a byte
+// boundary. They must produce exactly the same output as the scalar code.
+//
+// The palette kernels at the end of the file convert PAL8 pixels to 32-bit
+// colours for backends that can't do it on the GPU. As only the low nibble of a
+// pixel is significant, the 16-entry palette fits in one vector per byte of the
+// output colour, so a byte shuffle can do the lookup for 16 pixels at a time.
+
+#include "id_vl.h"
+#include "id_vl_private.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VL_SIMD_X86
+#define VL_SIMD_HAVE_SSE2
+#define VL_SIMD_HAVE_SSSE3
+#define VL_SIMD_HAVE_AVX2
+#define VL_SIMD_TARGET(t) __attribute__((target(t)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define VL_SIMD_X86
+#define VL_SIMD_HAVE_SSE2
+#ifdef __AVX__
+// MSVC has no runtime dispatch here, so only use SSSE3 when /arch:AVX (or
+// better) already guarantees it.
+#define VL_SIMD_HAVE_SSSE3
+#endif
+#define VL_SIMD_TARGET(t)
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VL_SIMD_HAVE_NEON
+#endif
+
+#ifdef VL_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#ifdef VL_SIMD_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+/*
+ * SSE2: 16 pixels per iteration (two bytes per plane).
+ */
+#ifdef VL_SIMD_HAVE_SSE2
+
+VL_SIMD_TARGET("sse2")
+static inline __m128i VL_SSE2_Expand16(const uint8_t *plane, __m128i bits)
+{
+	__m128i v = _mm_cvtsi32_si128(plane[0] | (plane[1] << 8));
+	v = _mm_unpacklo_epi8(v, v);  // b0 b0 b1 b1
+	v = _mm_unpacklo_epi16(v, v); // b0 x4, b1 x4
+	v = _mm_unpacklo_epi32(v, v); // b0 x8, b1 x8
+	return _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+}
+
+#define VL_SSE2_BITS _mm_setr_epi8((char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1)
+
+VL_SIMD_TARGET("sse2")
+static inline __m128i VL_SSE2_Pixels16(const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, __m128i bits)
+{
+	__m128i pix = _mm_and_si128(VL_SSE2_Expand16(b, bits), _mm_set1_epi8(1));
+	pix = _mm_or_si128(pix, _mm_and_si128(VL_SSE2_Expand16(g, bits), _mm_set1_epi8(2)));
+	pix = _mm_or_si128(pix, _mm_and_si128(VL_SSE2_Expand16(r, bits), _mm_set1_epi8(4)));
+	pix = _mm_or_si128(pix, _mm_and_si128(VL_SSE2_Expand16(i, bits), _mm_set1_epi8(8)));
+	return pix;
+}
+
+VL_SIMD_TARGET("sse2")
+static void VL_SSE2_Unmasked(const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, uint8_t *dst, int groups)
+{
+	const __m128i bits = VL_SSE2_BITS;
+	for (int n = 0; n < groups; ++n, b += 2, g += 2, r += 2, i += 2, dst += 16)
+		_mm_storeu_si128((__m128i *)dst, VL_SSE2_Pixels16(b, g, r, i, bits));
+}
+
+VL_SIMD_TARGET("sse2")
+static void VL_SSE2_Masked(const uint8_t *a, const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, uint8_t *dst, int groups)
+{
+	const __m128i bits = VL_SSE2_BITS;
+	const __m128i hi = _mm_set1_epi8((char)0xF0);
+	for (int n = 0; n < groups; ++n, a += 2, b += 2, g += 2, r += 2, i += 2, dst += 16)
+	{
+		__m128i alpha = _mm_and_si128(VL_SSE2_Expand16(a, bits), hi);
+		_mm_storeu_si128((__m128i *)dst, _mm_and_si128(VL_SSE2_Pixels16(b, g, r, i, bits), alpha));
+	}
+}
+
+VL_SIMD_TARGET("sse2")
+static void VL_SSE2_MaskedBlit(const uint8_t *a, const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, uint8_t *dst, int groups)
+{
+	const __m128i bits = VL_SSE2_BITS;
+	for (int n = 0; n < groups; ++n, a += 2, b += 2, g += 2, r += 2, i += 2, dst += 16)
+	{
+		__m128i keep = _mm_and_si128(_mm_loadu_si128((const __m128i *)dst), VL_SSE2_Expand16(a, bits));
+		_mm_storeu_si128((__m128i *)dst, _mm_or_si128(keep, VL_SSE2_Pixels16(b, g, r, i, bits)));
+	}
+}
+
+VL_SIMD_TARGET("sse2")
+static void VL_SSE2_Bit(const uint8_t *src, uint8_t *dst, int groups, int colour)
+{
+	const __m128i bits = VL_SSE2_BITS;
+	const __m128i col = _mm_set1_epi8((char)colour);
+	const __m128i colHi = _mm_set1_epi8((char)(colour & 0xF0));
+	for (int n = 0; n < groups; ++n, src += 2, dst += 16)
+		_mm_storeu_si128((__m128i *)dst, _mm_or_si128(colHi, _mm_and_si128(VL_SSE2_Expand16(src, bits), col)));
+}
+
+VL_SIMD_TARGET("sse2")
+static void VL_SSE2_BitXor(const uint8_t *src, uint8_t *dst, int groups, int colour)
+{
+	const __m128i bits = VL_SSE2_BITS;
+	const __m128i col = _mm_set1_epi8((char)colour);
+	for (int n = 0; n < groups; ++n, src += 2, dst += 16)
+	{
+		__m128i d = _mm_loadu_si128((const __m128i *)dst);
+		_mm_storeu_si128((__m128i *)dst, _mm_xor_si128(d, _mm_and_si128(VL_SSE2_Expand16(src, bits), col)));
+	}
+}
+
+VL_SIMD_TARGET("sse2")
+static void VL_SSE2_BitBlit(const uint8_t *src, uint8_t *dst, int groups, int colour)
+{
+	const __m128i bits = VL_SSE2_BITS;
+	const __m128i col = _mm_set1_epi8((char)colour);
+	for (int n = 0; n < groups; ++n, src += 2, dst += 16)
+	{
+		__m128i m = VL_SSE2_Expand16(src, bits);
+		__m128i d = _mm_loadu_si128((const __m128i *)dst);
+		_mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_andnot_si128(m, d), _mm_and_si128(m, col)));
+	}
+}
+
+VL_SIMD_TARGET("sse2")
+static void VL_SSE2_BitInvBlit(const uint8_t *src, uint8_t *dst, int groups, int colour)
+{
+	const __m128i bits = VL_SSE2_BITS;
+	const __m128i col = _mm_set1_epi8((char)colour);
+	for (int n = 0; n < groups; ++n, src += 2, dst += 16)
+	{
+		__m128i m = VL_SSE2_Expand16(src, bits);
+		__m128i d = _mm_loadu_si128((const __m128i *)dst);
+		_mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_and_si128(m, d), _mm_andnot_si128(m, col)));
+	}
+}
+
+static const VL_PlanarKernels vl_planarKernels_sse2 = {
+	/*.name =*/"SSE2",
+	/*.width =*/16,
+	/*.unmasked =*/&VL_SSE2_Unmasked,
+	/*.masked =*/&VL_SSE2_Masked,
+	/*.maskedBlit =*/&VL_SSE2_MaskedBlit,
+	/*.bit =*/&VL_SSE2_Bit,
+	/*.bitXor =*/&VL_SSE2_BitXor,
+	/*.bitBlit =*/&VL_SSE2_BitBlit,
+	/*.bitInvBlit =*/&VL_SSE2_BitInvBlit,
+};
+
+#endif // VL_SIMD_HAVE_SSE2
+
+/*
+ * AVX2: 32 pixels per iteration (four bytes per plane).
+ *
+ * The groups are still 16 pixels wide, so 16px tiles and sprite rows don't
+ * drop to the scalar code. Pairs of groups are done 32 pixels at a time, and
+ * an odd group left over is handed to the SSE2 kernel.
+ */
+#ifdef VL_SIMD_HAVE_AVX2
+
+VL_SIMD_TARGET("avx2")
+static inline __m256i VL_AVX2_Expand32(const uint8_t *plane, __m256i spread, __m256i bits)
+{
+	int32_t word;
+	memcpy(&word, plane, 4);
+	// Each 128-bit lane gets a copy of all four bytes, so the per-lane
+	// shuffle can pick bytes 0,1 for the low lane and 2,3 for the high lane.
+	__m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(word), spread);
+	return _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+}
+
+#define VL_AVX2_SPREAD _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, \
+	2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3)
+#define VL_AVX2_BITS _mm256_setr_epi8((char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, \
+	(char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1)
+
+VL_SIMD_TARGET("avx2")
+static inline __m256i VL_AVX2_Pixels32(const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, __m256i spread, __m256i bits)
+{
+	__m256i pix = _mm256_and_si256(VL_AVX2_Expand32(b, spread, bits), _mm256_set1_epi8(1));
+	pix = _mm256_or_si256(pix, _mm256_and_si256(VL_AVX2_Expand32(g, spread, bits), _mm256_set1_epi8(2)));
+	pix = _mm256_or_si256(pix, _mm256_and_si256(VL_AVX2_Expand32(r, spread, bits), _mm256_set1_epi8(4)));
+	pix = _mm256_or_si256(pix, _mm256_and_si256(VL_AVX2_Expand32(i, spread, bits), _mm256_set1_epi8(8)));
+	return pix;
+}
+
+VL_SIMD_TARGET("avx2")
+static void VL_AVX2_Unmasked(const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, uint8_t *dst, int groups)
+{
+	const __m256i spread = VL_AVX2_SPREAD;
+	const __m256i bits = VL_AVX2_BITS;
+	for (; groups >= 2; groups -= 2, b += 4, g += 4, r += 4, i += 4, dst += 32)
+		_mm256_storeu_si256((__m256i *)dst, VL_AVX2_Pixels32(b, g, r, i, spread, bits));
+	if (groups)
+		VL_SSE2_Unmasked(b, g, r, i, dst, 1);
+}
+
+VL_SIMD_TARGET("avx2")
+static void VL_AVX2_Masked(const uint8_t *a, const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, uint8_t *dst, int groups)
+{
+	const __m256i spread = VL_AVX2_SPREAD;
+	const __m256i bits = VL_AVX2_BITS;
+	const __m256i hi = _mm256_set1_epi8((char)0xF0);
+	for (; groups >= 2; groups -= 2, a += 4, b += 4, g += 4, r += 4, i += 4, dst += 32)
+	{
+		__m256i alpha = _mm256_and_si256(VL_AVX2_Expand32(a, spread, bits), hi);
+		_mm256_storeu_si256((__m256i *)dst, _mm256_and_si256(VL_AVX2_Pixels32(b, g, r, i, spread, bits), alpha));
+	}
+	if (groups)
+		VL_SSE2_Masked(a, b, g, r, i, dst, 1);
+}
+
+VL_SIMD_TARGET("avx2")
+static void VL_AVX2_MaskedBlit(const uint8_t *a, const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, uint8_t *dst, int groups)
+{
+	const __m256i spread = VL_AVX2_SPREAD;
+	const __m256i bits = VL_AVX2_BITS;
+	for (; groups >= 2; groups -= 2, a += 4, b += 4, g += 4, r += 4, i += 4, dst += 32)
+	{
+		__m256i keep = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)dst), VL_AVX2_Expand32(a, spread, bits));
+		_mm256_storeu_si256((__m256i *)dst, _mm256_or_si256(keep, VL_AVX2_Pixels32(b, g, r, i, spread, bits)));
+	}
+	if (groups)
+		VL_SSE2_MaskedBlit(a, b, g, r, i, dst, 1);
+}
+
+VL_SIMD_TARGET("avx2")
+static void VL_AVX2_Bit(const uint8_t *src, uint8_t *dst, int groups, int colour)
+{
+	const __m256i spread = VL_AVX2_SPREAD;
+	const __m256i bits = VL_AVX2_BITS;
+	const __m256i col = _mm256_set1_epi8((char)colour);
+	const __m256i colHi = _mm256_set1_epi8((char)(colour & 0xF0));
+	for (; groups >= 2; groups -= 2, src += 4, dst += 32)
+		_mm256_storeu_si256((__m256i *)dst, _mm256_or_si256(colHi, _mm256_and_si256(VL_AVX2_Expand32(src, spread, bits), col)));
+	if (groups)
+		VL_SSE2_Bit(src, dst, 1, colour);
+}
+
+VL_SIMD_TARGET("avx2")
+static void VL_AVX2_BitXor(const uint8_t *src, uint8_t *dst, int groups, int colour)
+{
+	const __m256i spread = VL_AVX2_SPREAD;
+	const __m256i bits = VL_AVX2_BITS;
+	const __m256i col = _mm256_set1_epi8((char)colour);
+	for (; groups >= 2; groups -= 2, src += 4, dst += 32)
+	{
+		__m256i d = _mm256_loadu_si256((const __m256i *)dst);
+		_mm256_storeu_si256((__m256i *)dst, _mm256_xor_si256(d, _mm256_and_si256(VL_AVX2_Expand32(src, spread, bits), col)));
+	}
+	if (groups)
+		VL_SSE2_BitXor(src, dst, 1, colour);
+}
+
+VL_SIMD_TARGET("avx2")
+static void VL_AVX2_BitBlit(const uint8_t *src, uint8_t *dst, int groups, int colour)
+{
+	const __m256i spread = VL_AVX2_SPREAD;
+	const __m256i bits = VL_AVX2_BITS;
+	const __m256i col = _mm256_set1_epi8((char)colour);
+	for (; groups >= 2; groups -= 2, src += 4, dst += 32)
+	{
+		__m256i m = VL_AVX2_Expand32(src, spread, bits);
+		__m256i d = _mm256_loadu_si256((const __m256i *)dst);
+		_mm256_storeu_si256((__m256i *)dst, _mm256_blendv_epi8(d, col, m));
+	}
+	if (groups)
+		VL_SSE2_BitBlit(src, dst, 1, colour);
+}
+
+VL_SIMD_TARGET("avx2")
+static void VL_AVX2_BitInvBlit(const uint8_t *src, uint8_t *dst, int groups, int colour)
+{
+	const __m256i spread = VL_AVX2_SPREAD;
+	const __m256i bits = VL_AVX2_BITS;
+	const __m256i col = _mm256_set1_epi8((char)colour);
+	for (; groups >= 2; groups -= 2, src += 4, dst += 32)
+	{
+		__m256i m = VL_AVX2_Expand32(src, spread, bits);
+		__m256i d = _mm256_loadu_si256((const __m256i *)dst);
+		_mm256_storeu_si256((__m256i *)dst, _mm256_blendv_epi8(col, d, m));
+	}
+	if (groups)
+		VL_SSE2_BitInvBlit(src, dst, 1, colour);
+}
+
+static const VL_PlanarKernels vl_planarKernels_avx2 = {
+	/*.name =*/"AVX2",
+	/*.width =*/16,
+	/*.unmasked =*/&VL_AVX2_Unmasked,
+	/*.masked =*/&VL_AVX2_Masked,
+	/*.maskedBlit =*/&VL_AVX2_MaskedBlit,
+	/*.bit =*/&VL_AVX2_Bit,
+	/*.bitXor =*/&VL_AVX2_BitXor,
+	/*.bitBlit =*/&VL_AVX2_BitBlit,
+	/*.bitInvBlit =*/&VL_AVX2_BitInvBlit,
+};
+
+#endif // VL_SIMD_HAVE_AVX2
+
+/*
+ * NEON: 16 pixels per iteration (two bytes per plane).
+ */
+#ifdef VL_SIMD_HAVE_NEON
+
+static const uint8_t vl_neon_bits[16] = {0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, 0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1};
+
+static inline uint8x16_t VL_NEON_Expand16(const uint8_t *plane, uint8x16_t bits)
+{
+	return vtstq_u8(vcombine_u8(vdup_n_u8(plane[0]), vdup_n_u8(plane[1])), bits);
+}
+
+static inline uint8x16_t VL_NEON_Pixels16(const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, uint8x16_t bits)
+{
+	uint8x16_t pix = vandq_u8(VL_NEON_Expand16(b, bits), vdupq_n_u8(1));
+	pix = vorrq_u8(pix, vandq_u8(VL_NEON_Expand16(g, bits), vdupq_n_u8(2)));
+	pix = vorrq_u8(pix, vandq_u8(VL_NEON_Expand16(r, bits), vdupq_n_u8(4)));
+	pix = vorrq_u8(pix, vandq_u8(VL_NEON_Expand16(i, bits), vdupq_n_u8(8)));
+	return pix;
+}
+
+static void VL_NEON_Unmasked(const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, uint8_t *dst, int groups)
+{
+	const uint8x16_t bits = vld1q_u8(vl_neon_bits);
+	for (int n = 0; n < groups; ++n, b += 2, g += 2, r += 2, i += 2, dst += 16)
+		vst1q_u8(dst, VL_NEON_Pixels16(b, g, r, i, bits));
+}
+
+static void VL_NEON_Masked(const uint8_t *a, const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, uint8_t *dst, int groups)
+{
+	const uint8x16_t bits = vld1q_u8(vl_neon_bits);
+	const uint8x16_t hi = vdupq_n_u8(0xF0);
+	for (int n = 0; n < groups; ++n, a += 2, b += 2, g += 2, r += 2, i += 2, dst += 16)
+	{
+		uint8x16_t alpha = vandq_u8(VL_NEON_Expand16(a, bits), hi);
+		vst1q_u8(dst, vandq_u8(VL_NEON_Pixels16(b, g, r, i, bits), alpha));
+	}
+}
+
+static void VL_NEON_MaskedBlit(const uint8_t *a, const uint8_t *b, const uint8_t *g, const uint8_t *r, const uint8_t *i, uint8_t *dst, int groups)
+{
+	const uint8x16_t bits = vld1q_u8(vl_neon_bits);
+	for (int n = 0; n < groups; ++n, a += 2, b += 2, g += 2, r += 2, i += 2, dst += 16)
+	{
+		uint8x16_t keep = vandq_u8(vld1q_u8(dst), VL_NEON_Expand16(a, bits));
+		vst1q_u8(dst, vorrq_u8(keep, VL_NEON_Pixels16(b, g, r, i, bits)));
+	}
+}
+
+static void VL_NEON_Bit(const uint8_t *src, uint8_t *dst, int groups, int colour)
+{
+	const uint8x16_t bits = vld1q_u8(vl_neon_bits);
+	const uint8x16_t col = vdupq_n_u8((uint8_t)colour);
+	const uint8x16_t colHi = vdupq_n_u8((uint8_t)(colour & 0xF0));
+	for (int n = 0; n < groups; ++n, src += 2, dst += 16)
+		vst1q_u8(dst, vorrq_u8(colHi, vandq_u8(VL_NEON_Expand16(src, bits), col)));
+}
+
+static void VL_NEON_BitXor(const uint8_t *src, uint8_t *dst, int groups, int colour)
+{
+	const uint8x16_t bits = vld1q_u8(vl_neon_bits);
+	const uint8x16_t col = vdupq_n_u8((uint8_t)colour);
+	for (int n = 0; n < groups; ++n, src += 2, dst += 16)
+		vst1q_u8(dst, veorq_u8(vld1q_u8(dst), vandq_u8(VL_NEON_Expand16(src, bits), col)));
+}
+
+static void VL_NEON_BitBlit(const uint8_t *src, uint8_t *dst, int groups, int colour)
+{
+	const uint8x16_t bits = vld1q_u8(vl_neon_bits);
+	const uint8x16_t col = vdupq_n_u8((uint8_t)colour);
+	for (int n = 0; n < groups; ++n, src += 2, dst += 16)
+		vst1q_u8(dst, vbslq_u8(VL_NEON_Expand16(src, bits), col, vld1q_u8(dst)));
+}
+
+static void VL_NEON_BitInvBlit(const uint8_t *src, uint8_t *dst, int groups, int colour)
+{
+	const uint8x16_t bits = vld1q_u8(vl_neon_bits);
+	const uint8x16_t col = vdupq_n_u8((uint8_t)colour);
+	for (int n = 0; n < groups; ++n, src += 2, dst += 16)
+		vst1q_u8(dst, vbslq_u8(VL_NEON_Expand16(src, bits), vld1q_u8(dst), col));
+}
+
+static const VL_PlanarKernels vl_planarKernels_neon = {
+	/*.name =*/"NEON",
+	/*.width =*/16,
+	/*.unmasked =*/&VL_NEON_Unmasked,
+	/*.masked =*/&VL_NEON_Masked,
+	/*.maskedBlit =*/&VL_NEON_MaskedBlit,
+	/*.bit =*/&VL_NEON_Bit,
+	/*.bitXor =*/&VL_NEON_BitXor,
+	/*.bitBlit =*/&VL_NEON_BitBlit,
+	/*.bitInvBlit =*/&VL_NEON_BitInvBlit,
+};
+
+#endif // VL_SIMD_HAVE_NEON
+
+/*
+ * Palette lookup kernels.
+ */
+
+// Splits a 16-entry palette of 32-bit colours into four tables, one for each
+// byte of the colour as it is laid out in memory.
+static void VL_SIMD_SplitPalette(const uint32_t *lut, uint8_t planes[4][16])
+{
+	uint8_t bytes[16 * 4];
+	memcpy(bytes, lut, sizeof(bytes));
+	for (int i = 0; i < 16; ++i)
+		for (int b = 0; b < 4; ++b)
+			planes[b][i] = bytes[i * 4 + b];
+}
+
+#ifdef VL_SIMD_HAVE_SSSE3
+
+VL_SIMD_TARGET("ssse3")
+static void VL_SSSE3_PAL8ToRGB32(const uint8_t *src, uint32_t *dst, int groups, const uint32_t *lut)
+{
+	uint8_t planes[4][16];
+	VL_SIMD_SplitPalette(lut, planes);
+	const __m128i lut0 = _mm_loadu_si128((const __m128i *)planes[0]);
+	const __m128i lut1 = _mm_loadu_si128((const __m128i *)planes[1]);
+	const __m128i lut2 = _mm_loadu_si128((const __m128i *)planes[2]);
+	const __m128i lut3 = _mm_loadu_si128((const __m128i *)planes[3]);
+	const __m128i nibble = _mm_set1_epi8(0xF);
+	for (int n = 0; n < groups; ++n, src += 16, dst += 16)
+	{
+		__m128i idx = _mm_and_si128(_mm_loadu_si128((const __m128i *)src), nibble);
+		__m128i b0 = _mm_shuffle_epi8(lut0, idx);
+		__m128i b1 = _mm_shuffle_epi8(lut1, idx);
+		__m128i b2 = _mm_shuffle_epi8(lut2, idx);
+		__m128i b3 = _mm_shuffle_epi8(lut3, idx);
+		__m128i lo01 = _mm_unpacklo_epi8(b0, b1), hi01 = _mm_unpackhi_epi8(b0, b1);
+		__m128i lo23 = _mm_unpacklo_epi8(b2, b3), hi23 = _mm_unpackhi_epi8(b2, b3);
+		_mm_storeu_si128((__m128i *)dst + 0, _mm_unpacklo_epi16(lo01, lo23));
+		_mm_storeu_si128((__m128i *)dst + 1, _mm_unpackhi_epi16(lo01, lo23));
+		_mm_storeu_si128((__m128i *)dst + 2, _mm_unpacklo_epi16(hi01, hi23));
+		_mm_storeu_si128((__m128i *)dst + 3, _mm_unpackhi_epi16(hi01, hi23));
+	}
+}
+
+static const VL_PaletteKernels vl_paletteKernels_ssse3 = {
+	/*.name =*/"SSSE3",
+	/*.width =*/16,
+	/*.pal8ToRGB32 =*/&VL_SSSE3_PAL8ToRGB32,
+};
+
+#endif // VL_SIMD_HAVE_SSSE3
+
+#ifdef VL_SIMD_HAVE_AVX2
+
+VL_SIMD_TARGET("avx2")
+static void VL_AVX2_PAL8ToRGB32(const uint8_t *src, uint32_t *dst, int groups, const uint32_t *lut)
+{
+	uint8_t planes[4][16];
+	VL_SIMD_SplitPalette(lut, planes);
+	const __m256i lut0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)planes[0]));
+	const __m256i lut1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)planes[1]));
+	const __m256i lut2 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)planes[2]));
+	const __m256i lut3 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)planes[3]));
+	const __m256i nibble = _mm256_set1_epi8(0xF);
+	for (int n = 0; n < groups; ++n, src += 32, dst += 32)
+	{
+		__m256i idx = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)src), nibble);
+		__m256i b0 = _mm256_shuffle_epi8(lut0, idx);
+		__m256i b1 = _mm256_shuffle_epi8(lut1, idx);
+		__m256i b2 = _mm256_shuffle_epi8(lut2, idx);
+		__m256i b3 = _mm256_shuffle_epi8(lut3, idx);
+		__m256i lo01 = _mm256_unpacklo_epi8(b0, b1), hi01 = _mm256_unpackhi_epi8(b0, b1);
+		__m256i lo23 = _mm256_unpacklo_epi8(b2, b3), hi23 = _mm256_unpackhi_epi8(b2, b3);
+		// The unpacks work within each 128-bit lane, so these hold pixels
+		// 0-3/16-19, 4-7/20-23, 8-11/24-27 and 12-15/28-31 respectively.
+		__m256i p0 = _mm256_unpacklo_epi16(lo01, lo23);
+		__m256i p1 = _mm256_unpackhi_epi16(lo01, lo23);
+		__m256i p2 = _mm256_unpacklo_epi16(hi01, hi23);
+		__m256i p3 = _mm256_unpackhi_epi16(hi01, hi23);
+		_mm256_storeu_si256((__m256i *)dst + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+		_mm256_storeu_si256((__m256i *)dst + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+		_mm256_storeu_si256((__m256i *)dst + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+		_mm256_storeu_si256((__m256i *)dst + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+	}
+}
+
+static const VL_PaletteKernels vl_paletteKernels_avx2 = {
+	/*.name =*/"AVX2",
+	/*.width =*/32,
+	/*.pal8ToRGB32 =*/&VL_AVX2_PAL8ToRGB32,
+};
+
+#endif // VL_SIMD_HAVE_AVX2
+
+#ifdef VL_SIMD_HAVE_NEON
+
+static void VL_NEON_PAL8ToRGB32(const uint8_t *src, uint32_t *dst, int groups, const uint32_t *lut)
+{
+	uint8_t planes[4][16];
+	VL_SIMD_SplitPalette(lut, planes);
+	const uint8x16_t nibble = vdupq_n_u8(0xF);
+#ifdef __aarch64__
+	uint8x16_t lut0 = vld1q_u8(planes[0]), lut1 = vld1q_u8(planes[1]);
+	uint8x16_t lut2 = vld1q_u8(planes[2]), lut3 = vld1q_u8(planes[3]);
+	for (int n = 0; n < groups; ++n, src += 16, dst += 16)
+	{
+		uint8x16_t idx = vandq_u8(vld1q_u8(src), nibble);
+		uint8x16x4_t out;
+		out.val[0] = vqtbl1q_u8(lut0, idx);
+		out.val[1] = vqtbl1q_u8(lut1, idx);
+		out.val[2] = vqtbl1q_u8(lut2, idx);
+		out.val[3] = vqtbl1q_u8(lut3, idx);
+		// Interleaving the four byte planes gives whole colours.
+		vst4q_u8((uint8_t *)dst, out);
+	}
+#else
+	uint8x8x2_t lut0, lut1, lut2, lut3;
+	lut0.val[0] = vld1_u8(planes[0]), lut0.val[1] = vld1_u8(planes[0] + 8);
+	lut1.val[0] = vld1_u8(planes[1]), lut1.val[1] = vld1_u8(planes[1] + 8);
+	lut2.val[0] = vld1_u8(planes[2]), lut2.val[1] = vld1_u8(planes[2] + 8);
+	lut3.val[0] = vld1_u8(planes[3]), lut3.val[1] = vld1_u8(planes[3] + 8);
+	for (int n = 0; n < groups; ++n, src += 16, dst += 16)
+	{
+		uint8x16_t idx = vandq_u8(vld1q_u8(src), nibble);
+		for (int half = 0; half < 2; ++half)
+		{
+			uint8x8_t hidx = half ? vget_high_u8(idx) : vget_low_u8(idx);
+			uint8x8x4_t out;
+			out.val[0] = vtbl2_u8(lut0, hidx);
+			out.val[1] = vtbl2_u8(lut1, hidx);
+			out.val[2] = vtbl2_u8(lut2, hidx);
+			out.val[3] = vtbl2_u8(lut3, hidx);
+			vst4_u8((uint8_t *)(dst + half * 8), out);
+		}
+	}
+#endif
+}
+
+static const VL_PaletteKernels vl_paletteKernels_neon = {
+	/*.name =*/"NEON",
+	/*.width =*/16,
+	/*.pal8ToRGB32 =*/&VL_NEON_PAL8ToRGB32,
+};
+
+#endif // VL_SIMD_HAVE_NEON
+
+const VL_PlanarKernels *VL_SIMD_GetPlanarKernels(int index)
+{
+	const VL_PlanarKernels *supported[2];
+	int count = 0;
+#if defined(VL_SIMD_X86) && defined(__GNUC__)
+	__builtin_cpu_init();
+#ifdef VL_SIMD_HAVE_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		supported[count++] = &vl_planarKernels_avx2;
+#endif
+	if (__builtin_cpu_supports("sse2"))
+		supported[count++] = &vl_planarKernels_sse2;
+#elif defined(VL_SIMD_HAVE_SSE2)
+	// SSE2 is part of the baseline for the MSVC targets we enable it on.
+	supported[count++] = &vl_planarKernels_sse2;
+#elif defined(VL_SIMD_HAVE_NEON)
+	supported[count++] = &vl_planarKernels_neon;
+#endif
+	return (index >= 0 && index < count) ? supported[index] : NULL;
+}
+
+const VL_PlanarKernels *VL_SIMD_DetectPlanarKernels(void)
+{
+	return VL_SIMD_GetPlanarKernels(0);
+}
+
+const VL_PaletteKernels *VL_SIMD_DetectPaletteKernels(void)
+{
+#if defined(VL_SIMD_X86) && defined(__GNUC__)
+	__builtin_cpu_init();
+#ifdef VL_SIMD_HAVE_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		return &vl_paletteKernels_avx2;
+#endif
+	if (__builtin_cpu_supports("ssse3"))
+		return &vl_paletteKernels_ssse3;
+#elif defined(VL_SIMD_HAVE_SSSE3)
+	return &vl_paletteKernels_ssse3;
+#elif defined(VL_SIMD_HAVE_NEON)
+	return &vl_paletteKernels_neon;
+#endif
+	return NULL;
+}
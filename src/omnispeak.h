@@ -0,0 +1,165 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2012 David Gow <david@ingeniumdigital.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef OMNISPEAK_H
+#define OMNISPEAK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * libomnispeak: Runs the game in-process, without a window or sound, so it
+ * can be stepped from another program (e.g. for training agents).
+ *
+ * Each reset() starts a level of a new game, and each step() plays frames
+ * with fixed input through the demo playback path, so runs are
+ * deterministic. Dialogs which wait for a key are dismissed at once.
+ *
+ * As in the game's own demos, this means that:
+ * - the DEMO sign is drawn in place of the scorebox;
+ * - no extra lives are given for points (the score still counts);
+ * - levels are on Normal difficulty, unless OMNI_SetDifficulty() says
+ *   otherwise.
+ *
+ * Each environment has a game context of its own (see CK_Context in
+ * ck_def.h), so several can be stepped in turn in one process. The engine
+ * and the game data are shared between them: it's started with the first
+ * environment and shut down with the last, and the library isn't
+ * thread-safe. Fatal errors still end the process, as they do in the game.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Input bits for OMNI_Step(). Fire is jump + pogo, as with two-button firing.
+#define OMNI_INPUT_UP 0x01
+#define OMNI_INPUT_DOWN 0x02
+#define OMNI_INPUT_LEFT 0x04
+#define OMNI_INPUT_RIGHT 0x08
+#define OMNI_INPUT_JUMP 0x10
+#define OMNI_INPUT_POGO 0x20
+#define OMNI_INPUT_FIRE 0x40
+
+// Difficulties for OMNI_SetDifficulty(), as in CK_Difficulty.
+#define OMNI_DIFFICULTY_EASY 1
+#define OMNI_DIFFICULTY_NORMAL 2
+#define OMNI_DIFFICULTY_HARD 3
+
+typedef struct OMNI_Env OMNI_Env;
+
+// The screen, which is drawn to in place: the pointers stay valid until the
+// next OMNI_Step() or OMNI_Reset() of any environment. Once another one has
+// drawn over it, the screen of an environment is kept as a copy.
+typedef struct OMNI_Frame
+{
+	const uint8_t *pixels; // One byte per pixel; the low nibble is the colour.
+	int width, height;     // Of the whole buffer (the pitch is 'width').
+	int scrollX, scrollY;  // Top-left corner of the visible 320x200 region.
+	uint8_t palette[16][3]; // RGB values of the 16 colours.
+} OMNI_Frame;
+
+// The simulation state. The layouts are CK_GameState and CK_object (see
+// ck_def.h), and can change between builds.
+typedef struct OMNI_RAM
+{
+	const void *gameState;
+	size_t gameStateSize;
+	const void *objects;
+	size_t objectSize;
+	int numObjects; // Bigger on maps with many objects
+	int keenObject; // Index of Keen in 'objects'
+} OMNI_RAM;
+
+// Makes an environment for episode 4, 5 or 6, starting the engine with the
+// game's data files in dataPath if this is the first one. Returns NULL if
+// the episode isn't supported or its files can't be found, or if other
+// environments exist for a different episode (their data path is used).
+OMNI_Env *OMNI_Create(int episode, const char *dataPath);
+void OMNI_Destroy(OMNI_Env *env);
+
+// Starts a new game on the given level. The game's RNG is a table of 256
+// entries, so only the low 8 bits of the seed matter.
+void OMNI_Reset(OMNI_Env *env, int level, uint32_t seed);
+
+// Sets the difficulty of the levels started by later resets. The default is
+// OMNI_DIFFICULTY_NORMAL; other values are ignored.
+void OMNI_SetDifficulty(OMNI_Env *env, int difficulty);
+
+// Plays frames with the given input until at least 'tics' (1/70 s) of game
+// time have passed, or the level ends. A frame is 3 tics long, unless
+// 'rf_demoTics' is changed in the config file. Returns 0 while the level is
+// being played, or the CK_LevelState it ended with.
+int OMNI_Step(OMNI_Env *env, uint8_t input, int tics);
+
+void OMNI_GetFrame(OMNI_Env *env, OMNI_Frame *frame);
+void OMNI_GetRAM(OMNI_Env *env, OMNI_RAM *ram);
+
+/*
+ * Batches: step many environments in parallel.
+ *
+ * As the library isn't thread-safe, each environment of a batch runs in a
+ * worker process of its own, rather than on a thread. The workers are forked from an engine started by
+ * OMNI_BatchCreate(), so the data loaded at startup is shared between them
+ * (copy-on-write). The results are written to buffers shared with the
+ * workers, which hold one entry per environment, one after another.
+ *
+ * Batches are only supported on POSIX systems: on Windows,
+ * OMNI_BatchCreate() always returns NULL.
+ */
+
+#define OMNI_FRAME_WIDTH 320
+#define OMNI_FRAME_HEIGHT 200
+
+typedef struct OMNI_Batch OMNI_Batch;
+
+// Returns NULL if numEnvs workers couldn't be started (which is always the
+// case on Windows), or on the same conditions as OMNI_Create().
+OMNI_Batch *OMNI_BatchCreate(int numEnvs, int episode, const char *dataPath);
+void OMNI_BatchDestroy(OMNI_Batch *batch);
+int OMNI_BatchSize(OMNI_Batch *batch);
+
+// Resets environment i to levels[i] with seeds[i], or leaves it alone if
+// levels[i] is negative.
+void OMNI_BatchReset(OMNI_Batch *batch, const int *levels, const uint32_t *seeds);
+
+// Like OMNI_SetDifficulty(), for every environment of the batch.
+void OMNI_BatchSetDifficulty(OMNI_Batch *batch, int difficulty);
+
+// Steps every environment which isn't done with inputs[i] (see OMNI_Step()).
+// Environments start out done, until they are first reset.
+void OMNI_BatchStep(OMNI_Batch *batch, const uint8_t *inputs, int tics);
+
+// The visible part of each screen after the last reset or step, as
+// OMNI_FRAME_WIDTH x OMNI_FRAME_HEIGHT PAL8 pixels, and their palettes.
+const uint8_t *OMNI_BatchFrames(OMNI_Batch *batch);
+const uint8_t (*OMNI_BatchPalettes(OMNI_Batch *batch))[16][3];
+// The points scored in the last step.
+const int32_t *OMNI_BatchRewards(OMNI_Batch *batch);
+// Nonzero once the level has ended (or the worker has failed).
+const uint8_t *OMNI_BatchDones(OMNI_Batch *batch);
+// What OMNI_Step() last returned.
+const int32_t *OMNI_BatchLevelStates(OMNI_Batch *batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //OMNISPEAK_H
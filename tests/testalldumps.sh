@@ -0,0 +1,35 @@
+#!/bin/sh
+
+# Checks every reference dump, running one omnispeak process per core.
+# Run it from the build directory, like testdump.sh. The output of each
+# failing demo is kept in ../log, and the exit code is nonzero if any failed.
+
+JOBS=${JOBS:-`getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1`}
+RESULTS=`mktemp -d`
+
+for EPISODE in 4 5 6v14 6v15 ; do
+	for DEMO in 0 1 2 3 4 ; do
+		echo "$DEMO $EPISODE"
+	done
+done | xargs -P "$JOBS" -n 2 sh -c '
+	if ./omnispeak /EPISODE $1 /PLAYDEMO $0 /VERIFYDUMP "../tests/demo$0.dump$1" > "'"$RESULTS"'/ep$1demo$0.txt" 2>&1 ; then
+		rm "'"$RESULTS"'/ep$1demo$0.txt"
+	fi
+'
+
+FAILED=`ls "$RESULTS"`
+if [ -n "$FAILED" ] ; then
+	mkdir -p ../log
+	for LOG in $FAILED ; do
+		echo "Dump was different for ${LOG%.txt}:"
+		cat "$RESULTS/$LOG"
+		mv "$RESULTS/$LOG" ../log/
+	done
+	RES=1
+else
+	echo "All dumps matched"
+	RES=0
+fi
+
+rmdir "$RESULTS"
+exit $RES
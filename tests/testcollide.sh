@@ -0,0 +1,25 @@
+#!/bin/sh
+
+# Plays back demo $1 of episode $2 twice in a build with the playloop dumper,
+# checking it against the matching reference dump both times: once testing
+# every pair of objects for collisions (/NOBROADPHASE), and once using the
+# broadphase (/BROADPHASE). The pairs which collided in every frame are logged
+# both times, and must be the same, in the same order.
+
+EPISODE=$2
+KEENDUMP="../tests/demo${1}.dump${EPISODE}"
+LOGDIR=`mktemp -d`
+
+./omnispeak /EPISODE $EPISODE /PLAYDEMO $1 /VERIFYDUMP "$KEENDUMP" /NOBROADPHASE /COLLIDELOG "$LOGDIR/bruteforce.log" &&
+	./omnispeak /EPISODE $EPISODE /PLAYDEMO $1 /VERIFYDUMP "$KEENDUMP" /BROADPHASE /COLLIDELOG "$LOGDIR/broadphase.log" &&
+	cmp "$LOGDIR/bruteforce.log" "$LOGDIR/broadphase.log"
+RES=$?
+
+if [ $RES -ne 0 ] ; then
+	echo "Collisions were different for Episode $EPISODE, Demo $1"
+else
+	echo "Collisions matched for Episode $EPISODE, Demo $1"
+fi
+
+rm -rf "$LOGDIR"
+exit $RES
@@ -0,0 +1,18 @@
+#!/bin/sh
+
+# Plays back demo $1 of episode $2 in two contexts at once, stepping them
+# alternately, and checks that both have the same state hash every frame.
+# Run it from the build directory, like testdump.sh.
+
+EPISODE=$2
+
+./omnispeak /EPISODE $EPISODE /CHECKCONTEXTS $1
+RES=$?
+
+if [ $RES -ne 0 ] ; then
+	echo "Contexts differed for Episode $EPISODE, Demo $1"
+else
+	echo "Contexts matched for Episode $EPISODE, Demo $1"
+fi
+
+exit $RES
@@ -2,205 +2,628 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /*** Some stuff was copied-and-pasted-and-modified from Omnispeak. ***/
 /*** ALL fields are printed as unsigned, making it possible to     ***/
 /*** read and print each object as an array of 16-bit values.      ***/
 
-/*** WARNING - Only little-endian is supported! ***/
+/*** Both the original dump format and the compact (v2) format     ***/
+/*** written for .ckdump files are supported; see src/ck_dump.c.   ***/
 
-static size_t CK_Cross_freadInt16LE(void *ptr, size_t count, FILE *stream)
+#define MAX_OBJECTS 100
+#define OBJ_WORDS 38
+#define MAX_GAMESTATE_WORDS 64
+#define MAX_RECORD_WORDS (MAX_GAMESTATE_WORDS + MAX_OBJECTS * OBJ_WORDS)
+#define KEYFRAME_INTERVAL 64
+#define END_BLOCK 0xFFFF
+
+static const char *objFieldNames[OBJ_WORDS] = {
+	"type", "active", "visible", "clipped", "timeUntillThink", "posX", "posY",
+	"xDirection", "yDirection", "deltaPosX", "deltaPosY", "velX", "velY",
+	"actionTimer", "currentAction", "gfxChunk", "zLayer",
+	"unitX1", "unitY1", "unitX2", "unitY2", "unitXmid",
+	"tileX1", "tileY1", "tileX2", "tileY2", "tileXmid",
+	"topTI", "rightTI", "bottomTI", "leftTI",
+	"user1", "user2", "user3", "user4", "sde", "next", "prev"};
+
+static uint16_t getLE16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t getLE32(const uint8_t *p)
 {
-	count = fread(ptr, 2, count, stream);
-#if 0
-//#ifdef CK_CROSS_IS_BIGENDIAN
-	for (size_t loopVar = 0; loopVar < count; loopVar++, ((uint16_t *) ptr)++)
-		*(uint16_t *) ptr = CK_Cross_Swap16(*(uint16_t *) ptr);
-#endif
-	return count;
+	return getLE16(p) | ((uint32_t)getLE16(p + 2) << 16);
 }
 
-static size_t CK_Cross_freadInt32LE(void *ptr, size_t count, FILE *stream)
+static void putLE16(uint8_t **p, uint16_t val)
+{
+	*(*p)++ = val & 0xFF;
+	*(*p)++ = val >> 8;
+}
+
+static void putLE32(uint8_t **p, uint32_t val)
+{
+	putLE16(p, val & 0xFFFF);
+	putLE16(p, val >> 16);
+}
+
+static bool readLE32(FILE *fp, uint32_t *val)
+{
+	uint8_t buf[4];
+	if (fread(buf, 1, 4, fp) != 4)
+		return false;
+	*val = getLE32(buf);
+	return true;
+}
+
+/*** Reading dumps ***/
+
+typedef struct DumpReader
+{
+	FILE *fp;
+	const char *fileName;
+	bool compact;
+	int episode;
+	int gameStateWords;
+	int numObjects;
+	long recordSize; // Original format only
+
+	// Compact format keyframe index, if the file has one
+	uint32_t *indexFrames;
+	uint32_t *indexOffsets;
+	uint32_t indexSize;
+	long firstRecordOffset;
+
+	// The frame which was last read
+	long frame;
+	uint32_t timecount;
+	uint16_t words[MAX_RECORD_WORDS]; // The game state, then the objects
+} DumpReader;
+
+static int gameStateWordsForEpisode(int episode)
 {
-	count = fread(ptr, 4, count, stream);
-#if 0
-//#ifdef CK_CROSS_IS_BIGENDIAN
-	for (size_t loopVar = 0; loopVar < count; loopVar++, ((uint32_t *) ptr)++)
-		*(uint32_t *) ptr = CK_Cross_Swap32(*(uint32_t *) ptr);
-#endif
-	return count;
+	return 41 + ((episode == 4) ? 2 : (episode == 5) ? 3 : 4);
 }
 
+static void readCompactIndex(DumpReader *r)
+{
+	static const char indexMagic[8] = {'C', 'K', 'D', 'I', 'D', 'X', '2', '\0'};
+	uint8_t trailer[12];
+	uint8_t recordHeader[5];
+	uint32_t count;
+
+	// Dumps which weren't closed properly have no index, so are only read
+	// from the start.
+	if (fseek(r->fp, -12, SEEK_END) || fread(trailer, 1, 12, r->fp) != 12 || memcmp(trailer + 4, indexMagic, 8))
+		return;
+	if (fseek(r->fp, getLE32(trailer), SEEK_SET) || fread(recordHeader, 1, 5, r->fp) != 5 || recordHeader[0] != 'I')
+		return;
+	if (!readLE32(r->fp, &count))
+		return;
+	r->indexFrames = (uint32_t *)malloc(count * sizeof(uint32_t));
+	r->indexOffsets = (uint32_t *)malloc(count * sizeof(uint32_t));
+	for (r->indexSize = 0; r->indexSize < count; ++r->indexSize)
+	{
+		if (!readLE32(r->fp, &r->indexFrames[r->indexSize]) || !readLE32(r->fp, &r->indexOffsets[r->indexSize]))
+			break;
+	}
+}
 
-typedef struct CK_GameState
+static bool openDump(DumpReader *r, const char *fileName, int episode)
 {
-	uint16_t mapPosX;
-	uint16_t mapPosY;
-	uint16_t levelsDone[25];	// Number of levels complete
-	uint32_t/*int32_t*/ keenScore;		// Keen's score. (This _is_ signed, by the looks of all the 'jl' instructions)
-	uint32_t/*int32_t*/ nextKeenAt;		// Score keen will get a new life at.
-	uint16_t/*int16_t*/ numShots;
-	uint16_t/*int16_t*/ numCentilife;
+	static const char magic[8] = {'C', 'K', 'D', 'U', 'M', 'P', '2', '\0'};
+	uint8_t header[16];
 
-	// The episode-specific variables come here
-	// They were probably conditionally compiled in the DOS version
-	// so that the Gamestate struct is variably sized between eps.
-	union
+	memset(r, 0, sizeof(*r));
+	r->fileName = fileName;
+	r->frame = -1;
+	r->fp = fopen(fileName, "rb");
+	if (r->fp == NULL)
 	{
-		struct
-		{
-			uint16_t/*int16_t*/ wetsuit;
-			uint16_t/*int16_t*/ membersRescued;
-		} ck4;
+		fprintf(stderr, "ERROR - Cannot open file %s for reading\n", fileName);
+		return false;
+	}
 
-		struct
+	if (fread(header, 1, 16, r->fp) == 16 && !memcmp(header, magic, 8))
+	{
+		r->compact = true;
+		r->episode = getLE16(header + 8);
+		r->gameStateWords = getLE16(header + 10);
+		r->numObjects = getLE16(header + 12);
+		if ((r->episode != episode) || (getLE16(header + 14) != OBJ_WORDS)
+		    || (r->gameStateWords > MAX_GAMESTATE_WORDS) || (r->numObjects > MAX_OBJECTS))
 		{
-			uint16_t/*int16_t*/ securityCard;
-			uint16_t/*int16_t*/ word_4729C;
-			uint16_t/*int16_t*/ fusesRemaining;
-		} ck5;
+			fprintf(stderr, "ERROR - %s is an unsupported dump, or isn't from episode %d\n", fileName, episode);
+			return false;
+		}
+		r->firstRecordOffset = 16;
+		readCompactIndex(r);
+		fseek(r->fp, r->firstRecordOffset, SEEK_SET);
+	}
+	else
+	{
+		r->episode = episode;
+		r->gameStateWords = gameStateWordsForEpisode(episode);
+		r->numObjects = MAX_OBJECTS;
+		r->recordSize = 4 + 2 * (r->gameStateWords + r->numObjects * OBJ_WORDS);
+		rewind(r->fp);
+	}
+	return true;
+}
 
-		struct
+static void closeDump(DumpReader *r)
+{
+	free(r->indexFrames);
+	free(r->indexOffsets);
+	if (r->fp)
+		fclose(r->fp);
+}
+
+static int recordWords(DumpReader *r)
+{
+	return r->gameStateWords + r->numObjects * OBJ_WORDS;
+}
+
+static bool readFullRecord(DumpReader *r, const uint8_t *buf)
+{
+	r->timecount = getLE32(buf);
+	for (int i = 0; i < recordWords(r); ++i)
+		r->words[i] = getLE16(buf + 4 + 2 * i);
+	return true;
+}
+
+static bool applyDelta(DumpReader *r, const uint8_t *buf, uint32_t len)
+{
+	const uint8_t *end = buf + len;
+	r->timecount = getLE32(buf);
+	buf += 4;
+	while (buf + 2 <= end)
+	{
+		int block = getLE16(buf);
+		if (block == END_BLOCK)
+			return true;
+		if ((buf + 10 > end) || (block > r->numObjects))
+			return false;
+		uint64_t mask = getLE32(buf + 2) | ((uint64_t)getLE32(buf + 6) << 32);
+		int start = block ? r->gameStateWords + (block - 1) * OBJ_WORDS : 0;
+		int words = block ? OBJ_WORDS : r->gameStateWords;
+		buf += 10;
+		for (int i = 0; i < words; ++i)
 		{
-			uint16_t/*int16_t*/ sandwich;
-			uint16_t/*int16_t*/ rope;	// 1 == collected, 2 == deployed on cliff
-			uint16_t/*int16_t*/ passcard;
-			uint16_t/*int16_t*/ inRocket; // true if flying
-		} ck6;
-	} ep;
+			if (!(mask & ((uint64_t)1 << i)))
+				continue;
+			if (buf + 2 > end)
+				return false;
+			r->words[start + i] = getLE16(buf);
+			buf += 2;
+		}
+	}
+	return false;
+}
 
-	uint16_t/*int16_t*/ keyGems[4];
-	uint16_t/*int16_t*/ currentLevel;
-	uint16_t/*int16_t*/ numLives;			// Number of lives keen has.
-	uint16_t/*int16_t*/ difficulty;		// Difficulty level of current game
-	uint16_t platformOffset;	// This was a 16-bit pointer in DOS Keen5.exe
-} CK_GameState;
+// Reads the next frame. Returns false at the end of the dump.
+static bool readFrame(DumpReader *r)
+{
+	static uint8_t buf[4 + 2 * MAX_RECORD_WORDS + 10 * (MAX_OBJECTS + 1) + 2];
 
-/*** NOTE: There's no need for CK_object, we simply read object as an array ***/
+	if (!r->compact)
+	{
+		if (fread(buf, 1, r->recordSize, r->fp) != (size_t)r->recordSize)
+			return false;
+		r->frame++;
+		return readFullRecord(r, buf);
+	}
 
-static bool processTimeCount(FILE *fp)
+	uint8_t type;
+	uint32_t len;
+	if ((fread(&type, 1, 1, r->fp) != 1) || !readLE32(r->fp, &len))
+		return false;
+	if (((type != 'K') && (type != 'D')) || (len < 4) || (len > sizeof(buf)) || (fread(buf, 1, len, r->fp) != len))
+		return false;
+	if ((type == 'K') && (len != (uint32_t)(4 + 2 * recordWords(r))))
+		return false;
+	if ((type == 'D') && (r->frame < 0))
+		return false;
+	r->frame++;
+	return (type == 'K') ? readFullRecord(r, buf) : applyDelta(r, buf, len);
+}
+
+// Positions the reader so that the next frame read is the given one.
+static bool seekFrame(DumpReader *r, long frame)
 {
-	uint32_t timecount;
-	if (CK_Cross_freadInt32LE(&timecount, 1, fp) != 1)
+	if (!r->compact)
+	{
+		r->frame = frame - 1;
+		return !fseek(r->fp, frame * r->recordSize, SEEK_SET);
+	}
+
+	// Start from the last keyframe before the frame, and read up to it.
+	long offset = r->firstRecordOffset;
+	r->frame = -1;
+	for (uint32_t i = 0; i < r->indexSize && r->indexFrames[i] <= (uint32_t)frame; ++i)
+	{
+		offset = r->indexOffsets[i];
+		r->frame = (long)r->indexFrames[i] - 1;
+	}
+	if (fseek(r->fp, offset, SEEK_SET))
 		return false;
-	printf("Timecount: %08X\n", timecount);
+	while (r->frame < frame - 1)
+		if (!readFrame(r))
+			return false;
 	return true;
 }
 
-static int g_episodeNum;
-
-static bool processGameState(FILE *fp)
-{
-	CK_GameState state;
-	int i;
-
-	if ((CK_Cross_freadInt16LE(&state.mapPosX, 1, fp) != 1)
-	    || (CK_Cross_freadInt16LE(&state.mapPosY, 1, fp) != 1)
-	    || (CK_Cross_freadInt16LE(state.levelsDone, sizeof(state.levelsDone)/2, fp) != sizeof(state.levelsDone)/2)
-	    || (CK_Cross_freadInt32LE(&state.keenScore, 1, fp) != 1)
-	    || (CK_Cross_freadInt32LE(&state.nextKeenAt, 1, fp) != 1)
-	    || (CK_Cross_freadInt16LE(&state.numShots, 1, fp) != 1)
-	    || (CK_Cross_freadInt16LE(&state.numCentilife, 1, fp) != 1)
-	    || ((g_episodeNum == 4) &&
-	       (
-	        (CK_Cross_freadInt16LE(&state.ep.ck4.wetsuit, 1, fp) != 1)
-	        || (CK_Cross_freadInt16LE(&state.ep.ck4.membersRescued, 1, fp) != 1)
-	     )
-	    )
-	    || ((g_episodeNum == 5) &&
-	       (
-	        (CK_Cross_freadInt16LE(&state.ep.ck5.securityCard, 1, fp) != 1)
-	        || (CK_Cross_freadInt16LE(&state.ep.ck5.word_4729C, 1, fp) != 1)
-	        || (CK_Cross_freadInt16LE(&state.ep.ck5.fusesRemaining, 1, fp) != 1)
-	     )
-	    )
-	    || ((g_episodeNum == 6) &&
-	       (
-	        (CK_Cross_freadInt16LE(&state.ep.ck6.sandwich, 1, fp) != 1)
-	        || (CK_Cross_freadInt16LE(&state.ep.ck6.rope, 1, fp) != 1)
-	        || (CK_Cross_freadInt16LE(&state.ep.ck6.passcard, 1, fp) != 1)
-	        || (CK_Cross_freadInt16LE(&state.ep.ck6.inRocket, 1, fp) != 1)
-	     )
-	    )
-	    || (CK_Cross_freadInt16LE(state.keyGems, sizeof(state.keyGems)/2, fp) != sizeof(state.keyGems)/2)
-	    || (CK_Cross_freadInt16LE(&state.currentLevel, 1, fp) != 1)
-	    || (CK_Cross_freadInt16LE(&state.numLives, 1, fp) != 1)
-	    || (CK_Cross_freadInt16LE(&state.difficulty, 1, fp) != 1)
-	    || (CK_Cross_freadInt16LE(&state.platformOffset, 1, fp) != 1) // BACKWARDS COMPATIBILITY
-	)
-		return false;
+/*** Selecting what to print ***/
 
-	printf("Gamestate: %04X %04X", state.mapPosX, state.mapPosY);
+static bool selectedObjs[MAX_OBJECTS];
+static bool selectedFields[OBJ_WORDS];
+static bool filterObjs, filterFields;
 
-	for (i = 0; i < 25; ++i)
-		printf(" %04X", state.levelsDone[i]);
+// Parses a list like "0,3-5".
+static bool parseObjList(const char *list)
+{
+	char *end;
+	filterObjs = true;
+	while (*list)
+	{
+		long first = strtol(list, &end, 0), last = first;
+		if (end == list)
+			return false;
+		if (*end == '-')
+		{
+			list = end + 1;
+			last = strtol(list, &end, 0);
+			if (end == list)
+				return false;
+		}
+		for (long i = first; i <= last; ++i)
+			if (i >= 0 && i < MAX_OBJECTS)
+				selectedObjs[i] = true;
+		list = (*end == ',') ? end + 1 : end;
+		if (*end && *end != ',')
+			return false;
+	}
+	return true;
+}
 
-	printf(" %08X %08X %04X %04X", state.keenScore, state.nextKeenAt, state.numShots, state.numCentilife);
+// Parses a list of field names or numbers, like "posX,posY,14".
+static bool parseFieldList(const char *list)
+{
+	filterFields = true;
+	while (*list)
+	{
+		size_t len = strcspn(list, ",");
+		int field;
+		for (field = 0; field < OBJ_WORDS; ++field)
+			if (strlen(objFieldNames[field]) == len && !strncmp(objFieldNames[field], list, len))
+				break;
+		if (field == OBJ_WORDS)
+		{
+			char *end;
+			field = strtol(list, &end, 0);
+			if ((end != list + len) || (field < 0) || (field >= OBJ_WORDS))
+			{
+				fprintf(stderr, "Unknown object field: %.*s\n", (int)len, list);
+				return false;
+			}
+		}
+		selectedFields[field] = true;
+		list += len;
+		if (*list)
+			list++;
+	}
+	return true;
+}
 
-	if (g_episodeNum == 4)
-		printf(" %04X %04X", state.ep.ck4.wetsuit, state.ep.ck4.membersRescued);
-	else if (g_episodeNum == 5)
-		printf(" %04X %04X %04X", state.ep.ck5.securityCard, state.ep.ck5.word_4729C, state.ep.ck5.fusesRemaining);
-	else if (g_episodeNum == 6)
-		printf(" %04X %04X %04X %04X", state.ep.ck6.sandwich, state.ep.ck6.rope, state.ep.ck6.passcard, state.ep.ck6.inRocket);
+static bool objSelected(int obj)
+{
+	return !filterObjs || selectedObjs[obj];
+}
 
-	for (i = 0; i < 4; ++i)
-		printf(" %04X", state.keyGems[i]);
+static bool fieldSelected(int field)
+{
+	return !filterFields || selectedFields[field];
+}
 
-	printf(" %04X %04X %04X %04X\n", state.currentLevel, state.numLives, state.difficulty, state.platformOffset);
+/*** Printing ***/
 
-	return true;
+static void printGameState(DumpReader *r)
+{
+	const uint16_t *w = r->words;
+	int i, epWords = r->gameStateWords - 41;
+
+	printf("Gamestate: %04X %04X", w[0], w[1]);
+	for (i = 0; i < 25; ++i)
+		printf(" %04X", w[2 + i]);
+	printf(" %08X %08X %04X %04X", w[27] | ((uint32_t)w[28] << 16), w[29] | ((uint32_t)w[30] << 16), w[31], w[32]);
+	for (i = 0; i < epWords; ++i)
+		printf(" %04X", w[33 + i]);
+	for (i = 0; i < 4; ++i)
+		printf(" %04X", w[33 + epWords + i]);
+	printf(" %04X %04X %04X %04X\n", w[37 + epWords], w[38 + epWords], w[39 + epWords], w[40 + epWords]);
 }
 
-static bool processObjects(FILE *fp)
+static void printFrame(DumpReader *r)
 {
-	uint16_t objFields[38];
 	int i, j;
-	for (j = 0; j < 100; ++j)
+	printf("Timecount: %08X\n", r->timecount);
+	if (!filterObjs && !filterFields)
+		printGameState(r);
+	for (j = 0; j < r->numObjects; ++j)
 	{
-		if (CK_Cross_freadInt16LE(&objFields, 38, fp) != 38)
-			return false;
-
+		const uint16_t *objFields = r->words + r->gameStateWords + j * OBJ_WORDS;
+		if (!objSelected(j))
+			continue;
 		printf("Obj %02X:", j);
-		for (i = 0; i < 38; ++i)
-			printf(" %04X", objFields[i]);
+		for (i = 0; i < OBJ_WORDS; ++i)
+		{
+			if (!filterFields)
+				printf(" %04X", objFields[i]);
+			else if (selectedFields[i])
+				printf(" %s=%04X", objFieldNames[i], objFields[i]);
+		}
 		printf("\n");
 	}
-	return true;
 }
 
-int main(int argc, char **argv)
+// Prints the fields which differ between two frames. Returns true if any do.
+static bool diffFrame(DumpReader *a, DumpReader *b)
 {
-	// Minor little-endian test
-	uint16_t someUInt16 = 0x1234;
-	uint8_t *someUint8Ptr = (uint8_t *)&someUInt16;
-	if ((someUint8Ptr[0] != 0x34) || (someUint8Ptr[1] != 0x12))
+	bool differs = false;
+	if (a->timecount != b->timecount)
 	{
-		fprintf(stderr, "FATAL ERROR - Only Little-Endian architectures are supported!\n");
-		return 2;
+		printf("Frame %ld: Timecount: %08X vs %08X\n", a->frame, a->timecount, b->timecount);
+		differs = true;
 	}
+	if (!filterObjs && !filterFields)
+	{
+		for (int i = 0; i < a->gameStateWords; ++i)
+		{
+			if (a->words[i] == b->words[i])
+				continue;
+			printf("Frame %ld: Gamestate word %d: %04X vs %04X\n", a->frame, i, a->words[i], b->words[i]);
+			differs = true;
+		}
+	}
+	for (int j = 0; j < a->numObjects; ++j)
+	{
+		const uint16_t *objA = a->words + a->gameStateWords + j * OBJ_WORDS;
+		const uint16_t *objB = b->words + b->gameStateWords + j * OBJ_WORDS;
+		if (!objSelected(j) || !memcmp(objA, objB, OBJ_WORDS * 2))
+			continue;
+		for (int i = 0; i < OBJ_WORDS; ++i)
+		{
+			if (!fieldSelected(i) || objA[i] == objB[i])
+				continue;
+			printf("Frame %ld: Obj %02X %s: %04X vs %04X\n", a->frame, j, objFieldNames[i], objA[i], objB[i]);
+			differs = true;
+		}
+	}
+	return differs;
+}
 
-	if (argc != 3)
+/*** Writing compact dumps ***/
+
+static bool convertDump(DumpReader *r, const char *outFileName)
+{
+	static const char magic[8] = {'C', 'K', 'D', 'U', 'M', 'P', '2', '\0'};
+	static const char indexMagic[8] = {'C', 'K', 'D', 'I', 'D', 'X', '2', '\0'};
+	static uint8_t buf[4 + 2 * MAX_RECORD_WORDS + 10 * (MAX_OBJECTS + 1) + 2];
+	static uint16_t prevWords[MAX_RECORD_WORDS];
+	uint32_t *indexFrames = NULL, *indexOffsets = NULL;
+	uint32_t indexSize = 0;
+	uint8_t *p;
+
+	FILE *out = fopen(outFileName, "wb");
+	if (out == NULL)
 	{
-		fprintf(stderr, "Usage: %s <inFile> <episode>\n", argv[0]);
+		fprintf(stderr, "ERROR - Cannot open file %s for writing\n", outFileName);
+		return false;
+	}
+
+	p = buf;
+	memcpy(p, magic, 8);
+	p += 8;
+	putLE16(&p, r->episode);
+	putLE16(&p, r->gameStateWords);
+	putLE16(&p, r->numObjects);
+	putLE16(&p, OBJ_WORDS);
+	fwrite(buf, 1, p - buf, out);
+
+	while (readFrame(r))
+	{
+		uint8_t type;
+		p = buf;
+		putLE32(&p, r->timecount);
+		if (r->frame % KEYFRAME_INTERVAL == 0)
+		{
+			type = 'K';
+			indexFrames = (uint32_t *)realloc(indexFrames, (indexSize + 1) * sizeof(uint32_t));
+			indexOffsets = (uint32_t *)realloc(indexOffsets, (indexSize + 1) * sizeof(uint32_t));
+			indexFrames[indexSize] = r->frame;
+			indexOffsets[indexSize] = ftell(out);
+			indexSize++;
+			for (int i = 0; i < recordWords(r); ++i)
+				putLE16(&p, r->words[i]);
+		}
+		else
+		{
+			type = 'D';
+			for (int block = 0; block <= r->numObjects; ++block)
+			{
+				int start = block ? r->gameStateWords + (block - 1) * OBJ_WORDS : 0;
+				int words = block ? OBJ_WORDS : r->gameStateWords;
+				uint64_t mask = 0;
+				for (int i = 0; i < words; ++i)
+					if (r->words[start + i] != prevWords[start + i])
+						mask |= (uint64_t)1 << i;
+				if (!mask)
+					continue;
+				putLE16(&p, block);
+				putLE32(&p, mask & 0xFFFFFFFF);
+				putLE32(&p, mask >> 32);
+				for (int i = 0; i < words; ++i)
+					if (mask & ((uint64_t)1 << i))
+						putLE16(&p, r->words[start + i]);
+			}
+			putLE16(&p, END_BLOCK);
+		}
+		uint8_t recordHeader[5], *h = recordHeader;
+		*h++ = type;
+		putLE32(&h, p - buf);
+		fwrite(recordHeader, 1, 5, out);
+		fwrite(buf, 1, p - buf, out);
+		memcpy(prevWords, r->words, recordWords(r) * 2);
+	}
+
+	uint32_t indexOffset = ftell(out);
+	p = buf;
+	*p++ = 'I';
+	putLE32(&p, 4 + 8 * indexSize);
+	putLE32(&p, indexSize);
+	fwrite(buf, 1, p - buf, out);
+	for (uint32_t i = 0; i < indexSize; ++i)
+	{
+		p = buf;
+		putLE32(&p, indexFrames[i]);
+		putLE32(&p, indexOffsets[i]);
+		fwrite(buf, 1, p - buf, out);
+	}
+	p = buf;
+	putLE32(&p, indexOffset);
+	memcpy(p, indexMagic, 8);
+	p += 8;
+	fwrite(buf, 1, p - buf, out);
+
+	free(indexFrames);
+	free(indexOffsets);
+	fclose(out);
+	return true;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s <inFile> <episode> [options]\n"
+		"Options:\n"
+		"  -from <n>         Start at frame n\n"
+		"  -count <n>        Only print (or compare) n frames\n"
+		"  -objs <list>      Only print these objects, e.g. 0,3-5\n"
+		"  -fields <list>    Only print these object fields, e.g. posX,posY\n"
+		"  -diff <file>      Print the fields which differ from another dump\n"
+		"  -convert <file>   Write the dump out in the compact (.ckdump) format\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	long fromFrame = 0, frameCount = -1;
+	const char *diffFileName = NULL, *convertFileName = NULL;
+	DumpReader reader;
+	int episodeNum, result = 0;
+
+	if (argc < 3)
+	{
+		usage(argv[0]);
 		return 0;
 	}
-	g_episodeNum = atoi(argv[2]);
-	if ((g_episodeNum < 4) || (g_episodeNum > 6))
+	episodeNum = atoi(argv[2]);
+	if ((episodeNum < 4) || (episodeNum > 6))
 	{
 		fprintf(stderr, "<episode> argument must be a number in the range 4-6.\n");
 		return 1;
 	}
-	FILE *fp = fopen(argv[1], "rb");
-	if (fp == NULL)
+	for (int i = 3; i < argc; ++i)
 	{
-		fprintf(stderr, "ERROR - Cannot open file %s for reading\n", argv[1]);
+		if (i + 1 >= argc)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		if (!strcmp(argv[i], "-from"))
+			fromFrame = atol(argv[++i]);
+		else if (!strcmp(argv[i], "-count"))
+			frameCount = atol(argv[++i]);
+		else if (!strcmp(argv[i], "-objs"))
+		{
+			if (!parseObjList(argv[++i]))
+			{
+				fprintf(stderr, "Bad object list: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "-fields"))
+		{
+			if (!parseFieldList(argv[++i]))
+				return 1;
+		}
+		else if (!strcmp(argv[i], "-diff"))
+			diffFileName = argv[++i];
+		else if (!strcmp(argv[i], "-convert"))
+			convertFileName = argv[++i];
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!openDump(&reader, argv[1], episodeNum))
+		return 1;
+
+	if (convertFileName)
+	{
+		result = convertDump(&reader, convertFileName) ? 0 : 1;
+		closeDump(&reader);
+		return result;
+	}
+
+	if (!seekFrame(&reader, fromFrame))
+	{
+		fprintf(stderr, "ERROR - %s has no frame %ld\n", argv[1], fromFrame);
+		closeDump(&reader);
 		return 1;
 	}
 
-	while (processTimeCount(fp) && processGameState(fp) && processObjects(fp))
-		;
+	if (diffFileName)
+	{
+		DumpReader other;
+		long differingFrames = 0;
+		if (!openDump(&other, diffFileName, episodeNum) || !seekFrame(&other, fromFrame))
+		{
+			fprintf(stderr, "ERROR - %s has no frame %ld\n", diffFileName, fromFrame);
+			closeDump(&other);
+			closeDump(&reader);
+			return 1;
+		}
+		for (long n = 0; frameCount < 0 || n < frameCount; ++n)
+		{
+			bool haveA = readFrame(&reader), haveB = readFrame(&other);
+			if (!haveA || !haveB)
+			{
+				if (haveA != haveB)
+				{
+					printf("%s ends at frame %ld\n", haveA ? diffFileName : argv[1], haveA ? other.frame + 1 : reader.frame + 1);
+					differingFrames++;
+				}
+				break;
+			}
+			if (diffFrame(&reader, &other))
+				differingFrames++;
+		}
+		if (differingFrames)
+			printf("%ld frames differ\n", differingFrames);
+		result = differingFrames ? 1 : 0;
+		closeDump(&other);
+	}
+	else
+	{
+		for (long n = 0; (frameCount < 0 || n < frameCount) && readFrame(&reader); ++n)
+			printFrame(&reader);
+	}
 
-	fclose(fp);
-	return 0;
+	closeDump(&reader);
+	return result;
 }
@@ -0,0 +1,226 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2023 Omnispeak Authors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * simdcheck: checks the vectorised planar conversion kernels (id_vl_simd.c)
+ * against the scalar code.
+ *
+ * Usage: simdcheck [seed]
+ *
+ * Every planar-to-PAL8 converter in id_vl.c is run over random source and
+ * destination buffers, once with the scalar code and once with each kernel
+ * set the CPU supports. This is done for every width up to CHECK_MAX_W, and
+ * for the clipped converters, every starting offset into the source. The
+ * outputs must match exactly. The exit code is nonzero if any didn't.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../src/id_sd.h"
+#include "../../src/id_us.h"
+#include "../../src/id_vl.h"
+#include "../../src/id_vl_private.h"
+
+// id_vl.c only needs these for VL_Startup and VL_Present, which aren't used.
+const char **us_argv;
+int us_argc;
+
+int US_CheckParm(const char *parm, const char **strings)
+{
+	(void)parm;
+	(void)strings;
+	return -1;
+}
+
+uint32_t SD_GetTimeCount(void)
+{
+	return 0;
+}
+
+VL_Backend *VL_Impl_GetBackend(void)
+{
+	return NULL;
+}
+
+#define CHECK_MAX_W 96
+#define CHECK_MAX_H 3
+#define CHECK_MAX_CLIP 40
+#define CHECK_DEST_PITCH (CHECK_MAX_CLIP + CHECK_MAX_W + 8)
+#define CHECK_DEST_SIZE (CHECK_DEST_PITCH * CHECK_MAX_H)
+// Five planes, plus some slack as the kernels read whole groups.
+#define CHECK_SRC_SIZE (5 * (CHECK_MAX_W / 8 + 1) * CHECK_MAX_H + 64)
+
+typedef void (*CheckFunc)(uint8_t *src, uint8_t *dst, int x, int w, int h, int dw, int colour);
+
+static void Check_Unmasked(uint8_t *src, uint8_t *dst, int x, int w, int h, int dw, int colour)
+{
+	VL_UnmaskedToPAL8(src, dst, x, 0, CHECK_DEST_PITCH, w, h);
+}
+
+static void Check_Masked(uint8_t *src, uint8_t *dst, int x, int w, int h, int dw, int colour)
+{
+	VL_MaskedToPAL8(src, dst, x, 0, CHECK_DEST_PITCH, w, h);
+}
+
+static void Check_MaskedBlit(uint8_t *src, uint8_t *dst, int x, int w, int h, int dw, int colour)
+{
+	VL_MaskedBlitToPAL8(src, dst, x, 0, CHECK_DEST_PITCH, w, h);
+}
+
+static void Check_MaskedBlitClip(uint8_t *src, uint8_t *dst, int x, int w, int h, int dw, int colour)
+{
+	VL_MaskedBlitClipToPAL8(src, dst, x, 0, CHECK_DEST_PITCH, w, h, dw, h);
+}
+
+static void Check_1bpp(uint8_t *src, uint8_t *dst, int x, int w, int h, int dw, int colour)
+{
+	VL_1bppToPAL8(src, dst, x, 0, CHECK_DEST_PITCH, w, h, colour);
+}
+
+static void Check_1bppXor(uint8_t *src, uint8_t *dst, int x, int w, int h, int dw, int colour)
+{
+	VL_1bppXorWithPAL8(src, dst, x, 0, CHECK_DEST_PITCH, w, h, colour);
+}
+
+static void Check_1bppBlit(uint8_t *src, uint8_t *dst, int x, int w, int h, int dw, int colour)
+{
+	VL_1bppBlitToPAL8(src, dst, x, 0, CHECK_DEST_PITCH, w, h, colour);
+}
+
+static void Check_1bppInvBlit(uint8_t *src, uint8_t *dst, int x, int w, int h, int dw, int colour)
+{
+	VL_1bppInvBlitToPAL8(src, dst, x, 0, CHECK_DEST_PITCH, w, h, colour);
+}
+
+static void Check_1bppInvBlitClip(uint8_t *src, uint8_t *dst, int x, int w, int h, int dw, int colour)
+{
+	VL_1bppInvBlitClipToPAL8(src, dst, x, 0, CHECK_DEST_PITCH, w, h, dw, h, colour);
+}
+
+typedef struct CheckCase
+{
+	const char *name;
+	CheckFunc func;
+	bool clipped;
+} CheckCase;
+
+static const CheckCase checkCases[] = {
+	{"VL_UnmaskedToPAL8", Check_Unmasked, false},
+	{"VL_MaskedToPAL8", Check_Masked, false},
+	{"VL_MaskedBlitToPAL8", Check_MaskedBlit, false},
+	{"VL_MaskedBlitClipToPAL8", Check_MaskedBlitClip, true},
+	{"VL_1bppToPAL8", Check_1bpp, false},
+	{"VL_1bppXorWithPAL8", Check_1bppXor, false},
+	{"VL_1bppBlitToPAL8", Check_1bppBlit, false},
+	{"VL_1bppInvBlitToPAL8", Check_1bppInvBlit, false},
+	{"VL_1bppInvBlitClipToPAL8", Check_1bppInvBlitClip, true},
+};
+
+static uint8_t checkSrc[CHECK_SRC_SIZE];
+static uint8_t checkInitialDst[CHECK_DEST_SIZE];
+static uint8_t checkScalarDst[CHECK_DEST_SIZE];
+static uint8_t checkSimdDst[CHECK_DEST_SIZE];
+
+static void FillRandom(uint8_t *buf, size_t len)
+{
+	for (size_t i = 0; i < len; ++i)
+		buf[i] = (uint8_t)(rand() >> 4);
+}
+
+// Runs one converter with the scalar code and with 'kernels', and compares.
+static bool CheckOne(const VL_PlanarKernels *kernels, const CheckCase *c, int x, int w, int h, int dw)
+{
+	int colour = rand() & 0xFF;
+	FillRandom(checkSrc, sizeof(checkSrc));
+	FillRandom(checkInitialDst, sizeof(checkInitialDst));
+
+	// The destination is offset so that clipped converters can be given a
+	// negative x.
+	memcpy(checkScalarDst, checkInitialDst, CHECK_DEST_SIZE);
+	VL_SetPlanarKernels(NULL);
+	c->func(checkSrc, checkScalarDst + CHECK_MAX_CLIP, x, w, h, dw, colour);
+
+	memcpy(checkSimdDst, checkInitialDst, CHECK_DEST_SIZE);
+	VL_SetPlanarKernels(kernels);
+	c->func(checkSrc, checkSimdDst + CHECK_MAX_CLIP, x, w, h, dw, colour);
+
+	if (!memcmp(checkScalarDst, checkSimdDst, CHECK_DEST_SIZE))
+		return true;
+
+	for (int i = 0; i < CHECK_DEST_SIZE; ++i)
+	{
+		if (checkScalarDst[i] != checkSimdDst[i])
+		{
+			printf("%s: %s differs at x=%d w=%d h=%d dw=%d: pixel (%d, %d) is %02x, not %02x\n",
+				kernels->name, c->name, x, w, h, dw, i % CHECK_DEST_PITCH - CHECK_MAX_CLIP, i / CHECK_DEST_PITCH,
+				checkSimdDst[i], checkScalarDst[i]);
+			break;
+		}
+	}
+	return false;
+}
+
+int main(int argc, char **argv)
+{
+	int failed = 0;
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+
+	if (!VL_SIMD_GetPlanarKernels(0))
+	{
+		printf("No vectorised planar kernels are supported here.\n");
+		return 0;
+	}
+
+	for (int k = 0; VL_SIMD_GetPlanarKernels(k); ++k)
+	{
+		const VL_PlanarKernels *kernels = VL_SIMD_GetPlanarKernels(k);
+		long checks = 0, kernelFailed = 0;
+		for (size_t n = 0; n < sizeof(checkCases) / sizeof(checkCases[0]); ++n)
+		{
+			const CheckCase *c = &checkCases[n];
+			for (int w = 1; w <= CHECK_MAX_W; ++w)
+			{
+				for (int h = 1; h <= CHECK_MAX_H; ++h)
+				{
+					if (!c->clipped)
+					{
+						for (int x = 0; x < 8; ++x, ++checks)
+							kernelFailed += !CheckOne(kernels, c, x, w, h, CHECK_DEST_PITCH);
+						continue;
+					}
+					// Clip off every number of pixels on the left, and
+					// some on the right.
+					for (int x = -CHECK_MAX_CLIP; x < 8; ++x)
+					{
+						if (x <= -w)
+							continue;
+						for (int clipRight = 0; clipRight < 33 && clipRight < w + (x < 0 ? x : 0); clipRight += 3, ++checks)
+							kernelFailed += !CheckOne(kernels, c, x, w, h, x + w - clipRight);
+					}
+				}
+			}
+		}
+		printf("%s: %ld of %ld checks failed.\n", kernels->name, kernelFailed, checks);
+		failed += kernelFailed != 0;
+	}
+	return failed ? 1 : 0;
+}
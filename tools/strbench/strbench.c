@@ -0,0 +1,191 @@
+/*
+Omnispeak: A Commander Keen Reimplementation
+Copyright (C) 2023 Omnispeak Authors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * strbench: times the string tables (id_str.c) with an episode's variables.
+ *
+ * Usage: strbench EPISODE.CKx [trace] [repeats]
+ *
+ * Run it in the episode's data directory. The trace is a list of names, one
+ * per line, as written by omnispeak's /VARTRACE option; without one, every
+ * variable is looked up once per repeat.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../src/id_mm.h"
+#include "../../src/id_str.h"
+#include "../../src/ck_act.h"
+#include "../../src/ck_def.h"
+
+bool CA_LoadFile(const char *filename, mm_ptr_t *ptr, int *memsize)
+{
+	FILE *f = fopen(filename, "rb");
+
+	if (!f)
+		return false;
+
+	//Get length of file
+	fseek(f, 0, SEEK_END);
+	int length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	MM_GetPtr(ptr, length);
+
+	if (memsize)
+		*memsize = length;
+
+	int amountRead = fread(*ptr, 1, length, f);
+
+	fclose(f);
+
+	if (amountRead != length)
+		return false;
+	return true;
+}
+
+void Quit(const char *msg)
+{
+	if (msg)
+	{
+		fprintf(stderr, "%s\n", msg);
+		exit(1);
+	}
+	exit(0);
+}
+
+extern STR_Table *ck_varTable;
+
+static const char **names;
+static size_t numNames;
+static size_t namesSize;
+
+static void AddName(const char *name)
+{
+	if (numNames == namesSize)
+	{
+		namesSize = namesSize ? namesSize * 2 : 1024;
+		names = (const char **)realloc(names, namesSize * sizeof(const char *));
+		if (!names)
+			Quit("Out of memory!");
+	}
+	// Each is a copy, so that none of them are the table's own strings.
+	char *copy = (char *)malloc(strlen(name) + 1);
+	if (!copy)
+		Quit("Out of memory!");
+	strcpy(copy, name);
+	names[numNames++] = copy;
+}
+
+static void LoadTrace(const char *filename)
+{
+	FILE *f = fopen(filename, "r");
+	if (!f)
+		Quit("Couldn't open trace file.");
+
+	char line[256];
+	while (fgets(line, sizeof(line), f))
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0])
+			AddName(line);
+	}
+	fclose(f);
+}
+
+static double Seconds(clock_t start)
+{
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s EPISODE.CKx [trace] [repeats]\n", argv[0]);
+		return 1;
+	}
+
+	MM_Startup();
+	CK_VAR_Startup();
+	CK_VAR_LoadVars(argv[1]);
+
+	if (argc > 2)
+		LoadTrace(argv[2]);
+	else
+	{
+		for (size_t i = 0; i < ck_varTable->size; ++i)
+			if (ck_varTable->arr[i].str)
+				AddName(ck_varTable->arr[i].str);
+	}
+	if (!numNames)
+		Quit("Nothing to look up.");
+
+	// By default, do about ten million lookups.
+	long repeats = argc > 3 ? atol(argv[3]) : (long)(10000000 / numNames) + 1;
+	if (repeats < 1)
+		repeats = 1;
+
+	// How far entries are from the slot they hash to.
+	size_t totalProbes = 0, maxProbes = 0;
+	for (size_t i = 0; i < ck_varTable->size; ++i)
+	{
+		STR_Entry *entry = &ck_varTable->arr[i];
+		if (!entry->str)
+			continue;
+		size_t probes = (i - entry->hash) & (ck_varTable->size - 1);
+		totalProbes += probes;
+		if (probes > maxProbes)
+			maxProbes = probes;
+	}
+	printf("Table: %lu entries in %lu slots, %.2f extra probes on average (max %lu)\n",
+		(unsigned long)ck_varTable->numElements, (unsigned long)ck_varTable->size,
+		(double)totalProbes / ck_varTable->numElements, (unsigned long)maxProbes);
+
+	size_t found = 0;
+	clock_t start = clock();
+	for (long r = 0; r < repeats; ++r)
+		for (size_t i = 0; i < numNames; ++i)
+			found += STR_LookupEntryWithDefault(ck_varTable, names[i], &found) != &found;
+	double lookupTime = Seconds(start);
+	printf("Lookup: %lu names x %ld: %.1f ns/lookup (%lu found)\n", (unsigned long)numNames, repeats,
+		lookupTime * 1e9 / ((double)numNames * repeats), (unsigned long)found);
+
+	// Build a table of the same names from scratch, growing it as we go.
+	long builds = repeats / 10 + 1;
+	start = clock();
+	for (long r = 0; r < builds; ++r)
+	{
+		STR_Table *tabl;
+		STR_AllocTable(&tabl, 16);
+		for (size_t i = 0; i < numNames; ++i)
+			STR_AddEntry(tabl, names[i], (void *)names[i]);
+		free(tabl->arr);
+		MM_FreePtr((mm_ptr_t *)&tabl);
+	}
+	double insertTime = Seconds(start);
+	printf("Insert: %lu names x %ld: %.1f ns/insert\n", (unsigned long)numNames, builds,
+		insertTime * 1e9 / ((double)numNames * builds));
+
+	return 0;
+}
@@ -17,9 +17,11 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <ctype.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "../../src/id_mm.h"
 #include "../../src/id_str.h"
@@ -56,7 +58,7 @@ void Quit(const char *msg)
 {
 	if (msg)
 	{
-		printf(msg);
+		fprintf(stderr, "%s\n", msg);
 		exit(1);
 	}
 	exit(0);
@@ -90,6 +92,7 @@ typedef struct CK_VAR_Variable
 #endif
 
 
+
 void PrintQuotedString(FILE *f, const char *str)
 {
 	fprintf(f, "\"");
@@ -113,7 +116,10 @@ void PrintQuotedString(FILE *f, const char *str)
 			fprintf(f, "\\\"");
 			break;
 		default:
-			fprintf(f, "%c", c);
+			if ((unsigned char)c < ' ' || (unsigned char)c >= 0x7F)
+				fprintf(f, "\\%03o", (unsigned char)c);
+			else
+				fprintf(f, "%c", c);
 			break;
 		}
 	}
@@ -125,15 +131,240 @@ bool staticStrings = false;		/* Strings are generated as variables if true, defi
 const char *prefix = "";		/* Non-action variable prefix. */
 int maxVarNameLen = 30;			/* Warn if a variable name exceeds this length. */
 bool declareActionFuncs = false;	/* Forward-declare any functions mentioned in an action. */
+const char *inputName = "";		/* The last file given with --in, for the generated comments. */
+
+/*
+ * Variables can be set more than once (the first one wins), so only the entry
+ * which a lookup would find is output.
+ */
+bool IsCurrentEntry(size_t index)
+{
+	return STR_LookupEntry(ck_varTable, ck_varTable->arr[index-1].str) == ck_varTable->arr[index-1].ptr;
+}
+
+/*
+ * The names of all actions, in the order they were created, which is the
+ * order CK_LookupActionFrom16BitOffset() searches them in.
+ */
+const char **GetActionNames()
+{
+	const char **names = (const char **)calloc(ck_actionsUsed + 1, sizeof(const char *));
+	size_t index = 0;
+	CK_VAR_Variable *currentVar = NULL;
+	while ((currentVar = (CK_VAR_Variable *)STR_GetNextEntry(ck_varTable, &index)))
+	{
+		if (currentVar->type == VAR_Action && IsCurrentEntry(index))
+			names[(CK_action *)currentVar->value - ck_actionData] = ck_varTable->arr[index-1].str;
+	}
+	return names;
+}
+
+/*
+ * Variables used by the source files given with --scan. The game runs with
+ * the defaults of any which the episode doesn't set, so these are output as
+ * well, for a linked build.
+ */
+typedef enum VP_UseType
+{
+	USE_Int,
+	USE_Action,
+	USE_IntArray,
+	USE_String,
+	USE_StringArray
+} VP_UseType;
+
+typedef struct VP_UseMacro
+{
+	const char *macro;
+	VP_UseType type;
+	bool hasDefault;
+} VP_UseMacro;
+
+VP_UseMacro useMacros[] = {
+	{"CK_INT", USE_Int, true},
+	{"CK_CHUNKNUM", USE_Int, false},
+	{"CK_SOUNDNUM", USE_Int, false},
+	{"CK_CHUNKID", USE_Int, false},
+	{"CK_ACTION", USE_Action, false},
+	{"CK_INTARRAY", USE_IntArray, false},
+	{"CK_INTELEMENT", USE_IntArray, false},
+	{"CK_STRING", USE_String, false},
+	{"CK_STRINGARRAY", USE_StringArray, false},
+	{"CK_STRINGELEMENT", USE_StringArray, false},
+};
+
+typedef struct VP_Use
+{
+	VP_UseType type;
+	char *name;
+	char *def;
+} VP_Use;
+
+VP_Use *uses = NULL;
+size_t numUses = 0;
+
+const CK_VAR_VarType useVarTypes[] = {VAR_Int, VAR_Action, VAR_IntArray, VAR_String, VAR_StringArray};
+
+bool IsUseDefined(VP_Use *use)
+{
+	CK_VAR_Variable *var = (CK_VAR_Variable *)STR_LookupEntry(ck_varTable, use->name);
+	if (!var)
+		return false;
+	if (use->type == USE_Int && var->type == VAR_Bool)
+		return true;
+	return var->type == useVarTypes[use->type];
+}
+
+void AddUse(const char *filename, VP_UseType type, const char *name, size_t nameLen, const char *def, size_t defLen)
+{
+	for (size_t i = 0; i < numUses; ++i)
+	{
+		if (uses[i].type != type || strlen(uses[i].name) != nameLen || strncmp(uses[i].name, name, nameLen))
+			continue;
+		if (def && (strlen(uses[i].def) != defLen || strncmp(uses[i].def, def, defLen)))
+			fprintf(stderr, "%s: Warning: %s is used with defaults %s and %.*s, using %s.\n", filename, uses[i].name, uses[i].def, (int)defLen, def, uses[i].def);
+		return;
+	}
+
+	if (!(numUses & (numUses - 1)))
+		uses = (VP_Use *)realloc(uses, (numUses ? numUses * 2 : 64) * sizeof(VP_Use));
+	uses[numUses].type = type;
+	uses[numUses].name = (char *)calloc(nameLen + 1, 1);
+	memcpy(uses[numUses].name, name, nameLen);
+	uses[numUses].def = NULL;
+	if (def)
+	{
+		uses[numUses].def = (char *)calloc(defLen + 1, 1);
+		memcpy(uses[numUses].def, def, defLen);
+	}
+	numUses++;
+}
+
+#define IS_IDENT_CHAR(c) (isalnum((unsigned char)(c)) || (c) == '_')
+
+void ScanSource(const char *filename)
+{
+	FILE *f = fopen(filename, "rb");
+	if (!f)
+	{
+		fprintf(stderr, "Couldn't open \"%s\".\n", filename);
+		exit(1);
+	}
+	fseek(f, 0, SEEK_END);
+	long length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char *src = (char *)calloc(length + 1, 1);
+	if (fread(src, 1, length, f) != (size_t)length)
+	{
+		fprintf(stderr, "Couldn't read \"%s\".\n", filename);
+		exit(1);
+	}
+	fclose(f);
+
+	const char *p = src;
+	while (*p)
+	{
+		// Skip comments, and string and character literals.
+		if (p[0] == '/' && p[1] == '/')
+		{
+			while (*p && *p != '\n')
+				p++;
+			continue;
+		}
+		if (p[0] == '/' && p[1] == '*')
+		{
+			const char *end = strstr(p + 2, "*/");
+			p = end ? end + 2 : p + strlen(p);
+			continue;
+		}
+		if (*p == '"' || *p == '\'')
+		{
+			char quote = *p++;
+			while (*p && *p != quote)
+			{
+				if (*p == '\\' && p[1])
+					p++;
+				p++;
+			}
+			if (*p)
+				p++;
+			continue;
+		}
+		if (!IS_IDENT_CHAR(*p))
+		{
+			p++;
+			continue;
+		}
+
+		const char *ident = p;
+		while (IS_IDENT_CHAR(*p))
+			p++;
+		size_t identLen = p - ident;
+
+		VP_UseMacro *macro = NULL;
+		for (size_t i = 0; i < sizeof(useMacros) / sizeof(useMacros[0]); ++i)
+			if (strlen(useMacros[i].macro) == identLen && !strncmp(useMacros[i].macro, ident, identLen))
+				macro = &useMacros[i];
+		if (!macro)
+			continue;
+
+		const char *q = p;
+		while (isspace((unsigned char)*q))
+			q++;
+		if (*q++ != '(')
+			continue;
+		while (isspace((unsigned char)*q))
+			q++;
+		const char *name = q;
+		while (IS_IDENT_CHAR(*q))
+			q++;
+		size_t nameLen = q - name;
+		if (!nameLen)
+			continue;
+
+		const char *def = NULL;
+		size_t defLen = 0;
+		if (macro->hasDefault)
+		{
+			while (isspace((unsigned char)*q))
+				q++;
+			if (*q == ',')
+			{
+				def = ++q;
+				for (int depth = 0; *q && (depth || *q != ')'); ++q)
+				{
+					if (*q == '(')
+						depth++;
+					else if (*q == ')')
+						depth--;
+				}
+				while (isspace((unsigned char)*def))
+					def++;
+				defLen = q - def;
+				while (defLen && isspace((unsigned char)def[defLen - 1]))
+					defLen--;
+			}
+		}
 
+		// Carry on from the name, so that uses in the default are found, too.
+		AddUse(filename, macro->type, name, nameLen, def, defLen);
+		p = name + nameLen;
+	}
+
+	free(src);
+}
 
 void OutputHeaderVars(FILE *outfile)
 {
 	size_t index = 0;
 	CK_VAR_Variable *currentVar = NULL;
+	fprintf(outfile, "/* Generated by varparser from %s. Do not edit! */\n\n", inputName);
+	fprintf(outfile, "#ifndef CK_VARS_H\n#define CK_VARS_H\n\n");
 	/* Prototypes for action structs, so ->next works. */
 	while ((currentVar = (CK_VAR_Variable *)STR_GetNextEntry(ck_varTable, &index)))
 	{
+		if (!IsCurrentEntry(index))
+			continue;
 		int varNameLen = strlen(ck_varTable->arr[index-1].str) + strlen(prefix);
 		if (varNameLen > maxVarNameLen)
 			printf("/* Var '%s' has length %d */\n", ck_varTable->arr[index-1].str, varNameLen);
@@ -142,33 +373,68 @@ void OutputHeaderVars(FILE *outfile)
 			if (declareActionFuncs)
 			{
 				CK_action *act = (CK_action *)currentVar->value;
-				if (strcmp(act->think, "NULL"))
+				if (act->think && strcmp(act->think, "NULL"))
 					fprintf(outfile, "void %s(CK_object *obj);\n", act->think);
-				if (strcmp(act->draw, "NULL"))
+				if (act->draw && strcmp(act->draw, "NULL"))
 					fprintf(outfile, "void %s(CK_object *obj);\n", act->draw);
-				if (strcmp(act->collide, "NULL"))
+				if (act->collide && strcmp(act->collide, "NULL"))
 					fprintf(outfile, "void %s(CK_object *a, CK_object *b);\n", act->collide);
 			}
 			fprintf(outfile, "extern CK_action %s;\n", ck_varTable->arr[index-1].str);
 		}
 		else if (currentVar->type == VAR_String)
 		{
-			fprintf(outfile, "#define %sSTRING_%s ", prefix, ck_varTable->arr[index-1].str);
-			PrintQuotedString(outfile, (const char *)currentVar->value);
-			fprintf(outfile, "\n");
+			if (staticStrings)
+				fprintf(outfile, "extern const char *%sSTRING_%s;\n", prefix, ck_varTable->arr[index-1].str);
+			else
+			{
+				fprintf(outfile, "#define %sSTRING_%s ", prefix, ck_varTable->arr[index-1].str);
+				PrintQuotedString(outfile, (const char *)currentVar->value);
+				fprintf(outfile, "\n");
+			}
 		}
 		else if (currentVar->type == VAR_IntArray)
 		{
-			fprintf(outfile, "extern intptr_t %sINTARRAY_%s[%d];\n", prefix, ck_varTable->arr[index-1].str, currentVar->length);
+			fprintf(outfile, "extern intptr_t %sINTARRAY_%s[%d];\n", prefix, ck_varTable->arr[index-1].str, (int)currentVar->length);
 		}
 		else if (currentVar->type == VAR_StringArray)
 		{
-			fprintf(outfile, "extern const char *%sSTRARRAY_%s[%d];\n", prefix, ck_varTable->arr[index-1].str, currentVar->length);
+			fprintf(outfile, "extern const char *%sSTRARRAY_%s[%d];\n", prefix, ck_varTable->arr[index-1].str, (int)currentVar->length);
 		}
 		else
-			fprintf(outfile, "#define %sINT_%s %d\n", prefix, ck_varTable->arr[index-1].str, currentVar->value);
+			fprintf(outfile, "#define %sINT_%s ((intptr_t)%ld)\n", prefix, ck_varTable->arr[index-1].str, (long)(intptr_t)currentVar->value);
+	}
+
+	if (numUses)
+		fprintf(outfile, "\n/* Used by the game, but not set by this episode. */\n");
+	for (size_t i = 0; i < numUses; ++i)
+	{
+		VP_Use *use = &uses[i];
+		if (IsUseDefined(use))
+			continue;
+		switch (use->type)
+		{
+		case USE_Int:
+			fprintf(outfile, "#define %sINT_%s ((intptr_t)(%s))\n", prefix, use->name, use->def ? use->def : "0");
+			break;
+		case USE_Action:
+			fprintf(outfile, "#define %s (*(CK_action *)NULL)\n", use->name);
+			break;
+		case USE_IntArray:
+			fprintf(outfile, "#define %sINTARRAY_%s ((intptr_t *)NULL)\n", prefix, use->name);
+			break;
+		case USE_String:
+			fprintf(outfile, "#define %sSTRING_%s \"%s\"\n", prefix, use->name, use->name);
+			break;
+		case USE_StringArray:
+			fprintf(outfile, "#define %sSTRARRAY_%s ((const char **)NULL)\n", prefix, use->name);
+			break;
+		}
 	}
 
+	fprintf(outfile, "\n/* All of the actions, for CK_LookupActionFrom16BitOffset(). */\n");
+	fprintf(outfile, "extern CK_action *ck_linkedActions[];\n");
+	fprintf(outfile, "\n#endif\n");
 }
 
 void OutputStaticStrings(FILE *outfile)
@@ -178,7 +444,7 @@ void OutputStaticStrings(FILE *outfile)
 	/* Prototypes for action structs, so ->next works. */
 	while ((currentVar = (CK_VAR_Variable *)STR_GetNextEntry(ck_varTable, &index)))
 	{
-		if (currentVar->type == VAR_String)
+		if (currentVar->type == VAR_String && IsCurrentEntry(index))
 		{
 			fprintf(outfile, "const char *%sSTRING_%s = ", prefix, ck_varTable->arr[index-1].str);
 			PrintQuotedString(outfile, (const char *)currentVar->value);
@@ -194,9 +460,9 @@ void OutputStaticInts(FILE *outfile)
 	CK_VAR_Variable *currentVar = NULL;
 	while ((currentVar = (CK_VAR_Variable *)STR_GetNextEntry(ck_varTable, &index)))
 	{
-		if (currentVar->type == VAR_Int)
+		if (currentVar->type == VAR_Int && IsCurrentEntry(index))
 		{
-			fprintf(outfile, "const intptr_t %sINT_%s = %ld", prefix, ck_varTable->arr[index-1].str, (intptr_t)currentVar->value);
+			fprintf(outfile, "const intptr_t %sINT_%s = %ld;\n", prefix, ck_varTable->arr[index-1].str, (long)(intptr_t)currentVar->value);
 		}
 	}
 
@@ -208,13 +474,15 @@ void OutputStaticArrays(FILE *outfile)
 	CK_VAR_Variable *currentVar = NULL;
 	while ((currentVar = (CK_VAR_Variable *)STR_GetNextEntry(ck_varTable, &index)))
 	{
+		if (!IsCurrentEntry(index))
+			continue;
 		if (currentVar->type == VAR_IntArray)
 		{
-			fprintf(outfile, "intptr_t %sINTARRAY_%s[] = {\n", prefix, ck_varTable->arr[index-1].str);
-			for (int i = 0; i < currentVar->length; ++i)
+			fprintf(outfile, "intptr_t %sINTARRAY_%s[%d] = {\n", prefix, ck_varTable->arr[index-1].str, (int)currentVar->length);
+			for (int i = 0; i < (int)currentVar->length; ++i)
 			{
-				fprintf(outfile, "\t%ld", ((intptr_t *)currentVar->value)[i]);
-				if (i != currentVar->length - 1)
+				fprintf(outfile, "\t%ld", (long)((intptr_t *)currentVar->value)[i]);
+				if (i != (int)currentVar->length - 1)
 					fprintf(outfile, ",\n");
 				else
 					fprintf(outfile, "\n");
@@ -223,12 +491,12 @@ void OutputStaticArrays(FILE *outfile)
 		}
 		else if (currentVar->type == VAR_StringArray)
 		{
-			fprintf(outfile, "const char *%sSTRARRAY_%s[%d] = {\n", prefix, ck_varTable->arr[index-1].str, currentVar->length);
-			for (int i = 0; i < currentVar->length; ++i)
+			fprintf(outfile, "const char *%sSTRARRAY_%s[%d] = {\n", prefix, ck_varTable->arr[index-1].str, (int)currentVar->length);
+			for (int i = 0; i < (int)currentVar->length; ++i)
 			{
 				fprintf(outfile, "\t");
 				PrintQuotedString(outfile, ((const char **)currentVar->value)[i]);
-				if (i != currentVar->length - 1)
+				if (i != (int)currentVar->length - 1)
 					fprintf(outfile, ",\n");
 				else
 					fprintf(outfile, "\n");
@@ -248,6 +516,8 @@ void OutputActionsDOS16(FILE *outfile)
 		if (currentVar->type == VAR_Action)
 		{
 			CK_action *act = (CK_action *)currentVar->value;
+			if (!act->think)
+				continue;
 			fprintf(outfile, "CK_action %s = {%d, %d, %d, %d, %d, %d, %d, %d, %s, %s, %s, %c%s};\n",
 				ck_varTable->arr[index-1].str,
 				act->chunkLeft,
@@ -274,32 +544,88 @@ const char *actionTypes[] = {
 	"AT_ScaledFrame"
 };
 
+/*
+ * Functions are declared with the type of the first slot they're used in, and
+ * cast if they're used in a slot of the other type (CK_ObjBadstate is both).
+ */
+STR_Table *declaredFuncs = NULL;
+
+void OutputActionFunctionDecls(FILE *outfile)
+{
+	STR_AllocTable(&declaredFuncs, 1024);
+	for (int i = 0; i < ck_actionsUsed; ++i)
+	{
+		CK_action *act = &ck_actionData[i];
+		const char *funcs[] = {act->think, act->collide, act->draw};
+		for (int j = 0; j < 3; ++j)
+		{
+			if (!funcs[j] || !strcmp(funcs[j], "NULL") || STR_DoesEntryExist(declaredFuncs, funcs[j]))
+				continue;
+			STR_AddEntry(declaredFuncs, funcs[j], (void *)(intptr_t)(j == 1 ? 2 : 1));
+			if (j == 1)
+				fprintf(outfile, "void %s(CK_object *a, CK_object *b);\n", funcs[j]);
+			else
+				fprintf(outfile, "void %s(CK_object *obj);\n", funcs[j]);
+		}
+	}
+	fprintf(outfile, "\n");
+}
+
+const char *FunctionInitialiser(const char *func, bool collide)
+{
+	static char buf[4][ID_STR_MAX_TOKEN_LENGTH + 32];
+	static int bufIndex = 0;
+	if (!declaredFuncs || !strcmp(func, "NULL"))
+		return func;
+	bool declaredAsCollide = (intptr_t)STR_LookupEntry(declaredFuncs, func) == 2;
+	if (declaredAsCollide == collide)
+		return func;
+	char *str = buf[bufIndex++ & 3];
+	snprintf(str, sizeof(buf[0]), "(%s)%s", collide ? "CK_ACT_ColFunction" : "CK_ACT_Function", func);
+	return str;
+}
+
 void OutputActionsOmnispeak(FILE *outfile)
 {
-	size_t index = 0;
-	CK_VAR_Variable *currentVar = NULL;
-	while ((currentVar = (CK_VAR_Variable *)STR_GetNextEntry(ck_varTable, &index)))
+	const char **names = GetActionNames();
+	for (int i = 0; i < ck_actionsUsed; ++i)
 	{
-		if (currentVar->type == VAR_Action)
+		CK_action *act = &ck_actionData[i];
+		if (!act->think)
 		{
-			CK_action *act = (CK_action *)currentVar->value;
-			fprintf(outfile, "CK_action %s = {%d, %d, %s, %d, %d, %d, %d, %d, %s, %s, %s, %c%s, 0x%X};\n",
-				ck_varTable->arr[index-1].str,
-				act->chunkLeft,
-				act->chunkRight,
-				actionTypes[act->type],
-				act->protectAnimation, act->stickToGround,
-				act->timer,
-				act->velX, act->velY,
-				act->think,
-				act->collide,
-				act->draw,
-				strcmp((const char *)act->next, "NULL") ? '&' : ' ',
-				act->next,
-				act->compatDosPointer
-			);
+			// Only ever used as the next action of another one.
+			fprintf(stderr, "Warning: Action %s is used, but never defined.\n", names[i]);
+			fprintf(outfile, "CK_action %s = {0, 0, AT_UnscaledOnce, 0, 0, 0, 0, 0, NULL, NULL, NULL, NULL, 0};\n", names[i]);
+			continue;
 		}
+		fprintf(outfile, "CK_action %s = {%d, %d, %s, %d, %d, %d, %d, %d, %s, %s, %s, %c%s, 0x%X};\n",
+			names[i],
+			act->chunkLeft,
+			act->chunkRight,
+			actionTypes[act->type],
+			act->protectAnimation, act->stickToGround,
+			act->timer,
+			act->velX, act->velY,
+			FunctionInitialiser(act->think, false),
+			FunctionInitialiser(act->collide, true),
+			FunctionInitialiser(act->draw, false),
+			strcmp((const char *)act->next, "NULL") ? '&' : ' ',
+			act->next,
+			act->compatDosPointer
+		);
 	}
+	free(names);
+}
+
+void OutputActionTable(FILE *outfile)
+{
+	const char **names = GetActionNames();
+	fprintf(outfile, "CK_action *ck_linkedActions[] = {\n");
+	for (int i = 0; i < ck_actionsUsed; ++i)
+		fprintf(outfile, "\t&%s,\n", names[i]);
+	fprintf(outfile, "\tNULL\n");
+	fprintf(outfile, "};\n");
+	free(names);
 }
 
 void OutputDOS16ActionCompat(FILE *outfile)
@@ -323,6 +649,34 @@ void OutputDOS16ActionCompat(FILE *outfile)
 	fprintf(outfile, "}\n\n");
 }
 
+/*
+ * Everything the header from --header declares, for a CK_VARS_LINKED build.
+ */
+void OutputSource(FILE *outfile)
+{
+	fprintf(outfile, "/* Generated by varparser from %s. Do not edit! */\n\n", inputName);
+	fprintf(outfile, "#include <stddef.h>\n#include <stdint.h>\n\n#include \"ck_def.h\"\n\n");
+	OutputActionFunctionDecls(outfile);
+	OutputActionsOmnispeak(outfile);
+	fprintf(outfile, "\n");
+	if (staticStrings)
+		OutputStaticStrings(outfile);
+	OutputStaticArrays(outfile);
+	fprintf(outfile, "\n");
+	OutputActionTable(outfile);
+}
+
+FILE *OpenOutput(const char *filename)
+{
+	FILE *f = fopen(filename, "w");
+	if (!f)
+	{
+		fprintf(stderr, "Couldn't open \"%s\" for writing.\n", filename);
+		exit(1);
+	}
+	return f;
+}
+
 int main(int argc, char **argv)
 {
 	MM_Startup();
@@ -330,32 +684,43 @@ int main(int argc, char **argv)
 
 	for (int i = 1; i < argc; ++i)
 	{
-		if (!strcmp(argv[i], "--in"))
+		if (i + 1 < argc && !strcmp(argv[i], "--in"))
+		{
+			inputName = argv[++i];
+			CK_VAR_LoadVars(inputName);
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "--scan"))
 		{
-			CK_VAR_LoadVars(argv[++i]);
+			ScanSource(argv[++i]);
 		}
-		else if (!strcmp(argv[i], "--header"))
+		else if (i + 1 < argc && !strcmp(argv[i], "--header"))
 		{
-			FILE *f = fopen(argv[++i], "w");
+			FILE *f = OpenOutput(argv[++i]);
 			OutputHeaderVars(f);
 			fclose(f);
 		}
-		else if (!strcmp(argv[i], "--dos16-actions"))
+		else if (i + 1 < argc && !strcmp(argv[i], "--source"))
 		{
-			FILE *f = fopen(argv[++i], "w");
+			FILE *f = OpenOutput(argv[++i]);
+			OutputSource(f);
+			fclose(f);
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "--dos16-actions"))
+		{
+			FILE *f = OpenOutput(argv[++i]);
 			OutputActionsDOS16(f);
 			OutputDOS16ActionCompat(f);
 			fclose(f);
 		}
-		else if (!strcmp(argv[i], "--actions"))
+		else if (i + 1 < argc && !strcmp(argv[i], "--actions"))
 		{
-			FILE *f = fopen(argv[++i], "w");
+			FILE *f = OpenOutput(argv[++i]);
 			OutputActionsOmnispeak(f);
 			fclose(f);
 		}
-		else if (!strcmp(argv[i], "--statics"))
+		else if (i + 1 < argc && !strcmp(argv[i], "--statics"))
 		{
-			FILE *f = fopen(argv[++i], "w");
+			FILE *f = OpenOutput(argv[++i]);
 			OutputActionsOmnispeak(f);
 			if (staticStrings)
 				OutputStaticStrings(f);
@@ -366,7 +731,7 @@ int main(int argc, char **argv)
 		{
 			staticStrings = true;
 		}
-		else if (!strcmp(argv[i], "--prefix"))
+		else if (i + 1 < argc && !strcmp(argv[i], "--prefix"))
 		{
 			prefix = argv[++i];
 		}
@@ -377,11 +742,14 @@ int main(int argc, char **argv)
 		else
 		{
 			printf("%s: Convert Omnispeak variables to C headers\n\n", argv[0]);
-			printf("Usage: %s --in EPISODE.CKx --header episode.h --actions episode.c\n");
-			printf("\tOptions are processed in order, so --in must come before --header, --actions.\n");
+			printf("Usage: %s --in EPISODE.CKx [--scan file.c ...] --header ck_vars.h --source ck_vars.c\n", argv[0]);
+			printf("\tOptions are processed in order, so --in and --scan must come before --header, --source.\n");
+			printf("\t--scan adds defaults for variables which the given source file uses, but the episode\n");
+			printf("\tdoesn't set, and --source outputs everything the header declares, including the actions.\n");
+			printf("\tThese are used for builds with CK_VARS_LINKED and CK_STRINGS_LINKED.\n");
 			printf("\tActions compatible with 16-bit DOS versions can be made with --dos16-actions.\n");
 			return -1;
 		}
 	}
+	return 0;
 }
-